@@ -0,0 +1,57 @@
+#------------------------------------------------------------------------------
+#   Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>.
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#------------------------------------------------------------------------------
+
+## Benchmarks for the calibration and frame-processing kernels. Build it for
+## the camera like camApp, or for the build machine with "qmake CONFIG+=host",
+## and run "camBench -o results.json" from this directory.
+
+QT       += core
+QT       -= gui
+
+TARGET = camBench
+CONFIG += qt console
+TEMPLATE = app
+
+INCLUDEPATH += ..
+QMAKE_CXXFLAGS += -pthread -std=c++11
+
+!host {
+    INCLUDEPATH += $${QT_SYSROOT}/usr/include
+    QMAKE_LIBDIR += $${QT_SYSROOT}/usr/lib
+    QMAKE_CFLAGS += -march=armv7-a -mtune=cortex-a8 -mfpu=neon -mfloat-abi=softfp
+    QMAKE_CXXFLAGS += -march=armv7-a -mtune=cortex-a8 -mfpu=neon -mfloat-abi=softfp
+}
+
+QMAKE_CFLAGS += -Wno-unused-parameter -Wno-sign-compare
+QMAKE_CXXFLAGS += -Wno-unused-parameter -Wno-sign-compare
+
+LIBS += -lm -lpthread -lrt
+
+SOURCES += benchmark.cpp \
+    ../util.cpp \
+    ../gpmc.cpp \
+    ../gpmcSim.cpp \
+    ../frameAccumulator.cpp \
+    ../frameCorrector.cpp \
+    ../defectScan.cpp
+
+HEADERS += ../util.h \
+    ../gpmc.h \
+    ../gpmcSim.h \
+    ../frameAccumulator.h \
+    ../frameCorrector.h \
+    ../defectScan.h
@@ -0,0 +1,304 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "gpmc.h"
+#include "gpmcSim.h"
+#include "frameAccumulator.h"
+#include "frameCorrector.h"
+#include "frameGeometry.h"
+#include "defectScan.h"
+#include "util.h"
+#include "types.h"
+
+/*
+ * Benchmarks the calibration and frame-processing kernels on synthetic
+ * frames at each resolution from data/resolutions, using the simulated
+ * FPGA for the paths that read acquisition memory. Results are written as
+ * JSON with the time per pixel and the throughput of the packed frame data.
+ */
+
+#define BENCH_DEFAULT_RESOLUTIONS	"../data/resolutions"
+#define BENCH_DEFAULT_SECONDS		0.25
+#define BENCH_MAX_RESOLUTIONS		64
+#define BENCH_ADC_CHANNELS			16
+#define BENCH_GAIN_ROWS				64
+#define BENCH_FRAME_ADDRESS			0x100000
+
+typedef struct {
+	FrameGeometry geometry;
+	UInt32 pixels;
+	UInt32 bytes;
+	UInt16 *pix;
+	UInt16 *fpn;
+	UInt16 *out;
+	UInt32 *packed;
+	GPMC *gpmc;
+	FrameAccumulator *accumulator;
+	FrameCorrector *corrector;
+} BenchFrame;
+
+typedef struct {
+	const char *name;
+	void (*run)(BenchFrame *frame);
+} BenchCase;
+
+static void benchUnpack(BenchFrame *f)
+{
+	unpackPixelBuf12(f->out, f->packed, f->pixels);
+}
+
+static void benchPack(BenchFrame *f)
+{
+	packPixelBuf12(f->packed, f->pix, f->pixels);
+}
+
+static void benchAccumulate(BenchFrame *f)
+{
+	f->accumulator->addFrame(f->gpmc, BENCH_FRAME_ADDRESS);
+}
+
+/* Mirrors one voltage step of Camera::computeGainColumns. */
+static void benchGainColumns(BenchFrame *f)
+{
+	UInt32 rows = min(f->geometry.vRes, (UInt32)BENCH_GAIN_ROWS);
+	UInt32 rowSize = (f->geometry.hRes * 12) / 8;
+	UInt32 sums[BENCH_ADC_CHANNELS];
+
+	f->gpmc->readAcqMem(f->packed, BENCH_FRAME_ADDRESS, ROUND_UP_MULT(rowSize * rows, 4));
+	unpackPixelBuf12(f->out, f->packed, rows * f->geometry.hRes);
+	sumPixelColumns(sums, f->out, rows * f->geometry.hRes, BENCH_ADC_CHANNELS);
+}
+
+static void benchDeadPixels(BenchFrame *f)
+{
+	DefectScanResult result;
+	scanDeadPixels(f->pix, f->geometry.hRes, f->geometry.vRes, DEAD_PIXEL_THRESHHOLD, &result);
+}
+
+static void benchCorrect(BenchFrame *f)
+{
+	f->corrector->correct(f->pix, f->fpn, f->out, f->pixels, f->geometry.hRes);
+}
+
+static void benchReadCorrected(BenchFrame *f)
+{
+	f->corrector->readFrame(f->gpmc, BENCH_FRAME_ADDRESS, &f->geometry, f->fpn, f->out);
+}
+
+static const BenchCase benchCases[] = {
+	{ "unpack12",			benchUnpack },
+	{ "pack12",				benchPack },
+	{ "fpnAccumulate",		benchAccumulate },
+	{ "gainColumns",		benchGainColumns },
+	{ "deadPixelScan",		benchDeadPixels },
+	{ "correct2Point",		benchCorrect },
+	{ "readCorrectedFrame",	benchReadCorrected },
+};
+
+static double nowSeconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* readResolutions
+ *
+ * Reads the list of WIDTHxHEIGHT resolutions, one per line.
+ *
+ * returns: Number of resolutions read, or -1 if the file could not be opened
+ **/
+static int readResolutions(const char *path, FrameGeometry *list, int max)
+{
+	FILE *fp = fopen(path, "r");
+	char line[64];
+	int count = 0;
+
+	if (!fp) return -1;
+	while ((count < max) && fgets(line, sizeof(line), fp)) {
+		unsigned int h, v;
+		if (sscanf(line, "%ux%u", &h, &v) != 2) continue;
+		memset(&list[count], 0, sizeof(FrameGeometry));
+		list[count].hRes = h;
+		list[count].vRes = v;
+		list[count].bitDepth = 12;
+		count++;
+	}
+	fclose(fp);
+	return count;
+}
+
+/* setupFrame
+ *
+ * Builds a synthetic dark frame with fixed pattern noise and a few hot
+ * pixels, and stores it packed in simulated acquisition memory.
+ *
+ * returns: SUCCESS, or CAMERA_MEM_ERROR on allocation failure
+ **/
+static Int32 setupFrame(BenchFrame *f, const FrameGeometry *geometry, GPMC *gpmc)
+{
+	double gains[BENCH_ADC_CHANNELS];
+	UInt32 seed = 1;
+	UInt32 i;
+
+	f->geometry = *geometry;
+	f->pixels = geometry->pixels();
+	f->bytes = ROUND_UP_MULT(geometry->size(), 4);
+	f->pix = new UInt16[f->pixels];
+	f->fpn = new UInt16[f->pixels];
+	f->out = new UInt16[f->pixels];
+	f->packed = new UInt32[f->bytes / 4 + 1];
+	f->gpmc = gpmc;
+	f->accumulator = new FrameAccumulator();
+	f->corrector = new FrameCorrector();
+
+	for (i = 0; i < f->pixels; i++) {
+		seed = seed * 1103515245 + 12345;
+		f->fpn[i] = 64 + ((seed >> 16) & 0x1f);
+		f->pix[i] = f->fpn[i] + ((seed >> 8) & 0x7);
+		if ((seed >> 20) == 0) f->pix[i] = 4095;
+	}
+	packPixelBuf12(f->packed, f->pix, f->pixels);
+	gpmc->writeAcqMem(f->packed, BENCH_FRAME_ADDRESS, f->bytes);
+
+	for (i = 0; i < BENCH_ADC_CHANNELS; i++) {
+		gains[i] = 1.0 + (i * 0.01);
+	}
+	if (f->accumulator->init(f->pixels) != SUCCESS) return CAMERA_MEM_ERROR;
+	return f->corrector->setGain2Point(gains, BENCH_ADC_CHANNELS);
+}
+
+static void freeFrame(BenchFrame *f)
+{
+	delete [] f->pix;
+	delete [] f->fpn;
+	delete [] f->out;
+	delete [] f->packed;
+	delete f->accumulator;
+	delete f->corrector;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-r resolutions] [-t seconds] [-o output.json] [-f filter]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *resPath = BENCH_DEFAULT_RESOLUTIONS;
+	const char *outPath = NULL;
+	const char *filter = NULL;
+	double minSeconds = BENCH_DEFAULT_SECONDS;
+	FrameGeometry resolutions[BENCH_MAX_RESOLUTIONS];
+	int resCount;
+	bool first = true;
+	FILE *out = stdout;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:t:o:f:h")) != -1) {
+		switch (opt) {
+		case 'r': resPath = optarg; break;
+		case 't': minSeconds = strtod(optarg, NULL); break;
+		case 'o': outPath = optarg; break;
+		case 'f': filter = optarg; break;
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	resCount = readResolutions(resPath, resolutions, BENCH_MAX_RESOLUTIONS);
+	if (resCount <= 0) {
+		fprintf(stderr, "Unable to read resolutions from %s\n", resPath);
+		return 1;
+	}
+
+	/* Noise free frames keep the simulator out of the measurements. */
+	GPMC gpmc(new GPMCSim("noise=0,ram=64"));
+	if (gpmc.init() != SUCCESS) {
+		fprintf(stderr, "Unable to initialize the simulated FPGA\n");
+		return 1;
+	}
+
+	if (outPath) {
+		out = fopen(outPath, "w");
+		if (!out) {
+			fprintf(stderr, "Unable to open %s\n", outPath);
+			return 1;
+		}
+	}
+
+	fprintf(out, "{\n\t\"arch\": \"%s\",\n\t\"minSeconds\": %.3f,\n\t\"results\": [",
+#ifdef __ARM_NEON__
+			"armv7-neon",
+#else
+			"generic",
+#endif
+			minSeconds);
+
+	for (int r = 0; r < resCount; r++) {
+		BenchFrame frame;
+
+		if (setupFrame(&frame, &resolutions[r], &gpmc) != SUCCESS) {
+			fprintf(stderr, "Unable to allocate a %ux%u frame\n", resolutions[r].hRes, resolutions[r].vRes);
+			freeFrame(&frame);
+			continue;
+		}
+
+		for (unsigned int c = 0; c < sizeof(benchCases) / sizeof(benchCases[0]); c++) {
+			const BenchCase *bc = &benchCases[c];
+			UInt32 iterations = 0;
+			double start, elapsed;
+			UInt32 pixels = frame.pixels;
+
+			if (filter && !strstr(bc->name, filter)) continue;
+			if (bc->run == benchGainColumns) {
+				pixels = min(frame.geometry.vRes, (UInt32)BENCH_GAIN_ROWS) * frame.geometry.hRes;
+			}
+
+			/* Warm up the caches and buffers before timing. */
+			bc->run(&frame);
+
+			start = nowSeconds();
+			do {
+				bc->run(&frame);
+				iterations++;
+				elapsed = nowSeconds() - start;
+			} while (elapsed < minSeconds);
+
+			double nsPerPixel = (elapsed * 1e9) / ((double)iterations * pixels);
+			double mbPerSec = ((double)iterations * pixels * 12 / 8) / (elapsed * 1e6);
+
+			fprintf(out, "%s\n\t\t{\"name\": \"%s\", \"hRes\": %u, \"vRes\": %u, \"iterations\": %u, "
+						 "\"seconds\": %.6f, \"nsPerPixel\": %.4f, \"mbPerSec\": %.2f}",
+					first ? "" : ",", bc->name, frame.geometry.hRes, frame.geometry.vRes,
+					iterations, elapsed, nsPerPixel, mbPerSec);
+			fflush(out);
+			first = false;
+		}
+		freeFrame(&frame);
+	}
+
+	fprintf(out, "\n\t]\n}\n");
+	if (out != stdout) fclose(out);
+	return 0;
+}
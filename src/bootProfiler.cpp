@@ -0,0 +1,213 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <QDebug>
+
+#include "bootProfiler.h"
+
+static double toMsec(UInt64 nsec)
+{
+	return (double)nsec / 1000000.0;
+}
+
+BootProfiler::BootProfiler() : QObject(NULL)
+{
+	pthread_mutex_init(&mutex, NULL);
+	count = 0;
+	finished = false;
+	startTime = now();
+}
+
+BootProfiler *BootProfiler::instance(void)
+{
+	static BootProfiler *profiler = new BootProfiler();
+	return profiler;
+}
+
+/* Nanoseconds since boot. */
+UInt64 BootProfiler::now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (UInt64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* BootProfiler::begin
+ *
+ * Starts timing a step. Spans started after finish(), or once the
+ * timeline is full, are not recorded.
+ *
+ * name:	Name of the step, which must remain valid
+ *
+ * returns: Span to pass to end(), or -1 if it is not being recorded
+ **/
+Int32 BootProfiler::begin(const char *name)
+{
+	Int32 span = -1;
+
+	pthread_mutex_lock(&mutex);
+	if (!finished && (count < BOOT_PROFILER_MAX_SPANS)) {
+		span = count++;
+		spans[span].name = name;
+		spans[span].thread = syscall(SYS_gettid);
+		spans[span].end = 0;
+		spans[span].start = now();
+	}
+	pthread_mutex_unlock(&mutex);
+	return span;
+}
+
+void BootProfiler::end(Int32 span)
+{
+	UInt64 time = now();
+
+	if (span < 0) return;
+	pthread_mutex_lock(&mutex);
+	if (!spans[span].end) spans[span].end = time;
+	pthread_mutex_unlock(&mutex);
+}
+
+/* Records an event, which takes no time. */
+void BootProfiler::mark(const char *name)
+{
+	Int32 span = begin(name);
+
+	if (span < 0) return;
+	pthread_mutex_lock(&mutex);
+	spans[span].end = spans[span].start;
+	pthread_mutex_unlock(&mutex);
+}
+
+/* BootProfiler::getTimeline
+ *
+ * Formats the recorded steps in the order they were started, with their
+ * start times since boot, how long they took and which thread ran them.
+ *
+ * returns: Timeline, one step per line
+ **/
+QString BootProfiler::getTimeline(void)
+{
+	QString timeline;
+	QString line;
+
+	timeline.sprintf("Boot timeline, application started %.1f ms after boot\n", toMsec(startTime));
+	timeline.append("   start ms  duration ms  thread  step\n");
+
+	pthread_mutex_lock(&mutex);
+	for (UInt32 i = 0; i < count; i++) {
+		const Span *s = &spans[i];
+		if (!s->end) {
+			line.sprintf("%11.1f  %11s  %6d  %s\n", toMsec(s->start), "running", s->thread, s->name);
+		}
+		else if (s->end == s->start) {
+			line.sprintf("%11.1f  %11s  %6d  %s\n", toMsec(s->start), "-", s->thread, s->name);
+		}
+		else {
+			line.sprintf("%11.1f  %11.1f  %6d  %s\n", toMsec(s->start), toMsec(s->end - s->start), s->thread, s->name);
+		}
+		timeline.append(line);
+	}
+	pthread_mutex_unlock(&mutex);
+	return timeline;
+}
+
+/* BootProfiler::finish
+ *
+ * Marks the camera as ready to record, then logs the timeline and writes
+ * it to BOOT_TIMELINE_FILE. Only the first call has any effect.
+ *
+ * returns: nothing
+ **/
+void BootProfiler::finish(void)
+{
+	QString timeline;
+	UInt64 ready;
+	FILE *fp;
+
+	if (finished) return;
+	mark("Ready to record");
+	ready = now();
+
+	pthread_mutex_lock(&mutex);
+	finished = true;
+	pthread_mutex_unlock(&mutex);
+
+	timeline = getTimeline();
+	qDebug("%s", timeline.toLocal8Bit().constData());
+	qDebug("Ready to record %.1f ms after boot, %.1f ms after the application started",
+		   toMsec(ready), toMsec(ready - startTime));
+
+	fp = fopen(BOOT_TIMELINE_FILE, "w");
+	if (!fp) {
+		qDebug("Unable to write %s", BOOT_TIMELINE_FILE);
+		return;
+	}
+	fputs(timeline.toLocal8Bit().constData(), fp);
+	fclose(fp);
+}
+
+BootTask::BootTask(const char *name, void (*func)(void *), void *arg)
+{
+	this->name = name;
+	this->func = func;
+	this->arg = arg;
+	running = false;
+}
+
+BootTask::~BootTask()
+{
+	wait();
+}
+
+void *BootTask::taskThread(void *arg)
+{
+	BootTask *task = (BootTask *)arg;
+	BootSpan span(task->name);
+
+	task->func(task->arg);
+	return NULL;
+}
+
+void BootTask::start(void)
+{
+	if (running) return;
+	if (pthread_create(&thread, NULL, &taskThread, this) == 0) {
+		running = true;
+	}
+	else {
+		qDebug("Unable to start a thread for %s, running it now", name);
+		taskThread(this);
+	}
+}
+
+/* BootTask::wait
+ *
+ * Waits for the step to complete. Returns immediately if it already has,
+ * or was never started.
+ *
+ * returns: nothing
+ **/
+void BootTask::wait(void)
+{
+	if (running) {
+		pthread_join(thread, NULL);
+		running = false;
+	}
+}
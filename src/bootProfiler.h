@@ -0,0 +1,109 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef BOOTPROFILER_H
+#define BOOTPROFILER_H
+
+#include <pthread.h>
+
+#include <QObject>
+#include <QString>
+
+#include "types.h"
+
+#define BOOT_PROFILER_MAX_SPANS		64
+
+/* Written to the data directory once the camera is ready to record. */
+#define BOOT_TIMELINE_FILE			"bootTimeline.txt"
+
+/*
+ * Records how long each step of starting the application takes, from any
+ * thread. Times are kept against CLOCK_MONOTONIC, which starts when the
+ * kernel boots, so the timeline also shows the time spent before the
+ * application was started. The timeline is logged and written to a file
+ * when finish() is called.
+ */
+class BootProfiler : public QObject
+{
+	Q_OBJECT
+
+public:
+	static BootProfiler *instance(void);
+	static UInt64 now(void);
+
+	Int32 begin(const char *name);
+	void end(Int32 span);
+	void mark(const char *name);
+	QString getTimeline(void);
+
+public slots:
+	void finish(void);
+
+private:
+	BootProfiler();
+
+	struct Span {
+		const char *name;
+		UInt64 start;			/* Nanoseconds since boot. */
+		UInt64 end;				/* Zero until the span has ended. */
+		Int32 thread;
+	};
+
+	pthread_mutex_t mutex;
+	Span spans[BOOT_PROFILER_MAX_SPANS];
+	UInt32 count;
+	UInt64 startTime;			/* When the profiler was created. */
+	bool finished;
+};
+
+/* Times the enclosing scope, or until end() is called. */
+class BootSpan
+{
+public:
+	BootSpan(const char *name) { span = BootProfiler::instance()->begin(name); }
+	~BootSpan() { end(); }
+	void end(void) { BootProfiler::instance()->end(span); span = -1; }
+
+private:
+	Int32 span;
+};
+
+/*
+ * Runs a step of starting the application on its own thread, so that it
+ * can overlap steps it doesn't depend on. The step is run on the calling
+ * thread instead if a thread can't be created. Anything the step writes
+ * must not be used until wait() has returned.
+ */
+class BootTask
+{
+public:
+	BootTask(const char *name, void (*func)(void *), void *arg);
+	~BootTask();
+
+	void start(void);
+	void wait(void);
+
+private:
+	const char *name;
+	void (*func)(void *);
+	void *arg;
+	pthread_t thread;
+	bool running;
+
+	static void *taskThread(void *arg);
+};
+
+#endif // BOOTPROFILER_H
@@ -0,0 +1,388 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+#include "calibrationStore.h"
+
+/* Standard CRC-32 (IEEE 802.3), computed a byte at a time from a table. */
+static UInt32 crcTable[256];
+
+static UInt32 crc32(UInt32 crc, const void *data, UInt32 len)
+{
+	const UInt8 *p = (const UInt8 *)data;
+
+	if (!crcTable[1]) {
+		for (UInt32 i = 0; i < 256; i++) {
+			UInt32 c = i;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+			}
+			crcTable[i] = c;
+		}
+	}
+
+	crc = ~crc;
+	while (len--) {
+		crc = crcTable[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+/* Strip the extension off a filename, leaving any directories intact. */
+static QString stripExtension(const QString &filename)
+{
+	int dot = filename.lastIndexOf('.');
+	if (dot <= filename.lastIndexOf('/')) return filename;
+	return filename.left(dot);
+}
+
+/* Check the header of a calibration container. */
+static bool headerIsValid(const CalHeader *hdr)
+{
+	if (hdr->magic != CAL_STORE_MAGIC) return false;
+	if (hdr->version != CAL_STORE_VERSION) return false;
+	if (memchr(hdr->key, '\0', sizeof(hdr->key)) == NULL) return false;
+	return hdr->headerCrc == crc32(0, hdr, offsetof(CalHeader, headerCrc));
+}
+
+CalibrationStore::CalibrationStore()
+{
+	cacheBytes = 0;
+	indexLoaded = false;
+	generation = 0;
+}
+
+CalibrationStore *CalibrationStore::instance(void)
+{
+	static CalibrationStore store;
+	return &store;
+}
+
+void CalibrationStore::indexDirectory(const QString &dir)
+{
+	QFileInfoList files = QDir(dir).entryInfoList(QDir::Files);
+
+	for (int i = 0; i < files.count(); i++) {
+		const QFileInfo &info = files.at(i);
+		QString base = stripExtension(info.absoluteFilePath());
+		Entry entry;
+
+		entry.path = info.absoluteFilePath();
+		if (info.suffix() == QString(CAL_STORE_EXTENSION).mid(1)) {
+			CalHeader hdr;
+			QFile fp(entry.path);
+
+			if (!fp.open(QIODevice::ReadOnly) || (fp.read((char *)&hdr, sizeof(hdr)) != sizeof(hdr)) || !headerIsValid(&hdr)) {
+				qDebug("Calibration container %s has a bad header, ignoring", entry.path.toLocal8Bit().constData());
+				continue;
+			}
+			entry.container = true;
+			entry.length = hdr.length;
+			entry.modified = QDateTime::fromTime_t(hdr.timestamp);
+		}
+		else if ((info.suffix() == "raw") || (info.suffix() == "bin")) {
+			entry.container = false;
+			entry.length = info.size();
+			entry.modified = info.lastModified();
+		}
+		else {
+			continue;
+		}
+		/*
+		 * A container and a legacy file of the same name only both exist
+		 * after calibration was restored from a backup, so use whichever
+		 * was written last.
+		 */
+		if (index.contains(base) && (index[base].modified > entry.modified)) continue;
+		index.insert(base, entry);
+	}
+}
+
+/* CalibrationStore::loadIndex
+ *
+ * Scans the calibration search paths and indexes the calibration files
+ * found there. This should be called once at startup, and again if the
+ * calibration files are modified outside of the store.
+ *
+ * returns: SUCCESS
+ **/
+Int32 CalibrationStore::loadIndex(void)
+{
+	QStringList dirs = QDir::searchPaths("cal") + QDir::searchPaths("fpn");
+
+	index.clear();
+	cache.clear();
+	lru.clear();
+	cacheBytes = 0;
+	generation++;
+
+	dirs.removeDuplicates();
+	for (int i = 0; i < dirs.count(); i++) {
+		indexDirectory(dirs.at(i));
+	}
+	indexLoaded = true;
+
+	qDebug("Indexed %d calibration files", index.count());
+	return SUCCESS;
+}
+
+/* Resolve a filename into the candidate index keys, in search path order. */
+QStringList CalibrationStore::resolve(const QString &filename)
+{
+	QStringList candidates;
+	int colon = filename.indexOf(':');
+
+	if (colon > 1) {
+		QStringList dirs = QDir::searchPaths(filename.left(colon));
+		QString name = stripExtension(filename.mid(colon + 1));
+		for (int i = 0; i < dirs.count(); i++) {
+			candidates.append(QDir(dirs.at(i)).absoluteFilePath(name));
+		}
+	}
+	if (candidates.isEmpty()) {
+		/* Match the canonical paths used by the search paths. */
+		QFileInfo info(filename);
+		QString dir = QFileInfo(info.absolutePath()).canonicalFilePath();
+		if (dir.isEmpty()) dir = info.absolutePath();
+		candidates.append(stripExtension(QDir(dir).absoluteFilePath(info.fileName())));
+	}
+	return candidates;
+}
+
+Int32 CalibrationStore::readEntry(const QString &base, const Entry &entry, QByteArray *payload)
+{
+	QFile fp(entry.path);
+	CalHeader hdr;
+
+	if (!fp.open(QIODevice::ReadOnly)) {
+		return CAMERA_FILE_ERROR;
+	}
+
+	/* Legacy files are taken as-is. */
+	if (!entry.container) {
+		*payload = fp.readAll();
+		return SUCCESS;
+	}
+
+	if ((fp.read((char *)&hdr, sizeof(hdr)) != sizeof(hdr)) || !headerIsValid(&hdr)) {
+		qDebug("Calibration container %s has a bad header", entry.path.toLocal8Bit().constData());
+		return CAMERA_FILE_ERROR;
+	}
+	if (QFileInfo(base).fileName() != QString(hdr.key)) {
+		qDebug("Calibration container %s holds %s", entry.path.toLocal8Bit().constData(), hdr.key);
+		return CAMERA_FILE_ERROR;
+	}
+
+	*payload = fp.read(hdr.length);
+	if ((payload->size() != hdr.length) || (crc32(0, payload->constData(), hdr.length) != hdr.crc)) {
+		qDebug("Calibration container %s is corrupt or truncated", entry.path.toLocal8Bit().constData());
+		return CAMERA_FILE_ERROR;
+	}
+	return SUCCESS;
+}
+
+void CalibrationStore::cacheRemove(const QString &base)
+{
+	if (cache.contains(base)) {
+		cacheBytes -= cache[base].size();
+		cache.remove(base);
+		lru.removeAll(base);
+	}
+}
+
+void CalibrationStore::cacheInsert(const QString &base, const QByteArray &payload)
+{
+	cacheRemove(base);
+	if (payload.size() > CAL_CACHE_MAX_BYTES) return;
+
+	/* Evict the least recently used data to make room. */
+	while (!lru.isEmpty() && ((cacheBytes + payload.size()) > CAL_CACHE_MAX_BYTES)) {
+		cacheRemove(lru.last());
+	}
+	cache.insert(base, payload);
+	lru.prepend(base);
+	cacheBytes += payload.size();
+}
+
+/* CalibrationStore::read
+ *
+ * Reads calibration data, either from the cache or from the first file
+ * found along the search path. Containers that fail their integrity checks
+ * are skipped in favour of the next file in the search path.
+ *
+ * filename:	Calibration filename, optionally using a "cal:" or "fpn:" search path
+ * data:		Buffer to return the calibration data in
+ * size:		Number of bytes of calibration data to read
+ *
+ * returns: SUCCESS, CAMERA_FILE_NOT_FOUND or CAMERA_FILE_ERROR
+ **/
+Int32 CalibrationStore::read(const QString &filename, void *data, UInt32 size)
+{
+	QStringList candidates;
+	Int32 retVal = CAMERA_FILE_NOT_FOUND;
+
+	if (!indexLoaded) loadIndex();
+
+	candidates = resolve(filename);
+	for (int i = 0; i < candidates.count(); i++) {
+		const QString &base = candidates.at(i);
+		QByteArray payload;
+
+		if (cache.contains(base) && (cache[base].size() >= size)) {
+			memcpy(data, cache[base].constData(), size);
+			lru.removeAll(base);
+			lru.prepend(base);
+			return SUCCESS;
+		}
+		if (!index.contains(base)) continue;
+
+		retVal = readEntry(base, index[base], &payload);
+		if (retVal != SUCCESS) continue;
+		if (payload.size() < size) {
+			qDebug("Calibration file %s is too short (%d < %u)", index[base].path.toLocal8Bit().constData(), payload.size(), size);
+			retVal = CAMERA_FILE_ERROR;
+			continue;
+		}
+
+		qDebug("Loaded calibration from %s", index[base].path.toLocal8Bit().constData());
+		memcpy(data, payload.constData(), size);
+		cacheInsert(base, payload);
+		return SUCCESS;
+	}
+	return retVal;
+}
+
+/* CalibrationStore::write
+ *
+ * Writes calibration data into a container, replacing any legacy file of
+ * the same name. The container is written to a temporary file first, so a
+ * partial write never replaces good calibration data.
+ *
+ * filename:	Calibration filename, the extension is replaced by CAL_STORE_EXTENSION
+ * data:		Calibration data to write
+ * size:		Number of bytes of calibration data
+ * type:		Type of calibration data (CAL_TYPE_xxx)
+ * gain:		Gain setting the calibration applies to
+ * geometry:	Optional frame geometry the calibration applies to
+ *
+ * returns: SUCCESS or CAMERA_FILE_ERROR
+ **/
+Int32 CalibrationStore::write(const QString &filename, const void *data, UInt32 size, UInt16 type, UInt32 gain, const FrameGeometry *geometry)
+{
+	QString base;
+	QString path;
+	QString tmpPath;
+	CalHeader hdr;
+	Entry entry;
+	QFile fp;
+
+	if (!indexLoaded) loadIndex();
+
+	base = resolve(filename).first();
+	path = base + CAL_STORE_EXTENSION;
+	tmpPath = path + ".tmp";
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CAL_STORE_MAGIC;
+	hdr.version = CAL_STORE_VERSION;
+	hdr.type = type;
+	hdr.gain = gain;
+	if (geometry) {
+		hdr.hRes = geometry->hRes;
+		hdr.vRes = geometry->vRes;
+		hdr.hOffset = geometry->hOffset;
+		hdr.vOffset = geometry->vOffset;
+		hdr.vDarkRows = geometry->vDarkRows;
+		hdr.bitDepth = geometry->bitDepth;
+	}
+	hdr.timestamp = QDateTime::currentDateTime().toTime_t();
+	strncpy(hdr.key, QFileInfo(base).fileName().toLocal8Bit().constData(), sizeof(hdr.key) - 1);
+	hdr.length = size;
+	hdr.crc = crc32(0, data, size);
+	hdr.headerCrc = crc32(0, &hdr, offsetof(CalHeader, headerCrc));
+
+	qDebug("Writing calibration to %s", path.toLocal8Bit().constData());
+	fp.setFileName(tmpPath);
+	if (!fp.open(QIODevice::WriteOnly)) {
+		qDebug("Error: File couldn't be opened");
+		return CAMERA_FILE_ERROR;
+	}
+	if ((fp.write((const char *)&hdr, sizeof(hdr)) != sizeof(hdr)) ||
+		(fp.write((const char *)data, size) != size) ||
+		!fp.flush() || (fsync(fp.handle()) != 0)) {
+		qDebug("Error writing calibration data: %s", fp.errorString().toUtf8().data());
+		fp.close();
+		QFile::remove(tmpPath);
+		return CAMERA_FILE_ERROR;
+	}
+	fp.close();
+
+	if (rename(tmpPath.toLocal8Bit().constData(), path.toLocal8Bit().constData()) != 0) {
+		QFile::remove(tmpPath);
+		return CAMERA_FILE_ERROR;
+	}
+
+	/* Remove the legacy file this container replaces. */
+	if (index.contains(base) && !index[base].container) {
+		QFile::remove(index[base].path);
+	}
+
+	entry.path = path;
+	entry.container = true;
+	entry.length = size;
+	entry.modified = QDateTime::fromTime_t(hdr.timestamp);
+	index.insert(base, entry);
+	cacheInsert(base, QByteArray((const char *)data, size));
+	generation++;
+	return SUCCESS;
+}
+
+/* CalibrationStore::exists
+ *
+ * Looks up calibration data in the index without touching the filesystem.
+ *
+ * filename:	Calibration filename, optionally using a "cal:" or "fpn:" search path
+ * size:		Optional pointer to return the length of the calibration data in
+ * modified:	Optional pointer to return the time the calibration was written in
+ *
+ * returns: true if the calibration data was found
+ **/
+bool CalibrationStore::exists(const QString &filename, UInt32 *size, QDateTime *modified)
+{
+	QStringList candidates;
+
+	if (!indexLoaded) loadIndex();
+
+	candidates = resolve(filename);
+	for (int i = 0; i < candidates.count(); i++) {
+		if (!index.contains(candidates.at(i))) continue;
+
+		const Entry &entry = index[candidates.at(i)];
+		if (size) *size = entry.length;
+		if (modified) *modified = entry.modified;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,109 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef CALIBRATIONSTORE_H
+#define CALIBRATIONSTORE_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QByteArray>
+#include <QDateTime>
+
+#include "errorCodes.h"
+#include "frameGeometry.h"
+#include "types.h"
+
+/* Calibration data types recorded in the container header. */
+#define CAL_TYPE_RAW			0
+#define CAL_TYPE_FPN			1
+#define CAL_TYPE_COL_GAIN		2
+#define CAL_TYPE_COL_CURVE		3
+#define CAL_TYPE_ADC_OFFSETS	4
+#define CAL_TYPE_DEFECT_MAP		5
+
+#define CAL_STORE_MAGIC			0x4c414343	/* "CCAL" in little endian */
+#define CAL_STORE_VERSION		1
+#define CAL_STORE_EXTENSION		".cal"
+#define CAL_STORE_KEY_LEN		64
+
+/* Maximum size of calibration data kept in memory, FPN frames dominate this. */
+#define CAL_CACHE_MAX_BYTES		(16 * 1024 * 1024)
+
+typedef struct {
+	UInt32 magic;
+	UInt16 version;
+	UInt16 type;
+	UInt32 gain;
+	UInt32 hRes;
+	UInt32 vRes;
+	UInt32 hOffset;
+	UInt32 vOffset;
+	UInt32 vDarkRows;
+	UInt32 bitDepth;
+	UInt32 timestamp;			/* Seconds since the epoch when the data was written. */
+	char key[CAL_STORE_KEY_LEN];	/* Name of the calibration, without directory or extension. */
+	UInt32 length;				/* Length of the payload in bytes. */
+	UInt32 crc;					/* CRC-32 of the payload. */
+	UInt32 headerCrc;			/* CRC-32 of the header up to this field. */
+} __attribute__ ((__packed__)) CalHeader;
+
+/*
+ * Stores calibration data in versioned, checksummed containers. The headers
+ * of every calibration file are indexed once, so lookups through the "cal:"
+ * and "fpn:" search paths need not touch the filesystem, and recently used
+ * data is kept in an LRU cache. Legacy raw calibration files are still
+ * indexed and read, but without any integrity checking.
+ */
+class CalibrationStore
+{
+public:
+	static CalibrationStore *instance(void);
+
+	Int32 loadIndex(void);
+	Int32 read(const QString &filename, void *data, UInt32 size);
+	Int32 write(const QString &filename, const void *data, UInt32 size, UInt16 type, UInt32 gain, const FrameGeometry *geometry = NULL);
+	bool exists(const QString &filename, UInt32 *size = NULL, QDateTime *modified = NULL);
+
+	/* Changes whenever calibration data is written or the index is reloaded. */
+	UInt32 getGeneration(void) { return generation; }
+
+private:
+	CalibrationStore();
+
+	struct Entry {
+		QString path;			/* Absolute path of the file on disk. */
+		bool container;			/* Versioned container, or a legacy raw file. */
+		UInt32 length;			/* Length of the calibration data in bytes. */
+		QDateTime modified;
+	};
+
+	QHash<QString, Entry> index;
+	QHash<QString, QByteArray> cache;
+	QList<QString> lru;
+	UInt32 cacheBytes;
+	bool indexLoaded;
+	UInt32 generation;
+
+	void indexDirectory(const QString &dir);
+	QStringList resolve(const QString &filename);
+	Int32 readEntry(const QString &base, const Entry &entry, QByteArray *payload);
+	void cacheInsert(const QString &base, const QByteArray &payload);
+	void cacheRemove(const QString &base);
+};
+
+#endif // CALIBRATIONSTORE_H
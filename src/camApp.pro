@@ -76,6 +76,19 @@ SOURCES += main.cpp\
     camera.cpp \
     spi.cpp \
     gpmc.cpp \
+    gpmcSim.cpp \
+    frameAccumulator.cpp \
+    frameCorrector.cpp \
+    rawExport.cpp \
+    saveQueue.cpp \
+    saveEstimator.cpp \
+    storage.cpp \
+    systemStatus.cpp \
+    settingsCache.cpp \
+    sensorSCI.cpp \
+    bootProfiler.cpp \
+    calibrationStore.cpp \
+    defectScan.cpp \
     video.cpp \
     cammainwindow.cpp \
     myinputpanelcontext.cpp \
@@ -131,7 +144,20 @@ GENERATED_SOURCES += $$versionTarget.target
 
 HEADERS  += mainwindow.h \
     gpmc.h \
+    gpmcSim.h \
     gpmcRegs.h \
+    frameAccumulator.h \
+    frameCorrector.h \
+    rawExport.h \
+    saveQueue.h \
+    saveEstimator.h \
+    storage.h \
+    systemStatus.h \
+    settingsCache.h \
+    sensorSCI.h \
+    bootProfiler.h \
+    calibrationStore.h \
+    defectScan.h \
     camera.h \
     spi.h \
     defines.h \
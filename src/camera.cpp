@@ -16,7 +16,12 @@
  ****************************************************************************/
 #include <pthread.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <QDebug>
 #include <semaphore.h>
 #include <QSettings>
@@ -25,9 +30,13 @@
 #include <QScreen>
 #include <QIODevice>
 #include <QApplication>
+#include <QDateTime>
 
 #include "font.h"
 #include "camera.h"
+#include "calibrationStore.h"
+#include "settingsCache.h"
+#include "storage.h"
 #include "gpmc.h"
 #include "gpmcRegs.h"
 #include "cameraRegisters.h"
@@ -45,22 +54,31 @@ void* recDataThread(void *arg);
 
 Camera::Camera()
 {
-	QSettings appSettings;
-
 	terminateRecDataThread = false;
 	lastRecording = false;
+	recIrqFD = -1;
+	recWakeFD = -1;
+	recIrqIsUio = false;
 	playbackMode = false;
 	recording = false;
+	imagerSettingsApplied = false;
 	imgGain = 1.0;
 	recordingData.ignoreSegments = 0;
 	recordingData.hasBeenSaved = true;
+	recordingData.stopTime = SettingsCache::instance()->value("camera/recordingStopTime", 0).toLongLong();
 	recordingData.hasBeenViewed = true;
 	unsavedWarnEnabled = getUnsavedWarnEnable();
-	autoSave = appSettings.value("camera/autoSave", 0).toBool();
-	autoRecord = appSettings.value("camera/autoRecord", 0).toBool();
+	autoSave = get_autoSave();
+	autoRecord = get_autoRecord();
 	ButtonsOnLeft = getButtonsOnLeft();
 	UpsideDownDisplay = getUpsideDownDisplay();
 	strcpy(serialNumber, "Not_Set");
+	gpmc = NULL;
+	fpgaResetTime = 0;
+	eepromTask = NULL;
+	calIndexTask = NULL;
+	eepromError = SUCCESS;
+	ramSizeGBSlot[0] = ramSizeGBSlot[1] = 0;
 
 	pinst = new Power();
 }
@@ -68,29 +86,84 @@ Camera::Camera()
 Camera::~Camera()
 {
 	terminateRecDataThread = true;
+	if (recWakeFD >= 0) {
+		eventfd_write(recWakeFD, 1);
+	}
 	pthread_join(recDataThreadID, NULL);
+	if (recWakeFD >= 0) close(recWakeFD);
+	if (recIrqFD >= 0) close(recIrqFD);
 
+	delete eepromTask;
+	delete calIndexTask;
 	delete pinst;
 }
 
+void Camera::readEEPROMs(void *arg)
+{
+	Camera *camera = (Camera *)arg;
+
+	//Get the memory size
+	camera->eepromError = camera->getRamSizeGB(&camera->ramSizeGBSlot[0], &camera->ramSizeGBSlot[1]);
+	if (camera->eepromError != SUCCESS)
+		return;
+
+	//Read serial number in
+	camera->eepromError = camera->readSerialNumber(camera->serialNumber);
+}
+
+void Camera::loadCalIndex(void *arg)
+{
+	CalibrationStore::instance()->loadIndex();
+}
+
+/* Camera::startInit
+ *
+ * Resets the FPGA, and starts reading the EEPROMs and indexing the
+ * calibration data in the background, so that they overlap the FPGA
+ * reset and whatever the caller does before calling init(). Nothing
+ * else may use the calibration store until init() has waited for the
+ * index, which it does before the sensor is initialized.
+ *
+ * gpmcInst:	Initialized GPMC instance
+ *
+ * returns: nothing
+ **/
+void Camera::startInit(GPMC * gpmcInst)
+{
+	if (eepromTask) return;
+	gpmc = gpmcInst;
+
+	//dummy read
+	if(getRecording())
+		qDebug("rec true at init");
+
+	//Reset FPGA
+	gpmc->write16(SYSTEM_RESET_ADDR, 1);
+	fpgaResetTime = BootProfiler::now();
+	BootProfiler::instance()->mark("FPGA reset");
+
+	eepromTask = new BootTask("EEPROM read", &readEEPROMs, this);
+	calIndexTask = new BootTask("Calibration index", &loadCalIndex, NULL);
+	eepromTask->start();
+	calIndexTask->start();
+}
+
 CameraErrortype Camera::init(GPMC * gpmcInst, Video * vinstInst, ImageSensor * sensorInst, UserInterface * userInterface, UInt32 ramSizeVal, bool color)
 {
 	CameraErrortype retVal;
 	UInt32 ramSizeGBSlot0, ramSizeGBSlot1;
 	QSettings appSettings;
+	UInt64 resetElapsed;
 
-	//Get the memory size
-	retVal = (CameraErrortype)getRamSizeGB(&ramSizeGBSlot0, &ramSizeGBSlot1);
+	startInit(gpmcInst);
 
+	eepromTask->wait();
+	retVal = (CameraErrortype)eepromError;
 	if(retVal != SUCCESS)
 		return retVal;
+	ramSizeGBSlot0 = ramSizeGBSlot[0];
+	ramSizeGBSlot1 = ramSizeGBSlot[1];
 
-	//Read serial number in
-    retVal = (CameraErrortype)readSerialNumber(serialNumber);
-	if(retVal != SUCCESS)
-		return retVal;
-
-	gpmc = gpmcInst;
 	vinst = vinstInst;
 	sensor = sensorInst;
 	ui = userInterface;
@@ -113,19 +186,11 @@ CameraErrortype Camera::init(GPMC * gpmcInst, Video * vinstInst, ImageSensor * s
 		isColor = readIsColor();
 	}
 
-	//dummy read
-	if(getRecording())
-		qDebug("rec true at init");
-	int v = 0;
-
-	if(1)
-	{
-
-		//Reset FPGA
-		gpmc->write16(SYSTEM_RESET_ADDR, 1);
-		v++;
-		//Give the FPGA some time to reset
-		delayms(200);
+	//Give the FPGA the rest of its time to reset
+	resetElapsed = (BootProfiler::now() - fpgaResetTime) / 1000000;
+	if (resetElapsed < FPGA_RESET_DELAY_MSEC) {
+		BootSpan span("FPGA reset wait");
+		delayms(FPGA_RESET_DELAY_MSEC - resetElapsed);
 	}
 
 	if(ACCEPTABLE_FPGA_VERSION != getFPGAVersion())
@@ -159,23 +224,31 @@ CameraErrortype Camera::init(GPMC * gpmcInst, Video * vinstInst, ImageSensor * s
 
 	printf("Starting rec data thread\n");
 	terminateRecDataThread = false;
+	recWakeFD = eventfd(0, EFD_NONBLOCK);
+	openRecIrq();
 
 	err = pthread_create(&recDataThreadID, NULL, &recDataThread, this);
 	if(err)
 		return CAMERA_THREAD_ERROR;
 
+	/* The sensor and imager settings load calibration data, so the index must be complete first. */
+	calIndexTask->wait();
 
+	BootSpan sensorSpan("Sensor init");
 	retVal = sensor->init(gpmc);
 //mem problem before this
 	if(retVal != SUCCESS)
 	{
 		return retVal;
 	}
+	sensorSpan.end();
 
+	BootSpan ioSpan("IO init");
 	io = new IO(gpmc);
 	retVal = io->init();
 	if(retVal != SUCCESS)
 		return retVal;
+	ioSpan.end();
 
 	/* Load default recording from sensor limits. */
 	imagerSettings.geometry = sensor->getMaxGeometry();
@@ -191,25 +264,28 @@ CameraErrortype Camera::init(GPMC * gpmcInst, Video * vinstInst, ImageSensor * s
 
 	//Set to full resolution
 	ImagerSettings_t settings;
+	SettingsCache *settingsCache = SettingsCache::instance();
 
-	settings.geometry.hRes          = appSettings.value("camera/hRes", imagerSettings.geometry.hRes).toInt();
-	settings.geometry.vRes          = appSettings.value("camera/vRes", imagerSettings.geometry.vRes).toInt();
-	settings.geometry.hOffset       = appSettings.value("camera/hOffset", 0).toInt();
-	settings.geometry.vOffset       = appSettings.value("camera/vOffset", 0).toInt();
+	settings.geometry.hRes          = settingsCache->getInt("camera/hRes", imagerSettings.geometry.hRes);
+	settings.geometry.vRes          = settingsCache->getInt("camera/vRes", imagerSettings.geometry.vRes);
+	settings.geometry.hOffset       = settingsCache->getInt("camera/hOffset", 0);
+	settings.geometry.vOffset       = settingsCache->getInt("camera/vOffset", 0);
 	settings.geometry.vDarkRows     = 0;
 	settings.geometry.bitDepth		= imagerSettings.geometry.bitDepth;
-	settings.gain                   = appSettings.value("camera/gain", 1).toInt();
-	settings.period                 = appSettings.value("camera/period", sensor->getMinFramePeriod(&settings.geometry)).toInt();
-	settings.exposure               = appSettings.value("camera/exposure", sensor->getMaxIntegrationTime(settings.period, &settings.geometry)).toInt();
-	settings.recRegionSizeFrames    = appSettings.value("camera/recRegionSizeFrames", getMaxRecordRegionSizeFrames(&settings.geometry)).toInt();
-	settings.disableRingBuffer      = appSettings.value("camera/disableRingBuffer", 0).toInt();
-	settings.mode                   = (CameraRecordModeType)appSettings.value("camera/mode", RECORD_MODE_NORMAL).toInt();
-	settings.prerecordFrames        = appSettings.value("camera/prerecordFrames", 1).toInt();
-	settings.segmentLengthFrames    = appSettings.value("camera/segmentLengthFrames", settings.recRegionSizeFrames).toInt();
-	settings.segments               = appSettings.value("camera/segments", 1).toInt();
+	settings.gain                   = settingsCache->getInt("camera/gain", 1);
+	settings.period                 = settingsCache->getInt("camera/period", sensor->getMinFramePeriod(&settings.geometry));
+	settings.exposure               = settingsCache->getInt("camera/exposure", sensor->getMaxIntegrationTime(settings.period, &settings.geometry));
+	settings.recRegionSizeFrames    = settingsCache->getInt("camera/recRegionSizeFrames", getMaxRecordRegionSizeFrames(&settings.geometry));
+	settings.disableRingBuffer      = settingsCache->getInt("camera/disableRingBuffer", 0);
+	settings.mode                   = (CameraRecordModeType)settingsCache->getInt("camera/mode", RECORD_MODE_NORMAL);
+	settings.prerecordFrames        = settingsCache->getInt("camera/prerecordFrames", 1);
+	settings.segmentLengthFrames    = settingsCache->getInt("camera/segmentLengthFrames", settings.recRegionSizeFrames);
+	settings.segments               = settingsCache->getInt("camera/segments", 1);
 	settings.temporary              = 0;
 
+	BootSpan imagerSpan("Imager settings");
 	setImagerSettings(settings);
+	imagerSpan.end();
 
 	io->setTriggerDelayFrames(0, FLAG_USESAVED);
 	setTriggerDelayValues((double) io->getTriggerDelayFrames() / settings.recRegionSizeFrames,
@@ -222,28 +298,23 @@ CameraErrortype Camera::init(GPMC * gpmcInst, Video * vinstInst, ImageSensor * s
 	strcpy(vinst->filename,      appSettings.value("recorder/filename", "").toString().toAscii());
 	strcpy(vinst->fileDirectory, appSettings.value("recorder/fileDirectory", "").toString().toAscii());
 	if(strlen(vinst->fileDirectory) == 0){
-		/* Set the default file path, or fall back to the MMC card. */
-		int i;
-		bool fileDirFoundOnUSB = false;
-		for (i = 1; i <= 3; i++) {
-			sprintf(vinst->fileDirectory, "/media/sda%d", i);
-			if (path_is_mounted(vinst->fileDirectory)) {
-				fileDirFoundOnUSB = true;
-				break;
-			}
-		}
-		if(!fileDirFoundOnUSB) strcpy(vinst->fileDirectory, "/media/mmcblk1p1");
+		/* Set the default file path to the fastest drive, or fall back to the MMC card. */
+		strcpy(vinst->fileDirectory, Storage::instance()->defaultDirectory().toAscii().constData());
 	}
 
 	maxPostFramesRatio = 1;
 
-	/* Load calibration and perform perform automated cal. */
-	sensor->loadADCOffsetsFromFile(&settings.geometry);
-	loadColGainFromFile();
+	/* Load the calibration data and perform automated cal. */
+	BootSpan calSpan("Calibration load");
+	updateCalibration();
+	calSpan.end();
 
-	if(CAMERA_FILE_NOT_FOUND == loadFPNFromFile()) {
+	BootSpan fpnSpan("FPN load");
+	if(SUCCESS != loadFPNFromFile()) {
 		fastFPNCorrection();
 	}
+	loadDefectMap();
+	fpnSpan.end();
 
 	/* Load color matrix from settings */
 	if (isColor) {
@@ -258,6 +329,7 @@ CameraErrortype Camera::init(GPMC * gpmcInst, Video * vinstInst, ImageSensor * s
 	setCCMatrix(colorCalMatrix);
 	setWhiteBalance(whiteBalMatrix);
 
+	BootProfiler::instance()->mark("Live display");
 	vinst->setDisplayOptions(getZebraEnable(), getFocusPeakEnable() ? (FocusPeakColors)getFocusPeakColor() : FOCUS_PEAK_DISABLE);
 	vinst->setDisplayPosition(ButtonsOnLeft ^ UpsideDownDisplay);
 	vinst->liveDisplay((sensor->getSensorQuirks() & SENSOR_QUIRK_UPSIDE_DOWN) != 0);
@@ -267,9 +339,79 @@ CameraErrortype Camera::init(GPMC * gpmcInst, Video * vinstInst, ImageSensor * s
 	return SUCCESS;
 }
 
+/* Camera::diffImagerSettings
+ *
+ * Finds which of the sensor settings would change, compared to the
+ * settings currently programmed into the sensor.
+ *
+ * settings:	Requested imager settings
+ *
+ * returns: Bitmask of IMAGER_CHANGE flags
+ **/
+UInt32 Camera::diffImagerSettings(const ImagerSettings_t *settings)
+{
+	UInt32 changes = IMAGER_CHANGE_EXPOSURE;	/* Exposure is always written, which also restarts integration. */
+
+	if (!imagerSettingsApplied) {
+		return IMAGER_CHANGE_ALL;
+	}
+	if (memcmp(&settings->geometry, &imagerSettings.geometry, sizeof(FrameGeometry)) != 0) {
+		changes |= IMAGER_CHANGE_GEOMETRY;
+	}
+	if (settings->gain != imagerSettings.gain) {
+		changes |= IMAGER_CHANGE_GAIN;
+	}
+	if (settings->period != imagerSettings.period) {
+		changes |= IMAGER_CHANGE_PERIOD;
+	}
+	return changes;
+}
+
+/* Camera::updateCalibration
+ *
+ * Loads the ADC offsets and column gains for the current imager settings,
+ * unless they are already loaded and the calibration data hasn't changed.
+ *
+ * returns: nothing
+ **/
+void Camera::updateCalibration(void)
+{
+	QString key;
+
+	key.sprintf("%ux%u+%u+%u:%u:%u:", imagerSettings.geometry.hRes, imagerSettings.geometry.vRes,
+				imagerSettings.geometry.hOffset, imagerSettings.geometry.vOffset,
+				imagerSettings.geometry.vDarkRows, CalibrationStore::instance()->getGeneration());
+	key.append(sensor->getFilename("", "").c_str());
+	if (key == calibrationKey) {
+		return;
+	}
+
+	sensor->loadADCOffsetsFromFile(&imagerSettings.geometry);
+	loadColGainFromFile();
+	calibrationKey = key;
+}
+
+/* Forces the calibration to be reloaded after the sensor offsets or column gains were changed directly. */
+void Camera::invalidateCalibration(void)
+{
+	calibrationKey.clear();
+}
+
+/* Camera::setImagerSettings
+ *
+ * Programs the sensor and recording region for new imager settings. Only
+ * the sensor settings that changed are reprogrammed: the sensor is only stopped
+ * when the geometry, gain or wavetable changes, and the calibration is only
+ * reloaded when the sensor timing it depends on changes.
+ *
+ * settings:	Requested imager settings
+ *
+ * returns: SUCCESS, or CAMERA_INVALID_IMAGER_SETTINGS
+ **/
 UInt32 Camera::setImagerSettings(ImagerSettings_t settings)
 {
-	QSettings appSettings;
+	SettingsCache *appSettings = SettingsCache::instance();
+	UInt32 changes;
 
 	if(!sensor->isValidResolution(&settings.geometry) ||
 		settings.recRegionSizeFrames < RECORD_LENGTH_MIN ||
@@ -277,18 +419,39 @@ UInt32 Camera::setImagerSettings(ImagerSettings_t settings)
 		return CAMERA_INVALID_IMAGER_SETTINGS;
 	}
 
-	sensor->seqOnOff(false);
-	delayms(10);
+	changes = diffImagerSettings(&settings);
 	qDebug() << "Settings.period is" << settings.period;
 	qDebug() << "Settings.exposure is" << settings.exposure;
 
-	sensor->setResolution(&settings.geometry);
-	sensor->setGain(settings.gain);
-	sensor->setFramePeriod(settings.period, &settings.geometry);
-	delayms(10);
-	sensor->setIntegrationTime(settings.exposure, &settings.geometry);
+	if ((changes & (IMAGER_CHANGE_GEOMETRY | IMAGER_CHANGE_GAIN)) ||
+		((changes & IMAGER_CHANGE_PERIOD) && !sensor->isLivePeriodChange(settings.period, &settings.geometry))) {
+		/* Stop the sensor and reprogram it. */
+		sensor->seqOnOff(false);
+		delayms(10);
+
+		sensor->setResolution(&settings.geometry);
+		sensor->setGain(settings.gain);
+		sensor->setFramePeriod(settings.period, &settings.geometry);
+		delayms(10);
+		sensor->setIntegrationTime(settings.exposure, &settings.geometry);
+	}
+	else if (changes & IMAGER_CHANGE_PERIOD) {
+		/* Keep the exposure within the frame period while it changes. */
+		if (settings.period < imagerSettings.period) {
+			sensor->setIntegrationTime(settings.exposure, &settings.geometry);
+			sensor->setFramePeriod(settings.period, &settings.geometry);
+		}
+		else {
+			sensor->setFramePeriod(settings.period, &settings.geometry);
+			sensor->setIntegrationTime(settings.exposure, &settings.geometry);
+		}
+	}
+	else {
+		sensor->setIntegrationTime(settings.exposure, &settings.geometry);
+	}
 
 	memcpy(&imagerSettings, &settings, sizeof(settings));
+	imagerSettingsApplied = true;
 
 	//Zero trigger delay for Gated Burst
 	if(settings.mode == RECORD_MODE_GATED_BURST) {
@@ -305,8 +468,7 @@ UInt32 Camera::setImagerSettings(ImagerSettings_t settings)
 	setRecRegion(REC_REGION_START, imagerSettings.recRegionSizeFrames, &imagerSettings.geometry);
 
 	/* Load calibration. */
-	sensor->loadADCOffsetsFromFile(&imagerSettings.geometry);
-	loadColGainFromFile();
+	updateCalibration();
 
 	qDebug()	<< "\nSet imager settings:\nhRes" << imagerSettings.geometry.hRes
 				<< "vRes" << imagerSettings.geometry.vRes
@@ -323,19 +485,19 @@ UInt32 Camera::setImagerSettings(ImagerSettings_t settings)
 	}
 	else {
 		qDebug() << "--- settings --- saving";
-		appSettings.setValue("camera/hRes",                 imagerSettings.geometry.hRes);
-		appSettings.setValue("camera/vRes",                 imagerSettings.geometry.vRes);
-		appSettings.setValue("camera/hOffset",              imagerSettings.geometry.hOffset);
-		appSettings.setValue("camera/vOffset",              imagerSettings.geometry.vOffset);
-		appSettings.setValue("camera/gain",                 imagerSettings.gain);
-		appSettings.setValue("camera/period",               imagerSettings.period);
-		appSettings.setValue("camera/exposure",             imagerSettings.exposure);
-		appSettings.setValue("camera/recRegionSizeFrames",  imagerSettings.recRegionSizeFrames);
-		appSettings.setValue("camera/disableRingBuffer",    imagerSettings.disableRingBuffer);
-		appSettings.setValue("camera/mode",                 imagerSettings.mode);
-		appSettings.setValue("camera/prerecordFrames",      imagerSettings.prerecordFrames);
-		appSettings.setValue("camera/segmentLengthFrames",  imagerSettings.segmentLengthFrames);
-		appSettings.setValue("camera/segments",             imagerSettings.segments);
+		appSettings->setValue("camera/hRes",                 imagerSettings.geometry.hRes);
+		appSettings->setValue("camera/vRes",                 imagerSettings.geometry.vRes);
+		appSettings->setValue("camera/hOffset",              imagerSettings.geometry.hOffset);
+		appSettings->setValue("camera/vOffset",              imagerSettings.geometry.vOffset);
+		appSettings->setValue("camera/gain",                 imagerSettings.gain);
+		appSettings->setValue("camera/period",               imagerSettings.period);
+		appSettings->setValue("camera/exposure",             imagerSettings.exposure);
+		appSettings->setValue("camera/recRegionSizeFrames",  imagerSettings.recRegionSizeFrames);
+		appSettings->setValue("camera/disableRingBuffer",    imagerSettings.disableRingBuffer);
+		appSettings->setValue("camera/mode",                 imagerSettings.mode);
+		appSettings->setValue("camera/prerecordFrames",      imagerSettings.prerecordFrames);
+		appSettings->setValue("camera/segmentLengthFrames",  imagerSettings.segmentLengthFrames);
+		appSettings->setValue("camera/segments",             imagerSettings.segments);
 	}
 
 	return SUCCESS;
@@ -379,14 +541,12 @@ void Camera::updateTriggerValues(ImagerSettings_t settings){
 }
 
 unsigned short Camera::getTriggerDelayConstant(){
-	 QSettings appSettings;
-	//return appSettings.value("camera/triggerDelayConstant", TRIGGERDELAY_PRERECORDSECONDS).toUInt();
+	//return SettingsCache::instance()->getUInt("camera/triggerDelayConstant", TRIGGERDELAY_PRERECORDSECONDS);
 	return TRIGGERDELAY_TIME_RATIO;//With comboBox removed, always use this choice instead.
 }
 
 void Camera::setTriggerDelayConstant(unsigned short value){
-	 QSettings appSettings;
-	 appSettings.setValue("camera/triggerDelayConstant", value);
+	 SettingsCache::instance()->setValue("camera/triggerDelayConstant", value);
 }
 
 void Camera::setTriggerDelayValues(double ratio, double seconds, UInt32 frames){
@@ -397,11 +557,11 @@ void Camera::setTriggerDelayValues(double ratio, double seconds, UInt32 frames){
 
 UInt32 Camera::setIntegrationTime(double intTime, FrameGeometry *fSize, Int32 flags)
 {
-	QSettings appSettings;
+	SettingsCache *appSettings = SettingsCache::instance();
 	UInt32 validTime;
 	UInt32 defaultTime = sensor->getMaxIntegrationTime(sensor->getFramePeriod(), fSize);
 	if (flags & SETTING_FLAG_USESAVED) {
-		validTime = appSettings.value("camera/exposure", defaultTime).toInt();
+		validTime = appSettings->getInt("camera/exposure", defaultTime);
 		qDebug("--- Using old settings --- Exposure time: %d (default: %d)", validTime, defaultTime);
 		validTime = sensor->setIntegrationTime(validTime, fSize);
 	}
@@ -411,7 +571,7 @@ UInt32 Camera::setIntegrationTime(double intTime, FrameGeometry *fSize, Int32 fl
 
 	if (!(flags & SETTING_FLAG_TEMPORARY)) {
 		qDebug("--- Saving settings --- Exposure time: %d", validTime);
-		appSettings.setValue("camera/exposure", validTime);
+		appSettings->setValue("camera/exposure", validTime);
 		imagerSettings.exposure = validTime;
 	}
 	return SUCCESS;
@@ -458,6 +618,11 @@ Int32 Camera::startRecording(void)
 	ui->setRecLEDBack(true);
 	recording = true;
 
+	/* Kick the rec data thread over to the fast polling rate. */
+	if (recWakeFD >= 0) {
+		eventfd_write(recWakeFD, 1);
+	}
+
 	return SUCCESS;
 }
 
@@ -674,6 +839,8 @@ void Camera::loadFPNCorrection(FrameGeometry *geometry, const UInt16 *fpnBuffer,
 {
 	UInt32 *fpnColumns = (UInt32 *)calloc(geometry->hRes, sizeof(UInt32));
 	UInt8  *pixBuffer = (UInt8  *)calloc(1, geometry->size());
+	UInt16 *rowBuffer = (UInt16 *)malloc(geometry->hRes * sizeof(UInt16));
+	UInt32 rowSize = (geometry->hRes * BITS_PER_PIXEL) / 8;
 	UInt32 maxColumn = 0;
 
 	for(int row = 0; row < geometry->vRes; row++) {
@@ -720,16 +887,20 @@ void Camera::loadFPNCorrection(FrameGeometry *geometry, const UInt16 *fpnBuffer,
 		/* The AC component of each column remains as the per-pixel FPN. */
 		for(int row = 0; row < geometry->vRes; row++) {
 			for(int col = 0; col < geometry->hRes; col++) {
-				int i = row * geometry->hRes + col;
-				Int32 fpn = fpnBuffer[i] - (fpnColumns[col] / geometry->vRes);
-				writePixelBuf12(pixBuffer, i, (unsigned)(fpn / (int)framesToAverage) & 0xfff);
+				Int32 fpn = fpnBuffer[row * geometry->hRes + col] - (fpnColumns[col] / geometry->vRes);
+				rowBuffer[col] = (unsigned)(fpn / (int)framesToAverage) & 0xfff;
 			}
+			packPixelBuf12(pixBuffer + row * rowSize, rowBuffer, geometry->hRes);
 		}
 	}
 	/* Load 2-point FPN */
 	else {
-		for(int i = 0; i < geometry->pixels(); i++) {
-			writePixelBuf12(pixBuffer, i, fpnBuffer[i] / framesToAverage);
+		for(int row = 0; row < (geometry->pixels() / geometry->hRes); row++) {
+			const UInt16 *fpnRow = fpnBuffer + row * geometry->hRes;
+			for(int col = 0; col < geometry->hRes; col++) {
+				rowBuffer[col] = fpnRow[col] / framesToAverage;
+			}
+			packPixelBuf12(pixBuffer + row * rowSize, rowBuffer, geometry->hRes);
 		}
 	}
 	gpmc->writeAcqMem((UInt32 *)pixBuffer, FPN_ADDRESS, geometry->size());
@@ -740,63 +911,35 @@ void Camera::loadFPNCorrection(FrameGeometry *geometry, const UInt16 *fpnBuffer,
 	setWhiteBalance(whiteBalMatrix);
 
 	free(fpnColumns);
+	free(rowBuffer);
 	free(pixBuffer);
 }
 
 void Camera::computeFPNCorrection(FrameGeometry *geometry, UInt32 wordAddress, UInt32 framesToAverage, bool writeToFile, bool factory)
 {
 	UInt32 pixelsPerFrame = geometry->pixels();
-	const char *formatStr;
-	QString filename;
-	std::string fn;
-	QFile fp;
 
-	// If writing to file - generate the filename and open for writing
-	if(writeToFile)
-	{
-		//Generate the filename for this particular resolution and offset
-		if(factory) {
-			formatStr = "cal/factoryFPN/fpn_%dx%doff%dx%d";
-		}
-		else {
-			formatStr = "userFPN/fpn_%dx%doff%dx%d";
-		}
-
-		filename.sprintf(formatStr, geometry->hRes, geometry->vRes, geometry->hOffset, geometry->vOffset);
-		fn = sensor->getFilename("", ".raw");
-		filename.append(fn.c_str());
-
-		qDebug("Writing FPN to file %s", filename.toUtf8().data());
-
-		fp.setFileName(filename);
-		fp.open(QIODevice::WriteOnly);
-		if(!fp.isOpen())
-		{
-			qDebug() << "Error: File couldn't be opened";
-			return;
-		}
+	UInt16 * fpnBuffer = (UInt16 *)malloc(pixelsPerFrame * sizeof(UInt16));
+	if (!fpnBuffer || (accumulator.init(pixelsPerFrame) != SUCCESS)) {
+		qDebug() << "Error: Unable to allocate FPN buffers";
+		free(fpnBuffer);
+		return;
 	}
 
-	UInt16 * fpnBuffer = (UInt16 *)calloc(pixelsPerFrame, sizeof(UInt16));
-	UInt8  * pixBuffer = (UInt8  *)malloc(geometry->size());
-
 	// turn off the sensor
 	sensor->seqOnOff(false);
 
-	/* Read frames out of the recorded region and sum their pixels. */
+	/* Stream frames out of the recorded region and sum their pixels. */
 	for(int frame = 0; frame < framesToAverage; frame++) {
-		gpmc->readAcqMem((UInt32 *)pixBuffer, wordAddress, geometry->size());
-		for(int row = 0; row < geometry->vRes; row++) {
-			for(int col = 0; col < geometry->hRes; col++) {
-				int i = row * geometry->hRes + col;
-				UInt16 pix = readPixelBuf12(pixBuffer, i);
-				fpnBuffer[i] += pix;
-			}
-		}
+		accumulator.addFrame(gpmc, wordAddress);
 
 		/* Advance to the next frame. */
 		wordAddress += getFrameSizeWords(geometry);
 	}
+	const UInt32 *fpnSum = accumulator.getSum();
+	for(int i = 0; i < pixelsPerFrame; i++) {
+		fpnBuffer[i] = fpnSum[i];
+	}
 	loadFPNCorrection(geometry, fpnBuffer, framesToAverage);
 
 	// restart the sensor
@@ -805,20 +948,14 @@ void Camera::computeFPNCorrection(FrameGeometry *geometry, UInt32 wordAddress, U
 	qDebug() << "About to write file...";
 	if(writeToFile)
 	{
-		quint64 retVal;
 		for (int i = 0; i < pixelsPerFrame; i++) {
 			fpnBuffer[i] /= framesToAverage;
 		}
-		retVal = fp.write((const char*)fpnBuffer, sizeof(fpnBuffer[0])*pixelsPerFrame);
-		if (retVal != (sizeof(fpnBuffer[0])*pixelsPerFrame)) {
-			qDebug("Error writing FPN data to file: %s", fp.errorString().toUtf8().data());
-		}
-		fp.flush();
-		fp.close();
+		CalibrationStore::instance()->write(getFPNFilename(geometry, factory), fpnBuffer,
+											sizeof(fpnBuffer[0])*pixelsPerFrame, CAL_TYPE_FPN, imagerSettings.gain, geometry);
 	}
 
 	free(fpnBuffer);
-	free(pixBuffer);
 }
 
 /* Perform zero-time black cal using the calibration recording region. */
@@ -922,7 +1059,6 @@ UInt32 Camera::autoFPNCorrection(UInt32 framesToAverage, bool writeToFile, bool
 Int32 Camera::loadFPNFromFile(void)
 {
 	QString filename;
-	QFile fp;
 	UInt32 retVal = SUCCESS;
 
 	//Generate the filename for this particular resolution and offset
@@ -931,37 +1067,20 @@ Int32 Camera::loadFPNFromFile(void)
 	std::string fn;
 	fn = sensor->getFilename("", ".raw");
 	filename.append(fn.c_str());
-	QFileInfo fpnResFile(filename);
-	if (fpnResFile.exists() && fpnResFile.isFile())
-		fn = fpnResFile.absoluteFilePath().toLocal8Bit().constData();
-	else {
-		qDebug("loadFPNFromFile: File not found %s", filename.toLocal8Bit().constData());
-		return CAMERA_FILE_NOT_FOUND;
-	}
-
-	qDebug() << "Found FPN file" << fn.c_str();
-
-	fp.setFileName(filename);
-	fp.open(QIODevice::ReadOnly);
-	if(!fp.isOpen())
-	{
-		qDebug() << "Error: File couldn't be opened";
-		return CAMERA_FILE_ERROR;
-	}
 
 	UInt32 pixelsPerFrame = imagerSettings.geometry.pixels();
 	UInt16 * buffer = new UInt16[pixelsPerFrame];
 
-	//Read in the active region of the FPN data file.
-	if (fp.read((char*) buffer, pixelsPerFrame * sizeof(buffer[0])) < (pixelsPerFrame * sizeof(buffer[0]))) {
-		retVal = CAMERA_FILE_ERROR;
+	//Read in the active region of the FPN data, from memory if it was recently used.
+	retVal = CalibrationStore::instance()->read(filename, buffer, pixelsPerFrame * sizeof(buffer[0]));
+	if (retVal != SUCCESS) {
+		qDebug("loadFPNFromFile: Unable to load %s", filename.toLocal8Bit().constData());
 		goto loadFPNFromFileCleanup;
 	}
 	loadFPNCorrection(&imagerSettings.geometry, buffer, 1);
-	fp.close();
 
 loadFPNFromFileCleanup:
-	delete buffer;
+	delete[] buffer;
 
 	return retVal;
 }
@@ -978,61 +1097,34 @@ Int32 Camera::computeColGainCorrection(UInt32 framesToAverage, bool writeToFile)
 	UInt8 * rawBuffer = (UInt8 *)rawBuffer32;
 
 	QString filename;
-	QFile fp;
 
 	int i;
 	double minVal = 0;
 	double valueSum[sensor->getHResIncrement()] = {0.0};
 	double gainCorrection[sensor->getHResIncrement()];
 
-	// If writing to file - generate the filename and open for writing
-	if(writeToFile)
-	{
-		//Generate the filename for this particular resolution and offset
-		if(recordingData.is.gain >= LUX1310_GAIN_4)
-			filename.append("cal/dcgH.bin");
-		else
-			filename.append("cal/dcgL.bin");
-
-		qDebug("Writing colGain to file %s", filename.toUtf8().data());
-
-		fp.setFileName(filename);
-		fp.open(QIODevice::WriteOnly);
-		if(!fp.isOpen())
-		{
-			qDebug("Error: File couldn't be opened");
-			retVal = CAMERA_FILE_ERROR;
-			goto computeColGainCorrectionCleanup;
-		}
-	}
-
 	recordFrames(1);
 
-	//Zero buffer
-	memset(buffer, 0, sizeof(buffer)*sizeof(buffer[0]));
+	retVal = accumulator.init(pixelsPerFrame);
+	if(SUCCESS != retVal)
+		goto computeColGainCorrectionCleanup;
 
 	//Read the FPN frame into a buffer
 	gpmc->readAcqMem(rawBuffer32, FPN_ADDRESS, bytesPerFrame);
 
-	//Retrieve pixels from the raw buffer and sum them
-	for(i = 0; i < pixelsPerFrame; i++)
-	{
-		fpnBuffer[i] = readPixelBuf12(rawBuffer, i);
-	}
+	//Retrieve pixels from the raw buffer
+	unpackPixelBuf12(fpnBuffer, rawBuffer, pixelsPerFrame);
 
 	//Sum pixel values across frames
 	for(int frame = 0; frame < framesToAverage; frame++)
 	{
-		//Get one frame into the raw buffer
-		gpmc->readAcqMem(rawBuffer32,
-				   REC_REGION_START + frame * getFrameSizeWords(&recordingData.is.geometry),
-				   bytesPerFrame);
+		accumulator.addFrame(gpmc, REC_REGION_START + frame * getFrameSizeWords(&recordingData.is.geometry));
+	}
 
-		//Retrieve pixels from the raw buffer and sum them
-		for(i = 0; i < pixelsPerFrame; i++)
-		{
-			buffer[i] += readPixelBuf12(rawBuffer, i) - fpnBuffer[i];
-		}
+	//Subtract the FPN from the summed frames
+	for(i = 0; i < pixelsPerFrame; i++)
+	{
+		buffer[i] = accumulator.getSum()[i] - fpnBuffer[i] * framesToAverage;
 	}
 
 	if(isColor)
@@ -1085,17 +1177,21 @@ Int32 Camera::computeColGainCorrection(UInt32 framesToAverage, bool writeToFile)
 
 	if(writeToFile)
 	{
-		quint64 retVal64;
-		retVal64 = fp.write((const char*)gainCorrection, sizeof(gainCorrection[0])*sensor->getHResIncrement());
-		if (retVal64 != (sizeof(gainCorrection[0])*sensor->getHResIncrement())) {
-			qDebug("Error writing colGain data to file: %s (%d vs %d)", fp.errorString().toUtf8().data(), (UInt32) retVal64, sizeof(gainCorrection[0])*sensor->getHResIncrement());
-		}
-		fp.flush();
-		fp.close();
+		//Generate the filename for this particular gain
+		if(recordingData.is.gain >= LUX1310_GAIN_4)
+			filename.append("cal/dcgH.bin");
+		else
+			filename.append("cal/dcgL.bin");
+
+		retVal = CalibrationStore::instance()->write(filename, gainCorrection, sizeof(gainCorrection[0])*sensor->getHResIncrement(),
+													 CAL_TYPE_COL_GAIN, recordingData.is.gain);
+		if(SUCCESS != retVal)
+			goto computeColGainCorrectionCleanup;
 	}
 
 	for(i = 0; i < recordingData.is.geometry.hRes; i++)
 		gpmc->write16(COL_GAIN_MEM_START_ADDR+2*i, gainCorrection[i % sensor->getHResIncrement()]*4096.0);
+	invalidateCalibration();
 
 computeColGainCorrectionCleanup:
 	delete[] buffer;
@@ -1113,8 +1209,6 @@ computeColGainCorrectionCleanup:
  *
  * Pass/Fail is returned
  */
-#define BAD_PIXEL_RING_SIZE          6
-#define DEAD_PIXEL_THRESHHOLD        512
 #define MAX_DEAD_PIXELS              0
 Int32 Camera::checkForDeadPixels(int* resultCount, int* resultMax) {
 	Int32 retVal;
@@ -1126,22 +1220,18 @@ Int32 Camera::checkForDeadPixels(int* resultCount, int* resultMax) {
 	int x, y;
 
 	int averageQuad[4];
-	int quad[4];
-	int dividerValue;
 
 	int totalFailedPixels = 0;
 
 	ImagerSettings_t _is;
+	DefectScanResult scan;
+	DefectMap scanned;		/* Kept apart from the live map until the scan completes. */
 
 	int frame;
 	int stride;
-	int lx, ly;
-	int endX, endY;
 	int yOffset;
 
 	int maxOffset = 0;
-	int averageOffset = 0;
-	int pixelsInFrame = 0;
 
 	double exposures[] = {0.001,
 						  0.125,
@@ -1184,10 +1274,8 @@ Int32 Camera::checkForDeadPixels(int* resultCount, int* resultMax) {
 	//Read the FPN frame into a buffer
 	gpmc->readAcqMem(rawBuffer32, FPN_ADDRESS, bytesPerFrame);
 
-	//Retrieve pixels from the raw buffer and sum them
-	for(int i = 0; i < pixelsPerFrame; i++) {
-		fpnBuffer[i] = readPixelBuf12(rawBuffer, i);
-	}
+	//Retrieve pixels from the raw buffer
+	unpackPixelBuf12(fpnBuffer, rawBuffer, pixelsPerFrame);
 
 	retVal = adjustExposureToValue(CAMERA_MAX_EXPOSURE_TARGET, 100, false);
 	if(SUCCESS != retVal) {
@@ -1217,24 +1305,18 @@ Int32 Camera::checkForDeadPixels(int* resultCount, int* resultMax) {
 			goto checkForDeadPixelsCleanup;
 		}
 
-		//Zero buffer
-		memset(buffer, 0, sizeof(buffer));
-
-
+		retVal = accumulator.init(pixelsPerFrame);
+		if(SUCCESS != retVal) {
+			goto checkForDeadPixelsCleanup;
+		}
 
 		// Average pixels across frame
 		for(frame = 0; frame < 16; frame++) {
-			//Get one frame into the raw buffer
 			UInt32 frameAddr = REC_REGION_START + frame * getFrameSizeWords(&recordingData.is.geometry);
-			gpmc->readAcqMem(rawBuffer32, frameAddr, bytesPerFrame);
-
-			//Retrieve pixels from the raw buffer and sum them
-			for(i = 0; i < pixelsPerFrame; i++) {
-				buffer[i] += readPixelBuf12(rawBuffer, i) - fpnBuffer[i];
-			}
+			accumulator.addFrame(gpmc, frameAddr);
 		}
 		for(i = 0; i < pixelsPerFrame; i++) {
-			buffer[i] >>= 4;
+			buffer[i] = (UInt16)(accumulator.getSum()[i] - fpnBuffer[i] * 16) >> 4;
 		}
 
 		// take average quad
@@ -1257,95 +1339,21 @@ Int32 Camera::checkForDeadPixels(int* resultCount, int* resultMax) {
 		qDebug("bad pixel detection - average for frame: 0x%04X, 0x%04X, 0x%04X, 0x%04X", averageQuad[0], averageQuad[1], averageQuad[2], averageQuad[3]);
 		// note that the average isn't actually used after this point - the variables are reused later
 
-		//dividerValue = (1<<16) / (((BAD_PIXEL_RING_SIZE*2) * (BAD_PIXEL_RING_SIZE*2))/2);
-
 		// Check if pixel is valid
-		for (y = 0; y < recordingData.is.geometry.vRes-2; y += 2) {
-			for (x = 0; x < recordingData.is.geometry.hRes-2; x += 2) {
-				quad[0] = quad[1] = quad[2] = quad[3] = 0;
-				averageQuad[0] = averageQuad[1] = averageQuad[2] = averageQuad[3] = 0;
-
-				dividerValue = 0;
-				for (ly = -BAD_PIXEL_RING_SIZE; ly <= BAD_PIXEL_RING_SIZE+1; ly+=2) {
-					stride = _is.geometry.hRes;
-					endY = y + ly;
-					if (endY >= 0 && endY < recordingData.is.geometry.vRes-2)
-						yOffset = endY * _is.geometry.hRes;
-					else
-						yOffset = y * _is.geometry.hRes;
-
-					for (lx = -BAD_PIXEL_RING_SIZE; lx <= BAD_PIXEL_RING_SIZE+1; lx+=2) {
-						endX = x + lx;
-						if (endX >= 0 && endX < recordingData.is.geometry.hRes-2) {
-							averageQuad[0] += buffer[endX   + yOffset       ];
-							averageQuad[1] += buffer[endX+1 + yOffset       ];
-							averageQuad[2] += buffer[endX   + yOffset+stride];
-							averageQuad[3] += buffer[endX+1 + yOffset+stride];
-							dividerValue++;
-						}
-					}
-				}
-				dividerValue = (1<<16) / dividerValue;
-				// now divide the outcome by the number of pixels
-				//
-				averageQuad[0] = (averageQuad[0] * dividerValue);
-				averageQuad[0] >>= 16;
-
-				averageQuad[1] = (averageQuad[1] * dividerValue);
-				averageQuad[1] >>= 16;
-
-				averageQuad[2] = (averageQuad[2] * dividerValue);
-				averageQuad[2] >>= 16;
-
-				averageQuad[3] = (averageQuad[3] * dividerValue);
-				averageQuad[3] >>= 16;
-
-				yOffset = y * _is.geometry.hRes;
-
-				quad[0] = averageQuad[0] - buffer[x      + yOffset       ];
-				quad[1] = averageQuad[1] - buffer[x   +1 + yOffset       ];
-				quad[2] = averageQuad[2] - buffer[x      + yOffset+stride];
-				quad[3] = averageQuad[3] - buffer[x   +1 + yOffset+stride];
-
-				if (quad[0] > maxOffset) maxOffset = quad[0];
-				if (quad[1] > maxOffset) maxOffset = quad[1];
-				if (quad[2] > maxOffset) maxOffset = quad[2];
-				if (quad[3] > maxOffset) maxOffset = quad[3];
-				if (quad[0] < -maxOffset) maxOffset = -quad[0];
-				if (quad[1] < -maxOffset) maxOffset = -quad[1];
-				if (quad[2] < -maxOffset) maxOffset = -quad[2];
-				if (quad[3] < -maxOffset) maxOffset = -quad[3];
-
-				pixelsInFrame++;
-				averageOffset += quad[0] + quad[1] + quad[2] + quad[3];
-
-				if (quad[0] > DEAD_PIXEL_THRESHHOLD || quad[0] < -DEAD_PIXEL_THRESHHOLD) {
-					//qDebug("Bad pixel found: %dx%d (0x%04X vs 0x%04X in the local area)", x  , y  , buffer[x      + yOffset       ], averageQuad[0]);
-					totalFailedPixels++;
-				}
-				if (quad[1] > DEAD_PIXEL_THRESHHOLD || quad[1] < -DEAD_PIXEL_THRESHHOLD) {
-					//qDebug("Bad pixel found: %dx%d (0x%04X vs 0x%04X in the local area)", x+1, y  , buffer[x   +1 + yOffset       ], averageQuad[1]);
-					totalFailedPixels++;
-				}
-				if (quad[2] > DEAD_PIXEL_THRESHHOLD || quad[2] < -DEAD_PIXEL_THRESHHOLD) {
-					//qDebug("Bad pixel found: %dx%d (0x%04X vs 0x%04X in the local area)", x  , y+1, buffer[x      + yOffset+stride], averageQuad[2]);
-					totalFailedPixels++;
-				}
-				if (quad[3] > DEAD_PIXEL_THRESHHOLD || quad[3] < -DEAD_PIXEL_THRESHHOLD) {
-					//qDebug("Bad pixel found: %dx%d (0x%04X vs 0x%04X in the local area)", x+1, y+1, buffer[x   +1 + yOffset+stride], averageQuad[3]);
-					totalFailedPixels++;
-				}
-			}
-		}
+		scanDeadPixels(buffer, recordingData.is.geometry.hRes, recordingData.is.geometry.vRes, DEAD_PIXEL_THRESHHOLD, &scan, &scanned);
+		totalFailedPixels += scan.failed;
+		if (scan.maxOffset > maxOffset) maxOffset = scan.maxOffset;
 
-		averageOffset /= pixelsInFrame;
 		qDebug("===========================================================================");
-		qDebug("Average offset for exposure 1/%ds: %d", 100000000 / _is.exposure, averageOffset);
+		qDebug("Average offset for exposure 1/%ds: %d", 100000000 / _is.exposure, scan.averageOffset);
 		qDebug("===========================================================================");
-		pixelsInFrame = 0;
-		averageOffset = 0;
 	}
-	qDebug("Total dead pixels found: %d", totalFailedPixels);
+	/* Pixels failing at several exposures are only listed once in the map. */
+	scanned.finish();
+	qDebug("Total dead pixels found: %d, %u unique", totalFailedPixels, scanned.count());
+	CalibrationStore::instance()->write(DEFECT_MAP_FILENAME, scanned.entries(), scanned.count() * sizeof(UInt32),
+									   CAL_TYPE_DEFECT_MAP, _is.gain, &recordingData.is.geometry);
+	loadDefectMap();
 	if (totalFailedPixels > MAX_DEAD_PIXELS) {
 		retVal = CAMERA_DEAD_PIXEL_FAILED;
 		goto checkForDeadPixelsCleanup;
@@ -1369,16 +1377,22 @@ void Camera::computeFPNColumns(FrameGeometry *geometry, UInt32 wordAddress, UInt
 	UInt32 *pxBuffer = (UInt32 *)malloc(rowSize * geometry->vRes);
 	UInt32 *fpnColumns = (UInt32 *)calloc(geometry->hRes, sizeof(UInt32));
 
-	/* Read and sum the dark columns */
+	/* Read and sum the dark frames, then sum the columns */
+	if (accumulator.init(geometry->hRes * geometry->vRes) != SUCCESS) {
+		free(pxBuffer);
+		free(fpnColumns);
+		return;
+	}
 	for (int i = 0; i < framesToAverage; i++) {
-		gpmc->readAcqMem(pxBuffer, wordAddress, rowSize * geometry->vRes);
-		for (int row = 0; row < geometry->vRes; row++) {
-			for(int col = 0; col < geometry->hRes; col++) {
-				fpnColumns[col] += readPixelBuf12((UInt8 *)pxBuffer, row * geometry->hRes + col);
-			}
-		}
+		accumulator.addFrame(gpmc, wordAddress);
 		wordAddress += getFrameSizeWords(geometry);
 	}
+	for (int row = 0; row < geometry->vRes; row++) {
+		const UInt32 *rowSum = accumulator.getSum() + row * geometry->hRes;
+		for(int col = 0; col < geometry->hRes; col++) {
+			fpnColumns[col] += rowSum[col];
+		}
+	}
 	/* Write the average value for each column */
 	for (int col = 0; col < geometry->hRes; col++) {
 		UInt16 gain = gpmc->read16(COL_GAIN_MEM_START_ADDR + (2 * col));
@@ -1403,6 +1417,7 @@ void Camera::computeGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 	UInt32 rowStart = ((geometry->vRes - numRows) / 2) & ~0x1f;
 	UInt32 rowSize = (geometry->hRes * BITS_PER_PIXEL) / 8;
 	UInt32 *pxBuffer = (UInt32 *)malloc(numRows * rowSize);
+	UInt16 *pxUnpacked = (UInt16 *)malloc(numRows * geometry->hRes * sizeof(UInt16));
 	UInt32 highColumns[numChannels] = {0};
 	UInt32 midColumns[numChannels] = {0};
 	UInt32 lowColumns[numChannels] = {0};
@@ -1436,12 +1451,8 @@ void Camera::computeGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 
 		/* Get the average pixel value. */
 		gpmc->readAcqMem(pxBuffer, wordAddress, rowSize * numRows);
-		memset(highColumns, 0, sizeof(highColumns));
-		for (int row = 0; row < numRows; row++) {
-			for(int col = 0; col < geometry->hRes; col++) {
-				highColumns[col % numChannels] += readPixelBuf12((UInt8 *)pxBuffer, row * geometry->hRes + col);
-			}
-		}
+		unpackPixelBuf12(pxUnpacked, pxBuffer, numRows * geometry->hRes);
+		sumPixelColumns(highColumns, pxUnpacked, numRows * geometry->hRes, numChannels);
 		maxColumn = 0;
 		for (col = 0; col < numChannels; col++) {
 			if (highColumns[col] > maxColumn) maxColumn = highColumns[col];
@@ -1461,12 +1472,8 @@ void Camera::computeGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 
 		/* Get the average pixel value. */
 		gpmc->readAcqMem(pxBuffer, wordAddress, rowSize * numRows);
-		memset(lowColumns, 0, sizeof(lowColumns));
-		for (int row = 0; row < numRows; row++) {
-			for(col = 0; col < geometry->hRes; col++) {
-				lowColumns[col % numChannels] += readPixelBuf12((UInt8 *)pxBuffer, row * geometry->hRes + col);
-			}
-		}
+		unpackPixelBuf12(pxUnpacked, pxBuffer, numRows * geometry->hRes);
+		sumPixelColumns(lowColumns, pxUnpacked, numRows * geometry->hRes, numChannels);
 		minColumn = UINT32_MAX;
 		for (col = 0; col < numChannels; col++) {
 			if (lowColumns[col] < minColumn) minColumn = lowColumns[col];
@@ -1487,13 +1494,10 @@ void Camera::computeGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 
 	/* Get the average pixel value. */
 	gpmc->readAcqMem(pxBuffer, wordAddress, rowSize * numRows);
-	memset(midColumns, 0, sizeof(midColumns));
-	for (int row = 0; row < numRows; row++) {
-		for(int col = 0; col < geometry->hRes; col++) {
-			midColumns[col % numChannels] += readPixelBuf12((UInt8 *)pxBuffer, row * geometry->hRes + col);
-		}
-	}
+	unpackPixelBuf12(pxUnpacked, pxBuffer, numRows * geometry->hRes);
+	sumPixelColumns(midColumns, pxUnpacked, numRows * geometry->hRes, numChannels);
 	free(pxBuffer);
+	free(pxUnpacked);
 
 	/* Determine which column has the highest response, and sanity check the gain measurements. */
 	maxColumn = 0;
@@ -1566,7 +1570,6 @@ void Camera::computeGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 		double gainCorrection[numChannels];
 		double curveCorrection[numChannels];
 		QString filename;
-		QFile fp;
 
 		for (int col = 0; col < numChannels; col++) {
 			gainCorrection[col] = (double)colGain[col] / (1 << COL_GAIN_FRAC_BITS);
@@ -1575,24 +1578,12 @@ void Camera::computeGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 
 		/* Save column gain data. */
 		filename.sprintf("cal/colGain_%s.bin", gName);
-		fp.setFileName(filename);
-		fp.open(QIODevice::WriteOnly);
-		if(fp.isOpen()) {
-			fp.write((const char*)gainCorrection, sizeof(gainCorrection));
-			fp.flush();
-			fp.close();
-		}
+		CalibrationStore::instance()->write(filename, gainCorrection, sizeof(gainCorrection), CAL_TYPE_COL_GAIN, imagerSettings.gain);
 
 #if USE_3POINT_CAL
 		/* Save column curvature data. */
 		filename.sprintf("cal/colCurve_%s.bin", gName);
-		fp.setFileName(filename);
-		fp.open(QIODevice::WriteOnly);
-		if(fp.isOpen()) {
-			fp.write((const char*)curveCorrection, sizeof(curveCorrection));
-			fp.flush();
-			fp.close();
-		}
+		CalibrationStore::instance()->write(filename, curveCorrection, sizeof(curveCorrection), CAL_TYPE_COL_CURVE, imagerSettings.gain);
 #endif
 	}
 
@@ -1607,6 +1598,7 @@ cleanup:
 		gpmc->write16(COL_GAIN_MEM_START_ADDR + (2 * col), colGain[col % numChannels]);
 		gpmc->write16(COL_CURVE_MEM_START_ADDR + (2 * col), colCurve[col % numChannels]);
 	}
+	invalidateCalibration();
 }
 
 Int32 Camera::autoOffsetCalibration(unsigned int iterations)
@@ -1650,6 +1642,7 @@ Int32 Camera::autoOffsetCalibration(unsigned int iterations)
 
 	/* Run the ADC training algorithm. */
 	sensor->adcOffsetTraining(&isDark.geometry, CAL_REGION_START, CAL_REGION_FRAMES);
+	invalidateCalibration();
 
 	terminateRecord();
 	ui->setRecLEDFront(false);
@@ -1705,24 +1698,14 @@ void Camera::loadColGainFromFile(void)
 
 	/* Load gain correction. */
 	filename.sprintf("cal:colGain_G%d.bin", imagerSettings.gain);
-	QFileInfo colGainFile(filename);
-	if (!colGainFile.exists() || !colGainFile.isFile()) {
+	if (!CalibrationStore::instance()->exists(filename)) {
 		/* Fall back to legacy 2-point gain files. */
 		filename = (imagerSettings.gain < 4) ? "cal:dcgL.bin" : "cal:dcgH.bin";
-		colGainFile.setFile(filename);
 	}
-	if (colGainFile.exists() && colGainFile.isFile()) {
-		QFile fp;
-
-		qDebug("Found colGain file %s", colGainFile.absoluteFilePath().toLocal8Bit().constData());
-
-		fp.setFileName(filename);
-		fp.open(QIODevice::ReadOnly);
-		qint64 ret = fp.read((char*)gainCorrection, sizeof(gainCorrection));
-		if (ret < sizeof(gainCorrection)) {
-			qDebug("Error: File couldn't be opened (ret=%d)", (int)ret);
+	if (CalibrationStore::instance()->read(filename, gainCorrection, sizeof(gainCorrection)) != SUCCESS) {
+		for (int col = 0; col < numChannels; col++) {
+			gainCorrection[col] = 1.0;
 		}
-		fp.close();
 	}
 	for (int col = 0; col < imagerSettings.geometry.hRes; col++) {
 		gpmc->write16(COL_GAIN_MEM_START_ADDR + (2 * col), (int)(gainCorrection[col % numChannels] * (1 << COL_GAIN_FRAC_BITS)));
@@ -1731,20 +1714,7 @@ void Camera::loadColGainFromFile(void)
 #if USE_3POINT_CAL
 	/* Load curvature correction. */
 	filename.sprintf("cal:colCurve_G%d.bin", imagerSettings.gain);
-	QFileInfo colCurveFile(filename);
-	if (colCurveFile.exists() && colCurveFile.isFile()) {
-		QFile fp;
-
-		qDebug("Found colCurve file %s", colCurveFile.absoluteFilePath().toLocal8Bit().constData());
-
-		fp.setFileName(filename);
-		fp.open(QIODevice::ReadOnly);
-		qint64 ret = fp.read((char*)curveCorrection, sizeof(curveCorrection));
-		if (ret < sizeof(curveCorrection)) {
-			qDebug("Error: File couldn't be opened (ret=%d)", (int)ret);
-		}
-		fp.close();
-	}
+	CalibrationStore::instance()->read(filename, curveCorrection, sizeof(curveCorrection));
 	for (int col = 0; col < imagerSettings.geometry.hRes; col++) {
 		Int16 curve16 = curveCorrection[col % numChannels] * (1 << COL_CURVE_FRAC_BITS);
 		gpmc->write16(COL_CURVE_MEM_START_ADDR + (2 * col), (unsigned)curve16);
@@ -1768,6 +1738,7 @@ void Camera::factoryGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 	UInt32 rowStart = ((geometry->vRes - numRows) / 2) & ~0x1f;
 	UInt32 rowSize = (geometry->hRes * BITS_PER_PIXEL) / 8;
 	UInt32 *pxBuffer = (UInt32 *)malloc(numRows * rowSize);
+	UInt16 *pxUnpacked = (UInt16 *)malloc(numRows * geometry->hRes * sizeof(UInt16));
 	UInt32 highColumns[numChannels] = {0};
 	UInt32 lowColumns[numChannels] = {0};
 	UInt16 colGain[numChannels];
@@ -1795,10 +1766,11 @@ void Camera::factoryGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 
 		/* Get the average value for only green pixels. */
 		gpmc->readAcqMem(pxBuffer, wordAddress, rowSize * numRows);
+		unpackPixelBuf12(pxUnpacked, pxBuffer, numRows * geometry->hRes);
 		memset(highColumns, 0, sizeof(highColumns));
 		for (int row = 0; row < numRows; row += 2) {
 			for(int col = 0; col < geometry->hRes; col++) {
-				highColumns[col % numChannels] += readPixelBuf12((UInt8 *)pxBuffer, (row + (col&1)) * geometry->hRes + col);
+				highColumns[col % numChannels] += pxUnpacked[(row + (col&1)) * geometry->hRes + col];
 			}
 		}
 		maxColumn = 0;
@@ -1818,10 +1790,11 @@ void Camera::factoryGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 
 	/* Get the average pixel value. */
 	gpmc->readAcqMem(pxBuffer, wordAddress, rowSize * numRows);
+	unpackPixelBuf12(pxUnpacked, pxBuffer, numRows * geometry->hRes);
 	memset(lowColumns, 0, sizeof(lowColumns));
 	for (int row = 0; row < numRows; row += 2) {
 		for(col = 0; col < geometry->hRes; col++) {
-			lowColumns[col % numChannels] += readPixelBuf12((UInt8 *)pxBuffer, (row + (col&1)) * geometry->hRes + col);
+			lowColumns[col % numChannels] += pxUnpacked[(row + (col&1)) * geometry->hRes + col];
 		}
 	}
 	minColumn = UINT32_MAX;
@@ -1830,6 +1803,7 @@ void Camera::factoryGainColumns(FrameGeometry *geometry, UInt32 wordAddress, con
 	}
 	minColumn /= scale;
 	free(pxBuffer);
+	free(pxUnpacked);
 
 	/* Determine which column has the highest response, and sanity check the gain measurements. */
 	maxColumn = 0;
@@ -1863,6 +1837,7 @@ cleanup:
 		gpmc->write16(COL_GAIN_MEM_START_ADDR + (2 * col), colGain[col % numChannels]);
 		gpmc->write16(COL_CURVE_MEM_START_ADDR + (2 * col), 0);
 	}
+	invalidateCalibration();
 }
 
 Int32 Camera::autoColGainCorrection(void)
@@ -1934,6 +1909,7 @@ Int32 Camera::autoColGainCorrection(void)
 	ui->setRecLEDBack(true);
 
 	sensor->adcOffsetTraining(&imagerSettings.geometry, CAL_REGION_START, CAL_REGION_FRAMES);
+	invalidateCalibration();
 
 	//Turn on calibration light
 	io->setOutLevel((1 << 1));
@@ -2142,15 +2118,13 @@ Int32 Camera::getRawCorrectedFramesAveraged(UInt32 frame, UInt32 framesToAverage
 		return retVal;
 	}
 
-	//Allocate memory for sum buffer
-	UInt32 * summingBuffer = new UInt32[pixelsPerFrame];
-
-	if(NULL == summingBuffer)
-		return CAMERA_MEM_ERROR;
-
-	//Zero sum buffer
-	for(int i = 0; i < pixelsPerFrame; i++)
-		summingBuffer[i] = 0;
+	//Prepare the sum buffer
+	retVal = accumulator.init(pixelsPerFrame);
+	if(SUCCESS != retVal)
+	{
+		delete fpnUnpacked;
+		return retVal;
+	}
 
 	//For each frame to average
 	for(int i = 0; i < framesToAverage; i++)
@@ -2160,60 +2134,33 @@ Int32 Camera::getRawCorrectedFramesAveraged(UInt32 frame, UInt32 framesToAverage
 		if(SUCCESS != retVal)
 		{
 			delete fpnUnpacked;
-			delete summingBuffer;
 			return retVal;
 		}
 
 		//Add pixels to sum buffer
-		for(int j = 0; j < pixelsPerFrame; j++)
-			summingBuffer[j] += frameBuffer[j];
-
+		accumulator.addPixels(frameBuffer);
 	}
 
 	//Divide to get average and put in result buffer
-	for(int i = 0; i < pixelsPerFrame; i++)
-		frameBuffer[i] = summingBuffer[i] / framesToAverage;
+	accumulator.mean(frameBuffer);
 
 	delete fpnUnpacked;
-	delete summingBuffer;
 
 	return SUCCESS;
 }
 
 Int32 Camera::readDCG(double * gainCorrection)
 {
-	size_t count = 0;
 	QString filename;
-	QFile fp;
 
-	//Generate the filename for this particular resolution and offset
+	//Generate the filename for this particular gain
 	if(imagerSettings.gain >= LUX1310_GAIN_4)
 		filename.sprintf("cal:dcgH.bin");
 	else
 		filename.sprintf("cal:dcgL.bin");
 
-	QFileInfo colGainFile(filename);
-	if (colGainFile.exists() && colGainFile.isFile()) {
-		qDebug("Found colGain file, %s", colGainFile.absoluteFilePath().toLocal8Bit().constData());
-
-		fp.setFileName(filename);
-		fp.open(QIODevice::ReadOnly);
-		if(!fp.isOpen()) {
-			qDebug("Error: File couldn't be opened");
-		}
-
-		//If the column gain file exists, read it in
-		count = fp.read((char*) gainCorrection, sizeof(gainCorrection[0]) * LUX1310_HRES_INCREMENT);
-		fp.close();
-		if (count < sizeof(gainCorrection[0]) * LUX1310_HRES_INCREMENT)
-			return CAMERA_FILE_ERROR;
-	}
-	else {
-		return CAMERA_FILE_ERROR;
-	}
-
-	//If the file wasn't fully read in, fail
-	if(LUX1310_HRES_INCREMENT != count)
+	//If the column gain file wasn't fully read in, fail
+	if (CalibrationStore::instance()->read(filename, gainCorrection, sizeof(gainCorrection[0]) * LUX1310_HRES_INCREMENT) != SUCCESS)
 		return CAMERA_FILE_ERROR;
 
 	return SUCCESS;
@@ -2233,10 +2180,7 @@ Int32 Camera::readFPN(UInt16 * fpnUnpacked)
 	gpmc->readAcqMem(fpnBuffer32, FPN_ADDRESS, bytesPerFrame);
 
 	//Unpack the FPN data
-	for(int i = 0; i < pixelsPerFrame; i++)
-	{
-		fpnUnpacked[i] = readPixelBuf12(fpnBuffer, i);
-	}
+	unpackPixelBuf12(fpnUnpacked, fpnBuffer, pixelsPerFrame);
 
 	delete fpnBuffer32;
 
@@ -2245,39 +2189,199 @@ Int32 Camera::readFPN(UInt16 * fpnUnpacked)
 
 Int32 Camera::readCorrectedFrame(UInt32 frame, UInt16 * frameBuffer, UInt16 * fpnInput, double * gainCorrection)
 {
-	UInt32 pixelsPerFrame = recordingData.is.geometry.pixels();
-	UInt32 bytesPerFrame = recordingData.is.geometry.size();
-
-	UInt32 * rawFrameBuffer32 = new UInt32[bytesPerFrame / 4];
-	UInt8 * rawFrameBuffer = (UInt8 *)rawFrameBuffer32;
 	UInt32 frameAddr = REC_REGION_START + frame * getFrameSizeWords(&recordingData.is.geometry);
+	Int32 retVal;
 
-	if(NULL == rawFrameBuffer32)
-		return CAMERA_MEM_ERROR;
+	//Precompute the gain lookup (only rebuilt when the gains change)
+	retVal = corrector.setGain2Point(gainCorrection, LUX1310_HRES_INCREMENT);
+	if(SUCCESS != retVal)
+		return retVal;
 
-	//Read in the frame and FPN data
-	//Get one frame into the raw buffer
-	gpmc->readAcqMem(rawFrameBuffer32, frameAddr, bytesPerFrame);
+	//Read in the frame, subtract FPN, apply gain and clip in one pass
+	retVal = corrector.readFrame(gpmc, frameAddr, &recordingData.is.geometry, fpnInput, frameBuffer);
+	if(SUCCESS != retVal)
+		return retVal;
 
-	//Subtract the FPN data from the buffer
-	for(int i = 0; i < pixelsPerFrame; i++)
-	{
-		frameBuffer[i] = readPixelBuf12(rawFrameBuffer, i) - fpnInput[i];
+	//Conceal known defective pixels from their same-colour neighbours
+	if(defects.count())
+		concealDefects(frameBuffer, &recordingData.is.geometry, &defects, isColor ? 2 : 1);
+	return SUCCESS;
+}
 
-		//If the result underflowed, clip it to zero
-		if(frameBuffer[i] >= (1 << SENSOR_DATA_WIDTH))
-			frameBuffer[i] = 0;
+/* Camera::loadDefectMap
+ *
+ * Loads the defect map found by the last dead pixel check and merges it
+ * with the factory defect list, when either is present.
+ *
+ * returns: SUCCESS, or CAMERA_FILE_NOT_FOUND if there are no defect maps
+ **/
+Int32 Camera::loadDefectMap(void)
+{
+	const char *filenames[] = { "cal:defectMap.bin", "cal:factoryDefectMap.bin" };
+	Int32 retVal = CAMERA_FILE_NOT_FOUND;
+
+	defects.clear();
+	for (int i = 0; i < sizeof(filenames)/sizeof(filenames[0]); i++) {
+		UInt32 size;
+		UInt32 *entries;
 
-		frameBuffer[i] = (UInt16)((double)frameBuffer[i] * gainCorrection[i % LUX1310_HRES_INCREMENT]);
+		if (!CalibrationStore::instance()->exists(filenames[i], &size) || !size)
+			continue;
 
-		//If over max value, clip to max
-		if(frameBuffer[i] > ((1 << SENSOR_DATA_WIDTH) - 1))
-			frameBuffer[i] = ((1 << SENSOR_DATA_WIDTH) - 1);
+		entries = new UInt32[size / sizeof(UInt32)];
+		if (CalibrationStore::instance()->read(filenames[i], entries, size) == SUCCESS) {
+			for (UInt32 j = 0; j < size / sizeof(UInt32); j++) {
+				defects.add(DEFECT_X(entries[j]), DEFECT_Y(entries[j]), DEFECT_IS_HOT(entries[j]));
+			}
+			retVal = SUCCESS;
+		}
+		delete [] entries;
 	}
+	defects.finish();
+	qDebug("Loaded %u defective pixels", defects.count());
+	return retVal;
+}
 
-	delete rawFrameBuffer32;
+/* Camera::getDngBadPixelOpcodes
+ *
+ * Encodes the defective pixels within the recording as a DNG opcode list,
+ * for the OpcodeList1 tag of saved DNG frames.
+ *
+ * returns: Opcode list, or an empty array if there are no defects
+ **/
+QByteArray Camera::getDngBadPixelOpcodes(void)
+{
+	FrameGeometry *geometry = &recordingData.is.geometry;
+	QByteArray opcodes;
+	UInt32 length;
 
-	return SUCCESS;
+	if (!defects.count())
+		return opcodes;
+
+	length = buildDngBadPixelOpcodes(NULL, 0, geometry, &defects, 0);
+	opcodes.resize(length);
+	buildDngBadPixelOpcodes((UInt8 *)opcodes.data(), length, geometry, &defects, getBayerPhase(geometry));
+	return opcodes;
+}
+
+/* Camera::getBayerPhase
+ *
+ * Returns the DNG Bayer phase of the top-left pixel of a frame, which
+ * depends only on the parity of the frame offsets.
+ *
+ * geometry:	Geometry of the frame
+ *
+ * returns: Bayer phase, 0 for red, 1 for green in a red row, 2 for green in a blue row, 3 for blue
+ **/
+UInt32 Camera::getBayerPhase(const FrameGeometry *geometry)
+{
+	const UInt32 bayerPhase[2][2] = { { 1, 0 }, { 3, 2 } };
+	return bayerPhase[geometry->vOffset & 1][geometry->hOffset & 1];
+}
+
+/* Camera::exportRawFrames
+ *
+ * Streams a range of recorded frames to a file descriptor in their native
+ * packed 12-bit layout, without unpacking or applying any calibration. The
+ * frames are written getFrameSizeWords() apart, as described by the header
+ * from writeRawExportHeader().
+ *
+ * fd:			File descriptor to write to, at its current offset
+ * firstFrame:	Index of the first frame within the record region
+ * count:		Number of frames to export
+ * flags:		RAW_EXPORT_DIRECT to bypass the page cache with O_DIRECT
+ * stats:		Filled with the transfer statistics (may be NULL)
+ *
+ * returns: SUCCESS, or an error code if the export failed
+ **/
+Int32 Camera::exportRawFrames(int fd, UInt32 firstFrame, UInt32 count, UInt32 flags, RawExportStats *stats)
+{
+	FrameGeometry *geometry = &recordingData.is.geometry;
+	UInt32 frameWords = getFrameSizeWords(geometry);
+	RawFrameExporter exporter;
+	Int32 retVal;
+
+	if ((firstFrame >= recordingData.is.recRegionSizeFrames) || (count > recordingData.is.recRegionSizeFrames - firstFrame))
+		return CAMERA_INVALID_SETTINGS;
+
+	retVal = exporter.exportFrames(gpmc, fd, REC_REGION_START + firstFrame * frameWords, frameWords, count, flags);
+	if (stats)
+		*stats = *exporter.getStats();
+
+	qDebug("exportRawFrames: %u frames in %llu ms (%.1f MB/s%s)", exporter.getStats()->frames,
+		   exporter.getStats()->nsec / 1000000,
+		   exporter.getStats()->nsec ? (double)exporter.getStats()->bytes * 1000.0 / exporter.getStats()->nsec : 0.0,
+		   exporter.getStats()->direct ? ", direct" : "");
+	return retVal;
+}
+
+/* Camera::writeRawExportHeader
+ *
+ * Writes the sidecar header for frames exported by exportRawFrames(),
+ * describing the frame geometry, sensor timing and the calibration needed
+ * to process them, optionally followed by the packed FPN frame.
+ *
+ * fd:			File descriptor to write the header to
+ * firstFrame:	Index of the first exported frame within the record region
+ * count:		Number of exported frames
+ * includeFPN:	Append the packed FPN frame after the header
+ *
+ * returns: SUCCESS, or an error code if the header could not be written
+ **/
+Int32 Camera::writeRawExportHeader(int fd, UInt32 firstFrame, UInt32 count, bool includeFPN)
+{
+	FrameGeometry *geometry = &recordingData.is.geometry;
+	RawExportHeader header;
+	double gainCorrection[RAW_EXPORT_GAIN_CHANNELS];
+	Int32 retVal;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = RAW_EXPORT_MAGIC;
+	header.version = RAW_EXPORT_VERSION;
+	header.headerSize = sizeof(header);
+	header.hRes = geometry->hRes;
+	header.vRes = geometry->vRes;
+	header.hOffset = geometry->hOffset;
+	header.vOffset = geometry->vOffset;
+	header.vDarkRows = geometry->vDarkRows;
+	header.bitDepth = geometry->bitDepth;
+	header.frameBytes = geometry->size();
+	header.frameStride = getFrameSizeWords(geometry) * BYTES_PER_WORD;
+	header.firstFrame = firstFrame;
+	header.frameCount = count;
+	header.exposure = recordingData.is.exposure;
+	header.period = recordingData.is.period;
+	header.timingClock = sensor->getFramePeriodClock();
+	header.gain = recordingData.is.gain;
+	header.color = isColor;
+	header.bayerPhase = getBayerPhase(geometry);
+	header.timestamp = time(NULL);
+
+	//Column gains default to unity when there is no calibration for this gain
+	if (readDCG(gainCorrection) != SUCCESS) {
+		for (int i = 0; i < RAW_EXPORT_GAIN_CHANNELS; i++) gainCorrection[i] = 1.0;
+	}
+	memcpy(header.columnGain, gainCorrection, sizeof(header.columnGain));
+	memcpy(header.whiteBalance, whiteBalMatrix, sizeof(header.whiteBalance));
+	memcpy(header.colorMatrix, colorCalMatrix, sizeof(header.colorMatrix));
+	strncpy(header.serial, serialNumber, sizeof(header.serial) - 1);
+	strncpy(header.fpnKey, getFPNFilename(geometry, false).toAscii().constData(), sizeof(header.fpnKey) - 1);
+	if (includeFPN)
+		header.fpnBytes = header.frameBytes;
+
+	retVal = RawFrameExporter::writeAll(fd, &header, sizeof(header));
+	if ((SUCCESS != retVal) || !includeFPN)
+		return retVal;
+
+	//Append the FPN exactly as it is stored in acquisition memory
+	UInt32 * fpnBuffer = new UInt32[header.frameStride / 4];
+	if (NULL == fpnBuffer)
+		return CAMERA_MEM_ERROR;
+
+	gpmc->readAcqMem(fpnBuffer, FPN_ADDRESS, header.frameStride);
+	retVal = RawFrameExporter::writeAll(fd, fpnBuffer, header.fpnBytes);
+	delete [] fpnBuffer;
+	return retVal;
 }
 
 void Camera::loadCCMFromSettings(void)
@@ -2450,13 +2554,11 @@ Int32 Camera::autoWhiteBalance(UInt32 x, UInt32 y)
 }
 
 UInt8 Camera::getWBIndex(){
-	QSettings appsettings;
-	return appsettings.value("camera/WBIndex", 2).toUInt();
+	return SettingsCache::instance()->getUInt("camera/WBIndex", 2);
 }
 
 void Camera::setWBIndex(UInt8 index){
-	QSettings appsettings;
-	appsettings.setValue("camera/WBIndex", index);
+	SettingsCache::instance()->setValue("camera/WBIndex", index);
 }
 
 
@@ -2514,21 +2616,164 @@ round(UInt32  x, UInt32 mult)
 	return (offset >= mult/2) ? x - offset + mult : x - offset;
 }
 
-Int32 Camera::blackCalAllStdRes(bool factory, QProgressDialog *dialog)
+/* Camera::getFPNFilename
+ *
+ * Generates the filename that FPN calibration data is written to for a
+ * particular resolution, offset and sensor configuration.
+ *
+ * geometry:	Frame geometry of the calibration
+ * factory:		Generate the factory calibration filename instead of the user one
+ *
+ * returns: FPN filename
+ **/
+QString Camera::getFPNFilename(FrameGeometry *geometry, bool factory)
 {
-	int g;
-	ImagerSettings_t settings;
-	FrameGeometry	maxSize = sensor->getMaxGeometry();
-
-	//Populate the common resolution combo box from the list of resolutions
-	QFile fp;
-	UInt32 retVal = SUCCESS;
-	QStringList resolutions;
+	const char *formatStr;
 	QString filename;
-	QString line;
+	std::string fn;
+
+	//Generate the filename for this particular resolution and offset
+	if(factory) {
+		formatStr = "cal/factoryFPN/fpn_%dx%doff%dx%d";
+	}
+	else {
+		formatStr = "userFPN/fpn_%dx%doff%dx%d";
+	}
+
+	filename.sprintf(formatStr, geometry->hRes, geometry->vRes, geometry->hOffset, geometry->vOffset);
+	fn = sensor->getFilename("", ".raw");
+	filename.append(fn.c_str());
+	return filename;
+}
+
+/* Camera::isCalFileFresh
+ *
+ * Checks whether a calibration file exists and was written within the
+ * allowed age.
+ *
+ * filename:	Calibration file to check
+ * maxAgeSecs:	Maximum age of the calibration, or zero to always treat it as stale
+ * modified:	Optional pointer to return when the file was written
+ *
+ * returns: true if the file is fresh
+ **/
+bool Camera::isCalFileFresh(const QString &filename, UInt32 maxAgeSecs, QDateTime *modified)
+{
+	QDateTime written;
+
+	if (!maxAgeSecs) return false;
+	if (!CalibrationStore::instance()->exists(filename, NULL, &written)) return false;
+	if (modified) *modified = written;
+	return written.secsTo(QDateTime::currentDateTime()) < maxAgeSecs;
+}
+
+/* Camera::isFPNFileValid
+ *
+ * Checks whether the stored FPN calibration for the current sensor
+ * configuration is complete and was written within the allowed age. The
+ * FPN is measured through the ADC offsets and column gains, so it is also
+ * stale if either of those was calibrated after it.
+ *
+ * geometry:	Frame geometry of the calibration
+ * factory:		Check the factory calibration instead of the user one
+ * maxAgeSecs:	Maximum age of the calibration, or zero to always treat it as stale
+ *
+ * returns: true if the stored calibration can be reused
+ **/
+bool Camera::isFPNFileValid(FrameGeometry *geometry, bool factory, UInt32 maxAgeSecs)
+{
+	QDateTime modified;
+	QDateTime dependency;
+	QString filename = getFPNFilename(geometry, factory);
+	QString offsets = sensor->getADCOffsetsFilename().c_str();
+	QString gains;
+	UInt32 size;
+
+	if (!isCalFileFresh(filename, maxAgeSecs, &modified)) return false;
+	if (!CalibrationStore::instance()->exists(filename, &size)) return false;
+	if (size != (geometry->pixels() * sizeof(UInt16))) return false;
+
+	if (!offsets.isEmpty() && CalibrationStore::instance()->exists(offsets, NULL, &dependency) && (dependency > modified)) return false;
+	gains.sprintf("cal:colGain_G%d.bin", imagerSettings.gain);
+	if (CalibrationStore::instance()->exists(gains, NULL, &dependency) && (dependency > modified)) return false;
+	return true;
+}
+
+/* Camera::writeCroppedFPN
+ *
+ * Derives the FPN calibration of a sub-window by cropping the full frame
+ * FPN, and writes it out as though it had been captured directly.
+ *
+ * fullFpn:		Averaged FPN of the full sensor frame
+ * fullSize:	Frame geometry of fullFpn
+ * geometry:	Frame geometry of the sub-window
+ * factory:		Write the factory calibration instead of the user one
+ *
+ * returns: SUCCESS on success, or error code
+ **/
+Int32 Camera::writeCroppedFPN(const UInt16 *fullFpn, FrameGeometry *fullSize, FrameGeometry *geometry, bool factory)
+{
+	UInt16 *fpnBuffer;
+	Int32 retVal;
+
+	if ((geometry->hOffset + geometry->hRes > fullSize->hRes) ||
+		(geometry->vOffset + geometry->vRes > fullSize->vRes) ||
+		geometry->vDarkRows || fullSize->vDarkRows) {
+		return CAMERA_INVALID_IMAGER_SETTINGS;
+	}
+
+	fpnBuffer = (UInt16 *)malloc(geometry->pixels() * sizeof(UInt16));
+	if (!fpnBuffer) {
+		return CAMERA_MEM_ERROR;
+	}
+	for (UInt32 row = 0; row < geometry->vRes; row++) {
+		const UInt16 *src = fullFpn + (geometry->vOffset + row) * fullSize->hRes + geometry->hOffset;
+		memcpy(fpnBuffer + row * geometry->hRes, src, geometry->hRes * sizeof(UInt16));
+	}
+
+	retVal = CalibrationStore::instance()->write(getFPNFilename(geometry, factory), fpnBuffer,
+												 geometry->pixels() * sizeof(UInt16), CAL_TYPE_FPN, imagerSettings.gain, geometry);
+	free(fpnBuffer);
+	return retVal;
+}
 
-	filename.append("camApp:resolutions");
+/* Camera::getCalSettings
+ *
+ * Generates the imager settings used to black calibrate a resolution:
+ * minimum frame period and maximum exposure at the given gain.
+ **/
+void Camera::getCalSettings(ImagerSettings_t *settings, FrameGeometry *geometry, UInt32 gain)
+{
+	memcpy(&settings->geometry, geometry, sizeof(FrameGeometry));
+	settings->gain = gain;
+	settings->recRegionSizeFrames = getMaxRecordRegionSizeFrames(&settings->geometry);
+	settings->period = sensor->getMinFramePeriod(&settings->geometry);
+	settings->exposure = sensor->getMaxIntegrationTime(settings->period, &settings->geometry);
+	settings->disableRingBuffer = 0;
+	settings->mode = RECORD_MODE_NORMAL;
+	settings->prerecordFrames = 1;
+	settings->segmentLengthFrames = imagerSettings.recRegionSizeFrames;
+	settings->segments = 1;
+	settings->temporary = 0;
+}
+
+/* Camera::readStdResolutions
+ *
+ * Reads the list of standard resolutions supported by the sensor, centered
+ * on the sensor and sorted from largest to smallest. The maximum sensor size
+ * is always the first entry.
+ *
+ * resolutions:	List to return the frame geometries in
+ *
+ * returns: SUCCESS on success, or error code
+ **/
+Int32 Camera::readStdResolutions(QList<FrameGeometry> *resolutions)
+{
+	FrameGeometry maxSize = sensor->getMaxGeometry();
+	QString filename("camApp:resolutions");
 	QFileInfo resolutionsFile(filename);
+	QFile fp;
+
 	if (resolutionsFile.exists() && resolutionsFile.isFile()) {
 		fp.setFileName(filename);
 		fp.open(QIODevice::ReadOnly);
@@ -2542,11 +2787,19 @@ Int32 Camera::blackCalAllStdRes(bool factory, QProgressDialog *dialog)
 		return CAMERA_FILE_ERROR;
 	}
 
+	/* Always include the maximum sensor size. */
+	maxSize.vDarkRows = 0;
+	maxSize.hOffset = 0;
+	maxSize.vOffset = 0;
+	resolutions->clear();
+	resolutions->append(maxSize);
+
 	/* Read the resolutions file into a list. */
 	while (true) {
 		QString tmp = fp.readLine(30);
 		QStringList strlist;
 		FrameGeometry size;
+		int i;
 
 		/* Try to read another resolution from the file. */
 		if (tmp.isEmpty() || tmp.isNull()) break;
@@ -2560,133 +2813,208 @@ Int32 Camera::blackCalAllStdRes(bool factory, QProgressDialog *dialog)
 		size.bitDepth = maxSize.bitDepth;
 		size.hOffset = round((maxSize.hRes - size.hRes) / 2, sensor->getHResIncrement());
 		size.vOffset = round((maxSize.vRes - size.vRes) / 2, sensor->getVResIncrement());
-		if (sensor->isValidResolution(&size)) {
-			line.sprintf("%ux%u", size.hRes, size.vRes);
-			resolutions.append(line);
+		if (!sensor->isValidResolution(&size)) continue;
+
+		/* Insert in order of decreasing size, skipping duplicates. */
+		for (i = 0; i < resolutions->count(); i++) {
+			const FrameGeometry &other = resolutions->at(i);
+			if ((other.hRes == size.hRes) && (other.vRes == size.vRes)) break;
+			if (other.pixels() < size.pixels()) {
+				resolutions->insert(i, size);
+				break;
+			}
 		}
+		if (i == resolutions->count()) resolutions->append(size);
 	}
 	fp.close();
+	return SUCCESS;
+}
 
-	/* Ensure that the maximum sensor size is also included. */
-	line.sprintf("%ux%u", maxSize.hRes, maxSize.vRes);
-	if (!resolutions.contains(line)) {
-		resolutions.prepend(line);
-	}
+/* Camera::planBlackCal
+ *
+ * Orders the black calibration of every gain and standard resolution to
+ * minimize sensor reconfiguration: each gain is configured and gain
+ * calibrated once, starting with the full frame so that its FPN can be
+ * cropped for the smaller sub-windows that share its sensor timing.
+ *
+ * plan:		List to return the calibration steps in
+ * resolutions:	Standard resolutions, largest first
+ *
+ * returns: Estimated total calibration time in seconds
+ **/
+double Camera::planBlackCal(QList<BlackCalStep> *plan, const QList<FrameGeometry> &resolutions)
+{
+	const unsigned int offsetIterations = 32;
+	double total = 0.0;
+	UInt32 g;
 
-	/* If we have a progress dialog - figure out how many calibration steps to do. */
-	if (dialog) {
-		int maxcals = 0;
+	plan->clear();
+	for (g = sensor->getMinGain(); g <= sensor->getMaxGain(); g *= 2) {
+		for (int i = 0; i < resolutions.count(); i++) {
+			BlackCalStep step;
+			FrameGeometry geometry = resolutions.at(i);
+			double period = (double)sensor->getMinFramePeriod(&geometry) / sensor->getFramePeriodClock();
 
-		/* Count up the number of gain settings to calibrate for. */
-		for (g = sensor->getMinGain(); g <= sensor->getMaxGain(); g *= 2) {
-			 maxcals += resolutions.count();
+			/*
+			 * Assume the worst case of a full ADC offset training and FPN
+			 * capture for each step, plus the gain calibration on the first.
+			 */
+			step.geometry = geometry;
+			step.gain = g;
+			step.estimate = BLACK_CAL_CONFIG_SEC;
+			step.estimate += BLACK_CAL_FIXED_SEC + offsetIterations * (CAL_REGION_FRAMES + 10) * period;
+			step.estimate += BLACK_CAL_FIXED_SEC + (FPN_AVERAGE_FRAMES + 1) * period;
+			if (i == 0) {
+				step.estimate += BLACK_CAL_FIXED_SEC + (CAL_REGION_FRAMES + 10) * period;
+			}
+			total += step.estimate;
+			plan->append(step);
 		}
+	}
+	return total;
+}
+
+/* Camera::blackCalAllStdRes
+ *
+ * Performs black calibration of every gain and standard resolution. The
+ * ADC offsets are only trained once per sensor timing, and sub-windows
+ * sharing the sensor timing of the full frame are cropped from its FPN
+ * instead of being captured again.
+ *
+ * factory:		Write the factory calibration instead of the user one
+ * dialog:		Optional progress dialog to report progress and cancellation
+ * maxAgeSecs:	Skip calibration younger than this, and not older than what it depends on, or zero to calibrate all
+ *
+ * returns: SUCCESS on success, or error code
+ **/
+Int32 Camera::blackCalAllStdRes(bool factory, QProgressDialog *dialog, UInt32 maxAgeSecs)
+{
+	ImagerSettings_t settings;
+	FrameGeometry maxSize;
+	QList<FrameGeometry> resolutions;
+	QList<BlackCalStep> plan;
+	QStringList trainedTimings;
+	QString fullTiming;
+	UInt16 *fullFpn = NULL;
+	UInt32 currentGain = 0;
+	UInt32 retVal;
+	double remaining;
+	double scale = 1.0;
+	double estimated = 0.0;
+	qint64 tStart = QDateTime::currentMSecsSinceEpoch();
+
+	retVal = readStdResolutions(&resolutions);
+	if (SUCCESS != retVal)
+		return retVal;
+	maxSize = resolutions.first();
 
-		dialog->setMaximum(maxcals);
+	remaining = planBlackCal(&plan, resolutions);
+	qDebug("blackCalAllStdRes: %d steps, estimated %.0f seconds", plan.count(), remaining);
+
+	/* If we have a progress dialog - report the number of calibration steps. */
+	if (dialog) {
+		dialog->setMaximum(plan.count());
 		dialog->setValue(0);
 		dialog->setAutoClose(false);
 		dialog->setAutoReset(false);
 	}
 
+	fullFpn = (UInt16 *)malloc(maxSize.pixels() * sizeof(UInt16));
+	if (!fullFpn)
+		return CAMERA_MEM_ERROR;
+
 	/* Disable the video port during calibration. */
 	vinst->pauseDisplay();
 
-	//For each gain
-	int progress = 0;
-	for(g = sensor->getMinGain(); g <= sensor->getMaxGain(); g *= 2)
-	{
-		// Configure for maximum resolution
-		memcpy(&settings.geometry, &maxSize, sizeof(FrameGeometry));
-		settings.geometry.hRes = maxSize.hRes;
-		settings.geometry.vRes = maxSize.vRes;
-		settings.geometry.vDarkRows = 0;
-		settings.geometry.bitDepth = maxSize.bitDepth;
-		settings.geometry.hOffset = 0;
-		settings.geometry.vOffset = 0;
-		settings.gain = g;
-		settings.recRegionSizeFrames = getMaxRecordRegionSizeFrames(&settings.geometry);
-		settings.period = sensor->getMinFramePeriod(&settings.geometry);
-		settings.exposure = sensor->getMaxIntegrationTime(settings.period, &settings.geometry);
-		settings.disableRingBuffer = 0;
-		settings.mode = RECORD_MODE_NORMAL;
-		settings.prerecordFrames = 1;
-		settings.segmentLengthFrames = imagerSettings.recRegionSizeFrames;
-		settings.segments = 1;
-		settings.temporary = 0;
-		retVal = setImagerSettings(settings);
-		if (SUCCESS != retVal)
-			return retVal;
+	for (int progress = 0; progress < plan.count(); progress++) {
+		BlackCalStep *step = &plan[progress];
+		bool isFullFrame = (step->geometry.pixels() == maxSize.pixels());
+		QString timing;
 
-		/* Perform gain calibraton. */
-		retVal = autoGainCalibration();
-		if (SUCCESS != retVal)
-			return retVal;
+		/* Update the progress dialog. */
+		if (dialog) {
+			QString label;
+			if (dialog->wasCanceled()) {
+				goto exit_calibration;
+			}
+			label.sprintf("Computing calibration for %ux%u at x%d gain\n(about %.0f min remaining)",
+						  step->geometry.hRes, step->geometry.vRes, step->gain, (remaining * scale) / 60);
+			dialog->setValue(progress);
+			dialog->setLabelText(label);
+			QCoreApplication::processEvents();
+		}
 
-		QStringListIterator iter(resolutions);
-		while (iter.hasNext()) {
-			QString value = iter.next();
-			QStringList tmp = value.split('x');
-
-			// Split the resolution string on 'x' into horizontal and vertical sizes.
-			settings.geometry.hRes = tmp[0].toInt(); //pixels
-			settings.geometry.vRes = tmp[1].toInt(); //pixels
-			settings.geometry.vDarkRows = 0;	//dark rows
-			settings.geometry.bitDepth = maxSize.bitDepth;
-			settings.geometry.hOffset = round((maxSize.hRes - settings.geometry.hRes) / 2, sensor->getHResIncrement());
-			settings.geometry.vOffset = round((maxSize.vRes - settings.geometry.vRes) / 2, sensor->getVResIncrement());
-			settings.gain = g;
-			settings.recRegionSizeFrames = getMaxRecordRegionSizeFrames(&settings.geometry);
-			settings.period = sensor->getMinFramePeriod(&settings.geometry);
-			settings.exposure = sensor->getMaxIntegrationTime(settings.period, &settings.geometry);
-			settings.disableRingBuffer = 0;
-			settings.mode = RECORD_MODE_NORMAL;
-			settings.prerecordFrames = 1;
-			settings.segmentLengthFrames = imagerSettings.recRegionSizeFrames;
-			settings.segments = 1;
-			settings.temporary = 0;
-
-			/* Update the progress dialog. */
-			progress++;
-			if (dialog) {
-				QString label;
-				if (dialog->wasCanceled()) {
-					goto exit_calibration;
-				}
-				label.sprintf("Computing calibration for %ux%u at x%d gain",
-							  settings.geometry.hRes, settings.geometry.vRes, settings.gain);
-				dialog->setValue(progress);
-				dialog->setLabelText(label);
-				QCoreApplication::processEvents();
+		getCalSettings(&settings, &step->geometry, step->gain);
+		retVal = setImagerSettings(settings);
+		if (SUCCESS != retVal)
+			goto exit_error;
+
+		/* Gain calibration is done once per gain, at the full frame size. */
+		if (step->gain != currentGain) {
+			QString gainFilename;
+			gainFilename.sprintf("cal:colGain_G%d.bin", step->gain);
+			if (isCalFileFresh(gainFilename, maxAgeSecs)) {
+				qDebug("Gain calibration for x%d is still valid, skipping", step->gain);
 			}
+			else {
+				retVal = autoGainCalibration();
+				if (SUCCESS != retVal)
+					goto exit_error;
+			}
+			currentGain = step->gain;
+			fullTiming.clear();
+		}
 
-			retVal = setImagerSettings(settings);
-			if (SUCCESS != retVal)
-				return retVal;
+		/* The sensor filename suffix identifies the gain and sensor timing in use. */
+		timing = QString(sensor->getFilename("", "").c_str());
 
-			qDebug("Doing offset correction for %ux%u...", settings.geometry.hRes, settings.geometry.vRes);
-			retVal = autoOffsetCalibration();
-			if(SUCCESS != retVal)
-				return retVal;
+		if (isFPNFileValid(&step->geometry, factory, maxAgeSecs)) {
+			qDebug("Calibration for %ux%u is still valid, skipping", step->geometry.hRes, step->geometry.vRes);
+		}
+		else if (!fullTiming.isEmpty() && (timing == fullTiming)) {
+			qDebug("Cropping FPN for %ux%u from the full frame...", step->geometry.hRes, step->geometry.vRes);
+			retVal = writeCroppedFPN(fullFpn, &maxSize, &step->geometry, factory);
+			if (SUCCESS != retVal)
+				goto exit_error;
+		}
+		else {
+			/* ADC offsets are stored per sensor timing, and reloaded by setImagerSettings. */
+			if (!trainedTimings.contains(timing)) {
+				qDebug("Doing offset correction for %ux%u...", step->geometry.hRes, step->geometry.vRes);
+				retVal = autoOffsetCalibration();
+				if(SUCCESS != retVal)
+					goto exit_error;
+				trainedTimings.append(timing);
+			}
 
-			qDebug("Doing FPN correction for %ux%u...", settings.geometry.hRes, settings.geometry.vRes);
-			retVal = autoFPNCorrection(16, true, false, factory);	//Factory mode
+			qDebug("Doing FPN correction for %ux%u...", step->geometry.hRes, step->geometry.vRes);
+			retVal = autoFPNCorrection(FPN_AVERAGE_FRAMES, true, false, factory);
 			if(SUCCESS != retVal)
-				return retVal;
+				goto exit_error;
+		}
 
-			qDebug() << "Done.";
+		/* Keep the full frame FPN around to crop the sub-windows from it. */
+		if (isFullFrame) {
+			if (CalibrationStore::instance()->read(getFPNFilename(&step->geometry, factory), fullFpn, maxSize.pixels() * sizeof(UInt16)) == SUCCESS) {
+				fullTiming = timing;
+			}
 		}
+
+		/* Scale the remaining estimate by how long the calibration has actually taken. */
+		estimated += step->estimate;
+		remaining -= step->estimate;
+		scale = (QDateTime::currentMSecsSinceEpoch() - tStart) / (estimated * 1000.0);
+		qDebug() << "Done.";
 	}
 exit_calibration:
+	retVal = SUCCESS;
+exit_error:
+	free(fullFpn);
+	qDebug("blackCalAllStdRes: finished in %.0f seconds", (QDateTime::currentMSecsSinceEpoch() - tStart) / 1000.0);
+	if (SUCCESS != retVal)
+		return retVal;
 
-	fp.close();
-
-	memcpy(&settings.geometry, &maxSize, sizeof(maxSize));
-	settings.geometry.vDarkRows = 0; //Inactive dark rows on top
-	settings.gain = sensor->getMinGain();
-	settings.recRegionSizeFrames = getMaxRecordRegionSizeFrames(&settings.geometry);
-	settings.period = sensor->getMinFramePeriod(&settings.geometry);
-	settings.exposure = sensor->getMaxIntegrationTime(settings.period, &settings.geometry);
-
+	getCalSettings(&settings, &maxSize, sensor->getMinGain());
 	retVal = setImagerSettings(settings);
 	vinst->liveDisplay((sensor->getSensorQuirks() & SENSOR_QUIRK_UPSIDE_DOWN) != 0);
 	if(SUCCESS != retVal) {
@@ -2816,25 +3144,21 @@ cleanupTakeWhiteReferences:
 }
 
 bool Camera::getButtonsOnLeft(void){
-	QSettings appSettings;
-	return (appSettings.value("camera/ButtonsOnLeft", false).toBool());
+	return SettingsCache::instance()->getBool("camera/ButtonsOnLeft", false);
 }
 
 void Camera::setButtonsOnLeft(bool en){
-	QSettings appSettings;
 	ButtonsOnLeft = en;
-	appSettings.setValue("camera/ButtonsOnLeft", en);
+	SettingsCache::instance()->setValue("camera/ButtonsOnLeft", en);
 }
 
 bool Camera::getUpsideDownDisplay(){
-	QSettings appSettings;
-	return (appSettings.value("camera/UpsideDownDisplay", false).toBool());
+	return SettingsCache::instance()->getBool("camera/UpsideDownDisplay", false);
 }
 
 void Camera::setUpsideDownDisplay(bool en){
-	QSettings appSettings;
 	UpsideDownDisplay = en;
-	appSettings.setValue("camera/UpsideDownDisplay", en);
+	SettingsCache::instance()->setValue("camera/UpsideDownDisplay", en);
 }
 
 bool Camera::RotationArgumentIsSet()
@@ -2850,111 +3174,200 @@ void Camera::upsideDownTransform(int rotation){
 
 bool Camera::getFocusPeakEnable(void)
 {
-	QSettings appSettings;
-	return appSettings.value("camera/focusPeak", false).toBool();
+	return SettingsCache::instance()->getBool("camera/focusPeak", false);
 }
 
 void Camera::setFocusPeakEnable(bool en)
 {
-	QSettings appSettings;
-	appSettings.setValue("camera/focusPeak", en);
+	SettingsCache::instance()->setValue("camera/focusPeak", en);
 	vinst->setDisplayOptions(getZebraEnable(), en ? (FocusPeakColors)getFocusPeakColor() : FOCUS_PEAK_DISABLE);
 }
 
 int Camera::getFocusPeakColor(void)
 {
-	QSettings appSettings;
-	return appSettings.value("camera/focusPeakColor", FOCUS_PEAK_CYAN).toInt();
+	return SettingsCache::instance()->getInt("camera/focusPeakColor", FOCUS_PEAK_CYAN);
 }
 
 void Camera::setFocusPeakColor(int value)
 {
-	QSettings appSettings;
-	appSettings.setValue("camera/focusPeakColor", value);
+	SettingsCache::instance()->setValue("camera/focusPeakColor", value);
 	vinst->setDisplayOptions(getZebraEnable(), getFocusPeakEnable() ? (FocusPeakColors)value : FOCUS_PEAK_DISABLE);
 }
 
 bool Camera::getZebraEnable(void)
 {
-	QSettings appSettings;
-	return appSettings.value("camera/zebra", true).toBool();
+	return SettingsCache::instance()->getBool("camera/zebra", true);
 }
 
 void Camera::setZebraEnable(bool en)
 {
-	QSettings appSettings;
-	appSettings.setValue("camera/zebra", en);
+	SettingsCache::instance()->setValue("camera/zebra", en);
 	vinst->setDisplayOptions(en, getFocusPeakEnable() ? (FocusPeakColors)getFocusPeakColor() : FOCUS_PEAK_DISABLE);
 }
 
 int Camera::getUnsavedWarnEnable(void){
-	QSettings appSettings;
-	return appSettings.value("camera/unsavedWarn", 1).toInt();
+	return SettingsCache::instance()->getInt("camera/unsavedWarn", 1);
 	//If there is unsaved video in RAM, prompt to start record.  2=always, 1=if not reviewed, 0=never
 }
 
 void Camera::setUnsavedWarnEnable(int newSetting){
-	QSettings appSettings;
 	unsavedWarnEnabled = newSetting;
-	appSettings.setValue("camera/unsavedWarn", newSetting);
+	SettingsCache::instance()->setValue("camera/unsavedWarn", newSetting);
 }
 
 
 void Camera::set_autoSave(bool state) {
-	QSettings appSettings;
 	autoSave = state;
-	appSettings.setValue("camera/autoSave", state);
+	SettingsCache::instance()->setValue("camera/autoSave", state);
 }
 
 bool Camera::get_autoSave() {
-	QSettings appSettings;
-	return appSettings.value("camera/autoSave", false).toBool();
+	return SettingsCache::instance()->getBool("camera/autoSave", false);
 }
 
 
 void Camera::set_autoRecord(bool state) {
-	QSettings appSettings;
 	autoRecord = state;
-	appSettings.setValue("camera/autoRecord", state);
+	SettingsCache::instance()->setValue("camera/autoRecord", state);
 }
 
 bool Camera::get_autoRecord() {
-	QSettings appSettings;
-	return appSettings.value("camera/autoRecord", false).toBool();
+	return SettingsCache::instance()->getBool("camera/autoRecord", false);
 }
 
 
 void Camera::set_demoMode(bool state) {
-	QSettings appSettings;
 	demoMode = state;
-	appSettings.setValue("camera/demoMode", state);
+	SettingsCache::instance()->setValue("camera/demoMode", state);
 }
 
 bool Camera::get_demoMode() {
-	QSettings appSettings;
-	return appSettings.value("camera/demoMode", false).toBool();
+	return SettingsCache::instance()->getBool("camera/demoMode", false);
+}
+
+/* Camera::openRecIrq
+ *
+ * Opens an interrupt source for recording state changes, if one has been
+ * configured by the CAM_RECORD_IRQ environment variable. This can either be
+ * a UIO device, or the value file of a GPIO exported to sysfs with its edge
+ * configured. The sequencer status is still polled at an adaptive rate
+ * either way, so a missing or quiet interrupt only costs latency.
+ *
+ * returns: nothing
+ **/
+void Camera::openRecIrq(void)
+{
+	const char *path = getenv("CAM_RECORD_IRQ");
+	char buf[4];
+	ssize_t ret;
+
+	if (!path) return;
+
+	recIrqFD = open(path, O_RDWR | O_NONBLOCK);
+	if (recIrqFD < 0) {
+		qWarning("Failed to open recording IRQ %s, falling back to polling", path);
+		return;
+	}
+
+	recIrqIsUio = (strncmp(path, "/dev/uio", 8) == 0);
+	if (recIrqIsUio) {
+		/* Unmask the UIO interrupt. */
+		UInt32 enable = 1;
+		ret = write(recIrqFD, &enable, sizeof(enable));
+	}
+	else {
+		/* Read the GPIO to clear any pending edge. */
+		ret = read(recIrqFD, buf, sizeof(buf));
+	}
+	if (ret < 0) {
+		qWarning("Failed to enable recording IRQ %s: %s, falling back to polling", path, strerror(errno));
+		close(recIrqFD);
+		recIrqFD = -1;
+		return;
+	}
+	qDebug("Using recording IRQ %s", path);
+}
+
+static qint64 recTimestamp(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (qint64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
 void* recDataThread(void *arg)
 {
 	Camera * cInst = (Camera *)arg;
-	int ms = 100;
-	struct timespec ts = { ms / 1000, (ms % 1000) * 1000 * 1000 };
+	struct pollfd fds[2];
+	int nfds = 0;
+	int irqIndex = -1;
 	bool recording;
 
+	if (cInst->recWakeFD >= 0) {
+		fds[nfds].fd = cInst->recWakeFD;
+		fds[nfds].events = POLLIN;
+		nfds++;
+	}
+	if (cInst->recIrqFD >= 0) {
+		irqIndex = nfds;
+		fds[nfds].fd = cInst->recIrqFD;
+		fds[nfds].events = cInst->recIrqIsUio ? POLLIN : (POLLPRI | POLLERR);
+		nfds++;
+	}
+
 	while(!cInst->terminateRecDataThread) {
-		//On the falling edge of recording, call the user callback
+		/*
+		 * Wait for an interrupt, a wakeup, or for the poll interval to expire. The
+		 * interrupt reports the recording edges, so only the slow poll is needed
+		 * as a backstop, and the fast poll is kept for when there is no interrupt.
+		 */
+		bool fastPoll = (irqIndex < 0) && (cInst->recording || cInst->lastRecording);
+		int timeout = fastPoll ? REC_POLL_ACTIVE_MSEC : REC_POLL_IDLE_MSEC;
+		if (poll(fds, nfds, timeout) > 0) {
+			if (cInst->recWakeFD >= 0 && (fds[0].revents & POLLIN)) {
+				eventfd_t count;
+				eventfd_read(cInst->recWakeFD, &count);
+			}
+			if (irqIndex >= 0 && fds[irqIndex].revents) {
+				ssize_t ret;
+				if (cInst->recIrqIsUio) {
+					UInt32 enable = 1;
+					UInt32 irqCount;
+					ret = read(cInst->recIrqFD, &irqCount, sizeof(irqCount));
+					if (ret >= 0) ret = write(cInst->recIrqFD, &enable, sizeof(enable));
+				}
+				else {
+					char buf[4];
+					lseek(cInst->recIrqFD, 0, SEEK_SET);
+					ret = read(cInst->recIrqFD, buf, sizeof(buf));
+				}
+				/* Stop waiting on an interrupt that can't be acknowledged, and rely on polling. */
+				if ((ret < 0) && (errno != EAGAIN)) {
+					qWarning("Failed to acknowledge recording IRQ: %s, falling back to polling", strerror(errno));
+					fds[irqIndex].fd = -1;
+					irqIndex = -1;
+				}
+			}
+		}
+		if (cInst->terminateRecDataThread) break;
+
 		recording = cInst->getRecording();
+		if(recording && !cInst->lastRecording)
+		{
+			emit cInst->recordingStarted(recTimestamp());
+		}
+		//On the falling edge of recording, call the user callback
 		if(!recording && (cInst->lastRecording || cInst->recording))	//Take care of situtation where recording goes low->high-low between two interrutps by checking the cInst->recording flag
 		{
-			recording = false;
+			qint64 timestamp = recTimestamp();
 			cInst->ui->setRecLEDFront(false);
 			cInst->ui->setRecLEDBack(false);
 			cInst->recording = false;
+			cInst->recordingData.stopTime = timestamp;
+			SettingsCache::instance()->setValue("camera/recordingStopTime", timestamp);
+			emit cInst->recordingStopped(timestamp);
 		}
 		cInst->lastRecording = recording;
-
-		nanosleep(&ts, NULL);
 	}
 
 	pthread_exit(NULL);
@@ -20,16 +20,22 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <QProgressDialog>
+#include <QDateTime>
 
 #include "errorCodes.h"
 #include "defines.h"
 
 #include "gpmc.h"
+#include "frameAccumulator.h"
+#include "frameCorrector.h"
+#include "defectScan.h"
+#include "rawExport.h"
 #include "video.h"
 #include "sensor.h"
 #include "power.h"
 #include "userInterface.h"
 #include "io.h"
+#include "bootProfiler.h"
 #include "string.h"
 #include "types.h"
 
@@ -51,18 +57,32 @@
 #define BITS_PER_PIXEL			12
 #define BYTES_PER_WORD			32
 
+/* Sensor settings that differ, as found by Camera::diffImagerSettings. */
+#define IMAGER_CHANGE_GEOMETRY	(1 << 0)
+#define IMAGER_CHANGE_GAIN		(1 << 1)
+#define IMAGER_CHANGE_PERIOD	(1 << 2)
+#define IMAGER_CHANGE_EXPOSURE	(1 << 3)
+#define IMAGER_CHANGE_ALL		0xF
+
+/* Time the FPGA needs after a reset before it can be accessed. */
+#define FPGA_RESET_DELAY_MSEC	200
+
 #define MAX_LIVE_FRAMERATE      60
 #define MAX_RECORD_FRAMERATE    230
 
 #define FPN_AVERAGE_FRAMES		16	//Number of frames to average to get FPN correction data
 
-#define SENSOR_DATA_WIDTH		12
+#define BLACK_CAL_CONFIG_SEC	0.25	//Estimated time to reconfigure the sensor for a black cal step
+#define BLACK_CAL_FIXED_SEC		0.5		//Estimated fixed overhead of each offset or FPN calibration
+#define BLACK_CAL_MAX_AGE_SECS	(24*60*60)	//Default age up to which black calibration is kept rather than repeated
+
+#define REC_POLL_ACTIVE_MSEC	2	//Recording state poll interval while recording
+#define REC_POLL_IDLE_MSEC		50	//Recording state poll interval while idle
+
 #define COLOR_MATRIX_INT_BITS	3
 
 #define IMAGE_GAIN_FUDGE_FACTOR 1.0		//Multiplier to make sure clipped ADC value actually clips image
 #define COL_OFFSET_FOOTROOM		32		// Train ADC to not-quite zero to give footroom for noise.
-#define COL_GAIN_FRAC_BITS		12		// 2-point column gain fractional bits.
-#define COL_CURVE_FRAC_BITS		21		// 3-point column curvature factional bits.
 
 #define SETTING_FLAG_TEMPORARY  1
 #define SETTING_FLAG_USESAVED   2
@@ -142,6 +162,12 @@ typedef struct {
 	};
 } ImagerSettings_t;
 
+typedef struct {
+	FrameGeometry geometry;		//Frame geometry to calibrate.
+	UInt32 gain;
+	double estimate;			//Estimated time for this step in seconds.
+} BlackCalStep;
+
 
 typedef struct {
 	ImagerSettings_t is;
@@ -149,6 +175,7 @@ typedef struct {
 	bool hasBeenSaved;
 	bool hasBeenViewed;
 	UInt32 ignoreSegments;
+	qint64 stopTime;		/* When the recording ended against CLOCK_MONOTONIC, which identifies it. */
 } RecordSettings_t;
 
 typedef struct {
@@ -168,11 +195,14 @@ typedef struct {
 	double matrix[9];
 } ColorMatrix_t;
 
-class Camera
+class Camera : public QObject
 {
+	Q_OBJECT
+
 public:
 	Camera();
 	~Camera();
+	void startInit(GPMC * gpmcInst);
 	CameraErrortype init(GPMC * gpmcInst, Video * vinstInst, ImageSensor * sensorInst, UserInterface * userInterface, UInt32 ramSizeVal, bool color);
 	Int32 startRecording(void);
 	Int32 setRecSequencerModeNormal();
@@ -235,9 +265,15 @@ public:
 	int autoWhiteBalance(unsigned int x, unsigned int y);
 	void setFocusAid(bool enable);
 	bool getFocusAid();
-	int blackCalAllStdRes(bool factory = false, QProgressDialog *dialog = NULL);
+	int blackCalAllStdRes(bool factory = false, QProgressDialog *dialog = NULL, UInt32 maxAgeSecs = 0);
+	Int32 readStdResolutions(QList<FrameGeometry> *resolutions);
+	double planBlackCal(QList<BlackCalStep> *plan, const QList<FrameGeometry> &resolutions);
 
 	Int32 checkForDeadPixels(int* resultCount = NULL, int* resultMax = NULL);
+	Int32 loadDefectMap(void);
+	QByteArray getDngBadPixelOpcodes(void);
+	Int32 exportRawFrames(int fd, UInt32 firstFrame, UInt32 count, UInt32 flags = 0, RawExportStats *stats = NULL);
+	Int32 writeRawExportHeader(int fd, UInt32 firstFrame, UInt32 count, bool includeFPN = true);
 
 	bool getFocusPeakEnable(void);
 	void setFocusPeakEnable(bool en);
@@ -260,7 +296,16 @@ private:
 	void terminateRecord(void);
 	void writeSeqPgmMem(SeqPgmMemWord pgmWord, UInt32 address);
 	void setRecRegion(UInt32 start, UInt32 count, FrameGeometry *geometry);
+	UInt32 diffImagerSettings(const ImagerSettings_t *settings);
+	void updateCalibration(void);
+	void invalidateCalibration(void);
 	bool readIsColor(void);
+	void getCalSettings(ImagerSettings_t *settings, FrameGeometry *geometry, UInt32 gain);
+	QString getFPNFilename(FrameGeometry *geometry, bool factory);
+	UInt32 getBayerPhase(const FrameGeometry *geometry);
+	bool isFPNFileValid(FrameGeometry *geometry, bool factory, UInt32 maxAgeSecs);
+	bool isCalFileFresh(const QString &filename, UInt32 maxAgeSecs, QDateTime *modified = NULL);
+	Int32 writeCroppedFPN(const UInt16 *fullFpn, FrameGeometry *fullSize, FrameGeometry *geometry, bool factory);
 public:
 	void setFocusPeakThresholdLL(UInt32 thresh);
 	UInt32 getFocusPeakThresholdLL(void);
@@ -272,13 +317,28 @@ public:
 	bool ButtonsOnLeft;
 	bool UpsideDownDisplay;
 
+signals:
+	/*
+	 * Recording state edges, timestamped against CLOCK_MONOTONIC in nanoseconds.
+	 * The timestamp is when the edge was detected by the recording thread, from
+	 * the interrupt or by polling, rather than a time captured by the FPGA.
+	 */
+	void recordingStarted(qint64 timestamp);
+	void recordingStopped(qint64 timestamp);
+
 private:
 	friend void* recDataThread(void *arg);
+	int recIrqFD;
+	int recWakeFD;
+	bool recIrqIsUio;
+	void openRecIrq(void);
 
 	volatile bool recording;
 	bool playbackMode;
 
 	ImagerSettings_t imagerSettings;
+	bool imagerSettingsApplied;		/* imagerSettings has been programmed into the sensor. */
+	QString calibrationKey;			/* Sensor timing the loaded calibration is for, empty if unknown. */
 	bool isColor;
 
 	double imgGain;
@@ -337,7 +397,19 @@ private:
 	bool lastRecording;
 	bool terminateRecDataThread;
 	UInt32 ramSize;
+	FrameAccumulator accumulator;
+	FrameCorrector corrector;
+	DefectMap defects;
 	pthread_t recDataThreadID;
+
+	/* Started by startInit() and waited for by init(). */
+	UInt64 fpgaResetTime;
+	BootTask *eepromTask;
+	BootTask *calIndexTask;
+	Int32 eepromError;
+	UInt32 ramSizeGBSlot[2];
+	static void readEEPROMs(void *arg);
+	static void loadCalIndex(void *arg);
 };
 
 #endif // CAMERA_H
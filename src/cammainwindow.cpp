@@ -19,10 +19,11 @@
 #include <stdio.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <QSettings>
 
 #include "cameraRegisters.h"
 #include "userInterface.h"
+#include "settingsCache.h"
+#include "bootProfiler.h"
 #include "mainwindow.h"
 #include "playbackwindow.h"
 #include "recsettingswindow.h"
@@ -57,13 +58,27 @@ CamMainWindow::CamMainWindow(QWidget *parent) :
 	QDialog(parent),
 	ui(new Ui::CamMainWindow)
 {
-	QSettings appSettings;
 	CameraErrortype retVal;
-	ui->setupUi(this);
+	BootSpan span("Main window");
 
+	/*
+	 * Reset the FPGA and start reading the EEPROMs and calibration index
+	 * first, so that they run while the UI is built and the video pipeline
+	 * is connected to.
+	 */
 	gpmc = new GPMC();
+	gpmc->init();
 	camera = new Camera();
+	camera->startInit(gpmc);
+
+	BootSpan uiSpan("UI construction");
+	ui->setupUi(this);
+	uiSpan.end();
+
+	BootSpan videoSpan("Video pipeline connection");
 	vinst = new Video();
+	videoSpan.end();
+
 	userInterface = new UserInterface();
 	prompt = NULL;
 
@@ -90,9 +105,11 @@ CamMainWindow::CamMainWindow(QWidget *parent) :
 
 	vinst->displayWindowXOff = (camera->ButtonsOnLeft ^ camera->UpsideDownDisplay? 200 : 0);
 
-	gpmc->init();
 	userInterface->init();
+
+	BootSpan cameraSpan("Camera init");
 	retVal = camera->init(gpmc, vinst, sensor, userInterface, 16*1024/32*1024*1024, true);
+	cameraSpan.end();
 
 	if(retVal != SUCCESS)
 	{
@@ -118,12 +135,12 @@ CamMainWindow::CamMainWindow(QWidget *parent) :
 	timer->start(16);
 
 	connect(camera->vinst, SIGNAL(newSegment(VideoStatus *)), this, SLOT(on_newVideoSegment(VideoStatus *)));
+	connect(camera, SIGNAL(recordingStarted(qint64)), this, SLOT(on_recordingStarted(qint64)));
+	connect(camera, SIGNAL(recordingStopped(qint64)), this, SLOT(on_recordingStopped(qint64)));
 
-	if (appSettings.value("debug/hideDebug", true).toBool()) {
-		ui->cmdDebugWnd->setVisible(false);
-		ui->cmdClose->setVisible(false);
-		ui->cmdDPCButton->setVisible(false);
-	}
+	/* Follow changes to the debug controls setting, rather than polling it. */
+	connect(SettingsCache::instance(), SIGNAL(valueChanged(QString,QVariant)), this, SLOT(on_settingChanged(QString,QVariant)));
+	updateDebugControls();
 
 	if (camera->get_autoRecord()) {
 		camera->setRecSequencerModeNormal();
@@ -338,7 +355,6 @@ void CamMainWindow::updateRecordingState(bool recording)
 void CamMainWindow::on_MainWindowTimer()
 {
 	bool shutterButton = camera->ui->getShutterButton();
-	QSettings appSettings;
 
 	if(shutterButton && !lastShutterButton)
 	{
@@ -371,14 +387,8 @@ void CamMainWindow::on_MainWindowTimer()
 		}
 	}
 
-	bool recording = camera->getIsRecording();
-
-	if (recording != lastRecording) {
-		updateRecordingState(recording);
-		lastRecording = recording;
-	}
-	// Otherwise, start auto save after a small delay to allow segment data to arrive.
-	else if (autoSavePending > 1) {
+	// Start auto save after a small delay to allow segment data to arrive.
+	if (autoSavePending > 1) {
 		autoSavePending--;
 	}
 	else if (autoSavePending != 0) {
@@ -399,19 +409,40 @@ void CamMainWindow::on_MainWindowTimer()
 	}
 	powerLoopCount++;
 	updateCurrentSettingsLabel();
+}
 
-	if (appSettings.value("debug/hideDebug", true).toBool()) {
-		ui->cmdDebugWnd->setVisible(false);
-		ui->cmdClose->setVisible(false);
-		ui->cmdDPCButton->setVisible(false);
+void CamMainWindow::on_settingChanged(const QString &key, const QVariant &value)
+{
+	if (key == "debug/hideDebug") {
+		updateDebugControls();
 	}
-	else {
-		ui->cmdDebugWnd->setVisible(true);
-		ui->cmdClose->setVisible(true);
-		ui->cmdDPCButton->setVisible(true);
+}
+
+void CamMainWindow::updateDebugControls(void)
+{
+	bool visible = !SettingsCache::instance()->getBool("debug/hideDebug", true);
+
+	ui->cmdDebugWnd->setVisible(visible);
+	ui->cmdClose->setVisible(visible);
+	ui->cmdDPCButton->setVisible(visible);
+}
+
+void CamMainWindow::on_recordingStarted(qint64 timestamp)
+{
+	if (!lastRecording) {
+		updateRecordingState(true);
+		lastRecording = true;
 	}
 }
 
+void CamMainWindow::on_recordingStopped(qint64 timestamp)
+{
+	/* Always handle the stop edge, even if the recording was too short to see it start. */
+	qDebug("--- Sequencer --- Recording ended at %lld.%09lld", timestamp / 1000000000LL, timestamp % 1000000000LL);
+	updateRecordingState(false);
+	lastRecording = false;
+}
+
 void CamMainWindow::on_newVideoSegment(VideoStatus *st)
 {
 	/* Flag that we have unsaved video. */
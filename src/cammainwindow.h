@@ -62,7 +62,10 @@ private slots:
 	void on_cmdIOSettings_clicked();
 
 	void on_MainWindowTimer();
+	void on_settingChanged(const QString &key, const QVariant &value);
 	void on_newVideoSegment(VideoStatus *st);
+	void on_recordingStarted(qint64 timestamp);
+	void on_recordingStopped(qint64 timestamp);
 
 	void on_chkFocusAid_clicked(bool focusAidEnabled);
 
@@ -86,6 +89,7 @@ private:
 	void updateRecordingState(bool recording);
 	void updateCurrentSettingsLabel(void);
 	void updateExpSliderLimits(void);
+	void updateDebugControls(void);
 	QMessageBox::StandardButton question(const QString &title, const QString &text, QMessageBox::StandardButtons = QMessageBox::Yes|QMessageBox::No);
 
 	QMessageBox *prompt;
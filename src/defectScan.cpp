@@ -0,0 +1,310 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "defectScan.h"
+
+DefectMap::DefectMap()
+{
+	list = NULL;
+	used = 0;
+	alloc = 0;
+}
+
+DefectMap::~DefectMap()
+{
+	free(list);
+}
+
+void DefectMap::clear(void)
+{
+	used = 0;
+}
+
+/* DefectMap::add
+ *
+ * Appends a pixel to the map, growing the list as needed.
+ *
+ * x:		Column of the pixel
+ * y:		Row of the pixel
+ * hot:		true if the pixel is brighter than its neighbourhood
+ *
+ * returns: true on success, false if the map is full
+ **/
+bool DefectMap::add(UInt32 x, UInt32 y, bool hot)
+{
+	if (used >= alloc) {
+		UInt32 size = alloc ? alloc * 2 : 256;
+		UInt32 *grown;
+
+		if (alloc >= DEFECT_MAX_PIXELS) return false;
+		size = min(size, (UInt32)DEFECT_MAX_PIXELS);
+		grown = (UInt32 *)realloc(list, size * sizeof(UInt32));
+		if (!grown) return false;
+		list = grown;
+		alloc = size;
+	}
+	list[used++] = DEFECT_ENTRY(x, y, hot);
+	return true;
+}
+
+static int compareDefects(const void *a, const void *b)
+{
+	UInt32 ea = *(const UInt32 *)a & ~DEFECT_HOT;
+	UInt32 eb = *(const UInt32 *)b & ~DEFECT_HOT;
+	return (ea > eb) - (ea < eb);
+}
+
+/* DefectMap::finish
+ *
+ * Sorts the map in raster order and merges pixels that were added more
+ * than once, keeping the hot flag if any of the duplicates had it.
+ *
+ * returns: nothing
+ **/
+void DefectMap::finish(void)
+{
+	UInt32 out = 0;
+
+	if (!used) return;
+	qsort(list, used, sizeof(UInt32), compareDefects);
+	for (UInt32 i = 1; i < used; i++) {
+		if ((list[i] & ~DEFECT_HOT) == (list[out] & ~DEFECT_HOT)) {
+			list[out] |= list[i] & DEFECT_HOT;
+		}
+		else {
+			list[++out] = list[i];
+		}
+	}
+	used = out + 1;
+}
+
+/* DefectMap::contains
+ *
+ * Looks up a pixel in a finished map.
+ *
+ * returns: true if the pixel is defective
+ **/
+bool DefectMap::contains(UInt32 x, UInt32 y) const
+{
+	UInt32 key = DEFECT_ENTRY(x, y, false);
+	return bsearch(&key, list, used, sizeof(UInt32), compareDefects) != NULL;
+}
+
+/* Sum of a rectangle of quads [r0, r1) x [c0, c1) from a summed-area table.
+ * Wrapping arithmetic gives the right answer as long as the sum fits 32 bits. */
+static inline UInt32 boxSum(const UInt32 *sat, UInt32 stride, UInt32 r0, UInt32 r1, UInt32 c0, UInt32 c1)
+{
+	return sat[r1 * stride + c1] - sat[r0 * stride + c1] - sat[r1 * stride + c0] + sat[r0 * stride + c0];
+}
+
+/* scanDeadPixels
+ *
+ * Compares each pixel of an averaged dark-subtracted frame against the mean
+ * of the same Bayer channel over the surrounding neighbourhood, and counts
+ * the pixels that deviate by more than a threshold. Columns of the
+ * neighbourhood outside the frame are skipped, while rows outside the frame
+ * are replaced by the centre row.
+ *
+ * Each Bayer plane is reduced to a summed-area table, so the neighbourhood
+ * of every quad is summed in constant time instead of visiting all of its
+ * BAD_PIXEL_RING_TAPS^2 quads.
+ *
+ * frame:		Unpacked frame to scan
+ * hRes:		Width of the frame in pixels
+ * vRes:		Height of the frame in pixels
+ * threshold:	Largest deviation allowed for a good pixel
+ * result:		Returns the defect count and deviation statistics
+ * map:			Optional map to add the coordinates of the defects to
+ *
+ * returns: nothing
+ **/
+void scanDeadPixels(const UInt16 *frame, UInt32 hRes, UInt32 vRes, Int32 threshold, DefectScanResult *result, DefectMap *map)
+{
+	/* Only quads starting before the last two rows and columns are scanned. */
+	UInt32 quadCols = (hRes > 2) ? (hRes - 1) / 2 : 0;
+	UInt32 quadRows = (vRes > 2) ? (vRes - 1) / 2 : 0;
+	UInt32 satStride = quadCols + 1;
+	UInt32 *sat;
+	Int64 offsetSum = 0;
+
+	result->failed = 0;
+	result->maxOffset = 0;
+	result->averageOffset = 0;
+	if (!quadCols || !quadRows) return;
+
+	sat = (UInt32 *)calloc((quadRows + 1) * satStride, sizeof(UInt32));
+	if (!sat) return;
+
+	for (UInt32 plane = 0; plane < 4; plane++) {
+		UInt32 dx = plane & 1;
+		UInt32 dy = plane >> 1;
+
+		/* Build the summed-area table of this Bayer plane. */
+		for (UInt32 qy = 0; qy < quadRows; qy++) {
+			const UInt16 *row = frame + (2 * qy + dy) * hRes + dx;
+			UInt32 *above = sat + qy * satStride + 1;
+			UInt32 *out = sat + (qy + 1) * satStride + 1;
+			UInt32 rowSum = 0;
+
+			for (UInt32 qx = 0; qx < quadCols; qx++) {
+				rowSum += row[2 * qx];
+				out[qx] = above[qx] + rowSum;
+			}
+		}
+
+		for (UInt32 qy = 0; qy < quadRows; qy++) {
+			UInt32 r0 = (qy > BAD_PIXEL_RING_QUADS) ? (qy - BAD_PIXEL_RING_QUADS) : 0;
+			UInt32 r1 = min(qy + BAD_PIXEL_RING_QUADS + 1, quadRows);
+			UInt32 missingRows = BAD_PIXEL_RING_TAPS - (r1 - r0);
+			const UInt16 *row = frame + (2 * qy + dy) * hRes + dx;
+
+			for (UInt32 qx = 0; qx < quadCols; qx++) {
+				UInt32 c0 = (qx > BAD_PIXEL_RING_QUADS) ? (qx - BAD_PIXEL_RING_QUADS) : 0;
+				UInt32 c1 = min(qx + BAD_PIXEL_RING_QUADS + 1, quadCols);
+				Int32 sum = boxSum(sat, satStride, r0, r1, c0, c1);
+				Int32 average;
+				Int32 offset;
+
+				if (missingRows) sum += missingRows * boxSum(sat, satStride, qy, qy + 1, c0, c1);
+
+				/* Divide by the number of neighbours in 16.16 fixed point. */
+				average = (sum * ((1 << 16) / (Int32)(BAD_PIXEL_RING_TAPS * (c1 - c0)))) >> 16;
+				offset = average - row[2 * qx];
+
+				if (offset > result->maxOffset) result->maxOffset = offset;
+				if (offset < -result->maxOffset) result->maxOffset = -offset;
+				if (offset > threshold || offset < -threshold) {
+					result->failed++;
+					if (map) map->add(2 * qx + dx, 2 * qy + dy, offset < 0);
+				}
+				offsetSum += offset;
+			}
+		}
+	}
+	free(sat);
+
+	result->averageOffset = offsetSum / (quadRows * quadCols);
+}
+
+/* concealDefects
+ *
+ * Replaces each defective pixel within a frame by the mean of its nearest
+ * neighbours of the same colour, skipping neighbours that are outside the
+ * frame or defective themselves. Pixels without a usable neighbour are left
+ * untouched.
+ *
+ * frame:		Unpacked frame, including any dark rows ahead of the active pixels
+ * geometry:	Geometry of the frame, whose offsets locate it in the defect map
+ * map:			Finished defect map, in full sensor coordinates
+ * step:		Distance to the nearest pixel of the same colour, 2 for Bayer sensors
+ *
+ * returns: nothing
+ **/
+void concealDefects(UInt16 *frame, const FrameGeometry *geometry, const DefectMap *map, UInt32 step)
+{
+	const UInt32 *entries = map->entries();
+	UInt16 *active = frame + geometry->vDarkRows * geometry->hRes;
+	const int dx[4] = { -1, 1, 0, 0 };
+	const int dy[4] = { 0, 0, -1, 1 };
+
+	for (UInt32 i = 0; i < map->count(); i++) {
+		UInt32 x = DEFECT_X(entries[i]);
+		UInt32 y = DEFECT_Y(entries[i]);
+		UInt32 sum = 0;
+		UInt32 n = 0;
+
+		if (y < geometry->vOffset || x < geometry->hOffset) continue;
+		if (y >= geometry->vOffset + geometry->vRes) break;
+		if (x >= geometry->hOffset + geometry->hRes) continue;
+
+		for (int k = 0; k < 4; k++) {
+			int nx = (int)(x - geometry->hOffset) + dx[k] * (int)step;
+			int ny = (int)(y - geometry->vOffset) + dy[k] * (int)step;
+
+			if (nx < 0 || ny < 0 || nx >= (int)geometry->hRes || ny >= (int)geometry->vRes) continue;
+			if (map->contains(nx + geometry->hOffset, ny + geometry->vOffset)) continue;
+			sum += active[ny * geometry->hRes + nx];
+			n++;
+		}
+		if (n) {
+			active[(y - geometry->vOffset) * geometry->hRes + (x - geometry->hOffset)] = (sum + n / 2) / n;
+		}
+	}
+}
+
+static inline UInt8 *putBigEndian32(UInt8 *p, UInt32 value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+	return p + 4;
+}
+
+/* buildDngBadPixelOpcodes
+ *
+ * Encodes the defects within a frame as a DNG opcode list holding a single
+ * FixBadPixelsList opcode, suitable for the OpcodeList1 tag. The opcode is
+ * flagged optional so readers that do not support it can skip it.
+ *
+ * buf:			Output buffer, or NULL to compute the size only
+ * size:		Size of the output buffer in bytes
+ * geometry:	Geometry of the saved frames
+ * map:			Finished defect map, in full sensor coordinates
+ * bayerPhase:	DNG Bayer phase of the top-left pixel of the frame
+ *
+ * returns: Size of the opcode list in bytes, or zero if it does not fit
+ **/
+UInt32 buildDngBadPixelOpcodes(UInt8 *buf, UInt32 size, const FrameGeometry *geometry, const DefectMap *map, UInt32 bayerPhase)
+{
+	const UInt32 *entries = map->entries();
+	UInt32 points = 0;
+	UInt32 length;
+	UInt8 *p;
+
+	for (UInt32 i = 0; i < map->count(); i++) {
+		UInt32 x = DEFECT_X(entries[i]);
+		UInt32 y = DEFECT_Y(entries[i]);
+		if ((x >= geometry->hOffset) && (x < geometry->hOffset + geometry->hRes) &&
+			(y >= geometry->vOffset) && (y < geometry->vOffset + geometry->vRes)) points++;
+	}
+
+	/* Opcode count, opcode header, three parameters and two words per point. */
+	length = 4 + 16 + 12 + points * 8;
+	if (!buf) return length;
+	if (size < length) return 0;
+
+	p = putBigEndian32(buf, 1);
+	p = putBigEndian32(p, DNG_OPCODE_FIX_BAD_PIXELS_LIST);
+	p = putBigEndian32(p, DNG_OPCODE_VERSION);
+	p = putBigEndian32(p, DNG_OPCODE_FLAG_OPTIONAL);
+	p = putBigEndian32(p, 12 + points * 8);
+	p = putBigEndian32(p, bayerPhase);
+	p = putBigEndian32(p, points);
+	p = putBigEndian32(p, 0);
+	for (UInt32 i = 0; i < map->count(); i++) {
+		UInt32 x = DEFECT_X(entries[i]);
+		UInt32 y = DEFECT_Y(entries[i]);
+		if ((x >= geometry->hOffset) && (x < geometry->hOffset + geometry->hRes) &&
+			(y >= geometry->vOffset) && (y < geometry->vOffset + geometry->vRes)) {
+			p = putBigEndian32(p, y - geometry->vOffset);
+			p = putBigEndian32(p, x - geometry->hOffset);
+		}
+	}
+	return length;
+}
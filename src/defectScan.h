@@ -0,0 +1,87 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef DEFECTSCAN_H
+#define DEFECTSCAN_H
+
+#include <stddef.h>
+#include "types.h"
+#include "frameGeometry.h"
+
+/* Half-width of the neighbourhood each 2x2 quad is compared against, in pixels. */
+#define BAD_PIXEL_RING_SIZE			6
+#define DEAD_PIXEL_THRESHHOLD		512
+
+/* Neighbourhood in units of quads, which must be a whole number. */
+#define BAD_PIXEL_RING_QUADS		(BAD_PIXEL_RING_SIZE / 2)
+#define BAD_PIXEL_RING_TAPS			(2 * BAD_PIXEL_RING_QUADS + 1)
+
+/*
+ * Defect map entries pack the coordinates of a pixel into 32 bits, with the
+ * row in the upper half, and the column and a flag for pixels brighter than
+ * their neighbourhood in the lower half.
+ */
+#define DEFECT_X_MASK				0x7FFF
+#define DEFECT_HOT					(1 << 15)
+#define DEFECT_ENTRY(x, y, hot)		(((UInt32)(y) << 16) | ((x) & DEFECT_X_MASK) | ((hot) ? DEFECT_HOT : 0))
+#define DEFECT_X(e)					((e) & DEFECT_X_MASK)
+#define DEFECT_Y(e)					((e) >> 16)
+#define DEFECT_IS_HOT(e)			(((e) & DEFECT_HOT) != 0)
+
+#define DEFECT_MAX_PIXELS			65536
+#define DEFECT_MAP_FILENAME			"cal/defectMap.bin"
+#define DEFECT_FACTORY_FILENAME		"cal/factoryDefectMap.bin"
+
+/* DNG FixBadPixelsList opcode, see the DNG 1.3 specification. */
+#define DNG_OPCODE_FIX_BAD_PIXELS_LIST	5
+#define DNG_OPCODE_VERSION				0x01030000
+#define DNG_OPCODE_FLAG_OPTIONAL		0x1
+
+typedef struct {
+	UInt32 failed;			/* Pixels deviating from their neighbourhood by more than the threshold. */
+	Int32 maxOffset;		/* Largest absolute deviation found. */
+	Int32 averageOffset;	/* Mean of the summed quad deviations. */
+} DefectScanResult;
+
+/*
+ * Sorted list of defective pixel coordinates. Pixels can be added in any
+ * order, and finish() sorts them and merges duplicates.
+ */
+class DefectMap
+{
+public:
+	DefectMap();
+	~DefectMap();
+
+	void clear(void);
+	bool add(UInt32 x, UInt32 y, bool hot);
+	void finish(void);
+	bool contains(UInt32 x, UInt32 y) const;
+
+	UInt32 count(void) const { return used; }
+	const UInt32 *entries(void) const { return list; }
+
+private:
+	UInt32 *list;
+	UInt32 used;
+	UInt32 alloc;
+};
+
+void concealDefects(UInt16 *frame, const FrameGeometry *geometry, const DefectMap *map, UInt32 step);
+UInt32 buildDngBadPixelOpcodes(UInt8 *buf, UInt32 size, const FrameGeometry *geometry, const DefectMap *map, UInt32 bayerPhase);
+void scanDeadPixels(const UInt16 *frame, UInt32 hRes, UInt32 vRes, Int32 threshold, DefectScanResult *result, DefectMap *map = NULL);
+
+#endif // DEFECTSCAN_H
@@ -22,6 +22,8 @@
 #define IMAGE_SENSOR_SPI	"/dev/spidev3.0"
 #define	IMAGE_SENSOR_SPI_SPEED	500000
 #define	IMAGE_SENSOR_SPI_BITS	16
+#define IMAGE_SENSOR_DAC_CS_GPIO	33		//Chip select of the sensor board DACs
+#define IMAGE_SENSOR_CS_GPIO		34		//Chip select of sensors with an SPI control interface
 
 //FPGA config
 #define FPGA_PROGRAMN_PATH		"/sys/class/gpio/gpio47/value"
@@ -27,11 +27,15 @@ HOLDn		Out	AG6 : GP1[1]	33
 
 #include <stdint.h>
 #include <cstdio>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
 #include <QDebug>
 
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 #include <unistd.h>
@@ -43,6 +47,67 @@ HOLDn		Out	AG6 : GP1[1]	33
 #include "ecp5Config.h"
 #include "types.h"
 
+/* Configuration timing limits, polled rather than waited out. */
+#define ECP5_PROGRAMN_PULSE_MS		1		/* Time PROGRAMn is held low. */
+#define ECP5_INITN_LOW_TIMEOUT_MS	10		/* Time for INITn to go low after PROGRAMn or REFRESH. */
+#define ECP5_INITN_HIGH_TIMEOUT_MS	50		/* Time for INITn to go high after PROGRAMn is released. */
+#define ECP5_REFRESH_TIMEOUT_MS		100		/* Time for INITn to go high after REFRESH. */
+#define ECP5_DONE_TIMEOUT_MS		100		/* Time for DONE to go high after the bitstream. */
+#define ECP5_POLL_INTERVAL_US		100
+
+/* Largest transfer the spidev driver accepts, and the default if it can't be read. */
+#define ECP5_SPIDEV_BUFSIZ_PATH		"/sys/module/spidev/parameters/bufsiz"
+#define ECP5_SPI_DEFAULT_CHUNK		4096
+
+static UInt32 msecSince(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static bool gpioLevel(Int32 fd)
+{
+	char value = '0';
+	pread(fd, &value, 1, 0);
+	return value == '1';
+}
+
+/* Polls a GPIO until it reaches a level, returning false if it times out. */
+static bool waitGPIO(Int32 fd, bool level, UInt32 timeoutMs)
+{
+	struct timespec start;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (gpioLevel(fd) != level) {
+		if (msecSince(&start) >= timeoutMs)
+			return false;
+		usleep(ECP5_POLL_INTERVAL_US);
+	}
+	return true;
+}
+
+/* Largest single transfer the spidev driver accepts, set by its bufsiz parameter. */
+static UInt32 spiMaxTransfer(void)
+{
+	FILE *fp = fopen(ECP5_SPIDEV_BUFSIZ_PATH, "r");
+	unsigned int bufsiz = 0;
+
+	if (fp) {
+		if (fscanf(fp, "%u", &bufsiz) != 1)
+			bufsiz = 0;
+		fclose(fp);
+	}
+	return bufsiz ? bufsiz : ECP5_SPI_DEFAULT_CHUNK;
+}
+
+/* Bitstreams ending in .gz are decompressed while they are sent. */
+static bool isCompressed(const char *configFile)
+{
+	size_t len = strlen(configFile);
+	return (len > 3) && (strcmp(configFile + len - 3, ".gz") == 0);
+}
+
 
 Ecp5Config::Ecp5Config()
 {
@@ -133,50 +198,76 @@ void Ecp5Config::deinit(void)
 	}
 }
 
+/* Ecp5Config::configure
+ *
+ * Loads a bitstream into the FPGA over its slave SPI port. The bitstream is
+ * memory mapped and sent in the largest transfers the SPI driver accepts, or
+ * decompressed a block at a time if the file ends in .gz. The configuration
+ * pins are polled instead of waiting out the worst case delays.
+ *
+ * configFile:	Path of the bitstream
+ *
+ * returns: SUCCESS or an ECP5 error code
+ **/
 Int32 Ecp5Config::configure(const char * configFile)
 {
 	UInt8 cmd[4] = {0, 0, 0, 0};
 	UInt8 data[4];
-	UInt8 * bitstream;
-
-	struct stat stat_buf;
-	FILE * cfd;
-
-	//Open bitstream file
-	cfd = fopen(configFile, "rb");
-	if(!cfd)
-		return ECP5_FILE_IO_ERROR;
-
-	//Get file size
-	int rc = fstat(fileno(cfd), &stat_buf);
-	if(rc)
-		return ECP5_FILE_IO_ERROR;
-
-	UInt32 cfSize = stat_buf.st_size;
-
-	//Load bistream file
-	bitstream = new UInt8[cfSize];
-
-	if(!bitstream)
-		return ECP5_MEMORY_ERROR;
-
-	if(cfSize != fread(bitstream, sizeof(bitstream[0]), cfSize, cfd))
-		return ECP5_FILE_IO_ERROR;
+	UInt8 * bitstream = NULL;
+	UInt8 * block = NULL;
+	gzFile gz = NULL;
+	UInt32 cfSize = 0;
+	UInt32 chunk = spiMaxTransfer();
+	Int32 retVal = SUCCESS;
+	Int32 len;
+
+	//Open the bitstream before touching the FPGA, so a bad file leaves the current configuration running
+	if (isCompressed(configFile)) {
+		gz = gzopen(configFile, "rb");
+		block = new UInt8[chunk];
+		if (!gz)
+		{
+			retVal = ECP5_FILE_IO_ERROR;
+			goto configureCleanup;
+		}
+		gzbuffer(gz, 128 * 1024);
+	}
+	else {
+		struct stat stat_buf;
+		int cfd = open(configFile, O_RDONLY);
+		if (cfd < 0)
+			return ECP5_FILE_IO_ERROR;
+
+		if (fstat(cfd, &stat_buf) || !stat_buf.st_size)
+		{
+			close(cfd);
+			return ECP5_FILE_IO_ERROR;
+		}
+		cfSize = stat_buf.st_size;
+
+		bitstream = (UInt8 *)mmap(NULL, cfSize, PROT_READ, MAP_PRIVATE, cfd, 0);
+		close(cfd);
+		if (bitstream == MAP_FAILED)
+			return ECP5_MEMORY_ERROR;
+		madvise(bitstream, cfSize, MADV_SEQUENTIAL);
+		madvise(bitstream, cfSize, MADV_WILLNEED);
+	}
 
 	// See MachXO3 programming and configuration user guide for correct info. ECP5 SysConfig manual procedure is wrong
 	//Initialize signals
 	writeGPIO(pgmnFD, true);
 	writeGPIO(snFD, true);
 	writeGPIO(holdnFD, true);
-	delayms(50);
 
 	//Create a falling edge on PROGRAMn to put FPGA in program mode
 	writeGPIO(pgmnFD, false);
-	delayms(1);
+	waitGPIO(initnFD, false, ECP5_INITN_LOW_TIMEOUT_MS);
+	delayms(ECP5_PROGRAMN_PULSE_MS);
 	writeGPIO(pgmnFD, true);
-	delayms(50);		//50ms delay as specified by mfg
 
-	//INITn should guaranteed be high by now
+	//INITn goes high once the FPGA is ready to be configured, within 50ms as specified by mfg
+	if (!waitGPIO(initnFD, true, ECP5_INITN_HIGH_TIMEOUT_MS))
+		qDebug() << "ECP5: INITn did not go high after PROGRAMn";
 
 	//Send READ_ID command and read ID response
 	writeGPIO(snFD, false);
@@ -184,67 +275,86 @@ Int32 Ecp5Config::configure(const char * configFile)
 	spiWrite(cmd, 4);
 	spiRead(data, 4);
 	writeGPIO(snFD, true);
-	delayms(1);	//Just in case
 
 	//Check returend device ID. ID of LFE5U-85 is 0x41113043 (from device programmer).
     if(	(0x41 != data[0] && 0x01 != data[0]) || //0x41 for ECP5U, 0x01 for ECP5UM
 		0x11 != data[1] ||
 		0x30 != data[2] ||
 		0x43 != data[3])
-		return ECP5_WRONG_DEVICE_ID;
+	{
+		retVal = ECP5_WRONG_DEVICE_ID;
+		goto configureCleanup;
+	}
 
 	//Send refresh command
 	writeGPIO(snFD, false);
 	cmd[0] = ECP5_REFRESH;
 	spiWrite(cmd, 4);
 	writeGPIO(snFD, true);
-	delayms(100);	//The configuration manual says this isn't required, but some delay here is. Not sure exactly how much.
+
+	//The configuration manual says no delay is required here, but the refresh has to finish, which INITn pulsing low shows.
+	//If the pulse is missed, fall back to the delay that was found to work.
+	if (!waitGPIO(initnFD, false, ECP5_INITN_LOW_TIMEOUT_MS) || !waitGPIO(initnFD, true, ECP5_REFRESH_TIMEOUT_MS))
+		delayms(ECP5_REFRESH_TIMEOUT_MS);
 
 	//Send write enable command
 	writeGPIO(snFD, false);
 	cmd[0] = ECP5_LSC_ENABLE;
 	spiWrite(cmd, 4);
 	writeGPIO(snFD, true);
-	delayms(1);	//Just in case
 
 	//Send write inc command
 	writeGPIO(snFD, false);
 	cmd[0] = ECP5_LSC_BITSTREAM_BURST;
 	spiWrite(cmd, 4);	//command
-	//Now send the entire bitstream in one go
-	//The whole block? You can't handle the whole block!
-	//Write in 1k blocks because the SPI driver can't handle the whole thing
-	UInt32 pos = 0;
-	UInt32 len;
-	while(pos < cfSize)
-	{
-		len = min(1024, cfSize - pos);
-		spiWrite(bitstream + pos, len);
-		pos += len;
-
+	//Now send the entire bitstream with chip select held low, in the largest blocks the SPI driver can handle
+	if (gz) {
+		while ((len = gzread(gz, block, chunk)) > 0)
+		{
+			if (SUCCESS != spiWrite(block, len))
+				break;
+		}
+		if (len != 0)
+			retVal = (len < 0) ? ECP5_FILE_IO_ERROR : ECP5_IOCTL_FAIL;
+	}
+	else {
+		for (UInt32 pos = 0; pos < cfSize; pos += len)
+		{
+			len = min(chunk, cfSize - pos);
+			if (SUCCESS != spiWrite(bitstream + pos, len))
+			{
+				retVal = ECP5_IOCTL_FAIL;
+				break;
+			}
+		}
 	}
 	writeGPIO(snFD, true);
-	delayms(1);	//Just in case
+	if (retVal != SUCCESS)
+		goto configureCleanup;
+
+	//Wait for the DONE pin, then read the status to check config success (done bit)
+	if (!waitGPIO(doneFD, true, ECP5_DONE_TIMEOUT_MS))
+		qDebug() << "ECP5: DONE pin did not go high";
 
-	//Read the status to check config success (done bit)
 	writeGPIO(snFD, false);
 	cmd[0] = ECP5_LSC_READ_STATUS;
 	spiWrite(cmd, 4);
 	spiRead(data, 4);
 	writeGPIO(snFD, true);
-	delayms(1);	//Just in case
 	qDebug() << "Status readback:" << data[0] << data[1] << data[2] << data[3];
 
 	//Check DONE bit
 	if((data[2] & 0x1) != 1)
-		return ECP5_DONE_NOT_ASSERTED;
+	{
+		retVal = ECP5_DONE_NOT_ASSERTED;
+		goto configureCleanup;
+	}
 
 	//Send write disable command
 	writeGPIO(snFD, false);
 	cmd[0] = ECP5_LSC_DISABLE;
 	spiWrite(cmd, 4);
 	writeGPIO(snFD, true);
-	delayms(1);	//Just in case
 
 	//Send nop command
 	writeGPIO(snFD, false);
@@ -254,9 +364,14 @@ Int32 Ecp5Config::configure(const char * configFile)
 	cmd[3] = 0xFF;
 	spiWrite(cmd, 4);
 	writeGPIO(snFD, true);
-	delayms(1);	//Just in case
 
-	return SUCCESS;
+configureCleanup:
+	if (gz)
+		gzclose(gz);
+	delete[] block;
+	if (bitstream)
+		munmap(bitstream, cfSize);
+	return retVal;
 }
 
 void Ecp5Config::readStatus()
@@ -283,6 +398,7 @@ Int32 Ecp5Config::spiWrite(UInt8 * data, UInt32 len)
 	if(!isOpen)
 		return ECP5_NOT_OPEN;
 
+	memset(&tr, 0, sizeof(tr));
 	tr.tx_buf = (uint64_t)data;
 	tr.rx_buf = (uint64_t)NULL;
 	tr.len = len;
@@ -306,6 +422,7 @@ Int32 Ecp5Config::spiRead(UInt8 * data, UInt32 len)
 	if(!isOpen)
 		return ECP5_NOT_OPEN;
 
+	memset(&tr, 0, sizeof(tr));
 	tr.tx_buf = (uint64_t)NULL;
 	tr.rx_buf = (uint64_t)data;
 	tr.len = len;
@@ -323,9 +440,7 @@ Int32 Ecp5Config::spiRead(UInt8 * data, UInt32 len)
 
 bool Ecp5Config::readGPIO(Int32 fd)
 {
-	UInt8 value;
-	read(fd, &value, 1);
-	return value != 0;
+	return gpioLevel(fd);
 }
 
 void Ecp5Config::writeGPIO(Int32 fd, bool value)
@@ -0,0 +1,215 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "frameAccumulator.h"
+#include "util.h"
+
+FrameAccumulator::FrameAccumulator()
+{
+	flags = FRAME_ACC_SUM;
+	pixels = 0;
+	frames = 0;
+	capacity = 0;
+	sum = NULL;
+	sumSquares = NULL;
+	minimum = NULL;
+	maximum = NULL;
+	rawChunk = (UInt32 *)malloc((FRAME_ACC_CHUNK_PIXELS * 12) / 8);
+	pixChunk = (UInt16 *)malloc(FRAME_ACC_CHUNK_PIXELS * sizeof(UInt16));
+}
+
+FrameAccumulator::~FrameAccumulator()
+{
+	free(sum);
+	free(sumSquares);
+	free(minimum);
+	free(maximum);
+	free(rawChunk);
+	free(pixChunk);
+}
+
+/* FrameAccumulator::init
+ *
+ * Prepares the accumulator for a new set of frames. Buffers from previous
+ * uses are recycled when they are large enough.
+ *
+ * pixels:	Number of pixels in each frame
+ * flags:	FRAME_ACC_* bitmask of extra statistics to track
+ *
+ * returns: SUCCESS, or CAMERA_MEM_ERROR on allocation failure
+ **/
+Int32 FrameAccumulator::init(UInt32 pixels, UInt32 flags)
+{
+	if (!rawChunk || !pixChunk) {
+		return CAMERA_MEM_ERROR;
+	}
+
+	/* Grow the buffers if needed, and drop statistics no longer wanted. */
+	if (pixels > capacity) {
+		free(sum);
+		free(sumSquares);
+		free(minimum);
+		free(maximum);
+		sumSquares = NULL;
+		minimum = maximum = NULL;
+		capacity = 0;
+
+		sum = (UInt32 *)malloc(pixels * sizeof(UInt32));
+		if (!sum) return CAMERA_MEM_ERROR;
+		capacity = pixels;
+	}
+	if ((flags & FRAME_ACC_VARIANCE) && !sumSquares) {
+		sumSquares = (UInt64 *)malloc(capacity * sizeof(UInt64));
+		if (!sumSquares) return CAMERA_MEM_ERROR;
+	}
+	if ((flags & FRAME_ACC_MINMAX) && !minimum) {
+		minimum = (UInt16 *)malloc(capacity * sizeof(UInt16));
+		maximum = (UInt16 *)malloc(capacity * sizeof(UInt16));
+		if (!minimum || !maximum) return CAMERA_MEM_ERROR;
+	}
+
+	this->pixels = pixels;
+	this->flags = flags;
+	reset();
+	return SUCCESS;
+}
+
+/* FrameAccumulator::reset
+ *
+ * Clears the accumulated statistics without changing the frame size.
+ *
+ * returns: nothing
+ **/
+void FrameAccumulator::reset(void)
+{
+	frames = 0;
+	memset(sum, 0, pixels * sizeof(UInt32));
+	if (flags & FRAME_ACC_VARIANCE) {
+		memset(sumSquares, 0, pixels * sizeof(UInt64));
+	}
+	if (flags & FRAME_ACC_MINMAX) {
+		memset(minimum, 0xff, pixels * sizeof(UInt16));
+		memset(maximum, 0, pixels * sizeof(UInt16));
+	}
+}
+
+void FrameAccumulator::addChunk(UInt32 start, const UInt16 *pix, UInt32 count)
+{
+	UInt32 *s = sum + start;
+	for (UInt32 i = 0; i < count; i++) {
+		s[i] += pix[i];
+	}
+	if (flags & FRAME_ACC_VARIANCE) {
+		UInt64 *sq = sumSquares + start;
+		for (UInt32 i = 0; i < count; i++) {
+			sq[i] += (UInt32)pix[i] * pix[i];
+		}
+	}
+	if (flags & FRAME_ACC_MINMAX) {
+		UInt16 *mn = minimum + start;
+		UInt16 *mx = maximum + start;
+		for (UInt32 i = 0; i < count; i++) {
+			mn[i] = min(mn[i], pix[i]);
+			mx[i] = max(mx[i], pix[i]);
+		}
+	}
+}
+
+/* FrameAccumulator::addFrame
+ *
+ * Streams a 12-bit packed frame out of acquisition memory and accumulates
+ * it. When only the sum is tracked, each chunk is unpacked and summed in a
+ * single pass.
+ *
+ * gpmc:		GPMC interface to read acquisition memory through
+ * wordAddress:	Address of the frame in acquisition memory
+ *
+ * returns: nothing
+ **/
+void FrameAccumulator::addFrame(GPMC *gpmc, UInt32 wordAddress)
+{
+	UInt32 start;
+
+	for (start = 0; start < pixels; start += FRAME_ACC_CHUNK_PIXELS) {
+		UInt32 count = min(pixels - start, FRAME_ACC_CHUNK_PIXELS);
+		UInt32 bytes = ROUND_UP_MULT((count * 12) / 8, 4);
+
+		/* Chunks always begin on a 256-bit word boundary. */
+		gpmc->readAcqMem(rawChunk, wordAddress + (start * 12) / 256, bytes);
+		if (flags == FRAME_ACC_SUM) {
+			accumulatePixelBuf12(sum + start, rawChunk, count);
+		}
+		else {
+			unpackPixelBuf12(pixChunk, rawChunk, count);
+			addChunk(start, pixChunk, count);
+		}
+	}
+	frames++;
+}
+
+/* FrameAccumulator::addPixels
+ *
+ * Accumulates a frame that has already been unpacked into host memory.
+ *
+ * pix:		Pointer to the frame's pixel values
+ *
+ * returns: nothing
+ **/
+void FrameAccumulator::addPixels(const UInt16 *pix)
+{
+	addChunk(0, pix, pixels);
+	frames++;
+}
+
+/* FrameAccumulator::mean
+ *
+ * Computes the per-pixel mean of the accumulated frames.
+ *
+ * out:		Output buffer, with room for one value per pixel
+ *
+ * returns: nothing
+ **/
+void FrameAccumulator::mean(UInt16 *out)
+{
+	UInt32 n = frames ? frames : 1;
+	for (UInt32 i = 0; i < pixels; i++) {
+		out[i] = sum[i] / n;
+	}
+}
+
+/* FrameAccumulator::variance
+ *
+ * Computes the per-pixel sample variance of the accumulated frames. This
+ * requires the accumulator to have been initialized with FRAME_ACC_VARIANCE.
+ *
+ * out:		Output buffer, with room for one value per pixel
+ *
+ * returns: nothing
+ **/
+void FrameAccumulator::variance(UInt32 *out)
+{
+	if (!(flags & FRAME_ACC_VARIANCE) || (frames < 2)) {
+		memset(out, 0, pixels * sizeof(UInt32));
+		return;
+	}
+	for (UInt32 i = 0; i < pixels; i++) {
+		UInt64 s = sum[i];
+		out[i] = (sumSquares[i] * frames - s * s) / ((UInt64)frames * (frames - 1));
+	}
+}
@@ -0,0 +1,77 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef FRAMEACCUMULATOR_H
+#define FRAMEACCUMULATOR_H
+
+#include "errorCodes.h"
+#include "types.h"
+#include "gpmc.h"
+
+/* Optional statistics to track in addition to the per-pixel sum. */
+#define FRAME_ACC_SUM			0x0
+#define FRAME_ACC_VARIANCE		0x1
+#define FRAME_ACC_MINMAX		0x2
+
+/* Number of pixels streamed out of acquisition RAM at a time. This must be
+ * a multiple of 64 pixels so that each chunk starts on a 256-bit boundary. */
+#define FRAME_ACC_CHUNK_PIXELS	(64 * 128)
+
+/*
+ * Streams frames out of acquisition memory, a chunk of rows at a time, and
+ * accumulates the pixels into a preallocated 32-bit sum buffer. The buffers
+ * are kept between uses, and only reallocated when a larger frame is seen.
+ */
+class FrameAccumulator
+{
+public:
+	FrameAccumulator();
+	~FrameAccumulator();
+
+	Int32 init(UInt32 pixels, UInt32 flags = FRAME_ACC_SUM);
+	void reset(void);
+
+	void addFrame(GPMC *gpmc, UInt32 wordAddress);
+	void addPixels(const UInt16 *pixels);
+
+	UInt32 getFrames(void) { return frames; }
+	UInt32 getPixels(void) { return pixels; }
+	const UInt32 *getSum(void) { return sum; }
+	const UInt16 *getMin(void) { return minimum; }
+	const UInt16 *getMax(void) { return maximum; }
+
+	void mean(UInt16 *out);
+	void variance(UInt32 *out);
+
+private:
+	void addChunk(UInt32 start, const UInt16 *pix, UInt32 count);
+
+	UInt32 flags;
+	UInt32 pixels;
+	UInt32 frames;
+	UInt32 capacity;
+
+	UInt32 *sum;
+	UInt64 *sumSquares;
+	UInt16 *minimum;
+	UInt16 *maximum;
+
+	/* Scratch buffers for a single chunk of the frame. */
+	UInt32 *rawChunk;
+	UInt16 *pixChunk;
+};
+
+#endif // FRAMEACCUMULATOR_H
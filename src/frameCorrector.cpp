@@ -0,0 +1,207 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "frameCorrector.h"
+#include "cameraRegisters.h"
+#include "util.h"
+
+#define PIXEL_MAX	((1 << SENSOR_DATA_WIDTH) - 1)
+
+FrameCorrector::FrameCorrector()
+{
+	mode3Point = false;
+	lut = NULL;
+	lutChannels = 0;
+	memset(lutGain, 0, sizeof(lutGain));
+	colGain = colCurve = colOffset = NULL;
+	columns = 0;
+	rawBuffer = NULL;
+	rawSize = 0;
+}
+
+FrameCorrector::~FrameCorrector()
+{
+	free(lut);
+	free(colGain);
+	free(colCurve);
+	free(colOffset);
+	free(rawBuffer);
+}
+
+/* FrameCorrector::setGain2Point
+ *
+ * Selects 2-point correction and builds the per-channel gain lookup. Each
+ * entry is computed with exactly the same double-precision multiply and
+ * clipping as the per-pixel code it replaces. The table is only rebuilt
+ * when the gains change.
+ *
+ * gainCorrection:	Gain for each ADC channel
+ * channels:		Number of ADC channels (columns repeat modulo this)
+ *
+ * returns: SUCCESS, or CAMERA_MEM_ERROR on allocation failure
+ **/
+Int32 FrameCorrector::setGain2Point(const double *gainCorrection, UInt32 channels)
+{
+	mode3Point = false;
+	if (channels > FRAME_CORRECTOR_MAX_CHANNELS) {
+		return CAMERA_MEM_ERROR;
+	}
+	if (lut && (channels == lutChannels) && !memcmp(lutGain, gainCorrection, channels * sizeof(double))) {
+		return SUCCESS;
+	}
+
+	free(lut);
+	lutChannels = 0;
+	lut = (UInt16 *)malloc(channels * (PIXEL_MAX + 1) * sizeof(UInt16));
+	if (!lut) {
+		return CAMERA_MEM_ERROR;
+	}
+
+	for (UInt32 ch = 0; ch < channels; ch++) {
+		UInt16 *table = lut + ch * (PIXEL_MAX + 1);
+		for (UInt32 v = 0; v <= PIXEL_MAX; v++) {
+			UInt16 pix = (UInt16)((double)v * gainCorrection[ch]);
+			table[v] = (pix > PIXEL_MAX) ? PIXEL_MAX : pix;
+		}
+	}
+	memcpy(lutGain, gainCorrection, channels * sizeof(double));
+	lutChannels = channels;
+	return SUCCESS;
+}
+
+/* FrameCorrector::setGain3Point
+ *
+ * Selects 3-point correction and loads the column gain, curvature and
+ * offset terms out of the FPGA, as used by Camera::readPixelCal().
+ *
+ * gpmc:	GPMC interface to read the column calibration through
+ * hRes:	Number of columns in the frame
+ *
+ * returns: SUCCESS, or CAMERA_MEM_ERROR on allocation failure
+ **/
+Int32 FrameCorrector::setGain3Point(GPMC *gpmc, UInt32 hRes)
+{
+	mode3Point = true;
+	if (hRes > columns) {
+		free(colGain);
+		free(colCurve);
+		free(colOffset);
+		columns = 0;
+		colGain = (Int32 *)malloc(hRes * sizeof(Int32));
+		colCurve = (Int32 *)malloc(hRes * sizeof(Int32));
+		colOffset = (Int32 *)malloc(hRes * sizeof(Int32));
+		if (!colGain || !colCurve || !colOffset) {
+			return CAMERA_MEM_ERROR;
+		}
+		columns = hRes;
+	}
+
+	for (UInt32 col = 0; col < hRes; col++) {
+		colGain[col] = gpmc->read16(COL_GAIN_MEM_START_ADDR + (2 * col));
+		colCurve[col] = (Int16)gpmc->read16(COL_CURVE_MEM_START_ADDR + (2 * col));
+		colOffset[col] = (Int16)gpmc->read16(COL_OFFSET_MEM_START_ADDR + (2 * col));
+	}
+	return SUCCESS;
+}
+
+void FrameCorrector::correct2Point(const UInt16 *raw, const UInt16 *fpn, UInt16 *out, UInt32 pixels)
+{
+	UInt32 i = 0;
+
+	/* Walk the ADC channels in order rather than taking a modulo per pixel. */
+	while (i < pixels) {
+		const UInt16 *table = lut;
+		UInt32 end = min(i + lutChannels, pixels);
+		for (; i < end; i++, table += (PIXEL_MAX + 1)) {
+			/* Subtract FPN and clip underflow to zero without branching. */
+			Int32 diff = (Int32)raw[i] - (Int32)fpn[i];
+			diff &= ~(diff >> 31);
+			out[i] = table[diff & PIXEL_MAX];
+		}
+	}
+}
+
+void FrameCorrector::correct3Point(const UInt16 *raw, UInt16 *out, UInt32 pixels, UInt32 hRes)
+{
+	for (UInt32 row = 0; row < pixels; row += hRes) {
+		for (UInt32 col = 0; (col < hRes) && ((row + col) < pixels); col++) {
+			Int32 pixel = raw[row + col];
+			Int32 pxGain = (pixel * colGain[col]) >> COL_GAIN_FRAC_BITS;
+			Int32 pxCurve = (pixel * pixel * colCurve[col]) >> COL_CURVE_FRAC_BITS;
+			Int32 value = pxGain + pxCurve + colOffset[col];
+			out[row + col] = within(value, 0, PIXEL_MAX);
+		}
+	}
+}
+
+/* FrameCorrector::correct
+ *
+ * Applies the selected correction to unpacked pixels. The output may be
+ * the same buffer as the raw input.
+ *
+ * raw:		Unpacked pixels
+ * fpn:		Unpacked FPN (ignored in 3-point mode)
+ * out:		Corrected output pixels
+ * pixels:	Number of pixels
+ * hRes:	Horizontal resolution of the frame
+ *
+ * returns: nothing
+ **/
+void FrameCorrector::correct(const UInt16 *raw, const UInt16 *fpn, UInt16 *out, UInt32 pixels, UInt32 hRes)
+{
+	if (mode3Point) {
+		correct3Point(raw, out, pixels, min(hRes, columns));
+	}
+	else if (lut) {
+		correct2Point(raw, fpn, out, pixels);
+	}
+}
+
+/* FrameCorrector::readFrame
+ *
+ * Reads a frame out of acquisition memory and applies the selected
+ * correction to it.
+ *
+ * gpmc:		GPMC interface to read acquisition memory through
+ * wordAddress:	Address of the frame in acquisition memory
+ * geometry:	Geometry of the frame
+ * fpn:			Unpacked FPN (ignored in 3-point mode)
+ * out:			Output buffer, with room for geometry->pixels() values
+ *
+ * returns: SUCCESS, or CAMERA_MEM_ERROR on allocation failure
+ **/
+Int32 FrameCorrector::readFrame(GPMC *gpmc, UInt32 wordAddress, const FrameGeometry *geometry, const UInt16 *fpn, UInt16 *out)
+{
+	UInt32 bytes = ROUND_UP_MULT(geometry->size(), 4);
+
+	if (bytes > rawSize) {
+		free(rawBuffer);
+		rawSize = 0;
+		rawBuffer = (UInt32 *)malloc(bytes);
+		if (!rawBuffer) {
+			return CAMERA_MEM_ERROR;
+		}
+		rawSize = bytes;
+	}
+
+	gpmc->readAcqMem(rawBuffer, wordAddress, bytes);
+	unpackPixelBuf12(out, rawBuffer, geometry->pixels());
+	correct(out, fpn, out, geometry->pixels(), geometry->hRes);
+	return SUCCESS;
+}
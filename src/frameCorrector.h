@@ -0,0 +1,72 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef FRAMECORRECTOR_H
+#define FRAMECORRECTOR_H
+
+#include "errorCodes.h"
+#include "types.h"
+#include "gpmc.h"
+#include "frameGeometry.h"
+
+#define FRAME_CORRECTOR_MAX_CHANNELS	32
+#define SENSOR_DATA_WIDTH				12
+#define COL_GAIN_FRAC_BITS				12		// 2-point column gain fractional bits.
+#define COL_CURVE_FRAC_BITS				21		// 3-point column curvature factional bits.
+
+/*
+ * Applies FPN subtraction, column gain and saturation to frames read out of
+ * acquisition memory. The 2-point mode uses a per-ADC-channel lookup table,
+ * precomputed from the double-precision gain, which gives results identical
+ * to the per-pixel floating point math. The 3-point mode applies the same
+ * fixed-point gain, curvature and offset terms as the FPGA display pipeline.
+ */
+class FrameCorrector
+{
+public:
+	FrameCorrector();
+	~FrameCorrector();
+
+	Int32 setGain2Point(const double *gainCorrection, UInt32 channels);
+	Int32 setGain3Point(GPMC *gpmc, UInt32 hRes);
+	bool is3Point(void) { return mode3Point; }
+
+	Int32 readFrame(GPMC *gpmc, UInt32 wordAddress, const FrameGeometry *geometry, const UInt16 *fpn, UInt16 *out);
+	void correct(const UInt16 *raw, const UInt16 *fpn, UInt16 *out, UInt32 pixels, UInt32 hRes);
+
+private:
+	void correct2Point(const UInt16 *raw, const UInt16 *fpn, UInt16 *out, UInt32 pixels);
+	void correct3Point(const UInt16 *raw, UInt16 *out, UInt32 pixels, UInt32 hRes);
+
+	bool mode3Point;
+
+	/* 2-point calibration lookup, 4096 entries per ADC channel. */
+	UInt16 *lut;
+	UInt32 lutChannels;
+	double lutGain[FRAME_CORRECTOR_MAX_CHANNELS];
+
+	/* 3-point column calibration, in FPGA fixed-point format. */
+	Int32 *colGain;
+	Int32 *colCurve;
+	Int32 *colOffset;
+	UInt32 columns;
+
+	/* Packed frame buffer, reused between frames. */
+	UInt32 *rawBuffer;
+	UInt32 rawSize;
+};
+
+#endif // FRAMECORRECTOR_H
@@ -15,18 +15,60 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
  ****************************************************************************/
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
+#include <time.h>
 #include <sys/mman.h>
 #include "gpmc.h"
+#include "gpmcSim.h"
 #include "defines.h"
-#include "cameraRegisters.h"
 
-GPMC::GPMC()
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+GPMC::GPMC(GPMCBackend *backendInst)
 {
+	backend = backendInst;
+	memset(&readStats, 0, sizeof(readStats));
+	memset(&writeStats, 0, sizeof(writeStats));
+}
 
+GPMC::~GPMC()
+{
+	delete backend;
 }
 
+/* GPMC::init
+ *
+ * Initializes the backend. When none was given to the constructor, the
+ * simulator is used if CAM_GPMC_SIM is set in the environment, and the
+ * memory mapped hardware otherwise.
+ *
+ * returns: SUCCESS, or an error code from the backend
+ **/
 Int32 GPMC::init()
+{
+	if (!backend) {
+		const char *envSim = getenv(GPMC_SIM_ENV);
+		if (envSim) {
+			fprintf(stderr, "GPMC: using simulated FPGA (%s)\n", envSim);
+			backend = new GPMCSim(envSim);
+		}
+		else {
+			backend = new GPMCHardware();
+		}
+	}
+	return backend->init();
+}
+
+GPMCHardware::GPMCHardware()
+{
+	map_base = map_registers = map_ram = 0;
+}
+
+Int32 GPMCHardware::init()
 {
 	int fd_reg, fd_gpmc, fd_ram;
 
@@ -42,19 +84,19 @@ Int32 GPMC::init()
 	if(fd_ram < 0)
 		return GPMCERR_FOPEN;
 
-	map_base =(unsigned int) mmap(0, 0x1000000/*16MB*/, PROT_READ | PROT_WRITE, MAP_SHARED, fd_reg, GPMC_BASE);
+	map_base = (uintptr_t) mmap(0, 0x1000000/*16MB*/, PROT_READ | PROT_WRITE, MAP_SHARED, fd_reg, GPMC_BASE);
 
-	map_registers =(unsigned int) mmap(0, 0x1000000/*16MB*/, PROT_READ | PROT_WRITE, MAP_SHARED, fd_gpmc, GPMC_RANGE_BASE + GPMC_REGISTER_OFFSET);
+	map_registers = (uintptr_t) mmap(0, 0x1000000/*16MB*/, PROT_READ | PROT_WRITE, MAP_SHARED, fd_gpmc, GPMC_RANGE_BASE + GPMC_REGISTER_OFFSET);
 
-	map_ram =(unsigned int) mmap(0, 0x1000000/*16MB*/, PROT_READ | PROT_WRITE, MAP_SHARED, fd_ram, GPMC_RANGE_BASE + GPMC_RAM_OFFSET);
+	map_ram = (uintptr_t) mmap(0, 0x1000000/*16MB*/, PROT_READ | PROT_WRITE, MAP_SHARED, fd_ram, GPMC_RANGE_BASE + GPMC_RAM_OFFSET);
 
-	if(map_base == -1)
+	if(map_base == (uintptr_t)MAP_FAILED)
 		return GPMCERR_MAP;
 
-	if(map_registers == -1)
+	if(map_registers == (uintptr_t)MAP_FAILED)
 		return GPMCERR_MAP;
 
-	if(map_ram == -1)
+	if(map_ram == (uintptr_t)MAP_FAILED)
 		return GPMCERR_MAP;
 
 	//Reset GPMC
@@ -205,73 +247,100 @@ Int32 GPMC::init()
 	return SUCCESS;
 }
 
-void GPMC::setTimeoutEnable(bool timeoutEnable)
+void GPMCHardware::setTimeoutEnable(bool timeoutEnable)
 {
 	GPMC_TIMEOUT_CONTROL =	0x1FF << 4 |	/*TIMEOUTSTARTVALUE*/
 							(timeoutEnable ? 1 : 0);				/*TIMEOUTENABLE*/
 }
 
-UInt32 GPMC::read32(UInt32 offset)
-{
-	return *((volatile UInt32 *)(map_registers + offset));
-}
-
-void GPMC::write32(UInt32 offset, UInt32 data)
-{
-	*((volatile UInt32 *)(map_registers + offset)) = data;
-
-}
-
-UInt16 GPMC::read16(UInt32 offset)
-{
-	return *((volatile UInt16 *)(map_registers + offset));
-}
-
-void GPMC::write16(UInt32 offset, UInt16 data)
-{
-	*((volatile UInt16 *)(map_registers + offset)) = data;
-}
-
-UInt32 GPMC::readRam32(UInt32 offset)
-{
-	return *((volatile UInt32 *)(map_ram + offset));
-}
-
-void GPMC::writeRam32(UInt32 offset, UInt32 data)
-{
-	*((volatile UInt32 *)(map_ram + offset)) = data;
-}
-
-UInt16 GPMC::readRam16(UInt32 offset)
+UInt16 GPMC::readPixel12(UInt32 pixel, UInt32 offset)
 {
-	return *((volatile UInt16 *)(map_ram + offset));
+	UInt32 address = pixel * 12 / 8 + offset;
+	UInt8 shift = (pixel & 0x1) * 4;
+	return ((readRam8(address) >> shift) | (((UInt16)readRam8(address+1)) << (8 - shift))) & ((1 << 12) - 1);
 }
 
-void GPMC::writeRam16(UInt32 offset, UInt16 data)
+/* copyWords
+ *
+ * Copies a block of 32-bit words to or from the GPMC page buffer. On NEON
+ * targets this moves 64 bytes per iteration using quad-register loads and
+ * stores, which the GPMC issues back-to-back instead of serializing each
+ * volatile 32-bit access through the loop.
+ *
+ * dst:		Destination pointer (4-byte aligned)
+ * src:		Source pointer (4-byte aligned)
+ * words:	Number of 32-bit words to copy
+ *
+ * returns: nothing
+ **/
+static inline void copyWords(volatile UInt32 *dst, const volatile UInt32 *src, UInt32 words)
 {
-	*((volatile UInt16 *)(map_ram + offset)) = data;
+	UInt32 i = 0;
+
+#ifdef __ARM_NEON__
+	for (; (i + 16) <= words; i += 16) {
+		uint32x4_t q0 = vld1q_u32((const uint32_t *)src + i);
+		uint32x4_t q1 = vld1q_u32((const uint32_t *)src + i + 4);
+		uint32x4_t q2 = vld1q_u32((const uint32_t *)src + i + 8);
+		uint32x4_t q3 = vld1q_u32((const uint32_t *)src + i + 12);
+		vst1q_u32((uint32_t *)dst + i, q0);
+		vst1q_u32((uint32_t *)dst + i + 4, q1);
+		vst1q_u32((uint32_t *)dst + i + 8, q2);
+		vst1q_u32((uint32_t *)dst + i + 12, q3);
+	}
+#else
+	for (; (i + 8) <= words; i += 8) {
+		UInt32 w0 = src[i+0], w1 = src[i+1], w2 = src[i+2], w3 = src[i+3];
+		UInt32 w4 = src[i+4], w5 = src[i+5], w6 = src[i+6], w7 = src[i+7];
+		dst[i+0] = w0; dst[i+1] = w1; dst[i+2] = w2; dst[i+3] = w3;
+		dst[i+4] = w4; dst[i+5] = w5; dst[i+6] = w6; dst[i+7] = w7;
+	}
+#endif
+	for (; i < words; i++) {
+		dst[i] = src[i];
+	}
 }
 
-UInt8 GPMC::readRam8(UInt32 offset)
+static inline UInt64 elapsedNsec(const struct timespec *start)
 {
-	return *((volatile UInt8 *)(map_ram + offset));
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (UInt64)(now.tv_sec - start->tv_sec) * 1000000000ULL + (now.tv_nsec - start->tv_nsec);
 }
 
-void GPMC::writeRam8(UInt32 offset, UInt8 data)
+/* GPMC::waitRamPage
+ *
+ * Polls the RAM controller until the last page trigger has completed.
+ *
+ * returns: true if the page completed, false on timeout
+ **/
+bool GPMC::waitRamPage(void)
 {
-	*((volatile UInt8 *)(map_ram + offset)) = data;
+	for (int i = 0; i < GPMC_RAM_PAGE_POLL; i++) {
+		if (!read16(RAM_CONTROL)) return true;
+	}
+	return false;
 }
 
-UInt16 GPMC::readPixel12(UInt32 pixel, UInt32 offset)
+/* GPMC::getThroughput
+ *
+ * Computes the throughput of an acquisition memory transfer.
+ *
+ * stats:	Statistics returned from getReadStats() or getWriteStats()
+ *
+ * returns: Throughput in MB/s, or zero if nothing was transferred
+ **/
+double GPMC::getThroughput(const GPMCTransferStats *stats)
 {
-	UInt32 address = pixel * 12 / 8 + offset;
-	UInt8 shift = (pixel & 0x1) * 4;
-	return ((readRam8(address) >> shift) | (((UInt16)readRam8(address+1)) << (8 - shift))) & ((1 << 12) - 1);
+	if (!stats->nsec) return 0.0;
+	return ((double)stats->bytes * 1000.0) / stats->nsec;
 }
 
 /* GPMC::readAcqMem
  *
- * Reads data from acquisition memory into a buffer
+ * Reads data from acquisition memory into a buffer. Each page is copied out
+ * of the RAM page buffer using wide loads, and the transfer statistics are
+ * available afterwards from getReadStats().
  *
  * buf:			Pointer to image buffer
  * offsetWords:	Number words into acquisition memory to start read
@@ -281,46 +350,48 @@ UInt16 GPMC::readPixel12(UInt32 pixel, UInt32 offset)
  **/
 void GPMC::readAcqMem(UInt32 * buf, UInt32 offsetWords, UInt32 length)
 {
-	int i;
+	struct timespec start;
+	UInt32 totalWords = length / 4;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	readStats.bytes = length;
+	readStats.pages = 0;
+	readStats.timeouts = 0;
+
 	if (read16(RAM_IDENTIFIER_REG) == RAM_IDENTIFIER) {
-		UInt32 bytesLeft = length;
-		UInt32 pageOffset = 0;
+		volatile UInt32 *page = backend->pageBuffer();
+		UInt32 pageOffset;
 
-		while (bytesLeft) {
-			//---- read a page
-			// set address (in words or 256-bit blocks)
+		for (pageOffset = 0; pageOffset < totalWords; pageOffset += GPMC_RAM_PAGE_WORDS) {
+			UInt32 words = min(totalWords - pageOffset, GPMC_RAM_PAGE_WORDS);
+
+			// set address (in words or 256-bit blocks) and trigger a read
 			write32(RAM_ADDRESS, offsetWords + (pageOffset >> 3));
-			// trigger a read
 			write16(RAM_CONTROL, RAM_CONTROL_TRIGGER_READ);
-			// wait for read to complete
-			for(i = 0; i < 1000 && read16(RAM_CONTROL); i++);
-
-			// loop through reading out the data up to the full page
-			// size or until there's no data left
-			for (i = 0; i < 512 && bytesLeft > 0; ) {
-				buf[i+pageOffset] = read32(RAM_BUFFER_START + (i<<2));
-				i++;
-				bytesLeft -= 4;
-			}
-
-			pageOffset += 512;
+			if (!waitRamPage()) readStats.timeouts++;
+			readStats.pages++;
+
+			// drain the page buffer up to the full page size or until there's no data left
+			copyWords(buf + pageOffset, page, words);
 		}
 	}
 	else {
 		write32(GPMC_PAGE_OFFSET_ADDR, offsetWords);
-
-		for(i = 0; i < length/4; i++)
-		{
-			buf[i] = readRam32(4*i);
-		}
-
+		copyWords(buf, backend->ramWindow(), totalWords);
 		write32(GPMC_PAGE_OFFSET_ADDR, 0);
 	}
+
+	readStats.nsec = elapsedNsec(&start);
+	if (readStats.timeouts) {
+		fprintf(stderr, "readAcqMem: %u of %u pages timed out at address 0x%x\n", readStats.timeouts, readStats.pages, offsetWords);
+	}
 }
 
 /* GPMC::writeAcqMem
  *
- * Writes data from a buffer to acquisition memory
+ * Writes data from a buffer to acquisition memory. Each page is filled using
+ * wide stores before its write is triggered, and the transfer statistics are
+ * available afterwards from getWriteStats().
  *
  * buf:			Pointer to image buffer
  * offsetWords:	Number words into aqcuisition memory to start write
@@ -330,41 +401,39 @@ void GPMC::readAcqMem(UInt32 * buf, UInt32 offsetWords, UInt32 length)
  **/
 void GPMC::writeAcqMem(UInt32 * buf, UInt32 offsetWords, UInt32 length)
 {
-	int i;
+	struct timespec start;
+	UInt32 totalWords = length / 4;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	writeStats.bytes = length;
+	writeStats.pages = 0;
+	writeStats.timeouts = 0;
+
 	if (read16(RAM_IDENTIFIER_REG) == RAM_IDENTIFIER) {
-		UInt32 bytesLeft = length;
-		UInt32 pageOffset = 0;
+		volatile UInt32 *page = backend->pageBuffer();
+		UInt32 pageOffset;
 
-		while (bytesLeft) {
-			//---- write a page
+		for (pageOffset = 0; pageOffset < totalWords; pageOffset += GPMC_RAM_PAGE_WORDS) {
+			UInt32 words = min(totalWords - pageOffset, GPMC_RAM_PAGE_WORDS);
 
-			// loop through reading out the data up to the full page
-			// size or until there's no data left
-			for (i = 0; i < 512 && bytesLeft > 0; ) {
-				write32(RAM_BUFFER_START + (i<<2), buf[i+pageOffset]);
-				i++;
-				bytesLeft -= 4;
-			}
+			// fill the page buffer up to the full page size or until there's no data left
+			copyWords(page, buf + pageOffset, words);
 
-			// set address (in words or 256-bit blocks)
+			// set address (in words or 256-bit blocks) and trigger a write
 			write32(RAM_ADDRESS, offsetWords + (pageOffset >> 3));
-
-			// trigger a read
 			write16(RAM_CONTROL, RAM_CONTROL_TRIGGER_WRITE);
-			// wait for read to complete
-			for(i = 0; i < 1000 && read16(RAM_CONTROL); i++);
-
-			pageOffset += 512;
+			if (!waitRamPage()) writeStats.timeouts++;
+			writeStats.pages++;
 		}
 	}
 	else {
 		write32(GPMC_PAGE_OFFSET_ADDR, offsetWords);
-
-		for(i = 0; i < length/4; i++)
-		{
-			writeRam32(4*i, buf[i]);
-		}
-
+		copyWords(backend->ramWindow(), buf, totalWords);
 		write32(GPMC_PAGE_OFFSET_ADDR, 0);
 	}
+
+	writeStats.nsec = elapsedNsec(&start);
+	if (writeStats.timeouts) {
+		fprintf(stderr, "writeAcqMem: %u of %u pages timed out at address 0x%x\n", writeStats.timeouts, writeStats.pages, offsetWords);
+	}
 }
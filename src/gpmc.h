@@ -17,36 +17,116 @@
 #ifndef GPMC_H
 #define GPMC_H
 
+#include <string.h>
+#include <stdint.h>
 #include "errorCodes.h"
 #include "types.h"
 #include "gpmcRegs.h"
+#include "cameraRegisters.h"
 
 #define GPMC_MAPPED_BASE	map_base
 #define	GPMC_RANGE_BASE		0x1000000
 
+/* Number of 32-bit words in one acquisition RAM page buffer. */
+#define GPMC_RAM_PAGE_WORDS	512
+#define GPMC_RAM_PAGE_POLL	1000
+
+/* Set to use the simulated FPGA instead of /dev/mem, see gpmcSim.h for options. */
+#define GPMC_SIM_ENV		"CAM_GPMC_SIM"
+
+/* Transfer statistics for the most recent acquisition memory access. */
+typedef struct {
+	UInt32 bytes;		/* Bytes transferred. */
+	UInt32 pages;		/* RAM pages triggered. */
+	UInt32 timeouts;	/* Pages whose RAM handshake never completed. */
+	UInt64 nsec;		/* Elapsed time of the call. */
+} GPMCTransferStats;
+
+/*
+ * Raw access to the FPGA register file and acquisition RAM window. The GPMC
+ * class implements the page handshakes and transfer bookkeeping on top of a
+ * backend, so the same acquisition code can run against the memory mapped
+ * hardware or the in-process simulator.
+ */
+class GPMCBackend
+{
+public:
+	virtual ~GPMCBackend() {}
+	virtual Int32 init(void) = 0;
+	virtual void setTimeoutEnable(bool timeoutEnable) = 0;
+	virtual UInt32 read32(UInt32 offset) = 0;
+	virtual void write32(UInt32 offset, UInt32 data) = 0;
+	virtual UInt16 read16(UInt32 offset) = 0;
+	virtual void write16(UInt32 offset, UInt16 data) = 0;
+	virtual UInt32 readRam32(UInt32 offset) = 0;
+	virtual void writeRam32(UInt32 offset, UInt32 data) = 0;
+	virtual UInt16 readRam16(UInt32 offset) = 0;
+	virtual void writeRam16(UInt32 offset, UInt16 data) = 0;
+	virtual UInt8 readRam8(UInt32 offset) = 0;
+	virtual void writeRam8(UInt32 offset, UInt8 data) = 0;
+
+	/* Pointers for bulk copies to the RAM page buffer and the legacy RAM window. */
+	virtual volatile UInt32 *pageBuffer(void) = 0;
+	virtual volatile UInt32 *ramWindow(void) = 0;
+};
+
+/* Backend for the FPGA mapped through /dev/mem on the camera. */
+class GPMCHardware : public GPMCBackend
+{
+public:
+	GPMCHardware();
+	Int32 init(void);
+	void setTimeoutEnable(bool timeoutEnable);
+	UInt32 read32(UInt32 offset) { return *((volatile UInt32 *)(map_registers + offset)); }
+	void write32(UInt32 offset, UInt32 data) { *((volatile UInt32 *)(map_registers + offset)) = data; }
+	UInt16 read16(UInt32 offset) { return *((volatile UInt16 *)(map_registers + offset)); }
+	void write16(UInt32 offset, UInt16 data) { *((volatile UInt16 *)(map_registers + offset)) = data; }
+	UInt32 readRam32(UInt32 offset) { return *((volatile UInt32 *)(map_ram + offset)); }
+	void writeRam32(UInt32 offset, UInt32 data) { *((volatile UInt32 *)(map_ram + offset)) = data; }
+	UInt16 readRam16(UInt32 offset) { return *((volatile UInt16 *)(map_ram + offset)); }
+	void writeRam16(UInt32 offset, UInt16 data) { *((volatile UInt16 *)(map_ram + offset)) = data; }
+	UInt8 readRam8(UInt32 offset) { return *((volatile UInt8 *)(map_ram + offset)); }
+	void writeRam8(UInt32 offset, UInt8 data) { *((volatile UInt8 *)(map_ram + offset)) = data; }
+	volatile UInt32 *pageBuffer(void) { return (volatile UInt32 *)(map_registers + RAM_BUFFER_START); }
+	volatile UInt32 *ramWindow(void) { return (volatile UInt32 *)map_ram; }
+
+private:
+	uintptr_t map_base, map_registers, map_ram;
+};
+
 class GPMC
 {
 public:
-	GPMC();
+	GPMC(GPMCBackend *backendInst = NULL);
+	~GPMC();
 	Int32 init();
-	void setTimeoutEnable(bool timeoutEnable);
-	UInt32 read32(UInt32 offset);
-	void write32(UInt32 offset, UInt32 data);
-	UInt16 read16(UInt32 offset);
-	void write16(UInt32 offset, UInt16 data);
-	UInt32 readRam32(UInt32 offset);
-	void writeRam32(UInt32 offset, UInt32 data);
-	UInt16 readRam16(UInt32 offset);
-	void writeRam16(UInt32 offset, UInt16 data);
-	UInt8 readRam8(UInt32 offset);
-	void writeRam8(UInt32 offset, UInt8 data);
+	void setTimeoutEnable(bool timeoutEnable) { backend->setTimeoutEnable(timeoutEnable); }
+	UInt32 read32(UInt32 offset) { return backend->read32(offset); }
+	void write32(UInt32 offset, UInt32 data) { backend->write32(offset, data); }
+	UInt16 read16(UInt32 offset) { return backend->read16(offset); }
+	void write16(UInt32 offset, UInt16 data) { backend->write16(offset, data); }
+	UInt32 readRam32(UInt32 offset) { return backend->readRam32(offset); }
+	void writeRam32(UInt32 offset, UInt32 data) { backend->writeRam32(offset, data); }
+	UInt16 readRam16(UInt32 offset) { return backend->readRam16(offset); }
+	void writeRam16(UInt32 offset, UInt16 data) { backend->writeRam16(offset, data); }
+	UInt8 readRam8(UInt32 offset) { return backend->readRam8(offset); }
+	void writeRam8(UInt32 offset, UInt8 data) { backend->writeRam8(offset, data); }
 
 	UInt16 readPixel12(UInt32 pixel, UInt32 offset);
 	void readAcqMem(UInt32 * buf, UInt32 offsetWords, UInt32 length);
 	void writeAcqMem(UInt32 * buf, UInt32 offsetWords, UInt32 length);
 
+	const GPMCTransferStats *getReadStats() { return &readStats; }
+	const GPMCTransferStats *getWriteStats() { return &writeStats; }
+	double getThroughput(const GPMCTransferStats *stats);
+	GPMCBackend *getBackend() { return backend; }
+
 private:
-	UInt32 map_base, map_registers, map_ram;
+	GPMCBackend *backend;
+	GPMCTransferStats readStats;
+	GPMCTransferStats writeStats;
+
+	bool waitRamPage(void);
 };
 
 #endif // GPMC_H
@@ -49,17 +49,17 @@
 #define		GPMC_ECC_CONTROL_OFFSET			0x1F8
 #define		GPMC_ECC_SIZE_CONFIG_OFFSET		0x1FC
 
-#define		GPMC_ECCj_RESULT_OFFSET(j)		(0x200 + (0x4 × j))
-#define		GPMC_BCH_RESULT0_i_OFFSET(i)	(0x240 + (0x10 × i))
-#define		GPMC_BCH_RESULT1_i_OFFSET(i)	(0x244 + (0x10 × i))
-#define		GPMC_BCH_RESULT2_i_OFFSET(i)	(0x248 + (0x10 × i))
-#define		GPMC_BCH_RESULT3_i_OFFSET(i)	(0x24C + (0x10 × i))
+#define		GPMC_ECCj_RESULT_OFFSET(j)		(0x200 + (0x4 * j))
+#define		GPMC_BCH_RESULT0_i_OFFSET(i)	(0x240 + (0x10 * i))
+#define		GPMC_BCH_RESULT1_i_OFFSET(i)	(0x244 + (0x10 * i))
+#define		GPMC_BCH_RESULT2_i_OFFSET(i)	(0x248 + (0x10 * i))
+#define		GPMC_BCH_RESULT3_i_OFFSET(i)	(0x24C + (0x10 * i))
 
 #define		GPMC_BCH_SWDATA_OFFSET			0x2D0
 
-#define		GPMC_BCH_RESULT4_i_OFFSET(i)	(0x300 + (0x10 × i))
-#define		GPMC_BCH_RESULT5_i_OFFSET(i)	(0x304 + (0x10 × i))
-#define		GPMC_BCH_RESULT6_i_OFFSET(i)	(0x308 + (0x10 × i))
+#define		GPMC_BCH_RESULT4_i_OFFSET(i)	(0x300 + (0x10 * i))
+#define		GPMC_BCH_RESULT5_i_OFFSET(i)	(0x304 + (0x10 * i))
+#define		GPMC_BCH_RESULT6_i_OFFSET(i)	(0x308 + (0x10 * i))
 
 //-----------------------------------------------------------------------
 
@@ -0,0 +1,647 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gpmcSim.h"
+#include "defines.h"
+
+/* Sequencer program word flags, matching the layout of SeqPgmMemWord. */
+#define SEQ_PGM_TERM_REC_TRIG		(1 << 0)
+#define SEQ_PGM_TERM_REC_MEM		(1 << 1)
+#define SEQ_PGM_TERM_REC_BLK_END	(1 << 2)
+#define SEQ_PGM_TERM_BLK_FULL		(1 << 3)
+#define SEQ_PGM_TERM_BLK_HIGH		(1 << 5)
+#define SEQ_PGM_TERM_BLK_RISING		(1 << 7)
+
+static inline UInt64 nowNsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (UInt64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Stateless hash giving the fixed pattern of a pixel, uniform over [-1, 1). */
+static inline double fixedPattern(UInt32 index, UInt32 seed)
+{
+	UInt32 x = index * 0x9E3779B1 ^ seed;
+	x ^= x >> 16;
+	x *= 0x85EBCA6B;
+	x ^= x >> 13;
+	x *= 0xC2B2AE35;
+	x ^= x >> 16;
+	return ((double)x / 2147483648.0) - 1.0;
+}
+
+/* Approximately normal noise with unit variance, from the sum of four uniform samples. */
+static inline double gaussNoise(UInt32 *state)
+{
+	double sum = 0.0;
+	for (int i = 0; i < 4; i++) {
+		UInt32 x = *state;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		*state = x;
+		sum += (double)x / 4294967296.0;
+	}
+	return (sum - 2.0) * 1.7320508;
+}
+
+GPMCSim::GPMCSim(const char *options)
+{
+	config.ramMB = 256;
+	config.blackLevel = 100;
+	config.fpn = 24;
+	config.columnFpn = 8;
+	config.hRes = 1280;
+	config.noise = 3.0;
+	config.sensitivity = 20.0;
+	config.pageDelay = 2;
+	config.seed = 1;
+	config.realtime = false;
+	parseOptions(options);
+
+	regs = NULL;
+	ram = NULL;
+	ramBytes = 0;
+	framePixels = NULL;
+	framePacked = NULL;
+	frameAlloc = 0;
+	pattern = NULL;
+	patternPixels = 0;
+	pthread_mutex_init(&mutex, NULL);
+}
+
+GPMCSim::~GPMCSim()
+{
+	delete [] framePixels;
+	delete [] framePacked;
+	delete [] pattern;
+	free(ram);
+	free(regs);
+	pthread_mutex_destroy(&mutex);
+}
+
+/* GPMCSim::parseOptions
+ *
+ * Applies key=value pairs from the option string to the configuration.
+ * Unknown keys are reported and ignored.
+ *
+ * options:	Comma separated option string, or NULL for the defaults
+ *
+ * returns: nothing
+ **/
+void GPMCSim::parseOptions(const char *options)
+{
+	char buf[256];
+	char *saveptr;
+	char *tok;
+
+	if (!options) return;
+	strncpy(buf, options, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+
+	for (tok = strtok_r(buf, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+		char *value = strchr(tok, '=');
+		if (!value) continue;
+		*value++ = '\0';
+
+		if (strcmp(tok, "ram") == 0)			config.ramMB = strtoul(value, NULL, 0);
+		else if (strcmp(tok, "black") == 0)		config.blackLevel = strtoul(value, NULL, 0);
+		else if (strcmp(tok, "fpn") == 0)		config.fpn = strtoul(value, NULL, 0);
+		else if (strcmp(tok, "colfpn") == 0)	config.columnFpn = strtoul(value, NULL, 0);
+		else if (strcmp(tok, "hres") == 0)		config.hRes = strtoul(value, NULL, 0);
+		else if (strcmp(tok, "noise") == 0)		config.noise = strtod(value, NULL);
+		else if (strcmp(tok, "sens") == 0)		config.sensitivity = strtod(value, NULL);
+		else if (strcmp(tok, "delay") == 0)		config.pageDelay = strtoul(value, NULL, 0);
+		else if (strcmp(tok, "seed") == 0)		config.seed = strtoul(value, NULL, 0);
+		else if (strcmp(tok, "realtime") == 0)	config.realtime = strtoul(value, NULL, 0) != 0;
+		else fprintf(stderr, "GPMCSim: unknown option %s\n", tok);
+	}
+	if (!config.ramMB) config.ramMB = 1;
+	if (!config.hRes) config.hRes = 1;
+}
+
+/* GPMCSim::init
+ *
+ * Allocates the register file and acquisition memory, and sets the
+ * identification registers to those of a supported FPGA.
+ *
+ * returns: SUCCESS, or GPMCERR_MAP if the memory could not be allocated
+ **/
+Int32 GPMCSim::init(void)
+{
+	ramBytes = (UInt64)config.ramMB * 1024 * 1024;
+	regs = (UInt8 *)calloc(GPMC_SIM_REG_BYTES, 1);
+	ram = (UInt8 *)calloc(ramBytes, 1);
+	if (!regs || !ram)
+		return GPMCERR_MAP;
+
+	pageBusy = 0;
+	sciFifoLen = 0;
+	sciBusy = 0;
+	memset(sensorRegs, 0, sizeof(sensorRegs));
+	recording = false;
+	block = 0;
+	blockFrames = 0;
+	regionFrame = 0;
+	recStartNsec = 0;
+	framesRecorded = 0;
+	framesThisRecord = 0;
+	noiseState = config.seed ? config.seed : 1;
+
+	regWrite32(FPGA_VERSION_ADDR, ACCEPTABLE_FPGA_VERSION);
+	regWrite32(FPGA_SUBVERSION_ADDR, 0);
+	regWrite32(RAM_IDENTIFIER_REG, RAM_IDENTIFIER);
+	regWrite32(IMAGE_SENSOR_DATA_CORRECT_ADDR, 0x1FFF);
+	regWrite32(SEQ_STATUS_ADDR, SEQ_STATUS_MD_FIFO_EMPTY_MASK);
+	regWrite32(IMAGER_FRAME_PERIOD_ADDR, GPMC_SIM_TIMEBASE_HZ / 1000);
+	regWrite32(IMAGER_INT_TIME_ADDR, GPMC_SIM_TIMEBASE_HZ / 2000);
+	return SUCCESS;
+}
+
+UInt32 GPMCSim::regRead32(UInt32 offset)
+{
+	UInt32 value;
+	memcpy(&value, regs + (offset % GPMC_SIM_REG_BYTES), sizeof(value));
+	return value;
+}
+
+void GPMCSim::regWrite32(UInt32 offset, UInt32 data)
+{
+	memcpy(regs + (offset % GPMC_SIM_REG_BYTES), &data, sizeof(data));
+}
+
+UInt32 GPMCSim::read32(UInt32 offset)
+{
+	return readSideEffects(offset, regRead32(offset));
+}
+
+void GPMCSim::write32(UInt32 offset, UInt32 data)
+{
+	UInt32 old = regRead32(offset);
+	if (!writeSideEffects(offset, data, old))
+		regWrite32(offset, data);
+}
+
+UInt16 GPMCSim::read16(UInt32 offset)
+{
+	UInt32 aligned = offset & ~0x3;
+	UInt32 value = readSideEffects(aligned, regRead32(aligned));
+	return (offset & 0x2) ? (value >> 16) : (value & 0xFFFF);
+}
+
+void GPMCSim::write16(UInt32 offset, UInt16 data)
+{
+	UInt32 aligned = offset & ~0x3;
+	UInt32 old = regRead32(aligned);
+	UInt32 value = (offset & 0x2) ? ((old & 0xFFFF) | ((UInt32)data << 16)) : ((old & 0xFFFF0000) | data);
+
+	/* The page buffer and column memories are 16 bits wide, so halves are independent there. */
+	if (!writeSideEffects(aligned, value, old))
+		regWrite32(aligned, value);
+}
+
+/* GPMCSim::readSideEffects
+ *
+ * Models registers whose value changes as they are read: busy flags that
+ * clear after a few polls, and the sequencer status which advances the
+ * recording.
+ *
+ * offset:	Register offset, 32-bit aligned
+ * value:	Stored value of the register
+ *
+ * returns: Value seen by the reader
+ **/
+UInt32 GPMCSim::readSideEffects(UInt32 offset, UInt32 value)
+{
+	switch (offset) {
+	case RAM_CONTROL:
+		pthread_mutex_lock(&mutex);
+		if (pageBusy) pageBusy--;
+		else value = 0;
+		pthread_mutex_unlock(&mutex);
+		return value;
+
+	case SENSOR_SCI_CONTROL_ADDR:
+		pthread_mutex_lock(&mutex);
+		if (sciBusy) sciBusy--;
+		else value &= ~SENSOR_SCI_CONTROL_RUN_MASK;
+		regWrite32(SENSOR_SCI_CONTROL_ADDR, value);
+		pthread_mutex_unlock(&mutex);
+		return value;
+
+	case SEQ_STATUS_ADDR:
+		pthread_mutex_lock(&mutex);
+		seqUpdate();
+		value = SEQ_STATUS_MD_FIFO_EMPTY_MASK | (recording ? SEQ_STATUS_RECORDING_MASK : 0);
+		pthread_mutex_unlock(&mutex);
+		return value;
+
+	case SEQ_MD_FIFO_READ_ADDR:
+		return 0;
+
+	default:
+		return value;
+	}
+}
+
+/* GPMCSim::writeSideEffects
+ *
+ * Models registers that start an action when written.
+ *
+ * offset:	Register offset, 32-bit aligned
+ * data:	Value written
+ * old:		Previous value of the register
+ *
+ * returns: true if the write was fully handled, false if it should also be stored
+ **/
+bool GPMCSim::writeSideEffects(UInt32 offset, UInt32 data, UInt32 old)
+{
+	UInt64 address;
+
+	switch (offset) {
+	case RAM_CONTROL:
+		address = (UInt64)regRead32(RAM_ADDRESS) * GPMC_SIM_BYTES_PER_WORD;
+		pthread_mutex_lock(&mutex);
+		if (data & RAM_CONTROL_TRIGGER_READ) {
+			ramCopyOut(address, regs + RAM_BUFFER_START, GPMC_RAM_PAGE_WORDS * 4);
+		}
+		else if (data & RAM_CONTROL_TRIGGER_WRITE) {
+			ramCopyIn(address, regs + RAM_BUFFER_START, GPMC_RAM_PAGE_WORDS * 4);
+		}
+		pageBusy = config.pageDelay;
+		regWrite32(RAM_CONTROL, data);
+		pthread_mutex_unlock(&mutex);
+		return true;
+
+	case SENSOR_SCI_CONTROL_ADDR:
+		pthread_mutex_lock(&mutex);
+		if (data & 0x8000) {
+			sciFifoLen = 0;
+			data &= ~0x8000;
+		}
+		regWrite32(SENSOR_SCI_CONTROL_ADDR, data);
+		if ((data & SENSOR_SCI_CONTROL_RUN_MASK) && !(old & SENSOR_SCI_CONTROL_RUN_MASK)) {
+			sciRun(data);
+		}
+		pthread_mutex_unlock(&mutex);
+		return true;
+
+	case SENSOR_SCI_FIFO_WR_ADDR_ADDR:
+		pthread_mutex_lock(&mutex);
+		if (sciFifoLen < GPMC_SIM_SCI_FIFO_LEN) sciFifo[sciFifoLen++] = data & 0xFF;
+		pthread_mutex_unlock(&mutex);
+		return true;
+
+	case SEQ_CTL_ADDR:
+		pthread_mutex_lock(&mutex);
+		regWrite32(SEQ_CTL_ADDR, data);
+		seqControl(data, old);
+		pthread_mutex_unlock(&mutex);
+		return true;
+
+	case SEQ_STATUS_ADDR:
+	case RAM_IDENTIFIER_REG:
+	case FPGA_VERSION_ADDR:
+	case FPGA_SUBVERSION_ADDR:
+		return true;
+
+	case SYSTEM_RESET_ADDR:
+		pthread_mutex_lock(&mutex);
+		recording = false;
+		sciFifoLen = 0;
+		pageBusy = 0;
+		pthread_mutex_unlock(&mutex);
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+UInt32 GPMCSim::readRam32(UInt32 offset)
+{
+	UInt32 value;
+	ramCopyOut((UInt64)regRead32(GPMC_PAGE_OFFSET_ADDR) * GPMC_SIM_BYTES_PER_WORD + offset, (UInt8 *)&value, sizeof(value));
+	return value;
+}
+
+void GPMCSim::writeRam32(UInt32 offset, UInt32 data)
+{
+	ramCopyIn((UInt64)regRead32(GPMC_PAGE_OFFSET_ADDR) * GPMC_SIM_BYTES_PER_WORD + offset, (const UInt8 *)&data, sizeof(data));
+}
+
+UInt16 GPMCSim::readRam16(UInt32 offset)
+{
+	UInt16 value;
+	ramCopyOut((UInt64)regRead32(GPMC_PAGE_OFFSET_ADDR) * GPMC_SIM_BYTES_PER_WORD + offset, (UInt8 *)&value, sizeof(value));
+	return value;
+}
+
+void GPMCSim::writeRam16(UInt32 offset, UInt16 data)
+{
+	ramCopyIn((UInt64)regRead32(GPMC_PAGE_OFFSET_ADDR) * GPMC_SIM_BYTES_PER_WORD + offset, (const UInt8 *)&data, sizeof(data));
+}
+
+UInt8 GPMCSim::readRam8(UInt32 offset)
+{
+	return ram[ramAddress((UInt64)regRead32(GPMC_PAGE_OFFSET_ADDR) * GPMC_SIM_BYTES_PER_WORD + offset)];
+}
+
+void GPMCSim::writeRam8(UInt32 offset, UInt8 data)
+{
+	ram[ramAddress((UInt64)regRead32(GPMC_PAGE_OFFSET_ADDR) * GPMC_SIM_BYTES_PER_WORD + offset)] = data;
+}
+
+/* GPMCSim::ramWindow
+ *
+ * Returns the legacy 16MB RAM window at the current page offset. The window
+ * is clamped so that bulk copies through it stay within the modelled memory.
+ *
+ * returns: Pointer into the simulated acquisition memory
+ **/
+volatile UInt32 *GPMCSim::ramWindow(void)
+{
+	UInt64 address = ramAddress((UInt64)regRead32(GPMC_PAGE_OFFSET_ADDR) * GPMC_SIM_BYTES_PER_WORD);
+	if (address + GPMC_RAM_LEN > ramBytes)
+		address = (ramBytes > GPMC_RAM_LEN) ? (ramBytes - GPMC_RAM_LEN) : 0;
+	return (volatile UInt32 *)(ram + address);
+}
+
+void GPMCSim::ramCopyIn(UInt64 byteAddr, const UInt8 *src, UInt32 len)
+{
+	while (len) {
+		UInt64 address = ramAddress(byteAddr);
+		UInt32 count = min((UInt64)len, ramBytes - address);
+		memcpy(ram + address, src, count);
+		byteAddr += count;
+		src += count;
+		len -= count;
+	}
+}
+
+void GPMCSim::ramCopyOut(UInt64 byteAddr, UInt8 *dst, UInt32 len)
+{
+	while (len) {
+		UInt64 address = ramAddress(byteAddr);
+		UInt32 count = min((UInt64)len, ramBytes - address);
+		memcpy(dst, ram + address, count);
+		byteAddr += count;
+		dst += count;
+		len -= count;
+	}
+}
+
+/* GPMCSim::sciRun
+ *
+ * Completes an SCI transfer to the sensor register bank. Writes take the
+ * first two FIFO bytes as a big endian register value, reads return the
+ * register through SENSOR_SCI_READ_DATA_ADDR. The busy flag is held for two
+ * polls so the drivers see the transfer start.
+ *
+ * control:	Value written to the SCI control register
+ *
+ * returns: nothing
+ **/
+void GPMCSim::sciRun(UInt32 control)
+{
+	UInt32 address = regRead32(SENSOR_SCI_ADDRESS_ADDR) & 0xFF;
+
+	if (control & SENSOR_SCI_CONTROL_RW_MASK) {
+		regWrite32(SENSOR_SCI_READ_DATA_ADDR, sensorRegs[address]);
+	}
+	else if (sciFifoLen >= 2 && regRead32(SENSOR_SCI_DATALEN_ADDR) == 2) {
+		sensorRegs[address] = ((UInt16)sciFifo[0] << 8) | sciFifo[1];
+	}
+	sciFifoLen = 0;
+	sciBusy = 2;
+}
+
+/* GPMCSim::seqProgram
+ *
+ * Decodes a word of the record sequencer program memory.
+ *
+ * returns: nothing
+ **/
+void GPMCSim::seqProgram(UInt32 index, bool *blkFull, bool *recBlkEnd, bool *blkTrig, bool *recTrig, UInt32 *next, UInt32 *blkSize)
+{
+	UInt32 low = regRead32(SEQ_PGM_MEM_START_ADDR + (index % GPMC_SIM_SEQ_PGM_LEN) * 16);
+	UInt32 high = regRead32(SEQ_PGM_MEM_START_ADDR + (index % GPMC_SIM_SEQ_PGM_LEN) * 16 + 4);
+
+	*recTrig = (low & SEQ_PGM_TERM_REC_TRIG) != 0;
+	*recBlkEnd = (low & SEQ_PGM_TERM_REC_BLK_END) != 0;
+	*blkFull = (low & SEQ_PGM_TERM_BLK_FULL) != 0;
+	*blkTrig = (low & (SEQ_PGM_TERM_BLK_HIGH | SEQ_PGM_TERM_BLK_RISING)) != 0;
+	*next = (low >> 8) & 0xF;
+	*blkSize = (low >> 12) | (high << 20);
+}
+
+/* GPMCSim::seqControl
+ *
+ * Handles the rising edges of the sequencer control bits.
+ *
+ * returns: nothing
+ **/
+void GPMCSim::seqControl(UInt32 data, UInt32 old)
+{
+	UInt32 rising = data & ~old;
+
+	if (rising & SEQ_CTL_START_REC_MASK) {
+		seqStart();
+	}
+	if ((rising & SEQ_CTL_SW_TRIG_MASK) && recording) {
+		seqUpdate();
+		seqTrigger();
+	}
+	if ((rising & SEQ_CTL_STOP_REC_MASK) && recording) {
+		seqUpdate();
+		recording = false;
+	}
+}
+
+/* GPMCSim::seqStart
+ *
+ * Starts the sequencer at the first block of the program. Unless frames are
+ * paced in real time, a block that ends once full is recorded immediately,
+ * so single block captures complete before the first status poll.
+ *
+ * returns: nothing
+ **/
+void GPMCSim::seqStart(void)
+{
+	bool blkFull, recBlkEnd, blkTrig, recTrig;
+	UInt32 next, blkSize;
+
+	recording = true;
+	block = 0;
+	blockFrames = 0;
+	regionFrame = 0;
+	framesThisRecord = 0;
+	recStartNsec = nowNsec();
+
+	seqProgram(block, &blkFull, &recBlkEnd, &blkTrig, &recTrig, &next, &blkSize);
+	if (!config.realtime && blkFull) {
+		seqAdvance(blkSize + 1);
+	}
+}
+
+void GPMCSim::seqEndBlock(void)
+{
+	bool blkFull, recBlkEnd, blkTrig, recTrig;
+	UInt32 next, blkSize;
+
+	seqProgram(block, &blkFull, &recBlkEnd, &blkTrig, &recTrig, &next, &blkSize);
+	if (recBlkEnd) {
+		recording = false;
+		return;
+	}
+	block = next;
+	blockFrames = 0;
+}
+
+void GPMCSim::seqTrigger(void)
+{
+	bool blkFull, recBlkEnd, blkTrig, recTrig;
+	UInt32 next, blkSize;
+
+	seqProgram(block, &blkFull, &recBlkEnd, &blkTrig, &recTrig, &next, &blkSize);
+	if (recTrig) {
+		recording = false;
+	}
+	else if (blkTrig) {
+		seqEndBlock();
+	}
+}
+
+/* GPMCSim::seqUpdate
+ *
+ * Records the frames due since the last update. In real time mode this is
+ * the number of frame periods elapsed since recording started, otherwise
+ * each update records a single frame.
+ *
+ * returns: nothing
+ **/
+void GPMCSim::seqUpdate(void)
+{
+	if (!recording)
+		return;
+
+	if (config.realtime) {
+		UInt32 period = max(regRead32(IMAGER_FRAME_PERIOD_ADDR), 1U);
+		UInt64 due = (nowNsec() - recStartNsec) / ((UInt64)period * (1000000000ULL / GPMC_SIM_TIMEBASE_HZ));
+		if (due > framesThisRecord) {
+			seqAdvance(min(due - framesThisRecord, (UInt64)GPMC_SIM_MAX_CATCHUP));
+			framesThisRecord = due;
+		}
+	}
+	else {
+		seqAdvance(1);
+	}
+}
+
+/* GPMCSim::seqAdvance
+ *
+ * Writes frames into the record region, wrapping at the end of the region
+ * and following the program from block to block.
+ *
+ * frames:	Maximum number of frames to record
+ *
+ * returns: nothing
+ **/
+void GPMCSim::seqAdvance(UInt32 frames)
+{
+	UInt32 frameWords = regRead32(SEQ_FRAME_SIZE_ADDR);
+	UInt32 start = regRead32(SEQ_REC_REGION_START_ADDR);
+	UInt32 end = regRead32(SEQ_REC_REGION_END_ADDR);
+	UInt32 regionFrames = (frameWords && end > start) ? (end - start) / frameWords : 0;
+
+	if (!regionFrames) {
+		recording = false;
+		return;
+	}
+
+	while (frames-- && recording) {
+		bool blkFull, recBlkEnd, blkTrig, recTrig;
+		UInt32 next, blkSize;
+
+		writeFrame(start + (regionFrame % regionFrames) * frameWords);
+		regionFrame = (regionFrame + 1) % regionFrames;
+		blockFrames++;
+		framesRecorded++;
+
+		seqProgram(block, &blkFull, &recBlkEnd, &blkTrig, &recTrig, &next, &blkSize);
+		if (blkFull && blockFrames > blkSize) {
+			seqEndBlock();
+		}
+	}
+}
+
+/* GPMCSim::writeFrame
+ *
+ * Synthesizes one packed 12-bit frame at an acquisition memory address.
+ *
+ * wordAddress:	Address of the frame in 256-bit words
+ *
+ * returns: nothing
+ **/
+void GPMCSim::writeFrame(UInt32 wordAddress)
+{
+	UInt32 bytes = regRead32(SEQ_FRAME_SIZE_ADDR) * GPMC_SIM_BYTES_PER_WORD;
+	UInt32 pixels = (bytes * 8) / 12;
+	double intTimeMs = (double)regRead32(IMAGER_INT_TIME_ADDR) * 1000.0 / GPMC_SIM_TIMEBASE_HZ;
+	double signal = config.blackLevel + config.sensitivity * intTimeMs;
+	UInt32 i;
+
+	if (frameAlloc < pixels) {
+		delete [] framePixels;
+		delete [] framePacked;
+		framePixels = new UInt16[pixels + 1];
+		framePacked = new UInt8[bytes + 3];
+		frameAlloc = pixels;
+	}
+
+	/* The fixed pattern only depends on the frame size, so keep it between frames. */
+	if (patternPixels != pixels) {
+		delete [] pattern;
+		pattern = new float[pixels];
+		for (i = 0; i < pixels; i++) {
+			pattern[i] = config.fpn * fixedPattern(i, config.seed) +
+						 config.columnFpn * fixedPattern(i % config.hRes, ~config.seed);
+		}
+		patternPixels = pixels;
+	}
+
+	for (i = 0; i < pixels; i++) {
+		double value = signal + pattern[i];
+		if (config.noise > 0.0) value += config.noise * gaussNoise(&noiseState);
+		framePixels[i] = (UInt16)within(value + 0.5, 0.0, 4095.0);
+	}
+	framePixels[pixels] = 0;
+
+	/* Pack pairs of pixels into three bytes, least significant nibble first. */
+	for (i = 0; i < pixels; i += 2) {
+		UInt8 *dst = framePacked + (i / 2) * 3;
+		dst[0] = framePixels[i] & 0xFF;
+		dst[1] = (framePixels[i] >> 8) | ((framePixels[i + 1] & 0xF) << 4);
+		dst[2] = framePixels[i + 1] >> 4;
+	}
+	ramCopyIn((UInt64)wordAddress * GPMC_SIM_BYTES_PER_WORD, framePacked, bytes);
+}
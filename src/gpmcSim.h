@@ -0,0 +1,142 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef GPMCSIM_H
+#define GPMCSIM_H
+
+#include <pthread.h>
+#include "gpmc.h"
+
+/* Bytes of FPGA register space modelled, this covers the column gain and curve memories. */
+#define GPMC_SIM_REG_BYTES		0x10000
+#define GPMC_SIM_SCI_FIFO_LEN	1024
+#define GPMC_SIM_SEQ_PGM_LEN	16
+
+/* Size of an acquisition memory word, as used by RAM_ADDRESS and the sequencer. */
+#define GPMC_SIM_BYTES_PER_WORD	32
+
+/* Timebase of the sensor frame period and integration time registers. */
+#define GPMC_SIM_TIMEBASE_HZ	100000000
+
+/* Most frames generated by one sequencer update in real time mode. */
+#define GPMC_SIM_MAX_CATCHUP	64
+
+/*
+ * Options for the simulated FPGA, parsed from a comma separated list of
+ * key=value pairs in the CAM_GPMC_SIM environment variable, for example
+ * CAM_GPMC_SIM="fpn=24,noise=3.5,ram=512". Any other value uses the defaults.
+ */
+typedef struct {
+	UInt32 ramMB;			/* ram:		Size of acquisition memory to model, addresses wrap beyond this. */
+	UInt32 blackLevel;		/* black:	Mean dark pixel value in DN. */
+	UInt32 fpn;				/* fpn:		Peak amplitude of the per-pixel fixed pattern noise in DN. */
+	UInt32 columnFpn;		/* colfpn:	Peak amplitude of the per-column fixed pattern noise in DN. */
+	UInt32 hRes;			/* hres:	Row length used to derive the column of each pixel. */
+	double noise;			/* noise:	RMS temporal noise in DN. */
+	double sensitivity;		/* sens:	Signal in DN per millisecond of integration time. */
+	UInt32 pageDelay;		/* delay:	Polls of RAM_CONTROL before a page handshake completes. */
+	UInt32 seed;			/* seed:	Seed of the fixed pattern, frames with equal seeds match. */
+	bool realtime;			/* realtime: Pace recorded frames at the programmed frame period. */
+} GPMCSimConfig;
+
+/*
+ * In-process model of the FPGA for running the acquisition, calibration and
+ * sequencer code off the camera. It keeps a register file with the side
+ * effects the software depends on: the RAM page buffer handshake, the record
+ * sequencer and its program memory, and SCI transfers to a bank of sensor
+ * registers. Recording fills the record region with synthetic 12-bit frames
+ * built from a black level, a stable fixed pattern, temporal noise and a
+ * signal proportional to the integration time. Sensor gain and ADC offsets
+ * written over SCI are stored but do not affect the frames.
+ */
+class GPMCSim : public GPMCBackend
+{
+public:
+	GPMCSim(const char *options = NULL);
+	~GPMCSim();
+
+	Int32 init(void);
+	void setTimeoutEnable(bool timeoutEnable) { (void)timeoutEnable; }
+	UInt32 read32(UInt32 offset);
+	void write32(UInt32 offset, UInt32 data);
+	UInt16 read16(UInt32 offset);
+	void write16(UInt32 offset, UInt16 data);
+	UInt32 readRam32(UInt32 offset);
+	void writeRam32(UInt32 offset, UInt32 data);
+	UInt16 readRam16(UInt32 offset);
+	void writeRam16(UInt32 offset, UInt16 data);
+	UInt8 readRam8(UInt32 offset);
+	void writeRam8(UInt32 offset, UInt8 data);
+	volatile UInt32 *pageBuffer(void) { return (volatile UInt32 *)(regs + RAM_BUFFER_START); }
+	volatile UInt32 *ramWindow(void);
+
+	const GPMCSimConfig *getConfig(void) { return &config; }
+	UInt32 getFramesRecorded(void) { return framesRecorded; }
+	UInt16 getSensorReg(UInt32 address) { return sensorRegs[address & 0xFF]; }
+
+private:
+	GPMCSimConfig config;
+	UInt8 *regs;
+	UInt8 *ram;
+	UInt64 ramBytes;
+	pthread_mutex_t mutex;
+
+	/* RAM page handshake. */
+	UInt32 pageBusy;
+
+	/* SCI bus. */
+	UInt8 sciFifo[GPMC_SIM_SCI_FIFO_LEN];
+	UInt32 sciFifoLen;
+	UInt32 sciBusy;
+	UInt16 sensorRegs[256];
+
+	/* Record sequencer. */
+	bool recording;
+	UInt32 block;
+	UInt32 blockFrames;
+	UInt32 regionFrame;
+	UInt64 recStartNsec;
+	UInt64 framesRecorded;
+	UInt32 framesThisRecord;
+	UInt32 noiseState;
+	UInt16 *framePixels;
+	UInt8 *framePacked;
+	UInt32 frameAlloc;
+	float *pattern;
+	UInt32 patternPixels;
+
+	void parseOptions(const char *options);
+	UInt32 regRead32(UInt32 offset);
+	void regWrite32(UInt32 offset, UInt32 data);
+	bool writeSideEffects(UInt32 offset, UInt32 data, UInt32 old);
+	UInt32 readSideEffects(UInt32 offset, UInt32 value);
+
+	UInt64 ramAddress(UInt64 byteAddr) { return byteAddr % ramBytes; }
+	void ramCopyIn(UInt64 byteAddr, const UInt8 *src, UInt32 len);
+	void ramCopyOut(UInt64 byteAddr, UInt8 *dst, UInt32 len);
+
+	void sciRun(UInt32 control);
+	void seqControl(UInt32 data, UInt32 old);
+	void seqStart(void);
+	void seqEndBlock(void);
+	void seqTrigger(void);
+	void seqAdvance(UInt32 frames);
+	void seqUpdate(void);
+	void seqProgram(UInt32 index, bool *blkFull, bool *recBlkEnd, bool *blkTrig, bool *recTrig, UInt32 *next, UInt32 *blkSize);
+	void writeFrame(UInt32 wordAddress);
+};
+
+#endif // GPMCSIM_H
@@ -30,6 +30,7 @@
 
 #include "types.h"
 #include "lux1310.h"
+#include "calibrationStore.h"
 
 #include <QSettings>
 
@@ -58,11 +59,12 @@ CameraErrortype LUX1310::init(GPMC * gpmc_inst)
 	if(SUCCESS != retVal)
 		return retVal;
 
-	dacCSFD = open("/sys/class/gpio/gpio33/value", O_WRONLY);
-	if (-1 == dacCSFD)
+	if (SUCCESS != dacCS.Open(IMAGE_SENSOR_DAC_CS_GPIO))
 		return LUX1310_FILE_ERROR;
 
 	gpmc = gpmc_inst;
+	sci.init(gpmc);
+	sci.setResetRegister(0x7E);
 
 	retVal = initSensor();
 	//mem problem before this
@@ -209,87 +211,29 @@ CameraErrortype LUX1310::initSensor()
 
 bool LUX1310::SCIWrite(UInt8 address, UInt16 data, bool readback)
 {
-	int i = 0;
-
-	//Clear RW and reset FIFO
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, 0x8000);
-
-	//Set up address, transfer length and put data into FIFO
-	gpmc->write16(SENSOR_SCI_ADDRESS_ADDR, address);
-	gpmc->write16(SENSOR_SCI_DATALEN_ADDR, 2);
-	gpmc->write16(SENSOR_SCI_FIFO_WR_ADDR_ADDR, data >> 8);
-	gpmc->write16(SENSOR_SCI_FIFO_WR_ADDR_ADDR, data & 0xFF);
-
-	// Start the write and wait for completion.
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, SENSOR_SCI_CONTROL_RUN_MASK);
-	while(gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK) i++;
-
-	if (readback) {
-		UInt16 readback;
+	if (!readback) {
+		sci.write(address, data);
+		return true;
+	}
 
-		if (i == 0) {
-			qDebug() << "No busy detected, something is probably very wrong, address:" << address;
-		}
-		readback = SCIRead(address);
-		if (data != readback) {
-			qDebug() << "SCI readback wrong, address: " << address << " expected: " << data << " got: " << readback;
-			return false;
-		}
+	/* Always write the register when checking it, since this is testing the interface. */
+	sci.write(address, data, true);
+	UInt16 value = sci.read(address);
+	if (data != value) {
+		qDebug() << "SCI readback wrong, address: " << address << " expected: " << data << " got: " << value;
+		return false;
 	}
 	return true;
 }
 
 void LUX1310::SCIWriteBuf(UInt8 address, const UInt8 * data, UInt32 dataLen)
 {
-	int i = 0;
-
-	//Clear RW and reset FIFO
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, 0x8000);
-
-	//Set up address, transfer length and put data into FIFO
-	gpmc->write16(SENSOR_SCI_ADDRESS_ADDR, address);
-	gpmc->write16(SENSOR_SCI_DATALEN_ADDR, dataLen);
-	for(UInt32 i = 0; i < dataLen; i++) {
-		gpmc->write16(SENSOR_SCI_FIFO_WR_ADDR_ADDR, data[i]);
-	}
-
-	//Start transfer
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, SENSOR_SCI_CONTROL_RUN_MASK);
-	while(gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK) {
-		i++;
-	}
+	sci.writeBuf(address, data, dataLen);
 }
 
 UInt16 LUX1310::SCIRead(UInt8 address)
 {
-	int i = 0;
-
-	//Set RW
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, gpmc->read16(SENSOR_SCI_CONTROL_ADDR) | SENSOR_SCI_CONTROL_RW_MASK);
-
-	//Set up address and transfer length
-	gpmc->write16(SENSOR_SCI_ADDRESS_ADDR, address);
-	gpmc->write16(SENSOR_SCI_DATALEN_ADDR, 2);
-
-	//Start transfer
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, gpmc->read16(SENSOR_SCI_CONTROL_ADDR) | SENSOR_SCI_CONTROL_RUN_MASK);
-
-	int first = gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK;
-	//Wait for completion
-	while(gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK)
-		i++;
-
-	if(!first && i != 0)
-		qDebug() << "Read First busy was missed, address:" << address;
-	else if(i == 0)
-		qDebug() << "Read No busy detected, something is probably very wrong, address:" << address;
-
-
-	//Wait for completion
-//	while(gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK)
-//		count++;
-	delayms(1);
-	return gpmc->read16(SENSOR_SCI_READ_DATA_ADDR);
+	return sci.read(address);
 }
 
 CameraErrortype LUX1310::autoPhaseCal(void)
@@ -318,6 +262,7 @@ Int32 LUX1310::seqOnOff(bool on)
 void LUX1310::setReset(bool reset)
 {
 		gpmc->write16(IMAGE_SENSOR_CONTROL_ADDR, (gpmc->read16(IMAGE_SENSOR_CONTROL_ADDR) & ~IMAGE_SENSOR_RESET_MASK) | (reset ? IMAGE_SENSOR_RESET_MASK : 0));
+		if (reset) sci.invalidate();
 }
 
 void LUX1310::setClkPhase(UInt8 phase)
@@ -357,11 +302,13 @@ void LUX1310::setResolution(FrameGeometry *size)
 {
 	UInt32 hStartBlocks = size->hOffset / LUX1310_HRES_INCREMENT;
 	UInt32 hWidthblocks = size->hRes / LUX1310_HRES_INCREMENT;
+	sci.begin();
 	SCIWrite(0x05, 0x20 + hStartBlocks * LUX1310_HRES_INCREMENT);//X Start
 	SCIWrite(0x06, 0x20 + (hStartBlocks + hWidthblocks) * LUX1310_HRES_INCREMENT - 1);//X End
 	SCIWrite(0x07, size->vOffset);							//Y Start
 	SCIWrite(0x08, size->vOffset + size->vRes - 1);	//Y End
 	SCIWrite(0x29, (size->vDarkRows << 12) + (LUX1310_MAX_V_RES + LUX1310_MAX_V_DARK - size->vDarkRows + 4));
+	sci.commit();
 
 	memcpy(&currentRes, size, sizeof(currentRes));
 }
@@ -559,31 +506,55 @@ int LUX1310::writeDACSPI(UInt16 data)
 
 void LUX1310::setDACCS(bool on)
 {
-	lseek(dacCSFD, 0, SEEK_SET);
-	write(dacCSFD, on ? "1" : "0", 1);
+	dacCS.Set(on);
 }
 
-void LUX1310::updateWavetableSetting(bool gainCalMode)
+/* Search for the longest wavetable that it shorter than the frame period. */
+const lux1310wavetab_t *LUX1310::selectWavetable(UInt32 period, FrameGeometry *frameSize)
 {
-	/* Search for the longest wavetable that it shorter than the current frame period. */
 	const lux1310wavetab_t *wt = NULL;
-	int i;
 
-	qDebug() << "Selecting wavetable for period of" << currentPeriod;
-
-	for (i = 0; lux1310wt[i] != NULL; i++) {
+	for (int i = 0; lux1310wt[i] != NULL; i++) {
 		wt = lux1310wt[i];
-		if (currentPeriod >= getMinWavetablePeriod(&currentRes, wt->clocks)) break;
+		if (period >= getMinWavetablePeriod(frameSize, wt->clocks)) break;
 	}
+	return wt;
+}
+
+/* A new period only needs the sensor stopped if it needs a different wavetable. */
+bool LUX1310::isLivePeriodChange(UInt32 period, FrameGeometry *frameSize)
+{
+	UInt32 minPeriod = getMinFramePeriod(frameSize);
+	UInt32 maxPeriod = LUX1310_MAX_SLAVE_PERIOD;
+	const lux1310wavetab_t *wt = selectWavetable(within(period, minPeriod, maxPeriod), frameSize);
+
+	return wt && (wt->clocks == wavetableSize);
+}
+
+void LUX1310::updateWavetableSetting(bool gainCalMode)
+{
+	const lux1310wavetab_t *wt;
+
+	qDebug() << "Selecting wavetable for period of" << currentPeriod;
+	wt = selectWavetable(currentPeriod, &currentRes);
 
 	/* Update the wavetable. */
 	if (wt) {
-		SCIWrite(0x01, 0x0000);         //Disable internal timing engine
-		SCIWrite(0x37, wt->clocks);     //non-overlapping readout delay
-		SCIWrite(0x7A, wt->clocks);     //wavetable size
-		SCIWriteBuf(0x7F, gainCalMode ? wt->gaincal : wt->wavetab, wt->length);
-		delayms(1);
-		SCIWrite(0x01, 0x0001);         //Enable internal timing engine
+		const UInt8 *table = gainCalMode ? wt->gaincal : wt->wavetab;
+
+		if (sci.matchesBuf(0x7F, table, wt->length)) {
+			/* Already loaded, so leave the timing engine running. */
+			SCIWrite(0x37, wt->clocks);
+			SCIWrite(0x7A, wt->clocks);
+		}
+		else {
+			SCIWrite(0x01, 0x0000);         //Disable internal timing engine
+			SCIWrite(0x37, wt->clocks);     //non-overlapping readout delay
+			SCIWrite(0x7A, wt->clocks);     //wavetable size
+			SCIWriteBuf(0x7F, table, wt->length);
+			delayms(1);
+			SCIWrite(0x01, 0x0001);         //Enable internal timing engine
+		}
 		wavetableSize = wt->clocks;
 		gpmc->write16(SENSOR_MAGIC_START_DELAY_ADDR, wt->abnDelay);
 
@@ -645,9 +616,11 @@ Int32 LUX1310::setGain(UInt32 gainSetting)
 		writeDACVoltage(VRSTH_VOLTAGE, 3.6);
 
 		//Set Gain
+		sci.begin();
 		SCIWrite(0x51, 0x007F);	//gain selection sampling cap (11)	12 bit
 		SCIWrite(0x52, 0x007F);	//gain selection feedback cap (8) 7 bit
 		SCIWrite(0x53, 0x03);	//Serial gain
+		sci.commit();
 	break;
 
 	case LUX1310_GAIN_2:	//2
@@ -656,9 +629,11 @@ Int32 LUX1310::setGain(UInt32 gainSetting)
 		writeDACVoltage(VRSTH_VOLTAGE, 3.6);
 
 		//Set Gain
+		sci.begin();
 		SCIWrite(0x51, 0x0FFF);	//gain selection sampling cap (11)	12 bit
 		SCIWrite(0x52, 0x007F);	//gain selection feedback cap (8) 7 bit
 		SCIWrite(0x53, 0x03);	//Serial gain
+		sci.commit();
 	break;
 
 	case LUX1310_GAIN_4:	//4
@@ -667,9 +642,11 @@ Int32 LUX1310::setGain(UInt32 gainSetting)
 		writeDACVoltage(VRSTH_VOLTAGE, 3.6);
 
 		//Set Gain
+		sci.begin();
 		SCIWrite(0x51, 0x0FFF);	//gain selection sampling cap (11)	12 bit
 		SCIWrite(0x52, 0x007F);	//gain selection feedback cap (8) 7 bit
 		SCIWrite(0x53, 0x00);	//Serial gain
+		sci.commit();
 	break;
 
 	case LUX1310_GAIN_8:	//8
@@ -678,9 +655,11 @@ Int32 LUX1310::setGain(UInt32 gainSetting)
 		writeDACVoltage(VRSTH_VOLTAGE, 2.6);
 
 		//Set Gain
+		sci.begin();
 		SCIWrite(0x51, 0x0FFF);	//gain selection sampling cap (11)	12 bit
 		SCIWrite(0x52, 0x0007);	//gain selection feedback cap (8) 7 bit
 		SCIWrite(0x53, 0x00);	//Serial gain
+		sci.commit();
 	break;
 
 	case LUX1310_GAIN_16:	//16
@@ -689,9 +668,11 @@ Int32 LUX1310::setGain(UInt32 gainSetting)
 		writeDACVoltage(VRSTH_VOLTAGE, 2.6);
 
 		//Set Gain
+		sci.begin();
 		SCIWrite(0x51, 0x0FFF);	//gain selection sampling cap (11)	12 bit
 		SCIWrite(0x52, 0x0001);	//gain selection feedback cap (8) 7 bit
 		SCIWrite(0x53, 0x00);	//Serial gain
+		sci.commit();
 	break;
 
 	default:
@@ -716,19 +697,35 @@ UInt8 LUX1310::getFilterColor(UInt32 h, UInt32 v)
 
 }
 
-void LUX1310::offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, UInt32 address, UInt32 framesToAverage)
+/* LUX1310::offsetCorrectionIteration
+ *
+ * Performs one step of ADC offset training, nudging the offset of each
+ * active ADC channel towards a black level of footroom plus the standard
+ * deviation of the dark pixels.
+ *
+ * geometry:		Frame geometry being recorded
+ * offsets:			ADC offsets to update
+ * address:			Address of the first frame in acquisition memory
+ * framesToAverage:	Number of frames to sample
+ * activeMask:		Bitmask of the ADC channels to train
+ *
+ * returns: Bitmask of the channels whose offset changed by no more than LUX1310_OFFSET_CONVERGED
+ **/
+UInt32 LUX1310::offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, UInt32 address, UInt32 framesToAverage, UInt32 activeMask)
 {
 	UInt32 numRows = geometry->vDarkRows ? geometry->vDarkRows : 1;
 	UInt32 rowSize = (geometry->hRes * LUX1310_BITS_PER_PIXEL) / 8;
 	UInt32 samples = (numRows * framesToAverage * geometry->hRes / LUX1310_HRES_INCREMENT);
-	UInt32 adcAverage[LUX1310_HRES_INCREMENT];
-	UInt32 adcStdDev[LUX1310_HRES_INCREMENT];
+	UInt32 adcSum[LUX1310_HRES_INCREMENT];
+	UInt64 adcSumSq[LUX1310_HRES_INCREMENT];
+	UInt32 convergedMask = 0;
 
 	UInt32 *pxbuffer = (UInt32 *)malloc(rowSize * numRows * framesToAverage);
+	UInt16 *pxunpacked = (UInt16 *)malloc(numRows * framesToAverage * geometry->hRes * sizeof(UInt16));
 
 	for(int i = 0; i < LUX1310_HRES_INCREMENT; i++) {
-		adcAverage[i] = 0;
-		adcStdDev[i] = 0;
+		adcSum[i] = 0;
+		adcSumSq[i] = 0;
 	}
 	/* Read out the black regions from all frames. */
 	for (int i = 0; i < framesToAverage; i++) {
@@ -736,61 +733,87 @@ void LUX1310::offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, U
 		gpmc->readAcqMem(rowbuffer, address, rowSize * numRows);
 		address += gpmc->read32(SEQ_FRAME_SIZE_ADDR);
 	}
+	unpackPixelBuf12(pxunpacked, pxbuffer, numRows * framesToAverage * geometry->hRes);
 
-	/* Find the per-ADC averages and standard deviation */
-	for (int row = 0; row < (numRows * framesToAverage); row++) {
-		for (int col = 0; col < geometry->hRes; col++) {
-			adcAverage[col % LUX1310_HRES_INCREMENT] += readPixelBuf12((UInt8 *)pxbuffer, row * geometry->hRes + col);
-		}
-	}
+	/*
+	 * Find the per-ADC averages and standard deviation in a single pass. The
+	 * integer sums are exact, so this doesn't suffer the cancellation that
+	 * makes the naive one-pass variance unstable in floating point.
+	 */
 	for (int row = 0; row < (numRows * framesToAverage); row++) {
+		const UInt16 *px = pxunpacked + row * geometry->hRes;
 		for (int col = 0; col < geometry->hRes; col++) {
-			UInt16 pix = readPixelBuf12((UInt8 *)pxbuffer, row * geometry->hRes + col);
-			UInt16 avg = adcAverage[col % LUX1310_HRES_INCREMENT] / samples;
-			adcStdDev[col % LUX1310_HRES_INCREMENT] += (pix - avg) * (pix - avg);
+			UInt32 pix = px[col];
+			adcSum[col % LUX1310_HRES_INCREMENT] += pix;
+			adcSumSq[col % LUX1310_HRES_INCREMENT] += pix * pix;
 		}
 	}
-	for(int col = 0; col < LUX1310_HRES_INCREMENT; col++) {
-		adcStdDev[col] = sqrt(adcStdDev[col] / (samples - 1));
-		adcAverage[col] /= samples;
-	}
 	free(pxbuffer);
+	free(pxunpacked);
 
 	/* Train the ADC for a target of: Average = Footroom + StandardDeviation */
 	for(int col = 0; col < LUX1310_HRES_INCREMENT; col++) {
-		UInt16 avg = adcAverage[col];
-		UInt16 dev = adcStdDev[col];
+		UInt64 sumSqDev = adcSumSq[col] - ((UInt64)adcSum[col] * adcSum[col]) / samples;
+		UInt16 avg = adcSum[col] / samples;
+		UInt16 dev = sqrt((double)sumSqDev / (samples - 1));
+		int prev = offsets[col];
+
+		if (!(activeMask & (1U << col))) continue;
 
 		offsets[col] = offsets[col] - (avg - dev - 32) / 2;
 		offsets[col] = within(offsets[col], -1023, 1023);
-		setADCOffset(col, offsets[col]);
+		if (abs(offsets[col] - prev) <= LUX1310_OFFSET_CONVERGED) {
+			convergedMask |= (1U << col);
+		}
+		if (offsets[col] != prev) {
+			setADCOffset(col, offsets[col]);
+		}
 	}
+	return convergedMask;
 }
 
+/* LUX1310::adcOffsetTraining
+ *
+ * Trains the ADC offsets for the current gain and wavetable, starting from
+ * the stored offsets when there are any. Each channel stops training once
+ * its offset settles, and training ends when all channels have settled.
+ **/
 void LUX1310::adcOffsetTraining(FrameGeometry *size, UInt32 address, UInt32 numFrames)
 {
 	int offsets[LUX1310_HRES_INCREMENT];
+	int converged[LUX1310_HRES_INCREMENT];
+	Int16 off16[LUX1310_HRES_INCREMENT];
+	UInt32 activeMask = (1 << LUX1310_HRES_INCREMENT) - 1;
 	unsigned int iterations = 32;
+	unsigned int i;
 	struct timespec tRefresh;
 	char debugstr[8*LUX1310_HRES_INCREMENT];
 	int debuglen = 0;
 
 	std::string filename = getFilename("cal/lux1310Offsets", ".bin");
-	FILE *fp;
+	QString storedName = getADCOffsetsFilename().c_str();
 
 	tRefresh.tv_sec = 0;
 	tRefresh.tv_nsec = ((numFrames+10) * currentPeriod * 1000000000ULL) / LUX1310_TIMING_CLOCK;
 
-	/* Clear out the ADC Offsets. */
-	for (int i = 0; i < LUX1310_HRES_INCREMENT; i++) {
-		offsets[i] = 0;
-		setADCOffset(i, 0);
+	/* Warm start from the stored ADC offsets, or clear them out. */
+	if (CalibrationStore::instance()->read(storedName, off16, sizeof(off16)) != SUCCESS) {
+		memset(off16, 0, sizeof(off16));
+	}
+	for (int col = 0; col < LUX1310_HRES_INCREMENT; col++) {
+		offsets[col] = off16[col];
+		converged[col] = iterations;
+		setADCOffset(col, offsets[col]);
 	}
 
-	/* Tune the ADC offset calibration. */
-	for (int i = 0; i < iterations; i++) {
+	/* Tune the ADC offset calibration until every channel has settled. */
+	for (i = 0; (i < iterations) && activeMask; i++) {
 		nanosleep(&tRefresh, NULL);
-		offsetCorrectionIteration(size, offsets, address, numFrames);
+		UInt32 doneMask = offsetCorrectionIteration(size, offsets, address, numFrames, activeMask);
+		for (int col = 0; col < LUX1310_HRES_INCREMENT; col++) {
+			if (doneMask & (1U << col)) converged[col] = i + 1;
+		}
+		activeMask &= ~doneMask;
 	}
 
 	debuglen = 0;
@@ -798,17 +821,23 @@ void LUX1310::adcOffsetTraining(FrameGeometry *size, UInt32 address, UInt32 numF
 		debuglen += sprintf(debugstr + debuglen, " %+4d", offsets[col]);
 	}
 	qDebug("Calculated ADC Offsets:%s", debugstr);
+
+	debuglen = 0;
+	for (int col=0; col < LUX1310_HRES_INCREMENT; col++) {
+		debuglen += sprintf(debugstr + debuglen, " %4d", converged[col]);
+	}
+	qDebug("ADC offsets settled after %u iterations, per channel:%s", i, debugstr);
 	qDebug("Writing ADC offsets to %s", filename.c_str());
 
-	fp = fopen(filename.c_str(), "wb");
-	if (fp) {
-		Int16 off16[LUX1310_HRES_INCREMENT];
-		for (int col = 0; col < LUX1310_HRES_INCREMENT; col++) {
-			off16[col] = offsets[col];
-		}
-		fwrite(off16, sizeof(off16[0]), LUX1310_HRES_INCREMENT, fp);
-		fclose(fp);
+	for (int col = 0; col < LUX1310_HRES_INCREMENT; col++) {
+		off16[col] = offsets[col];
 	}
+	CalibrationStore::instance()->write(QString(filename.c_str()), off16, sizeof(off16), CAL_TYPE_ADC_OFFSETS, gain, size);
+}
+
+std::string LUX1310::getADCOffsetsFilename(void)
+{
+	return std::string("cal:lux1310Offsets") + getFilename("", ".bin");
 }
 
 Int32 LUX1310::loadADCOffsetsFromFile(FrameGeometry *size)
@@ -817,44 +846,17 @@ Int32 LUX1310::loadADCOffsetsFromFile(FrameGeometry *size)
 	Int32 ret = SUCCESS;
 	QString filename;
 
-	do {
-		//Generate the filename for this particular resolution and offset
-		filename.sprintf("cal:lux1310Offsets");
-
-		std::string fn;
-		fn = getFilename("", ".bin");
-		filename.append(fn.c_str());
-		QFileInfo adcOffsetsFile(filename);
-		if (!adcOffsetsFile.exists() || !adcOffsetsFile.isFile()) {
-			ret = CAMERA_FILE_NOT_FOUND;
-			break;
-		}
-
-		fn = adcOffsetsFile.absoluteFilePath().toLocal8Bit().constData();
-		qDebug() << "attempting to load ADC offsets from" << fn.c_str();
-
-		//If the offsets file exists, read it in
-		if( access( fn.c_str(), R_OK ) == -1 ) {
-			ret = CAMERA_FILE_NOT_FOUND;
-			break;
-		}
-
-		FILE * fp;
-		fp = fopen(fn.c_str(), "rb");
-		if(!fp) {
-			ret = CAMERA_FILE_ERROR;
-			break;
-		}
-
-		fread(offsets, sizeof(offsets[0]), LUX1310_HRES_INCREMENT, fp);
-		fclose(fp);
+	//Generate the filename for this particular gain and wavetable
+	filename = getADCOffsetsFilename().c_str();
 
-		//Write the values into the sensor
+	//If the offsets were calibrated, write the values into the sensor
+	ret = CalibrationStore::instance()->read(filename, offsets, sizeof(offsets));
+	if (ret == SUCCESS) {
 		for(int i = 0; i < LUX1310_HRES_INCREMENT; i++) {
 			setADCOffset(i, offsets[i]);
 		}
 		return SUCCESS;
-	} while (0);
+	}
 
 	/* Otherwise, if there is no cal, clear the offsets to zero. */
 	for (int i = 0; i < LUX1310_HRES_INCREMENT; i++) {
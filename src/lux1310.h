@@ -22,6 +22,7 @@
 #include "types.h"
 #include "spi.h"
 #include "gpmc.h"
+#include "sensorSCI.h"
 #include <string>
 
 #define LUX1310_HRES_INCREMENT 16
@@ -41,6 +42,7 @@
 
 #define LUX1310_GAIN_CORRECTION_MIN 0.999
 #define LUX1310_GAIN_CORRECTION_MAX 1.2
+#define LUX1310_OFFSET_CONVERGED	1	//ADC offset training stops once a channel moves by no more than this
 
 enum {
 	VDR3_VOLTAGE = 0,
@@ -115,6 +117,7 @@ public:
 	UInt32 getActualFramePeriod(double target, FrameGeometry *frameSize);
 	UInt32 getFramePeriod(void);
 	UInt32 setFramePeriod(UInt32 period, FrameGeometry *frameSize);
+	bool isLivePeriodChange(UInt32 period, FrameGeometry *frameSize);
 
 	/* Exposure Timing Functions */
 	UInt32 getIntegrationClock(void) { return LUX1310_TIMING_CLOCK; }
@@ -130,6 +133,7 @@ public:
 	void adcOffsetTraining(FrameGeometry *frameSize, UInt32 address, UInt32 numFrames);
 	Int32 loadADCOffsetsFromFile(FrameGeometry *frameSize);
 	std::string getFilename(const char * filename, const char * extension);
+	std::string getADCOffsetsFilename(void);
 
 	UInt32 getMinGain() { return 1; }
 	UInt32 getMaxGain() { return 16; }
@@ -156,13 +160,14 @@ private:
 	void SCIWriteBuf(UInt8 address, const UInt8 * data, UInt32 dataLen);
 	UInt16 SCIRead(UInt8 address);
 	void updateWavetableSetting(bool gainCalMode);
+	const lux1310wavetab_t *selectWavetable(UInt32 period, FrameGeometry *frameSize);
 	void setADCOffset(UInt8 channel, Int16 offset);
-	void offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, UInt32 address, UInt32 framesToAverage);
+	UInt32 offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, UInt32 address, UInt32 framesToAverage, UInt32 activeMask);
 
 	FrameGeometry currentRes;
 	UInt32 currentPeriod;
 	UInt32 currentExposure;
-	Int32 dacCSFD;
+	SPIChipSelect dacCS;
 	UInt32 wavetableSize;
 	UInt32 gain;
 	UInt32 startDelaySensorClocks;
@@ -170,6 +175,7 @@ private:
 
 	SPI * spi;
 	GPMC * gpmc;
+	SensorSCI sci;
 };
 
 #endif // LUX1310_H
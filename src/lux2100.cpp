@@ -30,6 +30,7 @@
 
 #include "types.h"
 #include "lux2100.h"
+#include "calibrationStore.h"
 
 #include <QSettings>
 
@@ -58,12 +59,15 @@ CameraErrortype LUX2100::init(GPMC * gpmc_inst)
 	if(SUCCESS != retVal)
 		return retVal;
 
-	dacCSFD = open("/sys/class/gpio/gpio33/value", O_WRONLY);
-	if (-1 == dacCSFD)
+	if (SUCCESS != dacCS.Open(IMAGE_SENSOR_DAC_CS_GPIO))
 		return LUX1310_FILE_ERROR;
 
 	gpmc = gpmc_inst;
 	wtlist = lux2100wt;
+	sci.init(gpmc);
+	sci.setResetRegister(0x7E);
+	sci.setBankRegister(0x04);		//0 for the sensor registers, 1 for the datapath registers
+	sci.setVolatile(0x0A, 1);		//Starts ADC offset calibration
 
 	retVal = initSensor();
 	//mem problem before this
@@ -106,90 +110,29 @@ CameraErrortype LUX2100::initSensor()
 
 void LUX2100::SCIWrite(UInt8 address, UInt16 data)
 {
-	int i = 0;
-
 	//qDebug() << "sci write" << data;
 
-	//Clear RW and reset FIFO
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, 0x8000 | (gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & ~SENSOR_SCI_CONTROL_RW_MASK));
-
-	//Set up address, transfer length and put data into FIFO
-	gpmc->write16(SENSOR_SCI_ADDRESS_ADDR, address);
-	gpmc->write16(SENSOR_SCI_DATALEN_ADDR, 2);
-	gpmc->write16(SENSOR_SCI_FIFO_WR_ADDR_ADDR, data >> 8);
-	gpmc->write16(SENSOR_SCI_FIFO_WR_ADDR_ADDR, data & 0xFF);
-
-	//Start transfer
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, gpmc->read16(SENSOR_SCI_CONTROL_ADDR) | SENSOR_SCI_CONTROL_RUN_MASK);
-
-	int first = gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK;
-	//Wait for completion
-	while(gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK)
-		i++;
-
 #ifdef SCI_DEBUG_PRINTS
-	if(!first && i != 0)
-		qDebug() << "First busy was missed, address:" << address;
-	else if(i == 0)
-		qDebug() << "No busy detected, something is probably very wrong, address:" << address;
+	sci.write(address, data, true);
 
 	int readback = SCIRead(address);
 	int readback2 = SCIRead(address);
 	int readback3 = SCIRead(address);
 	if(data != readback)
 		qDebug() << "SCI readback wrong, address: " << address << " expected: " << data << " got: " << readback << readback2 << readback3;
+#else
+	sci.write(address, data);
 #endif
 }
 
 void LUX2100::SCIWriteBuf(UInt8 address, const UInt8 * data, UInt32 dataLen)
 {
-	//Clear RW and reset FIFO
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, 0x8000 | (gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & ~SENSOR_SCI_CONTROL_RW_MASK));
-
-	//Set up address, transfer length and put data into FIFO
-	gpmc->write16(SENSOR_SCI_ADDRESS_ADDR, address);
-	gpmc->write16(SENSOR_SCI_DATALEN_ADDR, dataLen);
-	for(UInt32 i = 0; i < dataLen; i++)
-		gpmc->write16(SENSOR_SCI_FIFO_WR_ADDR_ADDR, data[i]);
-
-	//Start transfer
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, gpmc->read16(SENSOR_SCI_CONTROL_ADDR) | SENSOR_SCI_CONTROL_RUN_MASK);
-
-	//Wait for completion
-	while(gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK);
+	sci.writeBuf(address, data, dataLen);
 }
 
 UInt16 LUX2100::SCIRead(UInt8 address)
 {
-	int i = 0;
-
-	//Set RW
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, gpmc->read16(SENSOR_SCI_CONTROL_ADDR) | SENSOR_SCI_CONTROL_RW_MASK);
-
-	//Set up address and transfer length
-	gpmc->write16(SENSOR_SCI_ADDRESS_ADDR, address);
-	gpmc->write16(SENSOR_SCI_DATALEN_ADDR, 2);
-
-	//Start transfer
-	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, gpmc->read16(SENSOR_SCI_CONTROL_ADDR) | SENSOR_SCI_CONTROL_RUN_MASK);
-
-	int first = gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK;
-	//Wait for completion
-	while(gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK)
-		i++;
-
-#ifdef SCI_DEBUG_PRINTS
-	if(!first && i != 0)
-		qDebug() << "Read First busy was missed, address:" << address;
-	else if(i == 0)
-		qDebug() << "Read No busy detected, something is probably very wrong, address:" << address;
-#endif
-
-	//Wait for completion
-//	while(gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK)
-//		count++;
-	delayms(1);
-	return gpmc->read16(SENSOR_SCI_READ_DATA_ADDR);
+	return sci.read(address);
 }
 
 CameraErrortype LUX2100::autoPhaseCal(void)
@@ -218,6 +161,7 @@ Int32 LUX2100::seqOnOff(bool on)
 void LUX2100::setReset(bool reset)
 {
 		gpmc->write16(IMAGE_SENSOR_CONTROL_ADDR, (gpmc->read16(IMAGE_SENSOR_CONTROL_ADDR) & ~IMAGE_SENSOR_RESET_MASK) | (reset ? IMAGE_SENSOR_RESET_MASK : 0));
+		if (reset) sci.invalidate();
 }
 
 void LUX2100::setClkPhase(UInt8 phase)
@@ -260,6 +204,7 @@ void LUX2100::setResolution(FrameGeometry *size)
 	UInt32 vLastRow = LUX2100_MAX_V_RES + LUX2100_LOW_BOUNDARY_ROWS + LUX2100_HIGH_BOUNDARY_ROWS + LUX2100_HIGH_DARK_ROWS;
 
 	/* Everything is x2 because it's really a binned 4K sensor. */
+	sci.begin();
 	SCIWrite(0x06, (LUX2100_LEFT_DARK_COLUMNS + hStartBlocks * LUX2100_HRES_INCREMENT) * 2);
 	SCIWrite(0x07, (LUX2100_LEFT_DARK_COLUMNS + hEndblocks * LUX2100_HRES_INCREMENT) * 2 - 1);
 	SCIWrite(0x08, (LUX2100_LOW_BOUNDARY_ROWS + size->vOffset) * 2);
@@ -268,6 +213,7 @@ void LUX2100::setResolution(FrameGeometry *size)
 		SCIWrite(0x2A, (vLastRow - size->vDarkRows) * 2);
 	}
 	SCIWrite(0x2B, size->vDarkRows * 2);
+	sci.commit();
 
 	memcpy(&currentRes, size, sizeof(currentRes));
 }
@@ -331,26 +277,50 @@ UInt32 LUX2100::getActualFramePeriod(double targetPeriod, FrameGeometry *size)
 	return within(clocks, minPeriod, maxPeriod);
 }
 
-void LUX2100::updateWavetableSetting(void)
+/* Search for the longest wavetable that it shorter than the frame period. */
+const lux2100wavetab_t *LUX2100::selectWavetable(UInt32 period, FrameGeometry *frameSize)
 {
-	/* Search for the longest wavetable that it shorter than the current frame period. */
 	const lux2100wavetab_t *wt = NULL;
-	int i;
-
-	qDebug() << "Selecting wavetable for period of" << currentPeriod;
 
-	for (i = 0; wtlist[i] != NULL; i++) {
+	for (int i = 0; wtlist[i] != NULL; i++) {
 		wt = wtlist[i];
-		if (currentPeriod >= getMinWavetablePeriod(&currentRes, wt->clocks)) break;
+		if (period >= getMinWavetablePeriod(frameSize, wt->clocks)) break;
 	}
+	return wt;
+}
+
+/* A new period only needs the sensor stopped if it needs a different wavetable. */
+bool LUX2100::isLivePeriodChange(UInt32 period, FrameGeometry *frameSize)
+{
+	UInt32 minPeriod = getMinFramePeriod(frameSize);
+	UInt32 maxPeriod = LUX2100_MAX_SLAVE_PERIOD;
+	const lux2100wavetab_t *wt = selectWavetable(within(period, minPeriod, maxPeriod), frameSize);
+
+	return wt && (wt->clocks == wavetableSize);
+}
+
+void LUX2100::updateWavetableSetting(void)
+{
+	const lux2100wavetab_t *wt;
+
+	qDebug() << "Selecting wavetable for period of" << currentPeriod;
+	wt = selectWavetable(currentPeriod, &currentRes);
 
 	/* Update the wavetable. */
 	if (wt) {
-		SCIWrite(0x01, 0x0010);         //Disable internal timing engine
-		SCIWrite(0x34, wt->clocks);		//non-overlapping readout delay
-		//SCIWrite(0x7A, wt->clocks);     //wavetable size ???
-		SCIWriteBuf(0x7F, wt->wavetab, wt->length);
-		SCIWrite(0x01, 0x0011);			// enable the internal timing engine
+		if (sci.matchesBuf(0x7F, wt->wavetab, wt->length)) {
+			/* Already loaded, so leave the timing engine running. */
+			SCIWrite(0x34, wt->clocks);
+		}
+		else {
+			sci.begin();
+			SCIWrite(0x01, 0x0010);         //Disable internal timing engine
+			SCIWrite(0x34, wt->clocks);		//non-overlapping readout delay
+			//SCIWrite(0x7A, wt->clocks);     //wavetable size ???
+			SCIWriteBuf(0x7F, wt->wavetab, wt->length);
+			SCIWrite(0x01, 0x0011);			// enable the internal timing engine
+			sci.commit();
+		}
 
 		wavetableSize = wt->clocks;
 		gpmc->write16(SENSOR_MAGIC_START_DELAY_ADDR, wt->abnDelay);
@@ -521,8 +491,7 @@ int LUX2100::writeDACSPI(UInt16 data0, UInt16 data1)
 
 void LUX2100::setDACCS(bool on)
 {
-	lseek(dacCSFD, 0, SEEK_SET);
-	write(dacCSFD, on ? "1" : "0", 1);
+	dacCS.Set(on);
 }
 
 unsigned int LUX2100::enableAnalogTestMode(void)
@@ -608,7 +577,21 @@ void LUX2100::adcOffsetTraining(FrameGeometry *frameSize, UInt32 address, UInt32
 	SCIWrite(0x04, 0x0000); // switch back to sensor register space
 }
 #else
-void LUX2100::offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, UInt32 address, UInt32 framesToAverage, int iter)
+/* LUX2100::offsetCorrectionIteration
+ *
+ * Performs one step of ADC offset training on the active ADC channels. The
+ * first iteration of a cold start makes a coarse initial guess.
+ *
+ * geometry:		Frame geometry being recorded
+ * offsets:			ADC offsets to update
+ * address:			Address of the first frame in acquisition memory
+ * framesToAverage:	Number of frames to sample
+ * iter:			Iteration number, zero for the coarse initial guess
+ * activeMask:		Bitmask of the ADC channels to train
+ *
+ * returns: Bitmask of the channels whose offset changed by no more than LUX2100_OFFSET_CONVERGED
+ **/
+UInt32 LUX2100::offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, UInt32 address, UInt32 framesToAverage, int iter, UInt32 activeMask)
 {
 	//UInt32 numRows = geometry->vDarkRows + geometry->vRes;
 	UInt32 numRows = 1;
@@ -616,12 +599,15 @@ void LUX2100::offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, U
 	UInt32 samples = (numRows * framesToAverage * geometry->hRes / LUX2100_HRES_INCREMENT);
 	UInt32 adcAverage[LUX2100_HRES_INCREMENT];
 	UInt32 adcStdDev[LUX2100_HRES_INCREMENT];
+	UInt64 adcSumSq[LUX2100_HRES_INCREMENT];
+	UInt32 convergedMask = 0;
 
 	UInt32 *pxbuffer = (UInt32 *)malloc(rowSize * numRows * framesToAverage);
+	UInt16 *pxunpacked = (UInt16 *)malloc(numRows * framesToAverage * geometry->hRes * sizeof(UInt16));
 
 	for(int i = 0; i < LUX2100_HRES_INCREMENT; i++) {
 		adcAverage[i] = 0;
-		adcStdDev[i] = 0;
+		adcSumSq[i] = 0;
 	}
 	/* Read out the black regions from all frames. */
 	for (int i = 0; i < framesToAverage; i++) {
@@ -629,30 +615,33 @@ void LUX2100::offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, U
 		gpmc->readAcqMem(rowbuffer, address, rowSize * numRows);
 		address += gpmc->read32(SEQ_FRAME_SIZE_ADDR);
 	}
+	unpackPixelBuf12(pxunpacked, pxbuffer, numRows * framesToAverage * geometry->hRes);
 
-	/* Find the per-ADC averages and standard deviation */
+	/* Find the per-ADC averages and standard deviation in a single pass, using exact integer sums. */
 	for (int row = 0; row < (numRows * framesToAverage); row++) {
+		const UInt16 *px = pxunpacked + row * geometry->hRes;
 		for (int col = 0; col < geometry->hRes; col++) {
-			adcAverage[col % LUX2100_HRES_INCREMENT] += readPixelBuf12((UInt8 *)pxbuffer, row * geometry->hRes + col);
-		}
-	}
-	for (int row = 0; row < (numRows * framesToAverage); row++) {
-		for (int col = 0; col < geometry->hRes; col++) {
-			UInt16 pix = readPixelBuf12((UInt8 *)pxbuffer, row * geometry->hRes + col);
-			UInt16 avg = adcAverage[col % LUX2100_HRES_INCREMENT] / samples;
-			adcStdDev[col % LUX2100_HRES_INCREMENT] += (pix - avg) * (pix - avg);
+			UInt32 pix = px[col];
+			adcAverage[col % LUX2100_HRES_INCREMENT] += pix;
+			adcSumSq[col % LUX2100_HRES_INCREMENT] += pix * pix;
 		}
 	}
 	for(int col = 0; col < LUX2100_HRES_INCREMENT; col++) {
-		adcStdDev[col] = sqrt(adcStdDev[col] / (samples - 1));
+		UInt64 sumSqDev = adcSumSq[col] - ((UInt64)adcAverage[col] * adcAverage[col]) / samples;
+		adcStdDev[col] = sqrt((double)sumSqDev / (samples - 1));
 		adcAverage[col] /= samples;
 	}
 	free(pxbuffer);
+	free(pxunpacked);
 
 	/* Train the ADC for a target of: Average = Footroom + StandardDeviation */
 	for(int col = 0; col < LUX2100_HRES_INCREMENT; col++) {
 		UInt16 avg = adcAverage[col];
 		UInt16 dev = adcStdDev[col];
+		int prev = offsets[col];
+
+		if (!(activeMask & (1U << col))) continue;
+
 		if (iter == 0) {
 			offsets[col] = -(avg - dev - 32) * 3;
 		} else {
@@ -661,7 +650,12 @@ void LUX2100::offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, U
 			offsets[col] = offsets[col] - (avg - dev - 64) / 2;
 		}
 		offsets[col] = within(offsets[col], -1023, 1023);
-		setADCOffset(col, offsets[col]);
+		if ((iter != 0) && (abs(offsets[col] - prev) <= LUX2100_OFFSET_CONVERGED)) {
+			convergedMask |= (1U << col);
+		}
+		if (offsets[col] != prev) {
+			setADCOffset(col, offsets[col]);
+		}
 	}
 
 	char debugstr[8*LUX2100_HRES_INCREMENT];
@@ -686,76 +680,85 @@ void LUX2100::offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, U
 		debuglen += sprintf(debugstr + debuglen, " %+4d", offsets[col]);
 	}
 	qDebug("ADC Offsets:%s", debugstr);
+	return convergedMask;
 }
 
+/* LUX2100::adcOffsetTraining
+ *
+ * Trains the ADC offsets for the current gain and wavetable. Stored offsets
+ * are used as a warm start in place of the coarse initial guess, and each
+ * channel stops training once its offset settles.
+ **/
 void LUX2100::adcOffsetTraining(FrameGeometry *size, UInt32 address, UInt32 numFrames)
 {
 	Int32 offsets[LUX2100_HRES_INCREMENT];
+	int converged[LUX2100_HRES_INCREMENT];
+	Int16 off16[LUX2100_HRES_INCREMENT];
+	UInt32 activeMask = 0xFFFFFFFF;
 	struct timespec tRefresh;
 	std::string filename = getFilename("cal/lux2100Offsets", ".bin");
-	FILE *fp;
+	QString storedName = getADCOffsetsFilename().c_str();
 	unsigned int iterations = 32;
+	unsigned int i = 0;
+	char debugstr[8*LUX2100_HRES_INCREMENT];
+	int debuglen = 0;
 
 	tRefresh.tv_sec = 0;
 	tRefresh.tv_nsec = ((numFrames+10) * currentPeriod * 1000000000ULL) / LUX2100_TIMING_CLOCK_FREQ;
 
-	/* Clear out the ADC Offsets. */
-	for (int i = 0; i < LUX2100_HRES_INCREMENT; i++) {
-		offsets[i] = 0;
-		setADCOffset(i, 0);
+	/* Warm start from the stored ADC offsets, or clear them out for a cold start. */
+	if (CalibrationStore::instance()->read(storedName, off16, sizeof(off16)) == SUCCESS) {
+		i = 1;
+	} else {
+		memset(off16, 0, sizeof(off16));
+	}
+	for (int col = 0; col < LUX2100_HRES_INCREMENT; col++) {
+		offsets[col] = off16[col];
+		converged[col] = iterations;
+		setADCOffset(col, offsets[col]);
 	}
 
-	/* Tune the ADC offset calibration. */
-	for (int i = 0; i < iterations; i++) {
+	/* Tune the ADC offset calibration until every channel has settled. */
+	for (; (i < iterations) && activeMask; i++) {
 		nanosleep(&tRefresh, NULL);
-		offsetCorrectionIteration(size, offsets, address, numFrames, i);
+		UInt32 doneMask = offsetCorrectionIteration(size, offsets, address, numFrames, i, activeMask);
+		for (int col = 0; col < LUX2100_HRES_INCREMENT; col++) {
+			if (doneMask & (1U << col)) converged[col] = i + 1;
+		}
+		activeMask &= ~doneMask;
 	}
 
+	for (int col=0; col < LUX2100_HRES_INCREMENT; col++) {
+		debuglen += sprintf(debugstr + debuglen, " %4d", converged[col]);
+	}
+	qDebug("ADC offsets settled after %u iterations, per channel:%s", i, debugstr);
 	qDebug("Writing ADC offsets to %s", filename.c_str());
-	fp = fopen(filename.c_str(), "wb");
-	if (fp) {
-		Int16 off16[LUX2100_HRES_INCREMENT];
-		for (int col = 0; col < LUX2100_HRES_INCREMENT; col++) {
-			off16[col] = offsets[col];
-		}
-		fwrite(off16, sizeof(off16[0]), LUX2100_HRES_INCREMENT, fp);
-		fclose(fp);
+
+	for (int col = 0; col < LUX2100_HRES_INCREMENT; col++) {
+		off16[col] = offsets[col];
 	}
+	CalibrationStore::instance()->write(QString(filename.c_str()), off16, sizeof(off16), CAL_TYPE_ADC_OFFSETS, gain, size);
 }
 #endif
 
 
+std::string LUX2100::getADCOffsetsFilename(void)
+{
+	return std::string("cal:lux2100Offsets") + getFilename("", ".bin");
+}
+
 Int32 LUX2100::loadADCOffsetsFromFile(FrameGeometry *size)
 {
 	Int16 offsets[LUX2100_HRES_INCREMENT];
 
 	QString filename;
 
-	//Generate the filename for this particular resolution and offset
-	filename.sprintf("cal:lux2100Offsets");
-
-	std::string fn;
-	fn = getFilename("", ".bin");
-	filename.append(fn.c_str());
-	QFileInfo adcOffsetsFile(filename);
-	if (adcOffsetsFile.exists() && adcOffsetsFile.isFile())
-		fn = adcOffsetsFile.absoluteFilePath().toLocal8Bit().constData();
-	else
-		return CAMERA_FILE_NOT_FOUND;
-
-	qDebug() << "Loading ADC offsets from" << fn.c_str();
-
-	//If the offsets file exists, read it in
-	if( access( fn.c_str(), R_OK ) == -1 )
-		return CAMERA_FILE_NOT_FOUND;
-
-	FILE * fp;
-	fp = fopen(fn.c_str(), "rb");
-	if(!fp)
-		return CAMERA_FILE_ERROR;
+	//Generate the filename for this particular gain and wavetable
+	filename = getADCOffsetsFilename().c_str();
 
-	fread(offsets, sizeof(offsets[0]), LUX2100_HRES_INCREMENT, fp);
-	fclose(fp);
+	Int32 ret = CalibrationStore::instance()->read(filename, offsets, sizeof(offsets));
+	if (ret != SUCCESS)
+		return ret;
 
 	//Write the values into the sensor
 	char debugstr[8*LUX2100_HRES_INCREMENT];
@@ -783,6 +786,7 @@ std::string LUX2100::getFilename(const char * filename, const char * extension)
 
 Int32 LUX2100::setGain(UInt32 gainSetting)
 {
+	sci.begin();
 	switch(gainSetting)
 	{
 	case 1:
@@ -819,8 +823,10 @@ Int32 LUX2100::setGain(UInt32 gainSetting)
 	break;
 
 	default:
+		sci.commit();
 		return CAMERA_INVALID_SETTINGS;
 	}
+	sci.commit();
 
 	gain = gainSetting;
 	return SUCCESS;
@@ -22,6 +22,7 @@
 #include "types.h"
 #include "spi.h"
 #include "gpmc.h"
+#include "sensorSCI.h"
 #include <string>
 
 #define LUX2100_HRES_INCREMENT 32
@@ -41,6 +42,7 @@
 
 #define LUX2100_GAIN_CORRECTION_MIN 0.999
 #define LUX2100_GAIN_CORRECTION_MAX 1.2
+#define LUX2100_OFFSET_CONVERGED	1	//ADC offset training stops once a channel moves by no more than this
 
 /* Addressable image sensor boundary regions */
 #define LUX2100_LOW_BOUNDARY_ROWS	8
@@ -139,6 +141,7 @@ public:
 	UInt32 getActualFramePeriod(double target, FrameGeometry *frameSize);
 	UInt32 getFramePeriod(void);
 	UInt32 setFramePeriod(UInt32 period, FrameGeometry *frameSize);
+	bool isLivePeriodChange(UInt32 period, FrameGeometry *frameSize);
 
 	/* Exposure Timing Functions */
 	UInt32 getIntegrationClock(void) { return LUX2100_TIMING_CLOCK_FREQ; }
@@ -158,6 +161,7 @@ public:
 	void adcOffsetTraining(FrameGeometry *frameSize, UInt32 address, UInt32 numFrames);
 	Int32 loadADCOffsetsFromFile(FrameGeometry *size);
 	std::string getFilename(const char * filename, const char * extension);
+	std::string getADCOffsetsFilename(void);
 
 protected:
 	CameraErrortype initSensor();
@@ -179,14 +183,15 @@ protected:
 	Int32 doAutoADCOffsetCalibration(void);
 	Int32 initLUX2100(void);
 	void setADCOffset(UInt8 channel, Int16 offset);
-	void offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, UInt32 address, UInt32 framesToAverage, int iter);
+	UInt32 offsetCorrectionIteration(FrameGeometry *geometry, int *offsets, UInt32 address, UInt32 framesToAverage, int iter, UInt32 activeMask);
 	void updateWavetableSetting(void);
+	const lux2100wavetab_t *selectWavetable(UInt32 period, FrameGeometry *frameSize);
 	UInt32 getMinWavetablePeriod(FrameGeometry *frameSize, UInt32 wtSize);
 
 	FrameGeometry currentRes;
 	UInt32 currentPeriod;
 	UInt32 currentExposure;
-	Int32 dacCSFD;
+	SPIChipSelect dacCS;
 	UInt32 wavetableSize;
 	UInt32 gain;
 	UInt32 startDelaySensorClocks;
@@ -194,6 +199,7 @@ protected:
 
 	SPI * spi;
 	GPMC * gpmc;
+	SensorSCI sci;
 	const lux2100wavetab_t **wtlist;
 };
 
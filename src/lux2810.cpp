@@ -124,12 +124,10 @@ CameraErrortype LUX2810::init(GPMC * gpmc_inst)
 	if(SUCCESS != retVal)
 		return retVal;
 
-	dacCSFD = open("/sys/class/gpio/gpio33/value", O_WRONLY);
-	if (-1 == dacCSFD)
+	if (SUCCESS != dacCS.Open(IMAGE_SENSOR_DAC_CS_GPIO))
 		return LUX1310_FILE_ERROR;
 
-	sensorCSFD = open("/sys/class/gpio/gpio34/value", O_WRONLY);
-	if (-1 == dacCSFD)
+	if (SUCCESS != sensorCS.Open(IMAGE_SENSOR_CS_GPIO))
 		return LUX1310_FILE_ERROR;
 
 	gpmc = gpmc_inst;
@@ -489,14 +487,12 @@ int LUX2810::readSensorSPI(UInt16 addr, UInt16 & data)
 
 void LUX2810::setDACCS(bool on)
 {
-	lseek(dacCSFD, 0, SEEK_SET);
-	write(dacCSFD, on ? "1" : "0", 1);
+	dacCS.Set(on);
 }
 
 void LUX2810::setSensorCS(bool on)
 {
-    lseek(sensorCSFD, 0, SEEK_SET);
-    write(sensorCSFD, on ? "1" : "0", 1);
+    sensorCS.Set(on);
 }
 
 int LUX2810::LUX2810RegWrite(UInt16 addr, UInt16 data)
@@ -509,16 +505,26 @@ int LUX2810::LUX2810RegRead(UInt16 addr, UInt16 & data)
     return readSensorSPI((addr & 0xFF) << 4, data);
 }
 
+//Writes the wavetable entries, each one a register write of the address in the upper 16 bits and data in the lower 16 bits
 int LUX2810::LUX2810LoadWavetable(UInt32 * wavetable, UInt32 length)
 {
+    UInt8 *tx = new UInt8[length * 4];
     int retVal;
+
+    //Pack the whole table in writeSensorSPI's format, and send it in one pass
     for(int i = 0; i < length; i++)
     {
-        retVal = writeSensorSPI((wavetable[i] >> 16) & 0x7FFF, wavetable[i] & 0xFFFF);
-        if(SUCCESS != retVal)
-            return retVal;
+        UInt16 addr = (wavetable[i] >> 16) & 0x7FFF;
+        UInt16 data = wavetable[i] & 0xFFFF;
+
+        tx[i*4 + 3] = data >> 8;
+        tx[i*4 + 2] = data & 0xFF;
+        tx[i*4 + 1] = addr >> 8;
+        tx[i*4 + 0] = addr & 0xFF;
     }
-    return SUCCESS;
+    retVal = spi->TransferWords(&sensorCS, tx, 4, length, false, false);
+    delete[] tx;
+    return retVal;
 }
 
 unsigned int LUX2810::enableAnalogTestMode(void)
@@ -195,8 +195,8 @@ private:
 	FrameGeometry currentRes;
 	UInt32 currentPeriod;
 	UInt32 currentExposure;
-	Int32 dacCSFD;
-	Int32 sensorCSFD;
+	SPIChipSelect dacCS;
+	SPIChipSelect sensorCS;
 	UInt32 wavetableSize;
 	UInt32 gain;
 	UInt32 startDelaySensorClocks;
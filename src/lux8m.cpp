@@ -180,8 +180,7 @@ CameraErrortype LUX8M::init(GPMC * gpmc_inst)
 	if(SUCCESS != retVal)
 		return retVal;
 
-	dacCSFD = open("/sys/class/gpio/gpio33/value", O_WRONLY);
-	if (-1 == dacCSFD)
+	if (SUCCESS != dacCS.Open(IMAGE_SENSOR_DAC_CS_GPIO))
 		return LUX1310_FILE_ERROR;
 
 	gpmc = gpmc_inst;
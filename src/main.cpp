@@ -51,23 +51,39 @@ extern "C" {
 #include "util.h"
 #include "dm8148PWM.h"
 #include <QDir>
+#include <QTimer>
+#include <QSocketNotifier>
 
 #include "defines.h"
+#include "settingsCache.h"
+#include "bootProfiler.h"
 
 #include "myinputpanelcontext.h"
 
 volatile sig_atomic_t done = 0;
 
+/* Written by the SIGTERM handler, to wake the event loop. */
+static int termPipe[2] = {-1, -1};
+
+/*
+ * Only async-signal-safe calls are allowed here, so the event loop is woken
+ * to quit, and the settings are written as the application quits.
+ */
 void term(int signum)
 {
-	QSettings settings;
-	settings.sync();
-	qApp->exit();
+	char c = 1;
+
+	done = 1;
+	if (write(termPipe[1], &c, 1) < 0) {
+		/* Nothing can be done about it from a signal handler. */
+	}
 }
 
 int main(int argc, char *argv[])
 {
+	BootSpan appSpan("Qt startup");
 	QApplication a(argc, argv);
+	appSpan.end();
 	
 	QCoreApplication::setOrganizationName("KronTech");
 	QCoreApplication::setOrganizationDomain("krontech.ca");
@@ -94,6 +110,11 @@ int main(int argc, char *argv[])
 	checkAndCreateDir("userFPN");
 
 	//Set up SIGTERM handler to cleanly exit the application
+	if (pipe(termPipe) == 0) {
+		fcntl(termPipe[1], F_SETFL, O_NONBLOCK);
+		QSocketNotifier *termNotifier = new QSocketNotifier(termPipe[0], QSocketNotifier::Read, &a);
+		QObject::connect(termNotifier, SIGNAL(activated(int)), &a, SLOT(quit()));
+	}
 	struct sigaction action;
 	memset(&action, 0, sizeof(struct sigaction));
 	action.sa_handler = term;
@@ -154,12 +175,16 @@ int main(int argc, char *argv[])
 	CamMainWindow w;
 	w.setWindowFlags(Qt::FramelessWindowHint);
 
-	QSettings appSettings;
-	int displayPosition = (appSettings.value("camera/ButtonsOnLeft", false)).toBool() ? 0 : 600;
+	int displayPosition = SettingsCache::instance()->getBool("camera/ButtonsOnLeft", false) ? 0 : 600;
 	w.move(displayPosition,0);
 
 //	MainWindow w;
 	w.show();
+
+	/* The camera is ready once the event loop starts, so write out the boot timeline then. */
+	QTimer::singleShot(0, BootProfiler::instance(), SLOT(finish()));
 	
-	return a.exec();
+	int ret = a.exec();
+	SettingsCache::instance()->sync();
+	return ret;
 }
@@ -48,59 +48,74 @@ void PlaybackSlider::setHighlightRegion(int start, int end)
 	repaint();
 }
 
-void PlaybackSlider::paintEvent(QPaintEvent *ev) {
-	QStyleOptionSlider opt;
+/* PlaybackSlider::regionRect
+ *
+ * Computes the rectangle highlighting a range of frames beside the groove.
+ *
+ * groove:		Rectangle of the slider groove
+ * startFrame:	First frame of the region
+ * endFrame:	Last frame of the region
+ *
+ * returns: Rectangle to highlight
+ **/
+QRect PlaybackSlider::regionRect(const QRect &groove, int startFrame, int endFrame)
+{
 	int start;
 	int end;
-	initStyleOption(&opt);
-	
-	QSlider::paintEvent(ev);
-
-	opt.subControls = QStyle::SC_SliderGroove | QStyle::SC_SliderHandle;
-	if (tickPosition() != NoTicks) {
-		opt.subControls |= QStyle::SC_SliderTickmarks;
-	}
-
-	QRect groove_rect = style()->subControlRect(QStyle::CC_Slider, &opt, QStyle::SC_SliderGroove, this);
 
 	//Reverse the bar if the slider is set to reverse direction
 	if(!QSlider::invertedAppearance())//slider is not inverted, and position 0 is at top of screen
 	{
-		start = (groove_rect.height() - HANDLE_HEIGHT) * (double)(QSlider::maximum() - highlightRegionEndFrame) / QSlider::maximum();
-		end = (groove_rect.height() - HANDLE_HEIGHT) * (double)(QSlider::maximum() - highlightRegionStartFrame) / QSlider::maximum();
+		start = (groove.height() - HANDLE_HEIGHT) * (double)(QSlider::maximum() - endFrame) / QSlider::maximum();
+		end = (groove.height() - HANDLE_HEIGHT) * (double)(QSlider::maximum() - startFrame) / QSlider::maximum();
 		//Subtract the handle height because the start or end region should line up with the middle of the handle,
 		//and the middle if the handle cannot be moved to the very top or bottom of the screen
 	}
 	else
 	{
-		start = (groove_rect.height() - HANDLE_HEIGHT) * (double)highlightRegionStartFrame / QSlider::maximum();
-		end = (groove_rect.height() - HANDLE_HEIGHT) * (double)highlightRegionEndFrame / QSlider::maximum();
+		start = (groove.height() - HANDLE_HEIGHT) * (double)startFrame / QSlider::maximum();
+		end = (groove.height() - HANDLE_HEIGHT) * (double)endFrame / QSlider::maximum();
 	}
 
+	//specify (left, top, width, height) of the rectangle to highlight
+	return QRect(groove.left() + groove.width(),
+				 HANDLE_HEIGHT/2 + end,
+				 groove.width() + 2, //+ 2 pixels so the highlight will actually be visible instead of just covered up by the slider bar
+				 start - end);
+}
+
+void PlaybackSlider::paintEvent(QPaintEvent *ev) {
+	QStyleOptionSlider opt;
+	initStyleOption(&opt);
+	
+	QSlider::paintEvent(ev);
 
+	opt.subControls = QStyle::SC_SliderGroove | QStyle::SC_SliderHandle;
+	if (tickPosition() != NoTicks) {
+		opt.subControls |= QStyle::SC_SliderTickmarks;
+	}
 
-	//specify (left, top, width, height) of the rectangle to highlight
-	newSaveRegion.setRect(groove_rect.left() + groove_rect.width(),
-						  HANDLE_HEIGHT/2 + end,
-						  groove_rect.width() + 2, //+ 2 pixels so the highlight will actually be visible instead of just covered up by the slider bar
-						  start - end);
+	QRect groove_rect = style()->subControlRect(QStyle::CC_Slider, &opt, QStyle::SC_SliderGroove, this);
 	QPainter painter(this);
 
 	currentColorIndex = 0;
-	foreach (QRect regionInList, previouslySavedRegions) {
+	for (int i = 0; i < regionList.count(); i++) {
+		QRect regionInList = regionRect(groove_rect, regionList[i].first, regionList[i].second);
 		painter.fillRect(regionInList, QBrush(*(colorArray + (currentColorIndex % 9))));
 		currentColorIndex++;
 	}
 
+	QRect newSaveRegion = regionRect(groove_rect, highlightRegionStartFrame, highlightRegionEndFrame);
 	painter.fillRect(newSaveRegion, QBrush(*(colorArray + (currentColorIndex % 9))));
 }
 
 void PlaybackSlider::appendRegionToList(){
-	previouslySavedRegions.append(newSaveRegion);
+	regionList.append(qMakePair(highlightRegionStartFrame, highlightRegionEndFrame));
+	repaint();
 }
 
 void PlaybackSlider::removeLastRegionFromList()
 {
-	if(previouslySavedRegions.isEmpty()) return; // Without this check, if removeLast() is called when the list is empty, qt will crash with a "!isEmpty()" assert.
-	previouslySavedRegions.removeLast();
+	if(regionList.isEmpty()) return; // Without this check, if removeLast() is called when the list is empty, qt will crash with a "!isEmpty()" assert.
+	regionList.removeLast();
 }
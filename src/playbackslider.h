@@ -19,6 +19,8 @@
 
 
 #include <QSlider>
+#include <QList>
+#include <QPair>
 
 class PlaybackSlider : public QSlider
 {
@@ -29,14 +31,16 @@ public:
 	void setHighlightRegion(int start, int end);
 	void appendRegionToList();
 	void removeLastRegionFromList();
+	const QList<QPair<int, int> > &getRegionList() { return regionList; }
 protected:
 	void paintEvent(QPaintEvent *ev);
 
 private:
+	QRect regionRect(const QRect &groove, int startFrame, int endFrame);
+
 	int highlightRegionStartFrame = 0;
 	int highlightRegionEndFrame = 0;
-	QList<QRect> previouslySavedRegions;
-	QRect newSaveRegion;
+	QList<QPair<int, int> > regionList;	/* Start and end frames of each region appended to the list. */
 	unsigned int currentColorIndex;
 	QColor colorArray[9];
 };
@@ -16,11 +16,12 @@
  ****************************************************************************/
 #include <time.h>
 #include <sys/stat.h>
-#include <sys/statvfs.h>
 #include <sys/vfs.h>
 
 #include "util.h"
 #include "camera.h"
+#include "storage.h"
+#include "settingsCache.h"
 
 #include "savesettingswindow.h"
 #include "playbackwindow.h"
@@ -34,6 +35,28 @@
 #define USE_AUTONAME_FOR_SAVE ""
 #define MIN_FREE_SPACE 20000000
 
+/* Formats a duration for display, such as "4m 05s". */
+static QString formatDuration(double seconds)
+{
+	UInt32 secs = (UInt32)(seconds + 0.5);
+	if (secs >= 3600) {
+		return QString("%1h %2m").arg(secs / 3600).arg((secs / 60) % 60, 2, 10, QChar('0'));
+	}
+	if (secs >= 60) {
+		return QString("%1m %2s").arg(secs / 60).arg(secs % 60, 2, 10, QChar('0'));
+	}
+	return QString("%1s").arg(secs);
+}
+
+/* Formats a size in bytes for display, such as "2.1 GB". */
+static QString formatSize(UInt64 bytes)
+{
+	if (bytes >= 1000000000ULL) {
+		return QString("%1 GB").arg(bytes / 1e9, 0, 'f', 1);
+	}
+	return QString("%1 MB").arg(bytes / 1e6, 0, 'f', 0);
+}
+
 playbackWindow::playbackWindow(QWidget *parent, Camera * cameraInst, bool autosave) :
 	QWidget(parent),
 	ui(new Ui::playbackWindow)
@@ -47,9 +70,10 @@ playbackWindow::playbackWindow(QWidget *parent, Camera * cameraInst, bool autosa
 	autoSaveFlag = autosave;
 	autoRecordFlag = camera->get_autoRecord();
 	this->move(camera->ButtonsOnLeft? 0:600, 0);
-	saveDoneTimer = NULL;
 	saveAborted = false;
 	saveAbortedAutomatically = false;
+	memset(&saveEstimate, 0, sizeof(saveEstimate));
+	saveSecondsRemaining = 0;
 	
 	camera->vinst->getStatus(&vStatus);
 	
@@ -61,6 +85,13 @@ playbackWindow::playbackWindow(QWidget *parent, Camera * cameraInst, bool autosa
 	playLoop = false;
 	totalFrames = vStatus.totalFrames;
 
+	/* An interrupted save can only be resumed while its recording is still in memory. */
+	saveQueue = new SaveQueue(camera->vinst);
+	queuedRegionCount = 0;
+	if (!saveQueue->isEmpty() && (!camera->recordingData.hasBeenSaved || !saveQueue->matchesRecording(totalFrames, camera->recordingData.stopTime))) {
+		saveQueue->clear();
+	}
+
 	sw = new StatusWindow;
 
 	connect(ui->cmdClose, SIGNAL(clicked()), this, SLOT(close()));
@@ -68,7 +99,7 @@ playbackWindow::playbackWindow(QWidget *parent, Camera * cameraInst, bool autosa
 	ui->verticalSlider->setMinimum(0);
 	ui->verticalSlider->setMaximum(totalFrames - 1);
 	ui->verticalSlider->setValue(playFrame);
-	ui->cmdLoop->setVisible(appSettings.value("camera/demoMode", false).toBool());
+	ui->cmdLoop->setVisible(camera->get_demoMode());
 	markInFrame = 1;
 	markOutFrame = totalFrames;
 	ui->verticalSlider->setHighlightRegion(markInFrame, markOutFrame);
@@ -78,12 +109,12 @@ playbackWindow::playbackWindow(QWidget *parent, Camera * cameraInst, bool autosa
 	camera->vinst->setPosition(0);
 	connect(camera->vinst, SIGNAL(started(VideoState)), this, SLOT(videoStarted(VideoState)));
 	connect(camera->vinst, SIGNAL(ended(VideoState, QString)), this, SLOT(videoEnded(VideoState, QString)));
+	connect(camera->vinst, SIGNAL(statusChanged(VideoStatus*)), this, SLOT(updatePlayFrame(VideoStatus*)));
+	connect(camera->vinst, SIGNAL(saveProgress(VideoSaveProgress*)), this, SLOT(updateSaveProgress(VideoSaveProgress*)));
 
 	playbackExponent = 0;
 
-	timer = new QTimer(this);
-	connect(timer, SIGNAL(timeout()), this, SLOT(updatePlayFrame()));
-	timer->start(30);
+	camera->vinst->setStatusInterval(VIDEO_STATUS_INTERVAL_MSEC);
 
 	updateStatusText();
 
@@ -103,8 +134,9 @@ playbackWindow::~playbackWindow()
 {
 	qDebug()<<"playbackwindow deconstructor";
 	camera->setPlayMode(false);
-	timer->stop();
+	camera->vinst->setStatusInterval(0);
 	emit finishedSaving();
+	delete saveQueue;
 	delete sw;
 	delete ui;
 }
@@ -119,16 +151,13 @@ void playbackWindow::videoStarted(VideoState state)
 		camera->sensor->seqOnOff(false); /* Disable the sensor to reduce RAM contention */
 		ui->cmdSave->setText("Abort\nSave");
 
-		saveDoneTimer = new QTimer(this);
-		connect(saveDoneTimer, SIGNAL(timeout()), this, SLOT(checkForSaveDone()));
-		saveDoneTimer->start(1000);
 		saveAbortedAutomatically = false;
 
 		/* Prevent the user from pressing the abort/save button just after the last frame,
 		 * as that can make the camera try to save a 2nd video too soon, crashing the camapp.
-		 * It is also disabled in checkForSaveDone(), but if the video is very short,
+		 * It is also disabled in updateSaveProgress(), but if the video is very short,
 		 * that might not be called at all before the end of the video, so just disable the button right away.*/
-		if(markOutFrame - markInFrame < 25) ui->cmdSave->setEnabled(false);
+		if(saveQueue->chunkLength() < 25) ui->cmdSave->setEnabled(false);
 		else ui->cmdSave->setEnabled(true);
 	} else {
 		ui->cmdSave->setText("Save");
@@ -143,6 +172,14 @@ void playbackWindow::videoEnded(VideoState state, QString err)
 {
 	if (state == VIDEO_STATE_FILESAVE) { //Filesave has just ended
 		QMessageBox msg;
+		bool completed = err.isNull() && !saveAborted;
+
+		/* Carry on with the next chunk in the save queue, unless the save was aborted. */
+		saveQueue->chunkEnded(completed);
+		if (completed && !saveQueue->isEmpty()) {
+			QTimer::singleShot(0, this, SLOT(saveNextChunk()));
+			return;
+		}
 
 		/* When ending a filesave, restart the sensor and return to live display timing. */
 		camera->sensor->seqOnOff(true);
@@ -151,13 +188,6 @@ void playbackWindow::videoEnded(VideoState state, QString err)
 		ui->cmdSave->setText("Save");
 		saveAborted = false;
 		autoSaveFlag = false;
-		
-		if(saveDoneTimer){
-			saveDoneTimer->stop();
-			delete saveDoneTimer;
-			saveDoneTimer = NULL;
-			qDebug()<<"saveDoneTimer deleted";
-		} else qDebug("cannot delete saveDoneTimer because it is null");
 
 		/* If recording failed from an error. Tell the user about it. */
 		if (!err.isNull()) {
@@ -231,68 +261,96 @@ void playbackWindow::on_cmdSave_clicked()
 	if(camera->vinst->getStatus(NULL) != VIDEO_STATE_FILESAVE)
 	{
 		save_mode_type format = getSaveFormat();
-		UInt32 hRes = appSettings.value("camera/hRes", MAX_FRAME_SIZE_H).toInt();
-		UInt32 vRes = appSettings.value("camera/vRes", MAX_FRAME_SIZE_V).toInt();
+		UInt32 hRes = SettingsCache::instance()->getInt("camera/hRes", MAX_FRAME_SIZE_H);
+		UInt32 vRes = SettingsCache::instance()->getInt("camera/vRes", MAX_FRAME_SIZE_V);
+		QList<QPair<int, int> > regions;
+		bool includesMarked = false;
+		bool resume = false;
+		UInt32 saveFrames = 0;
+		bool autoSelectDrive = appSettings.value("recorder/autoSelectDrive", false).toBool();
+
+		memset(&saveEstimate, 0, sizeof(saveEstimate));
 
 		//If no directory set, complain to the user
-		if(strlen(camera->vinst->fileDirectory) == 0)
+		if((strlen(camera->vinst->fileDirectory) == 0) && !autoSelectDrive)
 		{
 			msg.setText("No save location set! Set save location in Settings");
 			msg.exec();
 			return;
 		}
 
+		//Offer to resume a save that was aborted or interrupted, otherwise queue the marked regions
+		if (!saveQueue->isEmpty() && !autoSaveFlag) {
+			QMessageBox::StandardButton reply;
+			reply = QMessageBox::question(this, "Resume save", QString("A previous save was interrupted with %1 frames left to save.\nResume it?").arg(saveQueue->framesRemaining()), QMessageBox::Yes|QMessageBox::No);
+			if (QMessageBox::Yes == reply) {
+				resume = true;
+				format = saveQueue->currentJob()->format;
+				hRes = saveQueue->currentJob()->hRes;
+				vRes = saveQueue->currentJob()->vRes;
+				saveFrames = saveQueue->framesRemaining();
+			}
+		}
+		if (!resume) {
+			regions = getSaveRegions(&includesMarked);
+			for (int i = 0; i < regions.count(); i++) {
+				saveFrames += regions[i].second - regions[i].first + 1;
+			}
+		}
+
+		//Save new regions to the fastest drive with room for them, drives are measured from the save settings
+		if (autoSelectDrive && !resume) {
+			SaveEstimate est = camera->vinst->estimateSave(format, (hRes + 15) & 0xFFFFFFF0, vRes, saveFrames);
+			QString target = Storage::instance()->selectTarget(est.bytes, false);
+
+			if (!target.isEmpty() && (target != camera->vinst->fileDirectory)) {
+				strcpy(camera->vinst->fileDirectory, target.toAscii().constData());
+				qDebug("Saving to the fastest drive %s", camera->vinst->fileDirectory);
+				strcpy(parentPath, camera->vinst->fileDirectory);
+				strcat(parentPath, "/..");
+			}
+			else if (target.isEmpty() && (strlen(camera->vinst->fileDirectory) == 0)) {
+				msg.setText("No drive has enough free space for this save");
+				msg.exec();
+				return;
+			}
+		}
+
 		if (!statfs(camera->vinst->fileDirectory, &statfsBuf)) {
-			unsigned int numFrames = (markOutFrame - markInFrame + 3);
 			uint64_t freeSpace = statfsBuf.f_bsize * (uint64_t)statfsBuf.f_bfree;
-			uint64_t fileOverhead = 4096;
-			double bpp = appSettings.value("recorder/bitsPerPixel", camera->vinst->bitsPerPixel).toDouble();
 			bool fileOverMaxSize = (statfsBuf.f_type == 0x4d44); // Check for file size limits for FAT32 only.
+			UInt32 chunkFrames = SaveQueue::configuredChunkFrames();
+			UInt32 fileFrames = 0;
 
-			/* Estimate bits per pixel, by format. */
-			switch(format) {
-			case SAVE_MODE_H264:
-				bpp *= 1.2;	/* Add a fudge factor. */
-				break;
-			case SAVE_MODE_DNG:
-			case SAVE_MODE_TIFF_RAW:
-				fileOverMaxSize = false;
-				fileOverhead *= numFrames;
-			case SAVE_MODE_RAW16:
-				bpp = 16;
-				break;
-			case SAVE_MODE_RAW12:
-				bpp = 12;
-				break;
-			case SAVE_MODE_TIFF:
+			/* Image sequences are saved one file per frame, so only single files can exceed the limit. */
+			if ((format != SAVE_MODE_H264) && (format != SAVE_MODE_RAW16) && (format != SAVE_MODE_RAW12)) {
 				fileOverMaxSize = false;
-				fileOverhead *= numFrames;
-				if (camera->getIsColor()) {
-					bpp = 24;
-				} else {
-					bpp = 8;
-				}
-				break;
-
-			default:
-				bpp = 16;
-				break;
 			}
 
-			// calculate estimated file size
-			estimatedSize = (hRes * vRes * numFrames);
-			estimatedSize = ((double)estimatedSize * bpp) / 8;
-			estimatedSize += fileOverhead;
+			/* Predict the size and duration from the throughput measured on this device. */
+			saveEstimate = camera->vinst->estimateSave(format, (hRes + 15) & 0xFFFFFFF0, vRes, saveFrames);
+			estimatedSize = saveEstimate.bytes;
+
+			/* The largest single output file is one chunk of the longest region. */
+			if (resume) {
+				fileFrames = saveQueue->currentJob()->length;
+			}
+			for (int i = 0; i < regions.count(); i++) {
+				fileFrames = max(fileFrames, (UInt32)(regions[i].second - regions[i].first + 1));
+			}
+			if (chunkFrames) {
+				fileFrames = min(fileFrames, chunkFrames);
+			}
 
 			qDebug("===================================");
 			qDebug("Resolution: %d x %d", hRes, vRes);
-			qDebug("Bits/pixel: %f", bpp);
-			qDebug("Frames: %d", markOutFrame - markInFrame + 1);
+			qDebug("Frames: %d", saveFrames);
 			qDebug("Free space: %llu", freeSpace);
 			qDebug("Estimated file size: %llu", estimatedSize);
+			qDebug("Estimated save time: %.0f s, from %u previous saves", saveEstimate.seconds, saveEstimate.samples);
 			qDebug("===================================");
 
-			fileOverMaxSize = fileOverMaxSize && (estimatedSize > 4294967296);
+			fileOverMaxSize = fileOverMaxSize && saveFrames && (estimatedSize * fileFrames / saveFrames > 4294967296);
 			insufficientFreeSpaceEstimate = (estimatedSize > freeSpace);
 
 			//If amount of free space is below both 10MB and below the estimated size of the video, do not allow the save to start
@@ -331,32 +389,34 @@ void playbackWindow::on_cmdSave_clicked()
 		if (stat(camera->vinst->fileDirectory, &sb) == 0 && S_ISDIR(sb.st_mode) &&
 				stat(parentPath, &sbP) == 0 && sb.st_dev != sbP.st_dev)		//If location is directory and is a mount point (device ID of parent is different from device ID of path)
 		{
-			ret = camera->vinst->startRecording((hRes + 15) & 0xFFFFFFF0, vRes, markInFrame - 1, markOutFrame - markInFrame + 1, format);
-			if (RECORD_FILE_EXISTS == ret) {
-				msg.setText("File already exists. Rename then try saving again.");
-				msg.exec();
-				return;
-			}
-			else if (RECORD_DIRECTORY_NOT_WRITABLE == ret) {
-				msg.setText("Save directory is not writable.");
-				msg.exec();
-				return;
+			if (!resume) {
+				saveQueue->clear();
+				saveQueue->setRecording(totalFrames, camera->recordingData.stopTime);
+				for (int i = 0; i < regions.count(); i++) {
+					saveQueue->addRegion(format, (hRes + 15) & 0xFFFFFFF0, vRes, regions[i].first - 1, regions[i].second - regions[i].first + 1);
+				}
 			}
-			else if (RECORD_INSUFFICIENT_SPACE == ret) {
-				msg.setText("Selected device does not have sufficient free space.");
-				msg.exec();
+
+			ret = startSaveQueue();
+			if (SUCCESS != ret) {
+				if (!resume) saveQueue->clear();
 				return;
 			}
 
 			ui->cmdSave->setEnabled(false);
 			setControlEnable(false);
-			sw->setText("Saving...");
+			saveSecondsRemaining = saveEstimate.seconds;
+			sw->setText(QString("Saving %1\nabout %2").arg(formatSize(saveEstimate.bytes)).arg(formatDuration(saveSecondsRemaining)));
 			sw->show();
 
-			ui->verticalSlider->appendRegionToList();
-			ui->verticalSlider->setHighlightRegion(markOutFrame, markOutFrame);
-			//both arguments should be markout because a new rectangle will be drawn,
-			//and it should not overlap the one that was just appended
+			if (includesMarked) {
+				ui->verticalSlider->setHighlightRegion(markInFrame, markOutFrame);
+				ui->verticalSlider->appendRegionToList();
+				ui->verticalSlider->setHighlightRegion(markOutFrame, markOutFrame);
+				//both arguments should be markout because a new rectangle will be drawn,
+				//and it should not overlap the one that was just appended
+			}
+			queuedRegionCount = ui->verticalSlider->getRegionList().count();
 			emit enableSaveSettingsButtons(false);
 		}
 		else {
@@ -367,16 +427,99 @@ void playbackWindow::on_cmdSave_clicked()
 	}
 	else {
 		//This block is executed when Abort is clicked
-		//or when save is automatically aborted due to full storage
+		//or when save is automatically aborted due to full storage.
+		//The save queue keeps its progress, so the save can be resumed later.
 		camera->vinst->stopRecording();
 		ui->cmdSave->setEnabled(false);
-		ui->verticalSlider->removeLastRegionFromList();
-		ui->verticalSlider->setHighlightRegion(markInFrame, markOutFrame);
 		saveAborted = true;
 		autoRecordFlag = false;
 	}
 }
 
+/* playbackWindow::getSaveRegions
+ *
+ * Lists the regions to save, in frames numbered from 1: the regions added
+ * to the slider since the last save, followed by the marked region unless
+ * it was the last one added.
+ *
+ * includesMarked:	Set if the marked region was included
+ *
+ * returns: Start and end frames of each region
+ **/
+QList<QPair<int, int> > playbackWindow::getSaveRegions(bool *includesMarked)
+{
+	QList<QPair<int, int> > regions = ui->verticalSlider->getRegionList().mid(queuedRegionCount);
+	QPair<int, int> marked = qMakePair((int)markInFrame, (int)markOutFrame);
+
+	*includesMarked = regions.isEmpty() || (regions.last() != marked);
+	if (*includesMarked) {
+		regions.append(marked);
+	}
+	return regions;
+}
+
+/* playbackWindow::startSaveQueue
+ *
+ * Starts saving the next chunk from the save queue, and tells the user
+ * why if it could not be started.
+ *
+ * returns: SUCCESS, or the error from SaveQueue::startChunk
+ **/
+CameraErrortype playbackWindow::startSaveQueue()
+{
+	QMessageBox msg;
+	CameraErrortype ret;
+
+	camera->vinst->setDngOpcodes(camera->getDngBadPixelOpcodes());
+	ret = saveQueue->startChunk();
+	if (RECORD_FILE_EXISTS == ret) {
+		msg.setText("File already exists. Rename then try saving again.");
+		msg.exec();
+	}
+	else if (RECORD_DIRECTORY_NOT_WRITABLE == ret) {
+		msg.setText("Save directory is not writable.");
+		msg.exec();
+	}
+	else if (RECORD_INSUFFICIENT_SPACE == ret) {
+		msg.setText("Selected device does not have sufficient free space.");
+		msg.exec();
+	}
+	else if (SUCCESS != ret) {
+		msg.setText("Unable to start saving.");
+		msg.exec();
+	}
+	return ret;
+}
+
+void playbackWindow::saveNextChunk()
+{
+	if (SUCCESS == startSaveQueue()) {
+		return;
+	}
+
+	/* The queue is kept, so the save can be resumed once the problem is fixed. */
+	camera->sensor->seqOnOff(true);
+	sw->close();
+	ui->cmdSave->setText("Save");
+	ui->cmdSave->setEnabled(true);
+	setControlEnable(true);
+	emit enableSaveSettingsButtons(true);
+}
+
+void playbackWindow::on_cmdAddRegion_clicked()
+{
+	const QList<QPair<int, int> > &regions = ui->verticalSlider->getRegionList();
+	QPair<int, int> marked = qMakePair((int)markInFrame, (int)markOutFrame);
+
+	//Add the marked region to the list to be saved, unless it was just added
+	if ((regions.count() > queuedRegionCount) && (regions.last() == marked))
+		return;
+
+	ui->verticalSlider->setHighlightRegion(markInFrame, markOutFrame);
+	ui->verticalSlider->appendRegionToList();
+	ui->verticalSlider->setHighlightRegion(markOutFrame, markOutFrame);
+}
+
 void playbackWindow::addDotsToString(QString* abc)
 {
 	periodsToAdd = (periodsToAdd + 1) % 4;
@@ -471,60 +614,65 @@ void playbackWindow::updateSWText(){
 		statusWindowText = QString("Aborting Save");
 	}
 	addDotsToString(&statusWindowText);
+	if (!saveAborted && (saveSecondsRemaining > 0)) {
+		statusWindowText.append("\n" + formatDuration(saveSecondsRemaining) + " left");
+	}
 	sw->setText(statusWindowText);
 }
 
-//Periodically check if the play frame is updated
-void playbackWindow::updatePlayFrame()
+//Update the play frame whenever the video status changes
+void playbackWindow::updatePlayFrame(VideoStatus *st)
 {
-	VideoStatus st;
 	char playRateStr[100];
-	camera->vinst->getStatus(&st);
+	double framerate = st->framerate;
 
 	/* Update the position */
-	playFrame = st.position;
-	ui->verticalSlider->setValue(st.position);
+	playFrame = st->position;
+	ui->verticalSlider->setValue(st->position);
 	updateStatusText();
 
 	/* Update the framerate. */
-	if (st.state != VIDEO_STATE_FILESAVE) {
-		st.framerate = (playbackExponent >= 0) ? (60 << playbackExponent) : 60.0 / (1 - playbackExponent);
+	if (st->state != VIDEO_STATE_FILESAVE) {
+		framerate = (playbackExponent >= 0) ? (60 << playbackExponent) : 60.0 / (1 - playbackExponent);
 	}
-	sprintf(playRateStr, "%.1ffps", st.framerate);
+	sprintf(playRateStr, "%.1ffps", framerate);
 	ui->lblFrameRate->setText(playRateStr);
 }
 
-//Once save is done, re-enable the window
-void playbackWindow::checkForSaveDone()
+//Update the save status while a filesave is in progress
+void playbackWindow::updateSaveProgress(VideoSaveProgress *progress)
 {
-	if(camera->vinst->getStatus(NULL) == VIDEO_STATE_FILESAVE) {
-		setControlEnable(false);
+	setControlEnable(false);
 
-		struct statvfs statvfsBuf;
-		statvfs(camera->vinst->fileDirectory, &statvfsBuf);
-		qDebug("Free space: %llu  (%lu * %lu)", statvfsBuf.f_bsize * (uint64_t)statvfsBuf.f_bfree, statvfsBuf.f_bsize, statvfsBuf.f_bfree);
-		
-		/* Prevent the user from pressing the abort/save button just after the last frame,
-		 * as that can make the camera try to save a 2nd video too soon, crashing the camapp.*/
-		if(playFrame >= markOutFrame - 25)
-			ui->cmdSave->setEnabled(false);
-		
-		/*Abort the save if insufficient free space,
-		but not if the save has already been aborted,
-		or if the save button is not enabled(unsafe to abort at that time)(except if save mode is RAW)*/
-		bool insufficientFreeSpaceCurrent = (MIN_FREE_SPACE > statvfsBuf.f_bsize * (uint64_t)statvfsBuf.f_bfree);
-		if(insufficientFreeSpaceCurrent &&
-		   insufficientFreeSpaceEstimate &&
-		   !saveAborted &&
-				(ui->cmdSave->isEnabled() ||
-				getSaveFormat() != SAVE_MODE_H264)
-		   ) {
-			saveAbortedAutomatically = true;
-			on_cmdSave_clicked();
-		}
-		
-		updateSWText();
+	/* Include the rest of the save queue in the time remaining. */
+	UInt32 queuedFrames = saveQueue->framesRemaining();
+	queuedFrames = (queuedFrames > progress->framesWritten) ? (queuedFrames - progress->framesWritten) : 0;
+	saveSecondsRemaining = (progress->estimatedRate > 0) ? (queuedFrames / progress->estimatedRate) : progress->secondsRemaining;
+
+	qDebug("Saved %u/%u frames, %llu bytes, %.0fs remaining, free space: %llu",
+		   progress->framesWritten, progress->framesTotal, progress->bytesWritten,
+		   saveSecondsRemaining, progress->bytesFree);
+
+	/* Prevent the user from pressing the abort/save button just after the last frame,
+	 * as that can make the camera try to save a 2nd video too soon, crashing the camapp.*/
+	if(playFrame + 25 >= saveQueue->chunkStart() + saveQueue->chunkLength())
+		ui->cmdSave->setEnabled(false);
+
+	/*Abort the save if insufficient free space,
+	but not if the save has already been aborted,
+	or if the save button is not enabled(unsafe to abort at that time)(except if save mode is RAW)*/
+	bool insufficientFreeSpaceCurrent = (MIN_FREE_SPACE > progress->bytesFree);
+	if(insufficientFreeSpaceCurrent &&
+	   insufficientFreeSpaceEstimate &&
+	   !saveAborted &&
+			(ui->cmdSave->isEnabled() ||
+			getSaveFormat() != SAVE_MODE_H264)
+	   ) {
+		saveAbortedAutomatically = true;
+		on_cmdSave_clicked();
 	}
+
+	updateSWText();
 }
 
 void playbackWindow::on_cmdRateUp_clicked()
@@ -549,6 +697,7 @@ void playbackWindow::setControlEnable(bool en)
 	}
 	ui->cmdMarkIn->setEnabled(en);
 	ui->cmdMarkOut->setEnabled(en);
+	ui->cmdAddRegion->setEnabled(en);
 	ui->cmdPlayForward->setEnabled(en);
 	ui->cmdPlayReverse->setEnabled(en);
 	ui->cmdRateDn->setEnabled(en);
@@ -23,6 +23,7 @@
 #include "statuswindow.h"
 #include "util.h"
 #include "camera.h"
+#include "saveQueue.h"
 
 namespace Ui {
 class playbackWindow;
@@ -53,13 +54,17 @@ private slots:
 
 	void on_cmdSaveSettings_clicked();
 
+	void on_cmdAddRegion_clicked();
+
+	void saveNextChunk();
+
 	void on_cmdMarkIn_clicked();
 
 	void on_cmdMarkOut_clicked();
 
-	void updatePlayFrame();
+	void updatePlayFrame(VideoStatus *st);
 
-	void checkForSaveDone();
+	void updateSaveProgress(VideoSaveProgress *progress);
 
 	void on_cmdRateUp_clicked();
 
@@ -85,14 +90,14 @@ private:
 	void stopPlayLoop();
 	void updateStatusText();
 	void setControlEnable(bool en);
+	QList<QPair<int, int> > getSaveRegions(bool *includesMarked);
+	CameraErrortype startSaveQueue();
 
 	UInt32 markInFrame;
 	UInt32 markOutFrame;
 	UInt32 totalFrames;
 	UInt32 playFrame;
 	bool playLoop;
-	QTimer * timer;
-	QTimer * saveDoneTimer;
 	Int32 playbackExponent;
 	bool autoSaveFlag, autoRecordFlag;
 	bool settingsWindowIsOpen;
@@ -100,6 +105,10 @@ private:
 	bool saveAbortedAutomatically;
 	bool insufficientFreeSpaceEstimate;
 	short periodsToAdd = 0;
+	SaveQueue *saveQueue;
+	SaveEstimate saveEstimate;
+	double saveSecondsRemaining;
+	int queuedRegionCount;	/* Regions in the slider's list that have been queued for saving. */
 	
 	save_mode_type getSaveFormat();
 
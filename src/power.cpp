@@ -1,6 +1,6 @@
 
-#include <QSettings>
 #include "power.h"
+#include "settingsCache.h"
 
 Power::Power(QObject *parent) : QObject(parent)
 {
@@ -52,17 +52,16 @@ void Power::setShippingMode(bool state)
 
 bool Power::getShippingMode()
 {
-	QSettings appSettings;
-	return appSettings.value("camera/shippingMode", false).toBool();
+	return SettingsCache::instance()->getBool("camera/shippingMode", false);
 }
 
 void Power::setAutoPowerMode(int mode)
 {
-	QSettings appSettings;
+	SettingsCache *appSettings = SettingsCache::instance();
 
 	switch (mode) {
 	default:
-		appSettings.setValue("camera/autoPowerMode", AUTO_POWER_DISABLED);
+		appSettings->setValue("camera/autoPowerMode", AUTO_POWER_DISABLED);
 		/* Fall-through */
 	case AUTO_POWER_DISABLED:
 		socket.write("SET_POWERUP_MODE_0");
@@ -84,13 +83,12 @@ void Power::setAutoPowerMode(int mode)
 
 int Power::getAutoPowerMode()
 {
-	QSettings appSettings;
-	return appSettings.value("camera/autoPowerMode", 0).toInt();
+	return SettingsCache::instance()->getInt("camera/autoPowerMode", 0);
 }
 
 void Power::on_socket_readyRead()
 {
-	QSettings appSettings;
+	SettingsCache *appSettings = SettingsCache::instance();
 	char buf[256];
 	qint64 len;
 
@@ -104,22 +102,25 @@ void Power::on_socket_readyRead()
 
 	/* Handle the data that was read. */
 	if(!strcmp(buf,"pwrmode0") == 0){
-		appSettings.setValue("camera/autoPowerMode", AUTO_POWER_DISABLED);
+		appSettings->setValue("camera/autoPowerMode", AUTO_POWER_DISABLED);
 	}
 	else if (strcmp(buf, "pwrmode1") == 0) {
-		appSettings.setValue("camera/autoPowerMode", AUTO_POWER_RESTORE_ONLY);
+		appSettings->setValue("camera/autoPowerMode", AUTO_POWER_RESTORE_ONLY);
 	}
 	else if (strcmp(buf,"pwrmode2") == 0){
-		appSettings.setValue("camera/autoPowerMode", AUTO_POWER_REMOVE_ONLY);
+		appSettings->setValue("camera/autoPowerMode", AUTO_POWER_REMOVE_ONLY);
 	}
 	else if (strcmp(buf,"pwrmode3") == 0){
-		appSettings.setValue("camera/autoPowerMode", AUTO_POWER_BOTH);
+		appSettings->setValue("camera/autoPowerMode", AUTO_POWER_BOTH);
 	}
 	else if (strcmp(buf,"shipping mode enabled") == 0) {
-		appSettings.setValue("camera/shippingMode", TRUE);
+		/* The camera may be powered off right after this, so write it out now. */
+		appSettings->setValue("camera/shippingMode", TRUE);
+		appSettings->sync();
 	}
 	else if (strcmp(buf,"shipping mode disabled") == 0) {
-		appSettings.setValue("camera/shippingMode", FALSE);
+		appSettings->setValue("camera/shippingMode", FALSE);
+		appSettings->sync();
 	}
 	/* Otherwise, it might be battery data. */
 	else {
@@ -0,0 +1,233 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "rawExport.h"
+#include "camera.h"
+
+static inline UInt64 elapsedNsec(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (UInt64)(now.tv_sec - start->tv_sec) * 1000000000ULL + (now.tv_nsec - start->tv_nsec);
+}
+
+RawFrameExporter::RawFrameExporter()
+{
+	fd = -1;
+	buffer[0] = buffer[1] = NULL;
+	length[0] = length[1] = 0;
+	chunkBytes = 0;
+	done = false;
+	error = SUCCESS;
+	memset(&stats, 0, sizeof(stats));
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+}
+
+RawFrameExporter::~RawFrameExporter()
+{
+	free(buffer[0]);
+	free(buffer[1]);
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+/* RawFrameExporter::writeAll
+ *
+ * Writes a buffer to a file descriptor, retrying short and interrupted
+ * writes. If the descriptor is open with O_DIRECT and the kernel rejects
+ * the alignment of a write, O_DIRECT is dropped and the write is retried
+ * through the page cache.
+ *
+ * fd:		File descriptor to write to
+ * buf:		Data to write
+ * length:	Number of bytes to write
+ * direct:	Whether O_DIRECT is in use, cleared when it is dropped (may be NULL)
+ *
+ * returns: SUCCESS, or CAMERA_FILE_ERROR if the write failed
+ **/
+Int32 RawFrameExporter::writeAll(int fd, const void *buf, size_t length, bool *direct)
+{
+	const UInt8 *p = (const UInt8 *)buf;
+
+	while (length) {
+		ssize_t n = write(fd, p, length);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			if ((errno == EINVAL) && direct && *direct) {
+				fprintf(stderr, "writeAll: unaligned for O_DIRECT, falling back to buffered writes\n");
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+				*direct = false;
+				continue;
+			}
+			fprintf(stderr, "writeAll: write failed: %s\n", strerror(errno));
+			return CAMERA_FILE_ERROR;
+		}
+		p += n;
+		length -= n;
+	}
+	return SUCCESS;
+}
+
+void *RawFrameExporter::writerThread(void *arg)
+{
+	((RawFrameExporter *)arg)->writerLoop();
+	return NULL;
+}
+
+/* RawFrameExporter::writerLoop
+ *
+ * Writes the transfer buffers out in turn as they are filled, until the
+ * export is done and both buffers have drained, or a write fails.
+ *
+ * returns: nothing
+ **/
+void RawFrameExporter::writerLoop(void)
+{
+	int cur = 0;
+
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		Int32 ret;
+
+		while (!length[cur] && !done) pthread_cond_wait(&cond, &mutex);
+		if (!length[cur]) break;
+		pthread_mutex_unlock(&mutex);
+
+		ret = writeAll(fd, buffer[cur], length[cur], &stats.direct);
+
+		pthread_mutex_lock(&mutex);
+		if (ret != SUCCESS) {
+			error = ret;
+			pthread_cond_broadcast(&cond);
+			break;
+		}
+		stats.bytes += length[cur];
+		length[cur] = 0;
+		pthread_cond_broadcast(&cond);
+		cur ^= 1;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/* RawFrameExporter::exportFrames
+ *
+ * Streams consecutive frames from acquisition memory to a file descriptor
+ * in their packed layout, including the padding between frames, so the
+ * data is never unpacked or copied more than once. Acquisition memory is
+ * read into one page aligned buffer while the other is being written.
+ *
+ * gpmc:		GPMC instance to read acquisition memory through
+ * fd:			File descriptor to write to, at its current offset
+ * wordAddress:	Address of the first frame in acquisition memory words
+ * frameWords:	Distance between frames in acquisition memory words
+ * count:		Number of frames to export
+ * flags:		RAW_EXPORT_DIRECT to bypass the page cache with O_DIRECT
+ *
+ * returns: SUCCESS, or an error code if the export failed
+ **/
+Int32 RawFrameExporter::exportFrames(GPMC *gpmc, int fd, UInt32 wordAddress, UInt32 frameWords, UInt32 count, UInt32 flags)
+{
+	UInt32 frameStride = frameWords * BYTES_PER_WORD;
+	UInt32 chunkFrames = max(RAW_EXPORT_CHUNK_BYTES / frameStride, 1U);
+	int fdFlags = fcntl(fd, F_GETFL);
+	struct timespec start;
+	pthread_t writer;
+	UInt32 frame;
+	int cur = 0;
+
+	if ((fdFlags < 0) || !frameWords) {
+		return CAMERA_INVALID_SETTINGS;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	memset(&stats, 0, sizeof(stats));
+
+	/* Allocate the transfer buffers, reusing them between exports where possible. */
+	if (chunkBytes != chunkFrames * frameStride) {
+		free(buffer[0]);
+		free(buffer[1]);
+		buffer[0] = buffer[1] = NULL;
+		chunkBytes = chunkFrames * frameStride;
+		if (posix_memalign((void **)&buffer[0], RAW_EXPORT_ALIGN, chunkBytes) ||
+			posix_memalign((void **)&buffer[1], RAW_EXPORT_ALIGN, chunkBytes)) {
+			chunkBytes = 0;
+			return CAMERA_MEM_ERROR;
+		}
+	}
+
+	if (flags & RAW_EXPORT_DIRECT) {
+		stats.direct = (fcntl(fd, F_SETFL, fdFlags | O_DIRECT) == 0);
+		if (!stats.direct) {
+			fprintf(stderr, "exportFrames: O_DIRECT not supported: %s\n", strerror(errno));
+		}
+	}
+
+	this->fd = fd;
+	length[0] = length[1] = 0;
+	done = false;
+	error = SUCCESS;
+	if (pthread_create(&writer, NULL, &writerThread, this)) {
+		fcntl(fd, F_SETFL, fdFlags);
+		return CAMERA_THREAD_ERROR;
+	}
+
+	for (frame = 0; frame < count; frame += chunkFrames) {
+		UInt32 frames = min(count - frame, chunkFrames);
+		struct timespec readStart;
+		Int32 ret;
+
+		/* Wait for the writer to drain this buffer. */
+		pthread_mutex_lock(&mutex);
+		while (length[cur] && (error == SUCCESS)) pthread_cond_wait(&cond, &mutex);
+		ret = error;
+		pthread_mutex_unlock(&mutex);
+		if (ret != SUCCESS) break;
+
+		clock_gettime(CLOCK_MONOTONIC, &readStart);
+		gpmc->readAcqMem((UInt32 *)buffer[cur], wordAddress + frame * frameWords, frames * frameStride);
+		stats.readNsec += elapsedNsec(&readStart);
+
+		pthread_mutex_lock(&mutex);
+		length[cur] = frames * frameStride;
+		stats.frames += frames;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&mutex);
+		cur ^= 1;
+	}
+
+	pthread_mutex_lock(&mutex);
+	done = true;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(writer, NULL);
+
+	fcntl(fd, F_SETFL, fdFlags);
+	stats.nsec = elapsedNsec(&start);
+	if (error != SUCCESS) {
+		fprintf(stderr, "exportFrames: failed after %llu of %u frames\n", stats.bytes / frameStride, count);
+		return error;
+	}
+	return SUCCESS;
+}
@@ -0,0 +1,115 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef RAWEXPORT_H
+#define RAWEXPORT_H
+
+#include <pthread.h>
+
+#include "errorCodes.h"
+#include "types.h"
+#include "gpmc.h"
+
+/* Flags for RawFrameExporter::exportFrames */
+#define RAW_EXPORT_DIRECT			0x1		/* Bypass the page cache with O_DIRECT */
+
+/* Size of each of the two transfer buffers, rounded down to whole frames. */
+#define RAW_EXPORT_CHUNK_BYTES		(4 * 1024 * 1024)
+#define RAW_EXPORT_ALIGN			4096
+
+#define RAW_EXPORT_MAGIC			0x57415243	/* "CRAW" in little endian */
+#define RAW_EXPORT_VERSION			1
+#define RAW_EXPORT_SERIAL_LEN		32
+#define RAW_EXPORT_KEY_LEN			64
+#define RAW_EXPORT_GAIN_CHANNELS	16
+
+/*
+ * Sidecar header describing an exported block of raw frames. The frames are
+ * stored back to back in their native packed 12-bit layout, frameStride bytes
+ * apart, with the first frameBytes of each holding pixel data. The packed FPN
+ * frame follows the header when fpnBytes is nonzero.
+ */
+typedef struct {
+	UInt32 magic;
+	UInt16 version;
+	UInt16 headerSize;			/* Size of this header in bytes. */
+	UInt32 hRes;
+	UInt32 vRes;
+	UInt32 hOffset;
+	UInt32 vOffset;
+	UInt32 vDarkRows;
+	UInt32 bitDepth;
+	UInt32 frameBytes;			/* Packed pixel data in each frame, including dark rows. */
+	UInt32 frameStride;			/* Distance between frames in the data file. */
+	UInt32 firstFrame;			/* Index of the first frame within the record region. */
+	UInt32 frameCount;
+	UInt32 exposure;			/* Integration time in timing clock cycles. */
+	UInt32 period;				/* Frame period in timing clock cycles. */
+	UInt32 timingClock;			/* Timing clock frequency in Hz. */
+	UInt32 gain;
+	UInt32 color;				/* Nonzero for colour sensors. */
+	UInt32 bayerPhase;			/* DNG Bayer phase of the top-left pixel. */
+	UInt32 timestamp;			/* Seconds since the epoch when the header was written. */
+	double columnGain[RAW_EXPORT_GAIN_CHANNELS];	/* 2-point gain of each ADC channel. */
+	double whiteBalance[3];
+	double colorMatrix[9];
+	char serial[RAW_EXPORT_SERIAL_LEN];
+	char fpnKey[RAW_EXPORT_KEY_LEN];	/* Calibration store key of the matching FPN. */
+	UInt32 fpnBytes;			/* Length of the packed FPN frame after the header. */
+} __attribute__ ((__packed__)) RawExportHeader;
+
+typedef struct {
+	UInt64 bytes;
+	UInt32 frames;
+	UInt64 nsec;				/* Total time for the export. */
+	UInt64 readNsec;			/* Time spent reading acquisition memory. */
+	bool direct;				/* O_DIRECT was used for the whole export. */
+} RawExportStats;
+
+/*
+ * Streams frames out of acquisition memory to a file descriptor without
+ * unpacking them. Two page aligned buffers are used so that reading the
+ * next chunk from acquisition memory overlaps writing the previous one.
+ */
+class RawFrameExporter
+{
+public:
+	RawFrameExporter();
+	~RawFrameExporter();
+
+	Int32 exportFrames(GPMC *gpmc, int fd, UInt32 wordAddress, UInt32 frameWords, UInt32 count, UInt32 flags = 0);
+	const RawExportStats *getStats() { return &stats; }
+
+	static Int32 writeAll(int fd, const void *buf, size_t length, bool *direct = NULL);
+
+private:
+	static void *writerThread(void *arg);
+	void writerLoop(void);
+
+	int fd;
+	UInt8 *buffer[2];
+	UInt32 length[2];			/* Bytes waiting to be written from each buffer, zero if free. */
+	UInt32 chunkBytes;
+	bool done;
+	Int32 error;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	RawExportStats stats;
+};
+
+#endif // RAWEXPORT_H
@@ -0,0 +1,188 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <QSettings>
+#include <QDebug>
+
+#include "saveEstimator.h"
+#include "video.h"
+
+SaveEstimator::SaveEstimator()
+{
+}
+
+QString SaveEstimator::modelKey(UInt32 format, const char *device)
+{
+	QString dev(device);
+	dev.replace('/', '_');
+	return QString("saveEstimator/%1/%2").arg(format).arg(dev);
+}
+
+/* SaveEstimator::getModel
+ *
+ * Returns the model for a format and storage device, loading it from the
+ * settings the first time. Devices that have not completed a save yet start
+ * from a conservative default for the format.
+ *
+ * format:	Save format, one of save_mode_type
+ * device:	Save location identifying the storage device
+ *
+ * returns: The model
+ **/
+SaveEstimator::Model SaveEstimator::getModel(UInt32 format, const char *device)
+{
+	QString key = modelKey(format, device);
+	QHash<QString, Model>::const_iterator it = models.constFind(key);
+	QSettings appSettings;
+	Model model;
+
+	if (it != models.constEnd()) {
+		return it.value();
+	}
+
+	/* Defaults, before anything has been learned for this device. */
+	switch (format) {
+	case SAVE_MODE_H264:
+		model.bytesScale = 1.2;		/* The encoder tends to overshoot its target bitrate. */
+		model.pixelRate = 1280 * 1024 * 60.0;
+		break;
+	case SAVE_MODE_RAW12:
+		model.bytesScale = 1.0;
+		model.pixelRate = 50e6;
+		break;
+	case SAVE_MODE_RAW16:
+	case SAVE_MODE_TIFF_RAW:
+		model.bytesScale = 1.0;
+		model.pixelRate = 40e6;
+		break;
+	case SAVE_MODE_DNG:
+		model.bytesScale = 1.0;
+		model.pixelRate = 25e6;
+		break;
+	case SAVE_MODE_TIFF:
+	default:
+		model.bytesScale = 1.0;
+		model.pixelRate = 15e6;
+		break;
+	}
+	model.samples = 0;
+
+	appSettings.beginGroup(key);
+	model.bytesScale = appSettings.value("bytesScale", model.bytesScale).toDouble();
+	model.pixelRate = appSettings.value("pixelRate", model.pixelRate).toDouble();
+	model.samples = appSettings.value("samples", model.samples).toUInt();
+	appSettings.endGroup();
+
+	models.insert(key, model);
+	return model;
+}
+
+/* SaveEstimator::estimate
+ *
+ * Predicts the size and duration of a save.
+ *
+ * format:				Save format, one of save_mode_type
+ * device:				Save location identifying the storage device
+ * hRes:				Horizontal resolution of the saved frames
+ * vRes:				Vertical resolution of the saved frames
+ * frames:				Number of frames to save
+ * nominalFrameBytes:	Size of each frame as configured, including any per-frame overhead
+ *
+ * returns: The prediction
+ **/
+SaveEstimate SaveEstimator::estimate(UInt32 format, const char *device, UInt32 hRes, UInt32 vRes, UInt32 frames, double nominalFrameBytes)
+{
+	Model model = getModel(format, device);
+	SaveEstimate est;
+
+	est.bytes = (UInt64)(nominalFrameBytes * model.bytesScale * frames);
+	est.framerate = model.pixelRate / ((double)hRes * vRes);
+	est.seconds = frames / est.framerate;
+	est.samples = model.samples;
+	return est;
+}
+
+/* SaveEstimator::learn
+ *
+ * Updates the model for a format and storage device from a completed save,
+ * and stores it in the settings. The first few saves are averaged evenly,
+ * after which recent saves are weighted more heavily so the model follows
+ * changes in the device.
+ *
+ * format:				Save format, one of save_mode_type
+ * device:				Save location identifying the storage device
+ * hRes:				Horizontal resolution of the saved frames
+ * vRes:				Vertical resolution of the saved frames
+ * frames:				Number of frames saved
+ * nominalFrameBytes:	Size of each frame as configured, including any per-frame overhead
+ * bytes:				Actual size of the saved file(s)
+ * seconds:				Actual duration of the save
+ *
+ * returns: nothing
+ **/
+void SaveEstimator::learn(UInt32 format, const char *device, UInt32 hRes, UInt32 vRes, UInt32 frames, double nominalFrameBytes, UInt64 bytes, double seconds)
+{
+	QString key = modelKey(format, device);
+	Model model = getModel(format, device);
+	QSettings appSettings;
+	double weight;
+
+	if ((frames < SAVE_ESTIMATOR_MIN_FRAMES) || (seconds < SAVE_ESTIMATOR_MIN_SECONDS) || (nominalFrameBytes <= 0)) {
+		return;
+	}
+
+	weight = max(1.0 / (model.samples + 1), SAVE_ESTIMATOR_MIN_WEIGHT);
+	model.bytesScale += weight * ((double)bytes / (nominalFrameBytes * frames) - model.bytesScale);
+	model.pixelRate += weight * ((double)hRes * vRes * frames / seconds - model.pixelRate);
+	model.samples++;
+	models.insert(key, model);
+
+	qDebug("Save estimator %s: size scale %.3f, %.1f Mpixel/s after %u saves",
+		   key.toAscii().constData(), model.bytesScale, model.pixelRate / 1e6, model.samples);
+
+	appSettings.beginGroup(key);
+	appSettings.setValue("bytesScale", model.bytesScale);
+	appSettings.setValue("pixelRate", model.pixelRate);
+	appSettings.setValue("samples", model.samples);
+	appSettings.endGroup();
+}
+
+/* SaveEstimator::blendFramerate
+ *
+ * Blends the rate measured during a save with the predicted rate, trusting
+ * the measurement more as the save progresses, for a live estimate of the
+ * time remaining that is stable from the first progress update.
+ *
+ * predicted:		Prediction made when the save started
+ * framesWritten:	Frames saved so far
+ * measuredRate:	Measured frames saved per second, or 0 if unknown
+ *
+ * returns: Estimated frames saved per second for the rest of the save
+ **/
+double SaveEstimator::blendFramerate(const SaveEstimate *predicted, UInt32 framesWritten, double measuredRate)
+{
+	double weight;
+
+	if (measuredRate <= 0) {
+		return predicted->framerate;
+	}
+	if (predicted->framerate <= 0) {
+		return measuredRate;
+	}
+
+	weight = framesWritten / (framesWritten + predicted->framerate * SAVE_ESTIMATOR_SETTLE_SECONDS);
+	return weight * measuredRate + (1.0 - weight) * predicted->framerate;
+}
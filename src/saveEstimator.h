@@ -0,0 +1,71 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef SAVEESTIMATOR_H
+#define SAVEESTIMATOR_H
+
+#include <QString>
+#include <QHash>
+
+#include "types.h"
+
+/* Saves shorter than this are dominated by startup time, and are not learned from. */
+#define SAVE_ESTIMATOR_MIN_SECONDS		2.0
+#define SAVE_ESTIMATOR_MIN_FRAMES		30
+
+/* Weight of the newest save once the model has settled. */
+#define SAVE_ESTIMATOR_MIN_WEIGHT		0.25
+
+/* Seconds of saving before the measured rate outweighs the model during a save. */
+#define SAVE_ESTIMATOR_SETTLE_SECONDS	5.0
+
+typedef struct {
+	UInt64 bytes;			/* Predicted size of the saved file(s). */
+	double seconds;			/* Predicted duration of the save. */
+	double framerate;		/* Predicted frames saved per second. */
+	UInt32 samples;			/* Completed saves the prediction was learned from, 0 if none. */
+} SaveEstimate;
+
+/*
+ * Predicts the size and duration of saves from a model learned from the
+ * saves that have completed on each storage device. The size is learned as
+ * a scale on the nominal size of the format, so that it carries over between
+ * resolutions and bitrates, and the throughput is learned in pixels per
+ * second. Each format and device has its own model, kept in the settings.
+ */
+class SaveEstimator
+{
+public:
+	SaveEstimator();
+
+	SaveEstimate estimate(UInt32 format, const char *device, UInt32 hRes, UInt32 vRes, UInt32 frames, double nominalFrameBytes);
+	void learn(UInt32 format, const char *device, UInt32 hRes, UInt32 vRes, UInt32 frames, double nominalFrameBytes, UInt64 bytes, double seconds);
+	double blendFramerate(const SaveEstimate *predicted, UInt32 framesWritten, double measuredRate);
+
+private:
+	struct Model {
+		double bytesScale;		/* Actual size relative to the nominal size. */
+		double pixelRate;		/* Pixels saved per second. */
+		UInt32 samples;
+	};
+
+	QHash<QString, Model> models;
+
+	QString modelKey(UInt32 format, const char *device);
+	Model getModel(UInt32 format, const char *device);
+};
+
+#endif // SAVEESTIMATOR_H
@@ -0,0 +1,303 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <QSettings>
+#include <QDebug>
+
+#include "saveQueue.h"
+
+/*
+ * Removes the incomplete output of a save, which is either a single file or
+ * a directory of frames. Only the files directly within a directory are
+ * removed, so a directory holding anything else is left in place.
+ */
+static void removeOutput(const char *path)
+{
+	struct stat st;
+	DIR *dir;
+	struct dirent *entry;
+	char file[PATH_MAX];
+
+	if (lstat(path, &st) != 0) return;
+	if (!S_ISDIR(st.st_mode)) {
+		unlink(path);
+		return;
+	}
+
+	dir = opendir(path);
+	if (!dir) return;
+	while ((entry = readdir(dir)) != NULL) {
+		snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+		if ((lstat(file, &st) == 0) && S_ISREG(st.st_mode)) unlink(file);
+	}
+	closedir(dir);
+	rmdir(path);
+}
+
+/* Only plain names are saved into the chosen directory, anything else can't have come from the queue. */
+static bool isPlainName(const QString &name)
+{
+	return !name.isEmpty() && !name.contains('/') && !name.startsWith('.');
+}
+
+SaveQueue::SaveQueue(Video *vinstInst)
+{
+	vinst = vinstInst;
+	recordingFrames = 0;
+	recordingId = 0;
+	regionCount = 0;
+	chunkFirst = 0;
+	chunkCount = 0;
+	load();
+}
+
+/* SaveQueue::clear
+ *
+ * Discards every queued region, along with its saved progress.
+ *
+ * returns: nothing
+ **/
+void SaveQueue::clear(void)
+{
+	jobs.clear();
+	regionCount = 0;
+	store();
+}
+
+/* SaveQueue::addRegion
+ *
+ * Queues a region of the recording to be saved. Regions queued together
+ * share the configured filename, or a generated one if it is empty, with
+ * a numeric suffix on every region after the first.
+ *
+ * format:	Format to save the region in
+ * hRes:	Horizontal resolution of the saved frames
+ * vRes:	Vertical resolution of the saved frames
+ * start:	First frame of the region within the recording
+ * length:	Number of frames in the region
+ *
+ * returns: nothing
+ **/
+void SaveQueue::addRegion(save_mode_type format, UInt32 hRes, UInt32 vRes, UInt32 start, UInt32 length)
+{
+	SaveJob job;
+
+	if (jobs.isEmpty()) {
+		char name[1000];
+		strcpy(name, vinst->filename);
+		if (strlen(name) == 0) Video::defaultFilename(name);
+		baseName = name;
+		regionCount = 0;
+	}
+
+	job.directory = vinst->fileDirectory;
+	job.name = regionCount ? QString("%1_%2").arg(baseName).arg(regionCount + 1) : baseName;
+	job.format = format;
+	job.hRes = hRes;
+	job.vRes = vRes;
+	job.start = start;
+	job.length = length;
+	job.chunkFrames = configuredChunkFrames();
+	job.framesDone = 0;
+	job.partial = false;
+	job.created = false;
+	jobs.append(job);
+	regionCount++;
+	store();
+}
+
+/* SaveQueue::setRecording
+ *
+ * Records the recording the queued regions belong to, used to check that a
+ * persisted queue can still be resumed.
+ *
+ * frames:	Total number of frames in the recording
+ * id:		Identifies the recording, such as when it ended
+ *
+ * returns: nothing
+ **/
+void SaveQueue::setRecording(UInt32 frames, qint64 id)
+{
+	recordingFrames = frames;
+	recordingId = id;
+	store();
+}
+
+/* SaveQueue::configuredChunkFrames
+ *
+ * Returns the number of frames saved to each output file of newly queued
+ * regions, from the recorder/saveChunkFrames setting.
+ *
+ * returns: Frames per output file, or 0 to save each region to a single file
+ **/
+UInt32 SaveQueue::configuredChunkFrames(void)
+{
+	QSettings appSettings;
+	return appSettings.value("recorder/saveChunkFrames", SAVE_QUEUE_CHUNK_FRAMES).toUInt();
+}
+
+UInt32 SaveQueue::framesRemaining(void)
+{
+	UInt32 frames = 0;
+	for (int i = 0; i < jobs.count(); i++) {
+		frames += jobs[i].length - jobs[i].framesDone;
+	}
+	return frames;
+}
+
+QString SaveQueue::chunkName(const SaveJob *job)
+{
+	if (!job->chunkFrames || (job->length <= job->chunkFrames)) {
+		return job->name;
+	}
+	return QString("%1_part%2").arg(job->name).arg(job->framesDone / job->chunkFrames + 1, 3, 10, QChar('0'));
+}
+
+/* SaveQueue::startChunk
+ *
+ * Starts saving the next chunk of the first queued region. If an earlier
+ * attempt at the same chunk was interrupted, its incomplete output is
+ * removed first so the chunk is saved again from its first frame. Output
+ * that already existed before the queue started the chunk is never removed.
+ *
+ * returns: SUCCESS, or the error from Video::startRecording
+ **/
+CameraErrortype SaveQueue::startChunk(void)
+{
+	CameraErrortype ret;
+	SaveJob *job;
+	QString name;
+	QString path;
+
+	if (jobs.isEmpty()) {
+		return CAMERA_NO_RECORDING_PRESENT;
+	}
+
+	job = &jobs.first();
+	if (!isPlainName(job->name)) {
+		qDebug() << "Refusing to save to" << job->name;
+		return CAMERA_FILE_ERROR;
+	}
+	name = chunkName(job);
+	path = job->directory + "/" + name + Video::fileExtension(job->format);
+	chunkFirst = job->start + job->framesDone;
+	chunkCount = job->length - job->framesDone;
+	if (job->chunkFrames) {
+		chunkCount = min(chunkCount, job->chunkFrames);
+	}
+
+	if (job->partial && job->created) {
+		qDebug() << "Removing incomplete save" << path;
+		removeOutput(path.toAscii().constData());
+	}
+	job->created = (access(path.toAscii().constData(), F_OK) != 0);
+
+	ret = vinst->startRecording(job->hRes, job->vRes, chunkFirst, chunkCount, job->format,
+								job->directory.toAscii().constData(), name.toAscii().constData());
+	if (ret == SUCCESS) {
+		job->partial = true;
+		store();
+	}
+	return ret;
+}
+
+/* SaveQueue::chunkEnded
+ *
+ * Updates the progress through the queue when a chunk ends, and removes the
+ * first region from the queue once it has been completely saved.
+ *
+ * completed:	The chunk was saved completely, without error or abort
+ *
+ * returns: nothing
+ **/
+void SaveQueue::chunkEnded(bool completed)
+{
+	if (jobs.isEmpty() || !completed) {
+		return;
+	}
+
+	SaveJob *job = &jobs.first();
+	job->framesDone += chunkCount;
+	job->partial = false;
+	job->created = false;
+	if (job->framesDone >= job->length) {
+		jobs.removeFirst();
+	}
+	store();
+}
+
+void SaveQueue::load(void)
+{
+	QSettings appSettings;
+	int count;
+
+	appSettings.beginGroup("saveQueue");
+	recordingFrames = appSettings.value("recordingFrames", 0).toUInt();
+	recordingId = appSettings.value("recordingId", 0).toLongLong();
+	count = appSettings.beginReadArray("jobs");
+	for (int i = 0; i < count; i++) {
+		SaveJob job;
+		appSettings.setArrayIndex(i);
+		job.directory = appSettings.value("directory").toString();
+		job.name = appSettings.value("name").toString();
+		job.format = (save_mode_type)appSettings.value("format").toUInt();
+		job.hRes = appSettings.value("hRes").toUInt();
+		job.vRes = appSettings.value("vRes").toUInt();
+		job.start = appSettings.value("start").toUInt();
+		job.length = appSettings.value("length").toUInt();
+		job.chunkFrames = appSettings.value("chunkFrames").toUInt();
+		job.framesDone = appSettings.value("framesDone").toUInt();
+		job.partial = appSettings.value("partial").toBool();
+		job.created = appSettings.value("created").toBool();
+		jobs.append(job);
+	}
+	appSettings.endArray();
+	appSettings.endGroup();
+}
+
+void SaveQueue::store(void)
+{
+	QSettings appSettings;
+
+	appSettings.beginGroup("saveQueue");
+	appSettings.remove("");
+	appSettings.setValue("recordingFrames", recordingFrames);
+	appSettings.setValue("recordingId", recordingId);
+	appSettings.beginWriteArray("jobs", jobs.count());
+	for (int i = 0; i < jobs.count(); i++) {
+		appSettings.setArrayIndex(i);
+		appSettings.setValue("directory", jobs[i].directory);
+		appSettings.setValue("name", jobs[i].name);
+		appSettings.setValue("format", (uint)jobs[i].format);
+		appSettings.setValue("hRes", jobs[i].hRes);
+		appSettings.setValue("vRes", jobs[i].vRes);
+		appSettings.setValue("start", jobs[i].start);
+		appSettings.setValue("length", jobs[i].length);
+		appSettings.setValue("chunkFrames", jobs[i].chunkFrames);
+		appSettings.setValue("framesDone", jobs[i].framesDone);
+		appSettings.setValue("partial", jobs[i].partial);
+		appSettings.setValue("created", jobs[i].created);
+	}
+	appSettings.endArray();
+	appSettings.endGroup();
+	appSettings.sync();
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef SAVEQUEUE_H
+#define SAVEQUEUE_H
+
+#include <QString>
+#include <QList>
+
+#include "errorCodes.h"
+#include "types.h"
+#include "video.h"
+
+/*
+ * Default number of frames saved to each output file, 0 saves each region to
+ * a single file. Splitting saves into chunks is enabled by setting
+ * recorder/saveChunkFrames.
+ */
+#define SAVE_QUEUE_CHUNK_FRAMES		0
+
+typedef struct {
+	QString directory;		/* Directory to save into. */
+	QString name;			/* Name of the output, without chunk suffix or extension. */
+	save_mode_type format;
+	UInt32 hRes;
+	UInt32 vRes;
+	UInt32 start;			/* First frame of the region within the recording. */
+	UInt32 length;			/* Number of frames in the region. */
+	UInt32 chunkFrames;		/* Frames saved to each output file, or 0 for a single file. */
+	UInt32 framesDone;		/* Frames of the region already written to complete output files. */
+	bool partial;			/* The output of the next chunk was started, but never completed. */
+	bool created;			/* The output of the partial chunk did not exist before it was started. */
+} SaveJob;
+
+/*
+ * Queue of regions to save from a recording, run back to back. Each region
+ * is split into chunks that are saved to separate output files, and the
+ * progress through each region is persisted after every chunk so that an
+ * aborted or interrupted save can resume from the first incomplete chunk,
+ * even after the application is restarted.
+ */
+class SaveQueue
+{
+public:
+	SaveQueue(Video *vinstInst);
+
+	void clear(void);
+	void addRegion(save_mode_type format, UInt32 hRes, UInt32 vRes, UInt32 start, UInt32 length);
+	bool isEmpty(void) { return jobs.isEmpty(); }
+	UInt32 count(void) { return jobs.count(); }
+	const SaveJob *currentJob(void) { return jobs.isEmpty() ? NULL : &jobs.first(); }
+
+	void setRecording(UInt32 frames, qint64 id);
+	bool matchesRecording(UInt32 frames, qint64 id) { return (frames == recordingFrames) && (id == recordingId); }
+	UInt32 framesRemaining(void);
+
+	static UInt32 configuredChunkFrames(void);
+
+	CameraErrortype startChunk(void);
+	void chunkEnded(bool completed);
+	UInt32 chunkStart(void) { return chunkFirst; }
+	UInt32 chunkLength(void) { return chunkCount; }
+
+private:
+	Video *vinst;
+	QList<SaveJob> jobs;
+	UInt32 recordingFrames;
+	qint64 recordingId;
+	UInt32 regionCount;		/* Number of regions queued since the queue was last empty. */
+	QString baseName;		/* Name shared by the regions queued together. */
+
+	/* Chunk currently being saved. */
+	UInt32 chunkFirst;
+	UInt32 chunkCount;
+
+	QString chunkName(const SaveJob *job);
+	void load(void);
+	void store(void);
+};
+
+#endif // SAVEQUEUE_H
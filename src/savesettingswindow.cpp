@@ -14,11 +14,9 @@
  *  You should have received a copy of the GNU General Public License       *
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
  ****************************************************************************/
-#include <mntent.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/vfs.h>
 #include <sys/mount.h>
 #include <unistd.h>
 
@@ -26,11 +24,13 @@
 #include "savesettingswindow.h"
 #include "ui_savesettingswindow.h"
 #include "video.h"
+#include "storage.h"
 
 #include <cstring>
 
 #include <QMessageBox>
 #include <QTimer>
+#include <QCoreApplication>
 #include <QDebug>
 #include <QSettings>
 
@@ -64,7 +64,14 @@ saveSettingsWindow::saveSettingsWindow(QWidget *parent, Camera * camInst) :
 		ui->lineFilename->setText(USE_AUTONAME_FOR_SAVE);
 	}
 	
+	driveCount = 0;
 	refreshDriveList();
+	connect(Storage::instance(), SIGNAL(benchmarkFinished()), this, SLOT(updateBenchmark()));
+	if (Storage::instance()->isBenchmarking()) {
+		ui->cmdBenchmark->setEnabled(false);
+		ui->cmdBenchmark->setText("Testing...");
+	}
+	ui->chkAutoDrive->setChecked(settings.value("recorder/autoSelectDrive", false).toBool());
 
 	ui->comboProfile->clear();
 	ui->comboProfile->addItem("Base");
@@ -131,7 +138,6 @@ saveSettingsWindow::saveSettingsWindow(QWidget *parent, Camera * camInst) :
 		ui->spinMaxBitrate->setEnabled(false);
 	}
 
-	driveCount = 0;
 	timer = new QTimer(this);
 	connect(timer, SIGNAL(timeout()), this, SLOT(updateDrives()));
 	timer->start(1000);
@@ -205,117 +211,25 @@ void saveSettingsWindow::on_cmdUMount_clicked()
 void saveSettingsWindow::refreshDriveList()
 {
 	QSettings settings;
-	FILE * fp;
-	FILE * mtab = setmntent("/etc/mtab", "r");
-	struct mntent* m;
-	struct mntent mnt;
-	char strings[4096];		//Temp buffer used by mntent
-	char model[256];		//Stores model name of sd* device
-	char vendor[256];		//Stores vendor of sd* device
-	char drive[1024];		//Stores string to be placed in combo box
-	UInt32 len;
+	QList<StorageDevice> devices = Storage::instance()->enumerate();
 	bool setDefault = true;	//Revert to defaults if the prevDirectory was not found.
 	QString prevDirectory = settings.value("recorder/fileDirectory", QString(camera->vinst->fileDirectory)).toString();
 
 	okToSaveLocation = false;//prevent saving a new value while drive list is being updated
 	ui->comboDrive->clear();
+	ui->comboDrive->setEnabled(true);
 
-	//ui->comboDrive->addItem("/");
-
-	while ((m = getmntent_r(mtab, &mnt, strings, sizeof(strings))))
+	for (int i = 0; i < devices.count(); i++)
 	{
-		struct statfs fs;
-		if ((mnt.mnt_dir != NULL) && (statfs(mnt.mnt_dir, &fs) == 0))
-		{
-			ui->comboDrive->setEnabled(true);
-
-			//Find only SATA drives, SD cards, and USB drives.
-			if(strstr(mnt.mnt_dir, "/media/mmcblk1") ||
-					strstr(mnt.mnt_dir, "/media/sd"))
-			{
-				if(strstr(mnt.mnt_dir, "/media/sd"))
-				{	//If this is not an SD card (ie a "sd*") type, get the
-					char * mountPoint = mnt.mnt_dir + 7;	//Get the mounted name eg "sda1"
-					Int32 part;
-					char device[10];
-					strncpy(device, mountPoint, 3);		//keep only the "sda" (discard any numbers such as "sda1"
-					device[3] = '\0';					//Add null terminator
-					char modelPath[256];
-					char vendorPath[256];
-
-					//If there's a number following the block name, that's our partition number
-					if(*(mountPoint+3))
-						part = atoi(mountPoint + 3);
-					else
-						part = 1;
-
-					//Produce the paths to read the model and vendor strings
-					sprintf(modelPath, "/sys/block/%s/device/model", device);
-					sprintf(vendorPath, "/sys/block/%s/device/vendor", device);
-
-					//Read the model and vendor strings for this block device
-					fp = fopen(modelPath, "r");
-					if(fp)
-					{
-						len = fread(model, 1, 255, fp);
-						model[len] = '\0';
-						fclose(fp);
-					}
-					else
-						strcpy(model, "???");
-
-					fp = fopen(vendorPath, "r");
-					if(fp)
-					{
-						len = fread(vendor, 1, 255, fp);
-						vendor[len] = '\0';
-						fclose(fp);
-					}
-					else
-						strcpy(vendor, "???");
-
-					//remove all trailing whitespace and carrage returns
-					int i;
-					for(i = strlen(vendor) - 1; ' ' == vendor[i] || '\n' == vendor[i]; i--) {};	//Search back from the end and put a null at the first trailing space
-					vendor[i + 1] = '\0';
-
-					for(i = strlen(model) - 1; ' ' == model[i] || '\n' == model[i]; i--) {};	//Search back from the end and put a null at the first trailing space
-					model[i + 1] = '\0';
-
-					sprintf(drive, "%s (%s %s Partition %d)", mnt.mnt_dir, vendor, model, part);
-				}
-				else
-				{
-					Int32 part;
-
-					//If there's a number following the block name, that's our partition number
-					if(*(mnt.mnt_dir + 15))		//Find the first character after "/media/mmcblk1p"
-						part = atoi(mnt.mnt_dir + 15);
-					else
-						part = 1;
-					sprintf(drive, "%s (SD Card Partition %d)", mnt.mnt_dir, part);
-
-				}
-
-				ui->comboDrive->addItem(drive);
+		ui->comboDrive->addItem(Storage::describe(&devices[i]));
 
-				// If this drive matches the previous selection, select it.
-				if (strcmp(mnt.mnt_dir, prevDirectory.toAscii().data()) == 0) {
-					ui->comboDrive->setCurrentIndex(ui->comboDrive->count() - 1);
-					setDefault = false;
-				}
-
-				unsigned long long int size = fs.f_blocks * fs.f_bsize;
-				unsigned long long int free = fs.f_bfree * fs.f_bsize;
-				unsigned long long int avail = fs.f_bavail * fs.f_bsize;
-				printf("%s %s size=%lld free=%lld avail=%lld\n",
-				mnt.mnt_fsname, mnt.mnt_dir, size, free, avail);
-			}
+		// If this drive matches the previous selection, select it.
+		if (devices[i].mountPoint == prevDirectory) {
+			ui->comboDrive->setCurrentIndex(ui->comboDrive->count() - 1);
+			setDefault = false;
 		}
 	}
 
-	endmntent(mtab);
-
 	if(ui->comboDrive->count() == 0)
 	{
 		ui->comboDrive->addItem("No storage devices detected");
@@ -325,6 +239,7 @@ void saveSettingsWindow::refreshDriveList()
 		ui->comboDrive->setCurrentIndex(0);
 		saveFileDirectory();
 	}
+	driveCount = devices.count();
 	okToSaveLocation = true;
 }
 
@@ -333,6 +248,31 @@ void saveSettingsWindow::on_cmdRefresh_clicked()
 	refreshDriveList();
 }
 
+//Measure the write speed of every mounted drive in the background
+void saveSettingsWindow::on_cmdBenchmark_clicked()
+{
+	ui->cmdBenchmark->setEnabled(false);
+	ui->cmdBenchmark->setText("Testing...");
+	Storage::instance()->startBenchmark(false);
+}
+
+//Show the measured write speeds once the benchmark is done
+void saveSettingsWindow::updateBenchmark()
+{
+	ui->cmdBenchmark->setText("Test Speed");
+	ui->cmdBenchmark->setEnabled(true);
+	refreshDriveList();
+}
+
+void saveSettingsWindow::on_chkAutoDrive_toggled(bool checked)
+{
+	QSettings settings;
+	settings.setValue("recorder/autoSelectDrive", checked);
+
+	//Drives are chosen by their speed, so measure any that haven't been yet
+	if (checked) Storage::instance()->startBenchmark(true);
+}
+
 void saveSettingsWindow::updateBitrate()
 {
 	if(!windowInitComplete) return;
@@ -390,34 +330,10 @@ void saveSettingsWindow::on_spinFramerate_valueChanged(int arg1)
 //Called by timer
 void saveSettingsWindow::updateDrives(void)
 {
-	FILE* mtab = setmntent("/etc/mtab", "r");
-	struct mntent* m;
-	struct mntent mnt;
-	char strings[4096];
-	UInt32 newDriveCount = 0;
-
-	while ((m = getmntent_r(mtab, &mnt, strings, sizeof(strings))))
-	{
-		struct statfs fs;
-		if ((mnt.mnt_dir != NULL) && (statfs(mnt.mnt_dir, &fs) == 0))
-		{
-			//Find only drives that are SD card or USB drives
-			if(strstr(mnt.mnt_dir, "/media/mmcblk1") ||
-					strstr(mnt.mnt_dir, "/media/sd"))
-			{
-				newDriveCount++;
-			}
-		}
-	}
-
-	endmntent(mtab);
-
-	if(newDriveCount != driveCount)
+	if(Storage::instance()->count() != driveCount) {
 		refreshDriveList();
-
-	driveCount = newDriveCount;
-
-
+		if (ui->chkAutoDrive->isChecked()) Storage::instance()->startBenchmark(true);
+	}
 }
 
 void saveSettingsWindow::on_lineFilename_textEdited(const QString &arg1)
@@ -465,6 +381,8 @@ void saveSettingsWindow::setControlEnable(bool en){
 	ui->comboSaveFormat->setEnabled(en);
 	ui->comboDrive->setEnabled(en);
 	ui->cmdRefresh->setEnabled(en);
+	ui->cmdBenchmark->setEnabled(en);
+	ui->chkAutoDrive->setEnabled(en);
 	ui->cmdUMount->setEnabled(en);
 	ui->cmdClose->setEnabled(en);
 	ui->chkEnableOverlay->setEnabled(en);
@@ -42,12 +42,17 @@ public:
 public slots:
 	void setControlEnable(bool en);
 private slots:
+	void updateBenchmark();
 	void on_cmdClose_clicked();
 
 	void on_cmdUMount_clicked();
 
 	void on_cmdRefresh_clicked();
 
+	void on_cmdBenchmark_clicked();
+
+	void on_chkAutoDrive_toggled(bool checked);
+
 	void on_spinBitrate_valueChanged(double arg1);
 
 	void updateDrives();
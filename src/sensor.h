@@ -51,6 +51,8 @@ public:
 	virtual UInt32 getActualFramePeriod(double target, FrameGeometry *frameSize) = 0;
 	virtual UInt32 getFramePeriod(void) = 0;
 	virtual UInt32 setFramePeriod(UInt32 period, FrameGeometry *frameSize) = 0;
+	/* Whether the period can be changed without stopping the sensor, eg. without loading a new wavetable. */
+	virtual bool isLivePeriodChange(UInt32 period, FrameGeometry *frameSize) { return false; }
 
 	/* Frame Exposure Functions. */
 	virtual UInt32 getIntegrationClock(void) = 0;
@@ -81,6 +83,9 @@ public:
 	virtual void adcOffsetTraining(FrameGeometry *frameSize, UInt32 address, UInt32 numFrames) {}
 	virtual std::string getFilename(const char * filename, const char * extension) = 0;
 
+	/* Name of the stored ADC offsets for the current sensor timing, empty if the sensor has none. */
+	virtual std::string getADCOffsetsFilename(void) { return ""; }
+
 	/* Load sensor calibration data after changing frame geometry. */
 	virtual Int32 loadADCOffsetsFromFile(FrameGeometry *frameSize) { return CAMERA_FILE_NOT_FOUND; }
 
@@ -0,0 +1,295 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <string.h>
+#include <QDebug>
+
+#include "util.h"
+#include "cameraRegisters.h"
+#include "sensorSCI.h"
+
+//#define SCI_DEBUG_PRINTS
+
+SensorSCI::SensorSCI()
+{
+	gpmc = NULL;
+	bankRegister = SENSOR_SCI_NO_BANK;
+	resetRegister = SENSOR_SCI_NO_BANK;
+	memset(isVolatile, 0, sizeof(isVolatile));
+	writesSkipped = 0;
+	batchDepth = 0;
+	queued = 0;
+	pending = false;
+	invalidate();
+}
+
+void SensorSCI::init(GPMC *gpmc_inst)
+{
+	gpmc = gpmc_inst;
+	pending = false;
+	invalidate();
+}
+
+/* SensorSCI::setBankRegister
+ *
+ * Sets the register that selects between the sensor's register banks. The
+ * value written to it selects the bank used by the following accesses, and
+ * each bank is shadowed separately.
+ *
+ * address:	Bank select register
+ *
+ * returns: nothing
+ **/
+void SensorSCI::setBankRegister(UInt8 address)
+{
+	bankRegister = address;
+}
+
+/* SensorSCI::setResetRegister
+ *
+ * Sets the register that resets every sensor register to its default when
+ * written, which also invalidates the shadow registers.
+ *
+ * address:	Reset register
+ *
+ * returns: nothing
+ **/
+void SensorSCI::setResetRegister(UInt8 address)
+{
+	resetRegister = address;
+}
+
+void SensorSCI::setVolatile(UInt8 address, UInt8 bank)
+{
+	isVolatile[bank % SENSOR_SCI_BANKS][address] = true;
+}
+
+/* SensorSCI::invalidate
+ *
+ * Forgets the contents of every register, so that each one is written the
+ * next time it is set. Must be called whenever the sensor is reset.
+ *
+ * returns: nothing
+ **/
+void SensorSCI::invalidate(void)
+{
+	memset(valid, 0, sizeof(valid));
+	bufValid = false;
+	bank = 0;
+}
+
+/* Starts a single register write, after waiting for the previous write to finish. */
+void SensorSCI::transfer(UInt8 address, UInt16 data)
+{
+	waitIdle();
+
+	//Clear RW and reset FIFO
+	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, 0x8000);
+
+	//Set up address, transfer length and put data into FIFO
+	gpmc->write16(SENSOR_SCI_ADDRESS_ADDR, address);
+	gpmc->write16(SENSOR_SCI_DATALEN_ADDR, 2);
+	gpmc->write16(SENSOR_SCI_FIFO_WR_ADDR_ADDR, data >> 8);
+	gpmc->write16(SENSOR_SCI_FIFO_WR_ADDR_ADDR, data & 0xFF);
+
+	//Start transfer
+	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, SENSOR_SCI_CONTROL_RUN_MASK);
+	pending = true;
+}
+
+void SensorSCI::waitIdle(void)
+{
+	if (pending) {
+		while (gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK);
+		pending = false;
+	}
+}
+
+/* Sends the queued writes in order, without waiting for the last one. */
+void SensorSCI::flush(void)
+{
+	for (UInt32 i = 0; i < queued; i++) {
+		transfer(queueAddress[i], queueData[i]);
+	}
+	queued = 0;
+}
+
+/* SensorSCI::write
+ *
+ * Writes a sensor register, unless it is already known to hold the value.
+ * Outside of a batch the write has completed on return.
+ *
+ * address:	Register address
+ * data:	Value to write
+ * force:	Write the register even if the shadow copy matches
+ *
+ * returns: true if the write was sent, false if it was skipped
+ **/
+bool SensorSCI::write(UInt8 address, UInt16 data, bool force)
+{
+	if (address == bankRegister) {
+		bank = (data < SENSOR_SCI_BANKS) ? data : 0;
+	}
+	else if (address == resetRegister) {
+		invalidate();
+	}
+	else if (!force && !isVolatile[bank][address] && valid[bank][address] && (shadow[bank][address] == data)) {
+		writesSkipped++;
+		return false;
+	}
+	else {
+		shadow[bank][address] = data;
+		valid[bank][address] = true;
+	}
+
+	if (batchDepth) {
+		if (queued >= SENSOR_SCI_BATCH_MAX) flush();
+		queueAddress[queued] = address;
+		queueData[queued] = data;
+		queued++;
+	}
+	else {
+		transfer(address, data);
+		waitIdle();
+	}
+	return true;
+}
+
+/* SensorSCI::writeBuf
+ *
+ * Writes a buffer to a register port, such as a wavetable, in one transfer.
+ * Any queued writes are sent first.
+ *
+ * address:	Register address
+ * data:	Bytes to write
+ * dataLen:	Number of bytes
+ *
+ * returns: nothing
+ **/
+void SensorSCI::writeBuf(UInt8 address, const UInt8 *data, UInt32 dataLen)
+{
+	flush();
+	waitIdle();
+
+	//Clear RW and reset FIFO
+	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, 0x8000);
+
+	//Set up address, transfer length and put data into FIFO
+	gpmc->write16(SENSOR_SCI_ADDRESS_ADDR, address);
+	gpmc->write16(SENSOR_SCI_DATALEN_ADDR, dataLen);
+	for (UInt32 i = 0; i < dataLen; i++) {
+		gpmc->write16(SENSOR_SCI_FIFO_WR_ADDR_ADDR, data[i]);
+	}
+
+	//Start transfer
+	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, SENSOR_SCI_CONTROL_RUN_MASK);
+	pending = true;
+	if (!batchDepth) waitIdle();
+
+	bufValid = true;
+	bufAddress = address;
+	bufData = data;
+	bufLen = dataLen;
+}
+
+/* SensorSCI::matchesBuf
+ *
+ * Checks whether a buffer was the last one written to a register port. The
+ * buffers are compared by address, so this is only useful for constant data
+ * such as the wavetables.
+ *
+ * returns: true if the same buffer was written since the last reset
+ **/
+bool SensorSCI::matchesBuf(UInt8 address, const UInt8 *data, UInt32 dataLen)
+{
+	return bufValid && (bufAddress == address) && (bufData == data) && (bufLen == dataLen);
+}
+
+/* SensorSCI::read
+ *
+ * Reads a sensor register from the sensor, and updates its shadow copy.
+ * Any queued writes are sent first.
+ *
+ * address:	Register address
+ *
+ * returns: Register value
+ **/
+UInt16 SensorSCI::read(UInt8 address)
+{
+	int i = 0;
+	UInt16 data;
+
+	flush();
+	waitIdle();
+
+	//Set RW
+	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, gpmc->read16(SENSOR_SCI_CONTROL_ADDR) | SENSOR_SCI_CONTROL_RW_MASK);
+
+	//Set up address and transfer length
+	gpmc->write16(SENSOR_SCI_ADDRESS_ADDR, address);
+	gpmc->write16(SENSOR_SCI_DATALEN_ADDR, 2);
+
+	//Start transfer
+	gpmc->write16(SENSOR_SCI_CONTROL_ADDR, gpmc->read16(SENSOR_SCI_CONTROL_ADDR) | SENSOR_SCI_CONTROL_RUN_MASK);
+
+	int first = gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK;
+	//Wait for completion
+	while(gpmc->read16(SENSOR_SCI_CONTROL_ADDR) & SENSOR_SCI_CONTROL_RUN_MASK)
+		i++;
+
+	/* If busy was never seen, the transfer may not have started yet, so give it time to finish. */
+	if (!first && (i == 0)) {
+#ifdef SCI_DEBUG_PRINTS
+		qDebug() << "Read No busy detected, something is probably very wrong, address:" << address;
+#endif
+		delayms(1);
+	}
+
+	data = gpmc->read16(SENSOR_SCI_READ_DATA_ADDR);
+	if ((address != bankRegister) && (address != resetRegister)) {
+		shadow[bank][address] = data;
+		valid[bank][address] = true;
+	}
+	return data;
+}
+
+/* SensorSCI::begin
+ *
+ * Starts a batch of writes, which are queued until commit() is called and
+ * then sent back to back. Writes keep their order, and reads or buffer
+ * writes during a batch send the writes queued before them.
+ *
+ * returns: nothing
+ **/
+void SensorSCI::begin(void)
+{
+	batchDepth++;
+}
+
+/* SensorSCI::commit
+ *
+ * Sends the writes queued since begin() and waits for them to complete.
+ *
+ * returns: nothing
+ **/
+void SensorSCI::commit(void)
+{
+	if (batchDepth && --batchDepth) {
+		return;
+	}
+	flush();
+	waitIdle();
+}
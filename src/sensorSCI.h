@@ -0,0 +1,91 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef SENSORSCI_H
+#define SENSORSCI_H
+
+#include "types.h"
+#include "gpmc.h"
+
+#define SENSOR_SCI_REGISTERS	256
+#define SENSOR_SCI_BANKS		2
+#define SENSOR_SCI_NO_BANK		0xFFFF
+
+/* Writes that can be queued by a batch before it is flushed early. */
+#define SENSOR_SCI_BATCH_MAX	64
+
+/*
+ * Register access to an image sensor through the FPGA's serial control
+ * interface (SCI). A shadow copy of the sensor registers is kept, so that
+ * writing a value a register already holds is skipped, and writes made
+ * between begin() and commit() are sent back to back, waiting only for the
+ * last one to complete.
+ *
+ * Registers are only shadowed once written or read, and the shadow must be
+ * invalidated whenever the sensor is reset. Registers with side effects,
+ * such as those that start an operation, must be marked volatile so that
+ * every write reaches the sensor.
+ */
+class SensorSCI
+{
+public:
+	SensorSCI();
+
+	void init(GPMC *gpmc_inst);
+	void setBankRegister(UInt8 address);
+	void setResetRegister(UInt8 address);
+	void setVolatile(UInt8 address, UInt8 bank = 0);
+	void invalidate(void);
+
+	bool write(UInt8 address, UInt16 data, bool force = false);
+	void writeBuf(UInt8 address, const UInt8 *data, UInt32 dataLen);
+	bool matchesBuf(UInt8 address, const UInt8 *data, UInt32 dataLen);
+	UInt16 read(UInt8 address);
+
+	void begin(void);
+	void commit(void);
+
+	UInt32 writesSkipped;		/* Writes dropped because the register already held the value. */
+
+private:
+	GPMC *gpmc;
+	UInt16 shadow[SENSOR_SCI_BANKS][SENSOR_SCI_REGISTERS];
+	bool valid[SENSOR_SCI_BANKS][SENSOR_SCI_REGISTERS];
+	bool isVolatile[SENSOR_SCI_BANKS][SENSOR_SCI_REGISTERS];
+	UInt16 bankRegister;
+	UInt16 resetRegister;
+	UInt8 bank;
+
+	/* Last buffer written, which the sensor can't be asked for. */
+	bool bufValid;
+	UInt8 bufAddress;
+	const UInt8 *bufData;
+	UInt32 bufLen;
+
+	/* Writes queued by begin(), which may be nested. */
+	UInt32 batchDepth;
+	UInt32 queued;
+	UInt8 queueAddress[SENSOR_SCI_BATCH_MAX];
+	UInt16 queueData[SENSOR_SCI_BATCH_MAX];
+
+	bool pending;				/* A write may still be running. */
+
+	void transfer(UInt8 address, UInt16 data);
+	void flush(void);
+	void waitIdle(void);
+};
+
+#endif // SENSORSCI_H
@@ -0,0 +1,190 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <QSettings>
+#include <QStringList>
+#include <QMetaObject>
+#include <QCoreApplication>
+#include <QDebug>
+
+#include "settingsCache.h"
+
+/* SettingsCache::SettingsCache
+ *
+ * Loads every setting from the settings file. This must happen after the
+ * organization and application names have been set, which determine where
+ * the settings file is.
+ **/
+SettingsCache::SettingsCache() : QObject(NULL)
+{
+	pthread_mutex_init(&mutex, NULL);
+	flushPending = false;
+	reload();
+
+	flushTimer = new QTimer(this);
+	flushTimer->setSingleShot(true);
+	flushTimer->setInterval(SETTINGS_FLUSH_DELAY_MSEC);
+	connect(flushTimer, SIGNAL(timeout()), this, SLOT(sync()));
+	if (QCoreApplication::instance()) {
+		connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this, SLOT(sync()));
+	}
+}
+
+/* SettingsCache::reload
+ *
+ * Discards the cached settings, including changes not yet written, and
+ * loads them from the settings file, such as after it was replaced.
+ *
+ * returns: nothing
+ **/
+void SettingsCache::reload(void)
+{
+	QSettings appSettings;
+	QStringList keys = appSettings.allKeys();
+	QHash<QString, QVariant> loaded;
+
+	for (int i = 0; i < keys.count(); i++) {
+		loaded.insert(keys[i], appSettings.value(keys[i]));
+	}
+
+	pthread_mutex_lock(&mutex);
+	values = loaded;
+	dirty.clear();
+	pthread_mutex_unlock(&mutex);
+}
+
+SettingsCache *SettingsCache::instance(void)
+{
+	static SettingsCache *cache = new SettingsCache();
+	return cache;
+}
+
+QVariant SettingsCache::value(const QString &key, const QVariant &defaultValue)
+{
+	pthread_mutex_lock(&mutex);
+	QVariant val = values.value(key, defaultValue);
+	pthread_mutex_unlock(&mutex);
+	return val;
+}
+
+/* Starts the write back timer, from whichever thread made the change. Called with the mutex held. */
+void SettingsCache::scheduleFlush(void)
+{
+	if (!flushPending) {
+		flushPending = true;
+		QMetaObject::invokeMethod(flushTimer, "start");
+	}
+}
+
+/* SettingsCache::setValue
+ *
+ * Changes a setting in memory, and schedules it to be written to disk.
+ * Setting a value it already has does nothing.
+ *
+ * key:		Name of the setting
+ * value:	New value
+ *
+ * returns: nothing
+ **/
+void SettingsCache::setValue(const QString &key, const QVariant &value)
+{
+	pthread_mutex_lock(&mutex);
+	QHash<QString, QVariant>::const_iterator it = values.constFind(key);
+	if ((it != values.constEnd()) && (it.value() == value)) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+	values.insert(key, value);
+	dirty.insert(key);
+	scheduleFlush();
+	pthread_mutex_unlock(&mutex);
+
+	emit valueChanged(key, value);
+}
+
+void SettingsCache::remove(const QString &key)
+{
+	pthread_mutex_lock(&mutex);
+	if (!values.contains(key)) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+	values.remove(key);
+	dirty.insert(key);
+	scheduleFlush();
+	pthread_mutex_unlock(&mutex);
+
+	emit valueChanged(key, QVariant());
+}
+
+/* SettingsCache::clear
+ *
+ * Deletes every setting, in memory and on disk, returning them all to
+ * their defaults.
+ *
+ * returns: nothing
+ **/
+void SettingsCache::clear(void)
+{
+	QSettings appSettings;
+
+	pthread_mutex_lock(&mutex);
+	values.clear();
+	dirty.clear();
+	pthread_mutex_unlock(&mutex);
+
+	appSettings.clear();
+	appSettings.sync();
+}
+
+/* SettingsCache::sync
+ *
+ * Writes the settings changed since the last call to the settings file.
+ * This happens automatically shortly after a change, and when the
+ * application quits, and only needs to be called directly before the
+ * camera is powered off.
+ *
+ * returns: nothing
+ **/
+void SettingsCache::sync(void)
+{
+	QHash<QString, QVariant> changes;
+	QSet<QString> removed;
+	QSettings appSettings;
+
+	pthread_mutex_lock(&mutex);
+	foreach (const QString &key, dirty) {
+		QHash<QString, QVariant>::const_iterator it = values.constFind(key);
+		if (it != values.constEnd()) changes.insert(key, it.value());
+		else removed.insert(key);
+	}
+	dirty.clear();
+	flushPending = false;
+	pthread_mutex_unlock(&mutex);
+
+	if (changes.isEmpty() && removed.isEmpty()) {
+		return;
+	}
+
+	for (QHash<QString, QVariant>::const_iterator it = changes.constBegin(); it != changes.constEnd(); it++) {
+		appSettings.setValue(it.key(), it.value());
+	}
+	foreach (const QString &key, removed) {
+		appSettings.remove(key);
+	}
+	appSettings.sync();
+	qDebug("SettingsCache: wrote %d changed settings", changes.count() + removed.count());
+}
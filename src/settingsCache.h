@@ -0,0 +1,80 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef SETTINGSCACHE_H
+#define SETTINGSCACHE_H
+
+#include <pthread.h>
+
+#include <QObject>
+#include <QString>
+#include <QVariant>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+
+#include "types.h"
+
+/* Delay between a setting being changed and it being written to disk. */
+#define SETTINGS_FLUSH_DELAY_MSEC	1000
+
+/*
+ * In-memory copy of the application settings, loaded once at startup so
+ * that reading a setting never touches the settings file. Changes are
+ * written back to the settings file in batches, shortly after the first
+ * change, and announced by the valueChanged signal.
+ *
+ * Keys accessed through the cache should not be written through QSettings
+ * directly, or the cache will not see the change.
+ */
+class SettingsCache : public QObject
+{
+	Q_OBJECT
+
+public:
+	static SettingsCache *instance(void);
+
+	QVariant value(const QString &key, const QVariant &defaultValue = QVariant());
+	bool getBool(const QString &key, bool defaultValue = false) { return value(key, defaultValue).toBool(); }
+	Int32 getInt(const QString &key, Int32 defaultValue = 0) { return value(key, defaultValue).toInt(); }
+	UInt32 getUInt(const QString &key, UInt32 defaultValue = 0) { return value(key, defaultValue).toUInt(); }
+	double getDouble(const QString &key, double defaultValue = 0.0) { return value(key, defaultValue).toDouble(); }
+	QString getString(const QString &key, const QString &defaultValue = QString()) { return value(key, defaultValue).toString(); }
+
+	void setValue(const QString &key, const QVariant &value);
+	void remove(const QString &key);
+	void clear(void);
+	void reload(void);
+
+public slots:
+	void sync(void);
+
+signals:
+	void valueChanged(const QString &key, const QVariant &value);
+
+private:
+	SettingsCache();
+
+	pthread_mutex_t mutex;
+	QHash<QString, QVariant> values;
+	QSet<QString> dirty;		/* Keys changed since the last write to disk. */
+	bool flushPending;
+	QTimer *flushTimer;
+
+	void scheduleFlush(void);
+};
+
+#endif // SETTINGSCACHE_H
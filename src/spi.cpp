@@ -21,6 +21,9 @@
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "defines.h"
 #include "spi.h"
@@ -125,6 +128,7 @@ CameraErrortype SPI::setMode(bool cpol, bool cpha)
         if (ret == -1)
             return SPI_IOCTL_FAIL;
     }
+    return SUCCESS;
 }
 
 Int32 SPI::Transfer(uint64_t txBuf, uint64_t rxBuf, uint32_t len, bool cpol, bool cpha)
@@ -136,6 +140,7 @@ Int32 SPI::Transfer(uint64_t txBuf, uint64_t rxBuf, uint32_t len, bool cpol, boo
 
     setMode(cpol, cpha);
 
+	memset(&tr, 0, sizeof(tr));
 	tr.tx_buf = txBuf;
 	tr.rx_buf = rxBuf;
 	tr.len = len;
@@ -150,3 +155,127 @@ Int32 SPI::Transfer(uint64_t txBuf, uint64_t rxBuf, uint32_t len, bool cpol, boo
 	else
 		return SUCCESS;
 }
+
+/* SPI::TransferWords
+ *
+ * Sends a sequence of words to a device that latches each word on the rising
+ * edge of its chip select, such as a register write or a DAC update. The mode
+ * is set once for the whole sequence, and the chip select is toggled between
+ * words without leaving the transfer loop.
+ *
+ * The chip selects on the camera are GPIOs, which the SPI controller can't
+ * toggle in the middle of a message, so each word is still its own message.
+ *
+ * cs:		Chip select of the device
+ * txBuf:	Words to send, one after the other
+ * wordLen:	Length of each word in bytes
+ * count:	Number of words
+ *
+ * returns: SUCCESS or an SPI error code
+ **/
+Int32 SPI::TransferWords(SPIChipSelect *cs, const void *txBuf, uint32_t wordLen, uint32_t count, bool cpol, bool cpha)
+{
+	struct spi_ioc_transfer tr;
+	const UInt8 *tx = (const UInt8 *)txBuf;
+	CameraErrortype err;
+
+	if(!isOpen)
+		return SPI_NOT_OPEN;
+
+	err = setMode(cpol, cpha);
+	if (err != SUCCESS)
+		return err;
+
+	memset(&tr, 0, sizeof(tr));
+	tr.len = wordLen;
+	tr.delay_usecs = delay;
+	tr.speed_hz = speed;
+	tr.bits_per_word = bits;
+	for (uint32_t i = 0; i < count; i++) {
+		tr.tx_buf = (uint64_t)(uintptr_t)(tx + i * wordLen);
+		cs->Set(false);
+		int ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
+		cs->Set(true);
+		if (ret < 1)
+			return SPI_IOCTL_FAIL;
+	}
+	return SUCCESS;
+}
+
+SPIChipSelect::SPIChipSelect()
+{
+	fd = -1;
+	map = MAP_FAILED;
+	regs = NULL;
+	mask = 0;
+}
+
+SPIChipSelect::~SPIChipSelect()
+{
+	Close();
+}
+
+/* SPIChipSelect::Open
+ *
+ * Opens a GPIO for use as a chip select, and maps its GPIO bank if possible.
+ *
+ * gpio:	GPIO number, as used by sysfs
+ *
+ * returns: SUCCESS, or SPI_OPEN_FAIL if the GPIO is not exported
+ **/
+CameraErrortype SPIChipSelect::Open(UInt32 gpio)
+{
+	static const UInt32 bankAddress[SPI_GPIO_BANKS] = { 0x48032000, 0x4804C000, 0x481AC000, 0x481AE000 };
+	char path[64];
+	int memfd;
+
+	Close();
+	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%u/value", gpio);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return SPI_OPEN_FAIL;
+
+	/* Fall back to sysfs if the registers can't be mapped, such as when not running on the camera. */
+	if (gpio >= (SPI_GPIO_BANKS * SPI_GPIO_BANK_PINS))
+		return SUCCESS;
+	memfd = open("/dev/mem", O_RDWR | O_SYNC);
+	if (memfd < 0)
+		return SUCCESS;
+	map = mmap(0, SPI_GPIO_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, bankAddress[gpio / SPI_GPIO_BANK_PINS]);
+	close(memfd);
+	if (map == MAP_FAILED)
+		return SUCCESS;
+
+	regs = (volatile UInt32 *)map;
+	mask = 1 << (gpio % SPI_GPIO_BANK_PINS);
+
+	/* Only drive the pin directly if sysfs has made it an output. */
+	if (regs[SPI_GPIO_OE / 4] & mask) {
+		munmap(map, SPI_GPIO_MAP_SIZE);
+		map = MAP_FAILED;
+		regs = NULL;
+	}
+	return SUCCESS;
+}
+
+void SPIChipSelect::Close(void)
+{
+	if (map != MAP_FAILED)
+		munmap(map, SPI_GPIO_MAP_SIZE);
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+	map = MAP_FAILED;
+	regs = NULL;
+}
+
+void SPIChipSelect::Set(bool high)
+{
+	if (regs) {
+		regs[(high ? SPI_GPIO_SETDATAOUT : SPI_GPIO_CLEARDATAOUT) / 4] = mask;
+		(void)regs[SPI_GPIO_DATAOUT / 4];	//Read back so the write has reached the pin before the next transfer
+	}
+	else {
+		pwrite(fd, high ? "1" : "0", 1, 0);
+	}
+}
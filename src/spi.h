@@ -21,6 +21,35 @@
 #include "errorCodes.h"
 #include "types.h"
 
+/* DM8148 GPIO registers, used to drive chip selects without a sysfs write. */
+#define SPI_GPIO_BANKS			4
+#define SPI_GPIO_BANK_PINS		32
+#define SPI_GPIO_MAP_SIZE		4096
+#define SPI_GPIO_OE				0x134
+#define SPI_GPIO_DATAOUT		0x13C
+#define SPI_GPIO_CLEARDATAOUT	0x190
+#define SPI_GPIO_SETDATAOUT		0x194
+
+/*
+ * A chip select driven from a GPIO. The pin is written directly through the
+ * GPIO registers when they can be mapped, and through its sysfs value file
+ * otherwise. The pin must already be exported and configured as an output.
+ */
+class SPIChipSelect
+{
+public:
+	SPIChipSelect();
+	~SPIChipSelect();
+	CameraErrortype Open(UInt32 gpio);
+	void Close(void);
+	void Set(bool high);
+
+private:
+	int fd;
+	void *map;
+	volatile UInt32 *regs;
+	UInt32 mask;
+};
 
 class SPI
 {
@@ -32,6 +61,7 @@ public:
 	void Close(void);
     CameraErrortype setMode(bool cpol, bool cpha);
     Int32 Transfer(uint64_t txBuf, uint64_t rxBuf, uint32_t len, bool cpol = false, bool cpha = true);
+	Int32 TransferWords(SPIChipSelect *cs, const void *txBuf, uint32_t wordLen, uint32_t count, bool cpol = false, bool cpha = true);
 
 	int fd;
 
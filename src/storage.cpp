@@ -0,0 +1,397 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <mntent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/vfs.h>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QRegExp>
+#include <QMetaObject>
+#include <QDebug>
+
+#include "storage.h"
+#include "rawExport.h"
+#include "errorCodes.h"
+
+Storage::Storage() : QObject(NULL)
+{
+	pthread_mutex_init(&mutex, NULL);
+	benchmarking = false;
+	benchUnmeasuredOnly = false;
+}
+
+Storage *Storage::instance(void)
+{
+	static Storage storage;
+	return &storage;
+}
+
+/* Reads a sysfs or procfs attribute, without the trailing newline. */
+QString Storage::readSysfs(const QString &path)
+{
+	QFile fp(path);
+
+	if (!fp.open(QIODevice::ReadOnly)) {
+		return QString();
+	}
+	return QString(fp.readAll()).trimmed();
+}
+
+/* Identifies a partition across mounts, for storing its measured throughput. */
+QString Storage::deviceKey(const StorageDevice *dev)
+{
+	QString key = QString("%1_%2_%3_%4_%5").arg(dev->vendor).arg(dev->model).arg(dev->serial)
+										   .arg(dev->partition).arg(dev->size);
+	key.replace(QRegExp("[^A-Za-z0-9_.-]"), "_");
+	return QString("storage/") + key;
+}
+
+/* Storage::enumerate
+ *
+ * Lists the storage devices mounted as save locations, with their free
+ * space and any throughput measured previously.
+ *
+ * returns: The mounted storage devices, in mount table order
+ **/
+QList<StorageDevice> Storage::enumerate(void)
+{
+	QList<StorageDevice> devices;
+	FILE *mtab = setmntent("/etc/mtab", "r");
+	struct mntent mnt;
+	char strings[4096];
+
+	if (!mtab) {
+		return devices;
+	}
+
+	while (getmntent_r(mtab, &mnt, strings, sizeof(strings))) {
+		StorageDevice dev;
+		struct statfs fs;
+		char sysPath[PATH_MAX];
+		QString name;
+
+		if (strncmp(mnt.mnt_dir, STORAGE_MOUNT_ROOT, strlen(STORAGE_MOUNT_ROOT)) != 0) continue;
+		if (strncmp(mnt.mnt_fsname, "/dev/", 5) != 0) continue;
+		if (statfs(mnt.mnt_dir, &fs) != 0) continue;
+
+		dev.mountPoint = mnt.mnt_dir;
+		dev.fsName = mnt.mnt_fsname;
+		dev.size = (UInt64)fs.f_blocks * fs.f_bsize;
+		dev.free = (UInt64)fs.f_bfree * fs.f_bsize;
+		dev.avail = (UInt64)fs.f_bavail * fs.f_bsize;
+		dev.writable = !hasmntopt(&mnt, MNTOPT_RO) && (access(mnt.mnt_dir, W_OK) == 0);
+
+		/* A partition is a child of its disk in sysfs, and has its number in the partition attribute. */
+		name = QFileInfo(dev.fsName).fileName();
+		dev.partition = readSysfs("/sys/class/block/" + name + "/partition").toUInt();
+		if (dev.partition && realpath(("/sys/class/block/" + name).toAscii().constData(), sysPath)) {
+			dev.disk = QFileInfo(QFileInfo(sysPath).path()).fileName();
+		}
+		else {
+			dev.disk = name;
+			dev.partition = 1;
+		}
+
+		dev.sdCard = dev.disk.startsWith("mmcblk");
+		dev.vendor = readSysfs("/sys/block/" + dev.disk + "/device/vendor");
+		dev.model = readSysfs("/sys/block/" + dev.disk + "/device/" + (dev.sdCard ? "name" : "model"));
+		dev.serial = readSysfs("/sys/block/" + dev.disk + "/device/serial");
+		dev.writeRate = getWriteRate(&dev);
+		devices.append(dev);
+	}
+
+	endmntent(mtab);
+	return devices;
+}
+
+/* Storage::count
+ *
+ * Counts the mounted storage devices without reading their details from
+ * sysfs, cheap enough to poll for devices being connected and removed.
+ *
+ * returns: Number of mounted storage devices
+ **/
+UInt32 Storage::count(void)
+{
+	FILE *mtab = setmntent("/etc/mtab", "r");
+	struct mntent mnt;
+	char strings[4096];
+	UInt32 devices = 0;
+
+	if (!mtab) {
+		return 0;
+	}
+	while (getmntent_r(mtab, &mnt, strings, sizeof(strings))) {
+		struct statfs fs;
+		if ((strncmp(mnt.mnt_dir, STORAGE_MOUNT_ROOT, strlen(STORAGE_MOUNT_ROOT)) == 0) &&
+			(strncmp(mnt.mnt_fsname, "/dev/", 5) == 0) && (statfs(mnt.mnt_dir, &fs) == 0)) {
+			devices++;
+		}
+	}
+	endmntent(mtab);
+	return devices;
+}
+
+double Storage::getWriteRate(const StorageDevice *dev)
+{
+	QString key = deviceKey(dev);
+	QSettings appSettings;
+	double rate;
+
+	pthread_mutex_lock(&mutex);
+	QHash<QString, double>::const_iterator it = writeRates.constFind(key);
+	if (it != writeRates.constEnd()) {
+		rate = it.value();
+		pthread_mutex_unlock(&mutex);
+		return rate;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	rate = appSettings.value(key + "/writeRate", 0.0).toDouble();
+	pthread_mutex_lock(&mutex);
+	if (!writeRates.contains(key)) writeRates.insert(key, rate);
+	pthread_mutex_unlock(&mutex);
+	return rate;
+}
+
+/* Storage::benchmark
+ *
+ * Measures the sequential write throughput of a storage device by writing a
+ * temporary file, bypassing the page cache where the filesystem allows it,
+ * and syncing it to the device before the clock is stopped. The result is
+ * kept in the settings for the device.
+ *
+ * dev:		Device to measure
+ *
+ * returns: The throughput in bytes per second, or 0 if it could not be measured
+ **/
+double Storage::benchmark(const StorageDevice *dev)
+{
+	QString path = dev->mountPoint + "/" + STORAGE_BENCH_FILENAME;
+	QSettings appSettings;
+	struct timespec start, end;
+	bool direct = true;
+	Int32 ret = SUCCESS;
+	double seconds;
+	double rate;
+	void *buf;
+	int fd;
+
+	if (!dev->writable || (dev->avail < 2 * STORAGE_BENCH_BYTES)) {
+		return 0;
+	}
+
+	if (posix_memalign(&buf, STORAGE_BENCH_ALIGN, STORAGE_BENCH_BLOCK)) {
+		return 0;
+	}
+	memset(buf, 0xA5, STORAGE_BENCH_BLOCK);
+
+	fd = open(path.toAscii().constData(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if ((fd < 0) && (errno == EINVAL)) {
+		direct = false;
+		fd = open(path.toAscii().constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (fd < 0) {
+		qDebug("Storage benchmark: unable to create %s: %s", path.toAscii().constData(), strerror(errno));
+		free(buf);
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (UInt32 written = 0; (written < STORAGE_BENCH_BYTES) && (ret == SUCCESS); written += STORAGE_BENCH_BLOCK) {
+		ret = RawFrameExporter::writeAll(fd, buf, STORAGE_BENCH_BLOCK, &direct);
+	}
+	if ((ret == SUCCESS) && fdatasync(fd)) {
+		ret = CAMERA_FILE_ERROR;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	close(fd);
+	unlink(path.toAscii().constData());
+	free(buf);
+
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	if ((ret != SUCCESS) || (seconds <= 0)) {
+		qDebug("Storage benchmark: writing to %s failed", dev->mountPoint.toAscii().constData());
+		return 0;
+	}
+
+	rate = STORAGE_BENCH_BYTES / seconds;
+	qDebug("Storage benchmark: %s writes %.1fMB/s%s", dev->mountPoint.toAscii().constData(),
+		   rate / 1e6, direct ? "" : " (buffered)");
+
+	pthread_mutex_lock(&mutex);
+	writeRates.insert(deviceKey(dev), rate);
+	pthread_mutex_unlock(&mutex);
+	appSettings.setValue(deviceKey(dev) + "/writeRate", rate);
+	return rate;
+}
+
+void *Storage::benchmarkThread(void *arg)
+{
+	Storage *storage = (Storage *)arg;
+	QList<StorageDevice> devices = storage->enumerate();
+
+	for (int i = 0; i < devices.count(); i++) {
+		if (storage->benchUnmeasuredOnly && (devices[i].writeRate > 0)) continue;
+		if (storage->benchmark(&devices[i]) <= 0) {
+			qDebug("Storage benchmark: could not measure %s", devices[i].mountPoint.toAscii().constData());
+		}
+	}
+
+	QMetaObject::invokeMethod(storage, "publishBenchmark", Qt::QueuedConnection);
+	return NULL;
+}
+
+void Storage::publishBenchmark(void)
+{
+	pthread_mutex_lock(&mutex);
+	benchmarking = false;
+	pthread_mutex_unlock(&mutex);
+	emit benchmarkFinished();
+}
+
+/* Storage::startBenchmark
+ *
+ * Measures the write throughput of the mounted devices on a background
+ * thread, and emits benchmarkFinished() on the GUI thread once done.
+ *
+ * unmeasuredOnly:	Only measure devices without a measured throughput
+ *
+ * returns: true if the benchmark was started, false if one is already running
+ **/
+bool Storage::startBenchmark(bool unmeasuredOnly)
+{
+	pthread_t thread;
+
+	pthread_mutex_lock(&mutex);
+	if (benchmarking) {
+		pthread_mutex_unlock(&mutex);
+		return false;
+	}
+	benchmarking = true;
+	benchUnmeasuredOnly = unmeasuredOnly;
+	pthread_mutex_unlock(&mutex);
+
+	if (pthread_create(&thread, NULL, &benchmarkThread, this) != 0) {
+		pthread_mutex_lock(&mutex);
+		benchmarking = false;
+		pthread_mutex_unlock(&mutex);
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+bool Storage::isBenchmarking(void)
+{
+	pthread_mutex_lock(&mutex);
+	bool running = benchmarking;
+	pthread_mutex_unlock(&mutex);
+	return running;
+}
+
+/* Returns true if save location a is preferred over b. */
+static bool isFaster(const StorageDevice *a, const StorageDevice *b)
+{
+	if ((a->writeRate > 0) || (b->writeRate > 0)) {
+		return a->writeRate > b->writeRate;
+	}
+	/* Neither has been measured, external drives are usually faster than the SD card. */
+	return !a->sdCard && b->sdCard;
+}
+
+/* Storage::selectTarget
+ *
+ * Chooses the fastest writable storage device with enough free space for a
+ * save. Devices that have not been measured are preferred least, unless
+ * they are measured first.
+ *
+ * bytesNeeded:		Free space required for the save
+ * measureUnknown:	Benchmark devices without a measured throughput, which
+ *					blocks for several seconds and must not be used from the GUI
+ *
+ * returns: Mount point of the chosen device, or an empty string if none has enough space
+ **/
+QString Storage::selectTarget(UInt64 bytesNeeded, bool measureUnknown)
+{
+	QList<StorageDevice> devices = enumerate();
+	const StorageDevice *best = NULL;
+
+	for (int i = 0; i < devices.count(); i++) {
+		StorageDevice *dev = &devices[i];
+
+		if (!dev->writable || (dev->avail < bytesNeeded)) continue;
+		if (measureUnknown && (dev->writeRate <= 0)) {
+			dev->writeRate = benchmark(dev);
+		}
+		if (!best || isFaster(dev, best)) {
+			best = dev;
+		}
+	}
+
+	return best ? best->mountPoint : QString();
+}
+
+/* Storage::defaultDirectory
+ *
+ * Returns the save location to use when none has been configured.
+ *
+ * returns: Mount point of the fastest writable device, or the SD card if none is mounted
+ **/
+QString Storage::defaultDirectory(void)
+{
+	QString dir = selectTarget(0, false);
+	return dir.isEmpty() ? QString(STORAGE_DEFAULT_DIRECTORY) : dir;
+}
+
+/* Storage::describe
+ *
+ * Builds the description of a storage device shown to the user, which
+ * starts with the mount point followed by a space.
+ *
+ * dev:		Device to describe
+ *
+ * returns: The description
+ **/
+QString Storage::describe(const StorageDevice *dev)
+{
+	QString desc;
+
+	if (dev->sdCard) {
+		desc = QString("%1 (SD Card Partition %2").arg(dev->mountPoint).arg(dev->partition);
+	}
+	else {
+		desc = QString("%1 (%2 %3 Partition %4").arg(dev->mountPoint)
+					.arg(dev->vendor.isEmpty() ? "???" : dev->vendor)
+					.arg(dev->model.isEmpty() ? "???" : dev->model)
+					.arg(dev->partition);
+	}
+	if (dev->writeRate > 0) {
+		desc += QString(", %1MB/s").arg(dev->writeRate / 1e6, 0, 'f', 0);
+	}
+	return desc + ")";
+}
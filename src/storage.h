@@ -0,0 +1,102 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <pthread.h>
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QList>
+
+#include "types.h"
+
+/* Only filesystems mounted below this directory are offered as save locations. */
+#define STORAGE_MOUNT_ROOT			"/media/"
+
+/* Save location used when no storage device is found. */
+#define STORAGE_DEFAULT_DIRECTORY	"/media/mmcblk1p1"
+
+/* Size of the sequential write benchmark, and of each write it makes. */
+#define STORAGE_BENCH_BYTES			(32 * 1024 * 1024)
+#define STORAGE_BENCH_BLOCK			(1024 * 1024)
+#define STORAGE_BENCH_ALIGN			4096
+#define STORAGE_BENCH_FILENAME		".storageBenchmark"
+
+typedef struct {
+	QString mountPoint;		/* Where the filesystem is mounted, eg. /media/sda1 */
+	QString fsName;			/* Block device holding the filesystem, eg. /dev/sda1 */
+	QString disk;			/* Name of the whole disk under /sys/block, eg. sda */
+	UInt32 partition;
+	QString vendor;
+	QString model;
+	QString serial;
+	bool sdCard;
+	bool writable;
+	UInt64 size;			/* Size of the filesystem in bytes. */
+	UInt64 free;			/* Free space in bytes. */
+	UInt64 avail;			/* Free space available to unprivileged users in bytes. */
+	double writeRate;		/* Measured sequential write throughput in bytes per second, 0 if not measured. */
+} StorageDevice;
+
+/*
+ * Enumerates the storage devices mounted as save locations, directly from
+ * the mount table, statfs and sysfs. The sequential write throughput of each
+ * device can be measured with a short benchmark, and is kept in the settings
+ * for the device so that the fastest device with room for a save can be
+ * chosen without measuring it again. The benchmark takes several seconds,
+ * so the GUI should run it in the background with startBenchmark().
+ */
+class Storage : public QObject
+{
+	Q_OBJECT
+
+public:
+	static Storage *instance(void);
+
+	QList<StorageDevice> enumerate(void);
+	UInt32 count(void);
+	double benchmark(const StorageDevice *dev);
+	bool startBenchmark(bool unmeasuredOnly);
+	bool isBenchmarking(void);
+	QString selectTarget(UInt64 bytesNeeded, bool measureUnknown);
+	QString defaultDirectory(void);
+
+	static QString describe(const StorageDevice *dev);
+	static QString readSysfs(const QString &path);
+
+signals:
+	void benchmarkFinished(void);
+
+private slots:
+	void publishBenchmark(void);
+
+private:
+	Storage();
+
+	pthread_mutex_t mutex;
+	QHash<QString, double> writeRates;		/* Protected by the mutex. */
+	bool benchmarking;
+	bool benchUnmeasuredOnly;
+
+	static QString deviceKey(const StorageDevice *dev);
+	double getWriteRate(const StorageDevice *dev);
+	static void *benchmarkThread(void *arg);
+};
+
+#endif // STORAGE_H
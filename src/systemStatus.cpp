@@ -0,0 +1,520 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#include <mntent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/vfs.h>
+
+#include <QDir>
+#include <QFile>
+#include <QMetaObject>
+#include <QPair>
+#include <QList>
+#include <QDebug>
+
+#include "systemStatus.h"
+#include "storage.h"
+
+SystemStatus::SystemStatus() : QObject(NULL)
+{
+	running = false;
+	changed = 0;
+	memset(subscribers, 0, sizeof(subscribers));
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+}
+
+/* The instance is never destroyed, so its thread can outlive the application's event loop. */
+SystemStatus *SystemStatus::instance(void)
+{
+	static SystemStatus *status = new SystemStatus();
+	return status;
+}
+
+/* SystemStatus::subscribe
+ *
+ * Starts collecting status, and triggers an update straight away. Each call
+ * must be balanced by a call to unsubscribe with the same status bits.
+ *
+ * status:	SYSTEM_STATUS_* bits of the status to collect
+ *
+ * returns: nothing
+ **/
+void SystemStatus::subscribe(UInt32 status)
+{
+	pthread_mutex_lock(&mutex);
+	for (UInt32 i = 0; i < sizeof(subscribers) / sizeof(subscribers[0]); i++) {
+		if (status & (1 << i)) subscribers[i]++;
+	}
+	if (!running) {
+		running = (pthread_create(&thread, NULL, &statusThread, this) == 0);
+		if (!running) {
+			qDebug("SystemStatus: unable to start the status thread");
+		}
+	}
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void SystemStatus::unsubscribe(UInt32 status)
+{
+	pthread_mutex_lock(&mutex);
+	for (UInt32 i = 0; i < sizeof(subscribers) / sizeof(subscribers[0]); i++) {
+		if ((status & (1 << i)) && subscribers[i]) subscribers[i]--;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/* SystemStatus::watchProcess
+ *
+ * Adds a process to the process status, which reports its PID, or -1 while
+ * it is not running, whenever it changes.
+ *
+ * name:	Name of the process, as in /proc/<pid>/comm
+ *
+ * returns: nothing
+ **/
+void SystemStatus::watchProcess(const QString &name)
+{
+	int pid = findProcess(name.toAscii().constData());
+
+	pthread_mutex_lock(&mutex);
+	if (!processes.contains(name)) {
+		processes.insert(name, pid);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+QString SystemStatus::getMounts(void)
+{
+	pthread_mutex_lock(&mutex);
+	QString value = mounts;
+	pthread_mutex_unlock(&mutex);
+	return value;
+}
+
+QString SystemStatus::getDisks(void)
+{
+	pthread_mutex_lock(&mutex);
+	QString value = disks;
+	pthread_mutex_unlock(&mutex);
+	return value;
+}
+
+QString SystemStatus::getSDCard(void)
+{
+	pthread_mutex_lock(&mutex);
+	QString value = sdCard;
+	pthread_mutex_unlock(&mutex);
+	return value;
+}
+
+QString SystemStatus::getNetwork(void)
+{
+	pthread_mutex_lock(&mutex);
+	QString value = network;
+	pthread_mutex_unlock(&mutex);
+	return value;
+}
+
+int SystemStatus::getProcess(const QString &name)
+{
+	pthread_mutex_lock(&mutex);
+	int pid = processes.value(name, -1);
+	pthread_mutex_unlock(&mutex);
+	return pid;
+}
+
+/* SystemStatus::findProcess
+ *
+ * Searches procfs for a running process by name.
+ *
+ * name:	Name of the process, as in /proc/<pid>/comm
+ *
+ * returns: The PID of the first matching process, or -1 if none is running
+ **/
+int SystemStatus::findProcess(const char *name)
+{
+	DIR *dir = opendir("/proc");
+	struct dirent *entry;
+	int pid = -1;
+
+	if (!dir) {
+		return -1;
+	}
+	while ((pid < 0) && (entry = readdir(dir)) != NULL) {
+		char path[64];
+		char comm[64];
+		char *end;
+		FILE *fp;
+		long n = strtol(entry->d_name, &end, 10);
+
+		if ((*end != '\0') || (n <= 0)) continue;
+
+		snprintf(path, sizeof(path), "/proc/%ld/comm", n);
+		fp = fopen(path, "r");
+		if (!fp) continue;
+		if (fgets(comm, sizeof(comm), fp)) {
+			comm[strcspn(comm, "\n")] = '\0';
+			if (strcmp(comm, name) == 0) pid = n;
+		}
+		fclose(fp);
+	}
+	closedir(dir);
+	return pid;
+}
+
+/* Returns the status bits with subscribers, called with the mutex held. */
+UInt32 SystemStatus::activeStatus(void)
+{
+	UInt32 status = 0;
+	for (UInt32 i = 0; i < sizeof(subscribers) / sizeof(subscribers[0]); i++) {
+		if (subscribers[i]) status |= (1 << i);
+	}
+	return status;
+}
+
+void *SystemStatus::statusThread(void *arg)
+{
+	((SystemStatus *)arg)->statusLoop();
+	return NULL;
+}
+
+/* SystemStatus::statusLoop
+ *
+ * Collects the subscribed status at a fixed interval, or straight away when
+ * a new subscriber arrives, and sleeps while there are no subscribers.
+ *
+ * returns: nothing
+ **/
+void SystemStatus::statusLoop(void)
+{
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		UInt32 status = activeStatus();
+		struct timespec deadline;
+
+		if (!status) {
+			pthread_cond_wait(&cond, &mutex);
+			continue;
+		}
+
+		pthread_mutex_unlock(&mutex);
+		collect(status);
+		pthread_mutex_lock(&mutex);
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += SYSTEM_STATUS_INTERVAL_MSEC / 1000;
+		deadline.tv_nsec += (SYSTEM_STATUS_INTERVAL_MSEC % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&cond, &mutex, &deadline);
+	}
+}
+
+/* Stores a new result, and schedules its publication if it changed. Called with the mutex held. */
+void SystemStatus::update(UInt32 bit, QString *cached, const QString &value)
+{
+	if (*cached == value) return;
+	*cached = value;
+	if (!changed) QMetaObject::invokeMethod(this, "publish", Qt::QueuedConnection);
+	changed |= bit;
+}
+
+/* SystemStatus::collect
+ *
+ * Collects the requested status without holding the mutex, then updates the
+ * cached results.
+ *
+ * status:	SYSTEM_STATUS_* bits of the status to collect
+ *
+ * returns: nothing
+ **/
+void SystemStatus::collect(UInt32 status)
+{
+	QString newMounts, newDisks, newSDCard, newNetwork;
+	QHash<QString, int> newProcesses;
+
+	if (status & SYSTEM_STATUS_MOUNTS) {
+		newMounts = collectMounts();
+	}
+	if (status & SYSTEM_STATUS_DISKS) {
+		QStringList blocks = QDir("/sys/block").entryList(QStringList() << "sd*", QDir::Dirs | QDir::NoDotAndDotDot);
+		for (int i = 0; i < blocks.count(); i++) {
+			newDisks += collectDisk(blocks[i]);
+		}
+		newSDCard = collectDisk("mmcblk1");
+	}
+	if (status & SYSTEM_STATUS_NETWORK) {
+		newNetwork = collectNetwork(SYSTEM_STATUS_INTERFACE);
+	}
+	if (status & SYSTEM_STATUS_PROCESSES) {
+		pthread_mutex_lock(&mutex);
+		newProcesses = processes;
+		pthread_mutex_unlock(&mutex);
+
+		/* Only search all of procfs for processes that are not still running under their last PID. */
+		for (QHash<QString, int>::iterator it = newProcesses.begin(); it != newProcesses.end(); it++) {
+			QByteArray name = it.key().toAscii();
+			if ((it.value() > 0) && (Storage::readSysfs(QString("/proc/%1/comm").arg(it.value())) == it.key())) {
+				continue;
+			}
+			it.value() = findProcess(name.constData());
+		}
+	}
+
+	pthread_mutex_lock(&mutex);
+	if (status & SYSTEM_STATUS_MOUNTS) {
+		update(SYSTEM_STATUS_MOUNTS, &mounts, newMounts);
+	}
+	if (status & SYSTEM_STATUS_DISKS) {
+		update(SYSTEM_STATUS_DISKS, &disks, newDisks);
+		update(SYSTEM_STATUS_DISKS, &sdCard, newSDCard);
+	}
+	if (status & SYSTEM_STATUS_NETWORK) {
+		update(SYSTEM_STATUS_NETWORK, &network, newNetwork);
+	}
+	if (status & SYSTEM_STATUS_PROCESSES) {
+		for (QHash<QString, int>::const_iterator it = newProcesses.constBegin(); it != newProcesses.constEnd(); it++) {
+			if (processes.value(it.key(), -1) == it.value()) continue;
+			processes.insert(it.key(), it.value());
+			if (!changedProcesses.contains(it.key())) changedProcesses.append(it.key());
+			if (!changed) QMetaObject::invokeMethod(this, "publish", Qt::QueuedConnection);
+			changed |= SYSTEM_STATUS_PROCESSES;
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/* SystemStatus::publish
+ *
+ * Emits the change signals for the results updated since the last call,
+ * run on the GUI thread.
+ *
+ * returns: nothing
+ **/
+void SystemStatus::publish(void)
+{
+	QList<QPair<QString, int> > procs;
+
+	pthread_mutex_lock(&mutex);
+	UInt32 bits = changed;
+	QString newMounts = mounts;
+	QString newDisks = disks;
+	QString newSDCard = sdCard;
+	QString newNetwork = network;
+	for (int i = 0; i < changedProcesses.count(); i++) {
+		procs.append(qMakePair(changedProcesses[i], processes.value(changedProcesses[i], -1)));
+	}
+	changedProcesses.clear();
+	changed = 0;
+	pthread_mutex_unlock(&mutex);
+
+	if (bits & SYSTEM_STATUS_MOUNTS) emit mountsChanged(newMounts);
+	if (bits & SYSTEM_STATUS_DISKS) emit disksChanged(newDisks, newSDCard);
+	if (bits & SYSTEM_STATUS_NETWORK) emit networkChanged(newNetwork);
+	for (int i = 0; i < procs.count(); i++) {
+		emit processChanged(procs[i].first, procs[i].second);
+	}
+}
+
+/* Formats a size in the style of df -h, rounding up. */
+QString SystemStatus::formatSize(UInt64 bytes)
+{
+	const char units[] = "BKMGTP";
+	double value = bytes;
+	int unit = 0;
+
+	while ((value >= 1024) && (unit < 5)) {
+		value /= 1024;
+		unit++;
+	}
+	if (unit == 0) {
+		return QString::number(bytes);
+	}
+	if (value < 10) {
+		return QString::number(ceil(value * 10) / 10, 'f', 1) + units[unit];
+	}
+	return QString::number(ceil(value), 'f', 0) + units[unit];
+}
+
+/* SystemStatus::collectMounts
+ *
+ * Lists the usage of the filesystems mounted as save locations, in the
+ * layout of df -h.
+ *
+ * returns: The usage table
+ **/
+QString SystemStatus::collectMounts(void)
+{
+	FILE *mtab = setmntent("/etc/mtab", "r");
+	struct mntent mnt;
+	char strings[4096];
+	char line[256];
+	QString text;
+
+	if (!mtab) {
+		return text;
+	}
+
+	snprintf(line, sizeof(line), "%-15s %5s %5s %5s %4s %s\n", "Filesystem", "Size", "Used", "Avail", "Use%", "Mounted on");
+	text = line;
+	while (getmntent_r(mtab, &mnt, strings, sizeof(strings))) {
+		struct statfs fs;
+		UInt64 used, avail;
+
+		if (strncmp(mnt.mnt_dir, STORAGE_MOUNT_ROOT, strlen(STORAGE_MOUNT_ROOT)) != 0) continue;
+		if (statfs(mnt.mnt_dir, &fs) != 0) continue;
+
+		used = (UInt64)(fs.f_blocks - fs.f_bfree) * fs.f_bsize;
+		avail = (UInt64)fs.f_bavail * fs.f_bsize;
+		snprintf(line, sizeof(line), "%-15s %5s %5s %5s %3d%% %s\n", mnt.mnt_fsname,
+				 formatSize((UInt64)fs.f_blocks * fs.f_bsize).toAscii().constData(),
+				 formatSize(used).toAscii().constData(),
+				 formatSize(avail).toAscii().constData(),
+				 (used + avail) ? (int)ceil(100.0 * used / (used + avail)) : 0,
+				 mnt.mnt_dir);
+		text += line;
+	}
+	endmntent(mtab);
+	return text;
+}
+
+/* Reads a property of a block device from the udev database. */
+static QString udevProperty(const QString &dev, const char *property)
+{
+	QFile fp(QString("/run/udev/data/b") + dev);
+	QByteArray prefix = QByteArray("E:") + property + "=";
+
+	if (!fp.open(QIODevice::ReadOnly)) {
+		return QString();
+	}
+	while (!fp.atEnd()) {
+		QByteArray line = fp.readLine().trimmed();
+		if (line.startsWith(prefix)) {
+			return QString(line.mid(prefix.length()));
+		}
+	}
+	return QString();
+}
+
+/* SystemStatus::collectDisk
+ *
+ * Describes a disk and its partitions, in the layout of lsblk with the
+ * NAME,SIZE,FSTYPE,LABEL,VENDOR,MODEL columns.
+ *
+ * disk:	Name of the disk under /sys/block
+ *
+ * returns: The description, or an empty string if the disk is not present
+ **/
+QString SystemStatus::collectDisk(const QString &disk)
+{
+	QString sysPath = QString("/sys/block/") + disk;
+	QStringList parts;
+	char line[256];
+	QString text;
+
+	if (!QDir(sysPath).exists()) {
+		return text;
+	}
+
+	snprintf(line, sizeof(line), "%-10s %6s %-6s %-11s %-8s %s\n", "NAME", "SIZE", "FSTYPE", "LABEL", "VENDOR", "MODEL");
+	text = line;
+	snprintf(line, sizeof(line), "%-10s %6s %-6s %-11s %-8s %s\n", disk.toAscii().constData(),
+			 formatSize(Storage::readSysfs(sysPath + "/size").toULongLong() * 512).toAscii().constData(), "", "",
+			 Storage::readSysfs(sysPath + "/device/vendor").toAscii().constData(),
+			 Storage::readSysfs(sysPath + "/device/model").toAscii().constData());
+	text += line;
+
+	parts = QDir(sysPath).entryList(QStringList() << disk + "*", QDir::Dirs | QDir::NoDotAndDotDot);
+	for (int i = 0; i < parts.count(); i++) {
+		QString partPath = sysPath + "/" + parts[i];
+		QString dev = Storage::readSysfs(partPath + "/dev");
+
+		snprintf(line, sizeof(line), "%-10s %6s %-6s %-11s\n",
+				 (QString((i == parts.count() - 1) ? "`-" : "|-") + parts[i]).toAscii().constData(),
+				 formatSize(Storage::readSysfs(partPath + "/size").toULongLong() * 512).toAscii().constData(),
+				 udevProperty(dev, "ID_FS_TYPE").toAscii().constData(),
+				 udevProperty(dev, "ID_FS_LABEL").toAscii().constData());
+		text += line;
+	}
+	return text;
+}
+
+/* SystemStatus::collectNetwork
+ *
+ * Describes the link state, addresses and traffic of a network interface,
+ * from sysfs and getifaddrs.
+ *
+ * iface:	Name of the interface
+ *
+ * returns: The description
+ **/
+QString SystemStatus::collectNetwork(const char *iface)
+{
+	QString sysPath = QString("/sys/class/net/") + iface;
+	QString operstate = Storage::readSysfs(sysPath + "/operstate");
+	struct ifaddrs *addrs;
+	QString text;
+
+	if (operstate.isEmpty()) {
+		return QString("%1: not present\n").arg(iface);
+	}
+
+	text = QString("%1: %2").arg(iface).arg(operstate);
+	if (operstate == "up") {
+		text += QString(", %1Mb/s %2 duplex").arg(Storage::readSysfs(sysPath + "/speed"))
+											  .arg(Storage::readSysfs(sysPath + "/duplex"));
+	}
+	text += QString("\nHWaddr %1  MTU %2\n").arg(Storage::readSysfs(sysPath + "/address"))
+										   .arg(Storage::readSysfs(sysPath + "/mtu"));
+
+	if (getifaddrs(&addrs) == 0) {
+		for (struct ifaddrs *ifa = addrs; ifa; ifa = ifa->ifa_next) {
+			char addr[INET6_ADDRSTRLEN];
+			char mask[INET6_ADDRSTRLEN];
+
+			if (!ifa->ifa_addr || strcmp(ifa->ifa_name, iface)) continue;
+			if (ifa->ifa_addr->sa_family == AF_INET) {
+				inet_ntop(AF_INET, &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr, addr, sizeof(addr));
+				inet_ntop(AF_INET, &((struct sockaddr_in *)ifa->ifa_netmask)->sin_addr, mask, sizeof(mask));
+				text += QString("inet %1  netmask %2\n").arg(addr).arg(mask);
+			}
+			else if (ifa->ifa_addr->sa_family == AF_INET6) {
+				inet_ntop(AF_INET6, &((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr, addr, sizeof(addr));
+				text += QString("inet6 %1\n").arg(addr);
+			}
+		}
+		freeifaddrs(addrs);
+	}
+
+	text += QString("RX %1 packets (%2)  TX %3 packets (%4)\n")
+				.arg(Storage::readSysfs(sysPath + "/statistics/rx_packets"))
+				.arg(formatSize(Storage::readSysfs(sysPath + "/statistics/rx_bytes").toULongLong()))
+				.arg(Storage::readSysfs(sysPath + "/statistics/tx_packets"))
+				.arg(formatSize(Storage::readSysfs(sysPath + "/statistics/tx_bytes").toULongLong()));
+	return text;
+}
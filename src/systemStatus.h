@@ -0,0 +1,106 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2017 Kron Technologies Inc <http://www.krontech.ca>. *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.   *
+ ****************************************************************************/
+#ifndef SYSTEMSTATUS_H
+#define SYSTEMSTATUS_H
+
+#include <pthread.h>
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+#include "types.h"
+
+/* Status that can be subscribed to. */
+#define SYSTEM_STATUS_MOUNTS		(1 << 0)
+#define SYSTEM_STATUS_DISKS			(1 << 1)
+#define SYSTEM_STATUS_NETWORK		(1 << 2)
+#define SYSTEM_STATUS_PROCESSES		(1 << 3)
+#define SYSTEM_STATUS_ALL			0xF
+
+#define SYSTEM_STATUS_INTERVAL_MSEC	1000
+
+/* Network interface reported by the network status. */
+#define SYSTEM_STATUS_INTERFACE		"eth0"
+
+/*
+ * Collects the status of the mounted filesystems, the disks, the network
+ * interface and the watched processes on a background thread, directly from
+ * statfs, sysfs and procfs rather than by running shell tools. The latest
+ * results are cached, and a signal is emitted on the GUI thread whenever one
+ * of them changes. Status is only collected while it has subscribers.
+ */
+class SystemStatus : public QObject
+{
+	Q_OBJECT
+
+public:
+	static SystemStatus *instance(void);
+
+	void subscribe(UInt32 status);
+	void unsubscribe(UInt32 status);
+	void watchProcess(const QString &name);
+
+	QString getMounts(void);
+	QString getDisks(void);
+	QString getSDCard(void);
+	QString getNetwork(void);
+	int getProcess(const QString &name);
+
+	static int findProcess(const char *name);
+
+signals:
+	void mountsChanged(const QString &mounts);
+	void disksChanged(const QString &disks, const QString &sdCard);
+	void networkChanged(const QString &network);
+	void processChanged(const QString &name, int pid);
+
+private slots:
+	void publish(void);
+
+private:
+	SystemStatus();
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool running;
+	UInt32 subscribers[4];		/* Subscriber count for each status bit. */
+	UInt32 changed;				/* Status bits updated since they were last published. */
+
+	/* Latest results, protected by the mutex. */
+	QString mounts;
+	QString disks;
+	QString sdCard;
+	QString network;
+	QHash<QString, int> processes;
+	QStringList changedProcesses;
+
+	UInt32 activeStatus(void);
+	void collect(UInt32 status);
+	void update(UInt32 bit, QString *cached, const QString &value);
+	static void *statusThread(void *arg);
+	void statusLoop(void);
+
+	static QString formatSize(UInt64 bytes);
+	static QString collectMounts(void);
+	static QString collectDisk(const QString &disk);
+	static QString collectNetwork(const char *iface);
+};
+
+#endif // SYSTEMSTATUS_H
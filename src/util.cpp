@@ -18,9 +18,14 @@
 #include "util.h"
 #include "QDebug"
 #include <sys/stat.h>
+#include <string.h>
 #include <QCoreApplication>
 #include <QTime>
 
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
 void delayms(int ms)
 {
 	struct timespec ts = { ms / 1000, (ms % 1000) * 1000 * 1000 };
@@ -113,3 +118,196 @@ void writePixelBuf12(void * buf, UInt32 pixel, UInt16 value)
 	u8buf[address] = dataL;
 	u8buf[address+1] = dataH;
 }
+
+/* unpackPixelBuf12
+ *
+ * Unpacks a run of 12-bit packed pixels into a 16-bit buffer. The source
+ * must begin on an even pixel (ie: a 3-byte boundary), which is always the
+ * case for rows and frames in acquisition memory. On NEON targets this
+ * handles 32 pixels per iteration, with the remainder done by the scalar
+ * loop.
+ *
+ * dst:		Pointer to the unpacked output buffer
+ * src:		Pointer to 12-bit packed data
+ * count:	Number of pixels to unpack
+ *
+ * returns: nothing
+ **/
+void unpackPixelBuf12(UInt16 * dst, const void * src, UInt32 count)
+{
+	const UInt8 *s = (const UInt8 *)src;
+	UInt32 i = 0;
+
+#ifdef __ARM_NEON__
+	for (; (i + 32) <= count; i += 32) {
+		/* De-interleave 16 byte triplets, each holding two pixels. */
+		uint8x16x3_t in = vld3q_u8(s);
+		uint8x16_t b0 = in.val[0];
+		uint8x16_t b1 = in.val[1];
+		uint8x16_t b2 = in.val[2];
+		uint8x16_t b1lo = vandq_u8(b1, vdupq_n_u8(0x0f));
+		uint8x16_t b1hi = vshrq_n_u8(b1, 4);
+		uint16x8x2_t out;
+
+		/* Even pixels: b0 | (b1 & 0xf) << 8, Odd pixels: (b1 >> 4) | b2 << 4 */
+		out.val[0] = vorrq_u16(vmovl_u8(vget_low_u8(b0)), vshll_n_u8(vget_low_u8(b1lo), 8));
+		out.val[1] = vorrq_u16(vmovl_u8(vget_low_u8(b1hi)), vshll_n_u8(vget_low_u8(b2), 4));
+		vst2q_u16(dst + i, out);
+		out.val[0] = vorrq_u16(vmovl_u8(vget_high_u8(b0)), vshll_n_u8(vget_high_u8(b1lo), 8));
+		out.val[1] = vorrq_u16(vmovl_u8(vget_high_u8(b1hi)), vshll_n_u8(vget_high_u8(b2), 4));
+		vst2q_u16(dst + i + 16, out);
+		s += 48;
+	}
+#endif
+
+	for (; (i + 2) <= count; i += 2) {
+		dst[i]     = s[0] | ((UInt16)(s[1] & 0x0f) << 8);
+		dst[i + 1] = (s[1] >> 4) | ((UInt16)s[2] << 4);
+		s += 3;
+	}
+	if (i < count) {
+		dst[i] = s[0] | ((UInt16)(s[1] & 0x0f) << 8);
+	}
+}
+
+/* packPixelBuf12
+ *
+ * Packs a run of 16-bit pixels into 12-bit packed format, discarding any
+ * bits above the 12th. The destination must begin on an even pixel. When
+ * the count is odd, the upper nibble shared with the following pixel is
+ * preserved. On NEON targets this handles 16 pixels per iteration.
+ *
+ * dst:		Pointer to the 12-bit packed output buffer
+ * src:		Pointer to the unpacked pixels
+ * count:	Number of pixels to pack
+ *
+ * returns: nothing
+ **/
+void packPixelBuf12(void * dst, const UInt16 * src, UInt32 count)
+{
+	UInt8 *d = (UInt8 *)dst;
+	UInt32 i = 0;
+
+#ifdef __ARM_NEON__
+	for (; (i + 16) <= count; i += 16) {
+		/* Load 8 pixel pairs, split into even and odd pixels. */
+		uint16x8x2_t in = vld2q_u16(src + i);
+		uint16x8_t p0 = in.val[0];
+		uint16x8_t p1 = vandq_u16(in.val[1], vdupq_n_u16(0x0fff));
+		uint16x8_t mid = vorrq_u16(vandq_u16(vshrq_n_u16(p0, 8), vdupq_n_u16(0x0f)), vshlq_n_u16(p1, 4));
+		uint8x8x3_t out;
+
+		out.val[0] = vmovn_u16(p0);
+		out.val[1] = vmovn_u16(mid);
+		out.val[2] = vmovn_u16(vshrq_n_u16(p1, 4));
+		vst3_u8(d, out);
+		d += 24;
+	}
+#endif
+
+	for (; (i + 2) <= count; i += 2) {
+		UInt16 p0 = src[i] & 0xfff;
+		UInt16 p1 = src[i + 1] & 0xfff;
+		d[0] = p0 & 0xff;
+		d[1] = (p0 >> 8) | ((p1 & 0x0f) << 4);
+		d[2] = p1 >> 4;
+		d += 3;
+	}
+	if (i < count) {
+		UInt16 p0 = src[i] & 0xfff;
+		d[0] = p0 & 0xff;
+		d[1] = (d[1] & 0xf0) | (p0 >> 8);
+	}
+}
+
+/* accumulatePixelBuf12
+ *
+ * Unpacks a run of 12-bit packed pixels and adds them into a 32-bit sum
+ * buffer in a single pass, without storing the unpacked pixels. The source
+ * must begin on an even pixel. On NEON targets this handles 32 pixels per
+ * iteration.
+ *
+ * sum:		Pointer to the per-pixel sum buffer
+ * src:		Pointer to 12-bit packed data
+ * count:	Number of pixels to accumulate
+ *
+ * returns: nothing
+ **/
+void accumulatePixelBuf12(UInt32 * sum, const void * src, UInt32 count)
+{
+	const UInt8 *s = (const UInt8 *)src;
+	UInt32 i = 0;
+
+#ifdef __ARM_NEON__
+	for (; (i + 32) <= count; i += 32) {
+		uint8x16x3_t in = vld3q_u8(s);
+		uint8x16_t b1lo = vandq_u8(in.val[1], vdupq_n_u8(0x0f));
+		uint8x16_t b1hi = vshrq_n_u8(in.val[1], 4);
+		uint16x8_t evenLo = vorrq_u16(vmovl_u8(vget_low_u8(in.val[0])), vshll_n_u8(vget_low_u8(b1lo), 8));
+		uint16x8_t oddLo = vorrq_u16(vmovl_u8(vget_low_u8(b1hi)), vshll_n_u8(vget_low_u8(in.val[2]), 4));
+		uint16x8_t evenHi = vorrq_u16(vmovl_u8(vget_high_u8(in.val[0])), vshll_n_u8(vget_high_u8(b1lo), 8));
+		uint16x8_t oddHi = vorrq_u16(vmovl_u8(vget_high_u8(b1hi)), vshll_n_u8(vget_high_u8(in.val[2]), 4));
+		uint32x4x2_t acc;
+
+		/* Each de-interleaved load covers 4 pixel pairs of the sum buffer. */
+		acc = vld2q_u32(sum + i);
+		acc.val[0] = vaddw_u16(acc.val[0], vget_low_u16(evenLo));
+		acc.val[1] = vaddw_u16(acc.val[1], vget_low_u16(oddLo));
+		vst2q_u32(sum + i, acc);
+
+		acc = vld2q_u32(sum + i + 8);
+		acc.val[0] = vaddw_u16(acc.val[0], vget_high_u16(evenLo));
+		acc.val[1] = vaddw_u16(acc.val[1], vget_high_u16(oddLo));
+		vst2q_u32(sum + i + 8, acc);
+
+		acc = vld2q_u32(sum + i + 16);
+		acc.val[0] = vaddw_u16(acc.val[0], vget_low_u16(evenHi));
+		acc.val[1] = vaddw_u16(acc.val[1], vget_low_u16(oddHi));
+		vst2q_u32(sum + i + 16, acc);
+
+		acc = vld2q_u32(sum + i + 24);
+		acc.val[0] = vaddw_u16(acc.val[0], vget_high_u16(evenHi));
+		acc.val[1] = vaddw_u16(acc.val[1], vget_high_u16(oddHi));
+		vst2q_u32(sum + i + 24, acc);
+		s += 48;
+	}
+#endif
+
+	for (; (i + 2) <= count; i += 2) {
+		sum[i]     += s[0] | ((UInt16)(s[1] & 0x0f) << 8);
+		sum[i + 1] += (s[1] >> 4) | ((UInt16)s[2] << 4);
+		s += 3;
+	}
+	if (i < count) {
+		sum[i] += s[0] | ((UInt16)(s[1] & 0x0f) << 8);
+	}
+}
+
+/* sumPixelColumns
+ *
+ * Sums unpacked pixels by ADC channel, where pixel i belongs to channel
+ * i % channels. The rows being summed must be a multiple of the channel
+ * count wide for the channels to line up with the columns.
+ *
+ * sums:		Pointer to the per-channel sums, overwritten
+ * pix:			Pointer to the unpacked pixels
+ * count:		Number of pixels to sum
+ * channels:	Number of ADC channels
+ *
+ * returns: nothing
+ **/
+void sumPixelColumns(UInt32 * sums, const UInt16 * pix, UInt32 count, UInt32 channels)
+{
+	UInt32 i = 0;
+	UInt32 ch;
+
+	memset(sums, 0, channels * sizeof(UInt32));
+	for (; (i + channels) <= count; i += channels) {
+		for (ch = 0; ch < channels; ch++) {
+			sums[ch] += pix[i + ch];
+		}
+	}
+	for (ch = 0; i < count; i++, ch++) {
+		sums[ch] += pix[i];
+	}
+}
@@ -36,5 +36,11 @@ int path_is_mounted(const char *path);
 UInt16 readPixelBuf12(const void * buf, UInt32 pixel);
 void writePixelBuf12(void * buf, UInt32 pixel, UInt16 value);
 
+/* Bulk conversion between 12-bit packed and 16-bit unpacked pixel buffers. */
+void unpackPixelBuf12(UInt16 * dst, const void * src, UInt32 count);
+void packPixelBuf12(void * dst, const UInt16 * src, UInt32 count);
+void accumulatePixelBuf12(UInt32 * sum, const void * src, UInt32 count);
+void sumPixelColumns(UInt32 * sums, const UInt16 * pix, UInt32 count, UInt32 channels);
+
 
 #endif // UTIL_H
@@ -38,6 +38,9 @@
 
 #include "aptupdate.h"
 #include "util.h"
+#include "calibrationStore.h"
+#include "systemStatus.h"
+#include "settingsCache.h"
 #include "chronosControlInterface.h"
 
 #define FOCUS_PEAK_THRESH_LOW	35
@@ -86,6 +89,16 @@ UtilWindow::UtilWindow(QWidget *parent, Camera * cameraInst) :
 	connect(timer, SIGNAL(timeout()), this, SLOT(onUtilWindowTimer()));
 	timer->start(500);
 
+	/* Drive and network status is collected in the background, and shown as it changes. */
+	SystemStatus *status = SystemStatus::instance();
+	connect(status, SIGNAL(mountsChanged(QString)), this, SLOT(onMountsChanged(QString)));
+	connect(status, SIGNAL(disksChanged(QString,QString)), this, SLOT(onDisksChanged(QString,QString)));
+	connect(status, SIGNAL(networkChanged(QString)), this, SLOT(onNetworkChanged(QString)));
+	status->subscribe(SYSTEM_STATUS_MOUNTS | SYSTEM_STATUS_DISKS | SYSTEM_STATUS_NETWORK);
+	onMountsChanged(status->getMounts());
+	onDisksChanged(status->getDisks(), status->getSDCard());
+	onNetworkChanged(status->getNetwork());
+
 	ui->tabWidget->setCurrentIndex(0);
 
 	ui->chkFPEnable->setChecked(camera->getFocusPeakEnable());
@@ -148,18 +161,18 @@ UtilWindow::UtilWindow(QWidget *parent, Camera * cameraInst) :
 	ui->lineNetUser->setEnabled(false);
 	ui->lineNetPassword->setEnabled(false);
 	ui->cmdNetTest->setEnabled(false);
-	ui->lblNetStatus->setText("Placeholder - Work in Progress");
 
 	if(camera->RotationArgumentIsSet())
 		ui->chkUpsideDownDisplay->setChecked(camera->getUpsideDownDisplay());
 	else //If the argument was not added, set the control to invisible because it would be useless anyway
 		ui->chkUpsideDownDisplay->setVisible(false);
 
-	ui->chkShowDebugControls->setChecked(!(appSettings.value("debug/hideDebug", true).toBool()));
+	ui->chkShowDebugControls->setChecked(!SettingsCache::instance()->getBool("debug/hideDebug", true));
 }
 
 UtilWindow::~UtilWindow()
 {
+	SystemStatus::instance()->unsubscribe(SYSTEM_STATUS_MOUNTS | SYSTEM_STATUS_DISKS | SYSTEM_STATUS_NETWORK);
 	timer->stop();
 	delete timer;
 	delete ui;
@@ -266,63 +279,22 @@ void UtilWindow::onUtilWindowTimer()
 		else
 			ui->dateTimeEdit->setDateTime(QDateTime::currentDateTime());
 	}
+}
 
-	/* If on the storage tab, update the drive and network status. */
-	if (ui->tabWidget->currentWidget() == ui->tabStorage) {
-		char line[128];
-		struct stat st;
-		FILE *fp;
-
-		QString mText = "";
-		fp = popen("df -h | grep \'/media/\'", "r");
-		if (fp) {
-			while (fgets(line, sizeof(line), fp) != NULL) {
-				mText.append(line);
-			}
-			pclose(fp);
-		}
-		ui->lblMountedDevices->setText(mText);
-
-		/* Update the disk status text. */
-		QString diskText = "";
-		while (stat("/dev/sda", &st) == 0) {
-			if (!S_ISBLK(st.st_mode)) break;
-			fp = popen("lsblk --output NAME,SIZE,FSTYPE,LABEL,VENDOR,MODEL /dev/sda", "r");
-			if (!fp) break;
-			while (fgets(line, sizeof(line), fp) != NULL) {
-				diskText.append(line);
-			}
-			pclose(fp);
-			break;
-		}
-		ui->lblStatusDisk->setText(diskText);
-
-		/* Update the SD card status text. */
-		QString sdText = "";
-		while (stat("/dev/mmcblk1", &st) == 0) {
-			if (!S_ISBLK(st.st_mode)) break;
-			fp = popen("lsblk --output NAME,SIZE,FSTYPE,LABEL,VENDOR,MODEL /dev/mmcblk1", "r");
-			if (!fp) break;
-			while (fgets(line, sizeof(line), fp) != NULL) {
-				sdText.append(line);
-			}
-			pclose(fp);
-			break;
-		}
-		ui->lblStatusSD->setText(sdText);
-	}
-	/* If on the network tab, update the interface and network status. */
-	if (ui->tabWidget->currentWidget()  == ui->tabNetwork) {
-		char line[128];
-		QString netText = "";
-		FILE *fp = popen("ifconfig eth0", "r");
-		if (!fp) return;
-		while (fgets(line, sizeof(line), fp) != NULL) {
-			netText.append(line);
-		}
-		pclose(fp);
-		ui->lblNetStatus->setText(netText);
-	}
+void UtilWindow::onMountsChanged(const QString &mounts)
+{
+	ui->lblMountedDevices->setText(mounts);
+}
+
+void UtilWindow::onDisksChanged(const QString &disks, const QString &sdCard)
+{
+	ui->lblStatusDisk->setText(disks);
+	ui->lblStatusSD->setText(sdCard);
+}
+
+void UtilWindow::onNetworkChanged(const QString &network)
+{
+	ui->lblNetStatus->setText(network);
 }
 
 void UtilWindow::on_cmdSetClock_clicked()
@@ -390,7 +362,7 @@ void UtilWindow::on_cmdBlackCalAll_clicked()
 	camera->io->setOutLevel(0);	//Turn off output drive
 
 	//Black cal all standard resolutions
-	retVal = camera->blackCalAllStdRes(true, progress);
+	retVal = camera->blackCalAllStdRes(true, progress, SettingsCache::instance()->getUInt("calibration/blackCalMaxAgeSecs", BLACK_CAL_MAX_AGE_SECS));
 
 	delete progress;
 
@@ -483,7 +455,7 @@ void UtilWindow::on_cmdAutoCal_clicked()
 
 	//Black cal all standard resolutions
 	qDebug("cmdAutoCal: blackCalAllStdRes");
-	retVal = camera->blackCalAllStdRes(true);
+	retVal = camera->blackCalAllStdRes(true, NULL, SettingsCache::instance()->getUInt("calibration/blackCalMaxAgeSecs", BLACK_CAL_MAX_AGE_SECS));
 
 	if(SUCCESS != retVal)
 	{
@@ -741,7 +713,8 @@ void UtilWindow::on_cmdRestoreCal_clicked()
 
 	sprintf(path, "/media/sda1/cal_%s", camera->getSerialNumber());
 
-	sprintf(str, "tar -xf %s.tar", path);
+	/* Give the restored files the current time, so that they replace any newer calibration containers. */
+	sprintf(str, "tar -xmf %s.tar", path);
 
 	retVal = system(str);	//tar cal files
 
@@ -753,6 +726,7 @@ void UtilWindow::on_cmdRestoreCal_clicked()
 		msg.exec();
 		return;
 	}
+	CalibrationStore::instance()->loadIndex();
 
 	sw.hide();
 	msg.setText("Calibration restore successful!");
@@ -955,9 +929,7 @@ void UtilWindow::on_cmdDefaults_clicked()
 	if(QMessageBox::Yes != reply)
 		return;
 
-	QSettings appSettings;
-	appSettings.clear();
-	appSettings.sync();
+	SettingsCache::instance()->clear();
 
 	QMessageBox::StandardButton reply2;
 	reply2 = QMessageBox::question(this, "Restart app?", "Current settings are cleared. Is it okay to restart the app so defaults can be selected?", QMessageBox::Yes|QMessageBox::No);
@@ -976,6 +948,7 @@ void UtilWindow::on_cmdBackupSettings_clicked()
 	char str[500];
 	struct stat st;
 
+	SettingsCache::instance()->sync();
 	appSettings.sync();
 
 	retVal = stat("/media/sda1",&st);
@@ -1096,8 +1069,7 @@ void UtilWindow::on_cmdRestoreSettings_clicked()
 		msg.exec();
 		return;
 	}
-	QSettings appSettings;
-	appSettings.sync();
+	SettingsCache::instance()->reload();
 
 	sw.hide();
 	msg.setText("User settings restore successful!");
@@ -1116,8 +1088,7 @@ void UtilWindow::on_cmdRestoreSettings_clicked()
 
 void UtilWindow::on_chkShowDebugControls_toggled(bool checked)
 {
-	QSettings appSettings;
-	appSettings.setValue("debug/hideDebug", !checked);
+	SettingsCache::instance()->setValue("debug/hideDebug", !checked);
 }
 
 void UtilWindow::on_cmdRevertCalData_pressed()
@@ -1133,6 +1104,7 @@ void UtilWindow::on_cmdRevertCalData_pressed()
 	// delete all files under userFPN/
 	sprintf(str, "rm userFPN/*");
 	retVal = system(str);
+	CalibrationStore::instance()->loadIndex();
 
 	if(0 != retVal)
 	{
@@ -112,6 +112,10 @@ private slots:
 	void on_cmdClose_5_clicked();
 
 	void on_tabWidget_currentChanged(int index);
+
+	void onMountsChanged(const QString &mounts);
+	void onDisksChanged(const QString &disks, const QString &sdCard);
+	void onNetworkChanged(const QString &network);
 	
 	int updateSoftware(char *updateLocation);
 private:
@@ -11,26 +11,24 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <dirent.h>
 
 #include <fcntl.h>
 #include <poll.h>
 #include "video.h"
 #include "camera.h"
 #include "util.h"
+#include "storage.h"
+#include "systemStatus.h"
+#include "settingsCache.h"
 
 void catch_sigchild(int sig) { /* nop */ }
 
-/* Check for the PID of the video daemon. */
-void Video::checkpid(void)
+/* Track the PID of the video daemon, which changes if it is restarted. */
+void Video::pipelineChanged(const QString &name, int newPid)
 {
-	FILE *fp = popen("pidof cam-pipeline", "r");
-	char line[64];
-	if (fp == NULL) {
-		return;
-	}
-	if (fgets(line, sizeof(line), fp) != NULL) {
-		pid = strtol(line, NULL, 10);
-
+	if (name == VIDEO_PIPELINE_PROCESS) {
+		pid = newPid;
 	}
 }
 
@@ -64,78 +62,294 @@ static VideoStatus *parseVideoStatus(const QVariantMap &args, VideoStatus *st)
 	return st;
 }
 
-VideoState Video::getStatus(VideoStatus *st)
+/* Video::refreshStatus
+ *
+ * Requests an updated status from the video pipeline without waiting for
+ * the reply, unless a request is already in flight. The cached status is
+ * updated from statusFinished() when the reply arrives. A reply to a request
+ * made before the latest sof or eof signal is discarded and requested again,
+ * since it may predate the state change.
+ **/
+void Video::refreshStatus(void)
 {
-	QDBusPendingReply<QVariantMap> reply;
-	QVariantMap map;
-
-	if (st) memset(st, 0, sizeof(VideoState));
+	if (statusPending) return;
+	statusPending = true;
+	statusRequested = statusGeneration;
 
 	pthread_mutex_lock(&mutex);
-	reply = iface.status();
-	reply.waitForFinished();
+	QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(iface.status(), this);
 	pthread_mutex_unlock(&mutex);
-	if (reply.isError()) {
-		/* TODO: Error handling */
-		return VIDEO_STATE_LIVEDISPLAY;
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(statusFinished(QDBusPendingCallWatcher*)));
+}
+
+void Video::statusFinished(QDBusPendingCallWatcher *watcher)
+{
+	QDBusPendingReply<QVariantMap> reply = *watcher;
+
+	statusPending = false;
+	watcher->deleteLater();
+	if (statusRequested != statusGeneration) {
+		refreshStatus();
+		return;
+	}
+	if (reply.isError()) return;
+
+	parseVideoStatus(reply.value(), &cachedStatus);
+	statusValid = true;
+
+	/* Only push the status to subscribers when something has changed. */
+	if ((cachedStatus.state != pushedStatus.state) ||
+		(cachedStatus.position != pushedStatus.position) ||
+		(cachedStatus.totalFrames != pushedStatus.totalFrames) ||
+		(cachedStatus.framerate != pushedStatus.framerate)) {
+		if (cachedStatus.state != pushedStatus.state) updateStatusTimer();
+		memcpy(&pushedStatus, &cachedStatus, sizeof(VideoStatus));
+		emit statusChanged(&pushedStatus);
 	}
 
-	map = reply.value();
-	if (!st) return parseVideoState(map);
+	if (cachedStatus.state == VIDEO_STATE_FILESAVE) {
+		updateSaveProgress();
+		emit saveProgress(&progress);
+	}
+}
+
+/* Video::setStatusInterval
+ *
+ * Sets the maximum rate at which statusChanged() is emitted outside of a
+ * filesave. The pipeline status is only polled while the interval is
+ * non-zero, so subscribers should set it back to zero when done.
+ *
+ * msec:	Minimum time between updates, or zero to disable them
+ *
+ * returns: nothing
+ **/
+void Video::setStatusInterval(UInt32 msec)
+{
+	statusInterval = msec;
+
+	/* Force the next status to be pushed to the new subscriber. */
+	pushedStatus.position = -1;
+	updateStatusTimer();
+}
+
+/* Video::setSaveProgressInterval
+ *
+ * Sets the maximum rate at which statusChanged() and saveProgress() are
+ * emitted while a filesave is in progress. This is kept slow by default
+ * so the polling does not compete with the encoder for CPU time.
+ *
+ * msec:	Minimum time between updates, or zero to disable them
+ *
+ * returns: nothing
+ **/
+void Video::setSaveProgressInterval(UInt32 msec)
+{
+	saveInterval = msec;
+	updateStatusTimer();
+}
+
+void Video::updateStatusTimer(void)
+{
+	UInt32 msec = (cachedStatus.state == VIDEO_STATE_FILESAVE) ? saveInterval : statusInterval;
 
-	parseVideoStatus(map, st);
-	return st->state;
+	if (msec == 0) {
+		statusTimer->stop();
+	}
+	else {
+		statusTimer->start(msec);
+	}
+}
+
+void Video::statusTimeout(void)
+{
+	refreshStatus();
+}
+
+/* Samples the free space in the save directory, against the bytes written so far. */
+void Video::sampleSaveFree(UInt64 bytesWritten)
+{
+	struct statvfs statvfsBuf;
+
+	if (statvfs(saveDirectory, &statvfsBuf) == 0) {
+		saveFree = statvfsBuf.f_bsize * (UInt64)statvfsBuf.f_bfree;
+	} else {
+		saveFree = 0;
+	}
+	saveFreeWritten = bytesWritten;
+	clock_gettime(CLOCK_MONOTONIC, &saveFreeTime);
+}
+
+/* Video::updateSaveProgress
+ *
+ * Derives the filesave progress from the cached pipeline status, the size
+ * of the output file and the free space. The free space is sampled every
+ * VIDEO_FREE_SAMPLE_MSEC, and estimated from the bytes written in between.
+ **/
+void Video::updateSaveProgress(void)
+{
+	struct stat st;
+	struct timespec now;
+	double elapsed;
+	UInt64 written;
+
+	progress.framesTotal = saveLength;
+	progress.framesWritten = within(cachedStatus.position - (Int32)saveStart, 0, (Int32)saveLength);
+	progress.framerate = cachedStatus.framerate;
+
+	/* Image sequences are saved into a directory, so estimate those. */
+	if ((stat(savePath, &st) == 0) && S_ISREG(st.st_mode)) {
+		progress.bytesWritten = st.st_size;
+	} else if (saveLength) {
+		progress.bytesWritten = saveEstSize * progress.framesWritten / saveLength;
+	} else {
+		progress.bytesWritten = 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (((now.tv_sec - saveFreeTime.tv_sec) * 1000 + (now.tv_nsec - saveFreeTime.tv_nsec) / 1000000) >= VIDEO_FREE_SAMPLE_MSEC) {
+		sampleSaveFree(progress.bytesWritten);
+	}
+	written = (progress.bytesWritten > saveFreeWritten) ? (progress.bytesWritten - saveFreeWritten) : 0;
+	progress.bytesFree = (saveFree > written) ? (saveFree - written) : 0;
+
+	/* Fall back to the average rate if the pipeline does not report one. */
+	if (progress.framerate <= 0) {
+		elapsed = (now.tv_sec - saveStartTime.tv_sec) + (now.tv_nsec - saveStartTime.tv_nsec) / 1e9;
+		progress.framerate = (elapsed > 0) ? (progress.framesWritten / elapsed) : 0;
+	}
+	progress.estimatedRate = estimator.blendFramerate(&savePrediction, progress.framesWritten, progress.framerate);
+	if (progress.estimatedRate > 0) {
+		progress.secondsRemaining = (progress.framesTotal - progress.framesWritten) / progress.estimatedRate;
+	} else {
+		progress.secondsRemaining = 0;
+	}
+}
+
+/* Video::getStatus
+ *
+ * Returns the most recent status of the video pipeline, which is kept up to
+ * date by the segment, sof and eof signals and by a background refresh.
+ * Only the very first call, before any status has been received, has to
+ * wait on a D-Bus round trip.
+ *
+ * st:		Optional pointer to return the full status in
+ *
+ * returns: The current video state
+ **/
+VideoState Video::getStatus(VideoStatus *st)
+{
+	if (!statusValid) {
+		QDBusPendingReply<QVariantMap> reply;
+
+		pthread_mutex_lock(&mutex);
+		reply = iface.status();
+		reply.waitForFinished();
+		pthread_mutex_unlock(&mutex);
+		if (reply.isError()) {
+			qDebug("Video status failed: %s", reply.error().message().toLocal8Bit().constData());
+			if (st) memset(st, 0, sizeof(VideoStatus));
+			return VIDEO_STATE_LIVEDISPLAY;
+		}
+		parseVideoStatus(reply.value(), &cachedStatus);
+		statusValid = true;
+	}
+	else {
+		refreshStatus();
+	}
+
+	if (st) memcpy(st, &cachedStatus, sizeof(VideoStatus));
+	return cachedStatus.state;
 }
 
 UInt32 Video::getPosition(void)
 {
-	QDBusPendingReply<QVariantMap> reply;
-	QVariantMap map;
+	VideoStatus st;
+	getStatus(&st);
+	return st.position;
+}
 
+/* Video::watchCall
+ *
+ * Tracks an asynchronous D-Bus call so that errors can be reported when
+ * the reply arrives, without blocking the caller.
+ **/
+void Video::watchCall(const QDBusPendingCall &call, const char *what)
+{
+	QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+	watcher->setObjectName(what);
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(callFinished(QDBusPendingCallWatcher*)));
+}
+
+void Video::callFinished(QDBusPendingCallWatcher *watcher)
+{
+	if (watcher->isError()) {
+		QDBusError err = watcher->error();
+		fprintf(stderr, "Failed to %s: %s - %s\n", watcher->objectName().toAscii().data(), err.name().toAscii().data(), err.message().toAscii().data());
+	}
+	watcher->deleteLater();
+}
+
+/* Video::requestPlayback
+ *
+ * Sends a playback request to the video pipeline. While a request is in
+ * flight, further requests are merged into a single pending request, so
+ * only the latest position and rate are sent once the pipeline catches up.
+ **/
+void Video::requestPlayback(const QVariantMap &args)
+{
+	/* Merge the new arguments over any pending request. */
+	if (!args.contains("loopcount")) {
+		playbackArgs.remove("loopcount");
+	}
+	for (QVariantMap::const_iterator i = args.constBegin(); i != args.constEnd(); i++) {
+		playbackArgs.insert(i.key(), i.value());
+	}
+	if (args.contains("position")) {
+		cachedStatus.position = args["position"].toInt();
+	}
+	if (playbackBusy) {
+		playbackQueued = true;
+		return;
+	}
+
+	playbackBusy = true;
+	playbackQueued = false;
 	pthread_mutex_lock(&mutex);
-	reply = iface.status();
-	reply.waitForFinished();
+	QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(iface.playback(playbackArgs), this);
 	pthread_mutex_unlock(&mutex);
-	if (reply.isError()) {
-		return 0;
+	playbackArgs.clear();
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(playbackFinished(QDBusPendingCallWatcher*)));
+}
+
+void Video::playbackFinished(QDBusPendingCallWatcher *watcher)
+{
+	if (watcher->isError()) {
+		QDBusError err = watcher->error();
+		fprintf(stderr, "Failed to set playback: %s - %s\n", err.name().toAscii().data(), err.message().toAscii().data());
+	}
+	watcher->deleteLater();
+
+	/* Send the latest coalesced request, if any arrived in the meantime. */
+	playbackBusy = false;
+	if (playbackQueued) {
+		QVariantMap args = playbackArgs;
+		requestPlayback(args);
 	}
-	map = reply.value();
-	return map["position"].toUInt();
 }
 
 void Video::setPosition(unsigned int position)
 {
 	QVariantMap args;
-	QDBusPendingReply<QVariantMap> reply;
 	args.insert("framerate", QVariant(0));
 	args.insert("position", QVariant(position));
-
-	pthread_mutex_lock(&mutex);
-	reply = iface.playback(args);
-	reply.waitForFinished();
-	pthread_mutex_unlock(&mutex);
-
-	if (reply.isError()) {
-		QDBusError err = reply.error();
-		fprintf(stderr, "Failed to set playback position: %s - %s\n", err.name().data(), err.message().toAscii().data());
-	}
+	requestPlayback(args);
 }
 
 void Video::setPlayback(int rate)
 {
 	QVariantMap args;
-	QDBusPendingReply<QVariantMap> reply;
 	args.insert("framerate", QVariant(rate));
-
-	pthread_mutex_lock(&mutex);
-	reply = iface.playback(args);
-	reply.waitForFinished();
-	pthread_mutex_unlock(&mutex);
-
-	if (reply.isError()) {
-		QDBusError err = reply.error();
-		fprintf(stderr, "Failed to set playback rate: %s - %s\n", err.name().data(), err.message().toAscii().data());
-	}
+	requestPlayback(args);
 }
 
 
@@ -150,85 +364,57 @@ void Video::seekFrame(int delta)
 void Video::loopPlayback(unsigned int start, unsigned int length, int rate)
 {
 	QVariantMap args;
-	QDBusPendingReply<QVariantMap> reply;
 	args.insert("framerate", QVariant(rate));
 	args.insert("position", QVariant(start));
 	args.insert("loopcount", QVariant(length));
-
-	pthread_mutex_lock(&mutex);
-	reply = iface.playback(args);
-	reply.waitForFinished();
-	pthread_mutex_unlock(&mutex);
-
-	if (reply.isError()) {
-		QDBusError err = reply.error();
-		fprintf(stderr, "Failed to start playback loop: %s - %s\n", err.name().data(), err.message().toAscii().data());
-	}
+	requestPlayback(args);
 }
 
 void Video::setDisplayOptions(bool zebra, FocusPeakColors fpColor)
 {
 	QVariantMap args;
-	QDBusPendingReply<QVariantMap> reply;
 	args.insert("zebra", QVariant(zebra));
 	args.insert("peaking", QVariant(fpColor));
 
 	pthread_mutex_lock(&mutex);
-	reply = iface.configure(args);
+	watchCall(iface.configure(args), "configure display options");
 	pthread_mutex_unlock(&mutex);
-
-	if (reply.isError()) {
-		QDBusError err = reply.error();
-		fprintf(stderr, "Failed to configure display options: %s - %s\n", err.name().data(), err.message().toAscii().data());
-	}
 }
 
 void Video::liveDisplay(bool flip)
 {
 	QVariantMap args;
-	QDBusPendingReply<QVariantMap> reply;
 	args.insert("flip", QVariant(flip));
 
 	pthread_mutex_lock(&mutex);
-	reply = iface.livedisplay(args);
-	reply.waitForFinished();
+	watchCall(iface.livedisplay(args), "start live display");
 	pthread_mutex_unlock(&mutex);
 }
 
 void Video::pauseDisplay(void)
 {
-	QDBusPendingReply<QVariantMap> reply;
-
 	pthread_mutex_lock(&mutex);
-	reply = iface.pause();
-	reply.waitForFinished();
+	watchCall(iface.pause(), "pause display");
 	pthread_mutex_unlock(&mutex);
 }
 
 void Video::setOverlay(const char *format)
 {
 	QVariantMap args;
-	QDBusPendingReply<QVariantMap> reply;
 
 	args.insert("format", QVariant(format));
 	args.insert("position", QVariant("bottom"));
 	args.insert("textbox", QVariant("0x0"));
 
 	pthread_mutex_lock(&mutex);
-	reply = iface.overlay(args);
+	watchCall(iface.overlay(args), "configure video overlay");
 	pthread_mutex_unlock(&mutex);
 
-	if (reply.isError()) {
-		QDBusError err = reply.error();
-		fprintf(stderr, "Failed to configure video overlay: %s - %s\n", err.name().data(), err.message().toAscii().data());
-	}
-	QSettings appSettings;
-	appSettings.setValue("overlayEnabled", true);
+	SettingsCache::instance()->setValue("overlayEnabled", true);
 }
 
 bool Video::getOverlayStatus(){
-	QSettings appSettings;
-	return appSettings.value("overlayEnabled", false).toBool();
+	return SettingsCache::instance()->getBool("overlayEnabled", false);
 }
 
 void Video::clearOverlay(void)
@@ -239,8 +425,7 @@ void Video::clearOverlay(void)
 	pthread_mutex_lock(&mutex);
 	iface.overlay(args);
 	pthread_mutex_unlock(&mutex);
-	QSettings appSettings;
-	appSettings.setValue("overlayEnabled", false);
+	SettingsCache::instance()->setValue("overlayEnabled", false);
 }
 
 void Video::flushRegions(void)
@@ -253,51 +438,76 @@ void Video::flushRegions(void)
 	pthread_mutex_unlock(&mutex);
 }
 
-int Video::mkfilename(char *path, save_mode_type save_mode)
+/* Video::defaultFilename
+ *
+ * Generates the default name of a saved video from the current time.
+ *
+ * name:	Buffer for the name, without directory or extension
+ *
+ * returns: nothing
+ **/
+void Video::defaultFilename(char *name)
+{
+	//Fill timeinfo structure with the current time
+	time_t rawtime;
+	struct tm * timeinfo;
+
+	time (&rawtime);
+	timeinfo = localtime (&rawtime);
+
+	sprintf(name, "vid_%04d-%02d-%02d_%02d-%02d-%02d",
+				timeinfo->tm_year + 1900,
+				timeinfo->tm_mon + 1,
+				timeinfo->tm_mday,
+				timeinfo->tm_hour,
+				timeinfo->tm_min,
+				timeinfo->tm_sec);
+}
+
+/* Video::fileExtension
+ *
+ * Returns the extension appended to saved files of a format. Image sequence
+ * formats are saved into a directory, and have no extension.
+ *
+ * save_mode:	Format of the saved file
+ *
+ * returns: Extension including the leading dot, or an empty string
+ **/
+const char *Video::fileExtension(save_mode_type save_mode)
+{
+	switch(save_mode) {
+	case SAVE_MODE_H264:
+		return ".mp4";
+	case SAVE_MODE_RAW16:
+	case SAVE_MODE_RAW12:
+		return ".raw";
+	case SAVE_MODE_DNG:
+	case SAVE_MODE_TIFF:
+	case SAVE_MODE_TIFF_RAW:
+	default:
+		return "";
+	}
+}
+
+int Video::mkfilename(char *path, save_mode_type save_mode, const char *directory, const char *name)
 {
 	char fname[1000];
 
-	if(strlen(fileDirectory) == 0)
+	if(strlen(directory) == 0)
 		return RECORD_NO_DIRECTORY_SET;
 
-	strcpy(path, fileDirectory);
-	if(strlen(filename) == 0)
+	strcpy(path, directory);
+	strcat(path, "/");
+	if(strlen(name) == 0)
 	{
-		//Fill timeinfo structure with the current time
-		time_t rawtime;
-		struct tm * timeinfo;
-
-		time (&rawtime);
-		timeinfo = localtime (&rawtime);
-
-		sprintf(fname, "/vid_%04d-%02d-%02d_%02d-%02d-%02d",
-					timeinfo->tm_year + 1900,
-					timeinfo->tm_mon + 1,
-					timeinfo->tm_mday,
-					timeinfo->tm_hour,
-					timeinfo->tm_min,
-					timeinfo->tm_sec);
+		defaultFilename(fname);
 		strcat(path, fname);
 	}
 	else
 	{
-		strcat(path, "/");
-		strcat(path, filename);
-	}
-
-	switch(save_mode) {
-	case SAVE_MODE_H264:
-		strcat(path, ".mp4");
-		break;
-	case SAVE_MODE_RAW16:
-	case SAVE_MODE_RAW12:
-		strcat(path, ".raw");
-		break;
-	case SAVE_MODE_DNG:
-	case SAVE_MODE_TIFF:
-	case SAVE_MODE_TIFF_RAW:
-		break;
+		strcat(path, name);
 	}
+	strcat(path, fileExtension(save_mode));
 
 	//If a file of this name already exists
 	struct stat buffer;
@@ -307,23 +517,123 @@ int Video::mkfilename(char *path, save_mode_type save_mode)
 	}
 
 	//Check that the directory is writable
-	if(access(fileDirectory, W_OK) != 0)
+	if(access(directory, W_OK) != 0)
 	{	//Not writable
 		return RECORD_DIRECTORY_NOT_WRITABLE;
 	}
 	return SUCCESS;
 }
 
-CameraErrortype Video::startRecording(UInt32 sizeX, UInt32 sizeY, UInt32 start, UInt32 length, save_mode_type save_mode)
+/* Video::setDngOpcodes
+ *
+ * Sets the DNG opcode list passed to the video pipeline and embedded
+ * as OpcodeList1 in subsequent DNG saves.
+ *
+ * opcodes:	Big endian opcode list, or empty for none
+ *
+ * returns: nothing
+ **/
+void Video::setDngOpcodes(const QByteArray &opcodes)
+{
+	dngOpcodes = opcodes;
+}
+
+/* Video::nominalFrameBytes
+ *
+ * Computes the size of each saved frame from the format and the configured
+ * bitrate, including the per-frame overhead of image sequence formats.
+ *
+ * save_mode:	Format of the save
+ * sizeX:		Horizontal resolution of the saved frames
+ * sizeY:		Vertical resolution of the saved frames
+ *
+ * returns: Nominal size of each frame in bytes
+ **/
+double Video::nominalFrameBytes(save_mode_type save_mode, UInt32 sizeX, UInt32 sizeY)
+{
+	double pixels = (double)sizeX * sizeY;
+	UInt32 realBitrate;
+
+	switch(save_mode) {
+	case SAVE_MODE_H264:
+		realBitrate = min(bitsPerPixel * sizeX * sizeY * framerate, min(60000000, (UInt32)(maxBitrate * 1000000.0)));
+		return (double)realBitrate / framerate / 8; /* size = (bits/sec) / (frames/sec) / (8 bits/byte) */
+	case SAVE_MODE_RAW16:
+		return pixels * 16 / 8;
+	case SAVE_MODE_RAW12:
+		return pixels * 12 / 8;
+	case SAVE_MODE_DNG:
+	case SAVE_MODE_TIFF_RAW:
+		return (pixels * 16 / 8) + 4096;
+	case SAVE_MODE_TIFF:
+		return (pixels * 24 / 8) + 4096;
+	default:
+		return pixels * 16 / 8;
+	}
+}
+
+/* Video::estimateSave
+ *
+ * Predicts the size and duration of a save from the throughput learned on
+ * the storage device it will be saved to.
+ *
+ * save_mode:	Format of the save
+ * sizeX:		Horizontal resolution of the saved frames
+ * sizeY:		Vertical resolution of the saved frames
+ * frames:		Number of frames to save
+ * directory:	Save location, or NULL for the configured location
+ *
+ * returns: The prediction
+ **/
+SaveEstimate Video::estimateSave(save_mode_type save_mode, UInt32 sizeX, UInt32 sizeY, UInt32 frames, const char *directory)
+{
+	if(!directory) directory = fileDirectory;
+	return estimator.estimate(save_mode, directory, sizeX, sizeY, frames, nominalFrameBytes(save_mode, sizeX, sizeY));
+}
+
+/* Returns the size of a saved file, or of all the files in an image sequence directory. */
+static UInt64 savedSize(const char *path)
+{
+	struct stat st;
+	struct dirent *entry;
+	UInt64 size = 0;
+	DIR *dir;
+
+	if (stat(path, &st) != 0) {
+		return 0;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		return st.st_size;
+	}
+
+	dir = opendir(path);
+	if (!dir) {
+		return 0;
+	}
+	while ((entry = readdir(dir)) != NULL) {
+		QString filePath = QString(path) + "/" + entry->d_name;
+		if ((stat(filePath.toAscii().constData(), &st) == 0) && S_ISREG(st.st_mode)) {
+			size += st.st_size;
+		}
+	}
+	closedir(dir);
+	return size;
+}
+
+CameraErrortype Video::startRecording(UInt32 sizeX, UInt32 sizeY, UInt32 start, UInt32 length, save_mode_type save_mode,
+									  const char *directory, const char *name)
 {
 	QDBusPendingReply<QVariantMap> reply;
 	QVariantMap map;
-	UInt64 estFileSize;
 	UInt32 realBitrate;
 	char path[1000];
 
+	/* Default to the configured save location and filename. */
+	if(!directory) directory = fileDirectory;
+	if(!name) name = filename;
+
 	/* Generate the desired filename, and check that we can write it. */
-	int ret = mkfilename(path, save_mode);
+	int ret = mkfilename(path, save_mode, directory, name);
 	if(ret != SUCCESS) return (CameraErrortype)ret;
 
 	/* Attempt to start the video recording process. */
@@ -333,37 +643,45 @@ CameraErrortype Video::startRecording(UInt32 sizeX, UInt32 sizeY, UInt32 start,
 	switch(save_mode) {
 	case SAVE_MODE_H264:
 		realBitrate = min(bitsPerPixel * sizeX * sizeY * framerate, min(60000000, (UInt32)(maxBitrate * 1000000.0)));
-		estFileSize = realBitrate * (length / framerate) / 8; /* size = (bits/sec) * (seconds) / (8 bits/byte) */
 		map.insert("format", QVariant("h264"));
 		map.insert("bitrate", QVariant((uint)realBitrate));
 		map.insert("framerate", QVariant((uint)framerate));
 		break;
 	case SAVE_MODE_RAW16:
-		estFileSize = 16 * sizeX * sizeY * length / 8;
 		map.insert("format", QVariant("y16"));
 		break;
 	case SAVE_MODE_RAW12:
-		estFileSize = 12 * sizeX * sizeY * length / 8;
 		map.insert("format", QVariant("y12b"));
 		break;
 	case SAVE_MODE_DNG:
-		estFileSize = 16 * sizeX * sizeY * length / 8;
-		estFileSize += (4096 * length);
 		map.insert("format", QVariant("dng"));
+		if (!dngOpcodes.isEmpty()) {
+			map.insert("dngOpcodeList1", QVariant(dngOpcodes));
+		}
 		break;
 	case SAVE_MODE_TIFF:
-		estFileSize = 24 * sizeX * sizeY * length / 8;
-		estFileSize += (4096 * length);
 		map.insert("format", QVariant("tiff"));
 		break;
 	case SAVE_MODE_TIFF_RAW:
-		estFileSize = 16 * sizeX * sizeY * length / 8;
-		estFileSize += (4096 * length);
 		map.insert("format", QVariant("tiffraw"));
 		break;
 	}
 	printf("Saving video to %s\r\n", path);
 
+	strcpy(savePath, path);
+	strcpy(saveDirectory, directory);
+	sampleSaveFree(0);
+	saveStart = start;
+	saveLength = length;
+	saveMode = save_mode;
+	saveSizeX = sizeX;
+	saveSizeY = sizeY;
+	saveStopped = false;
+	savePrediction = estimateSave(save_mode, sizeX, sizeY, length, directory);
+	saveEstSize = savePrediction.bytes;
+	clock_gettime(CLOCK_MONOTONIC, &saveStartTime);
+	memset(&progress, 0, sizeof(progress));
+
 	/* Send the DBus command to be*/
 	pthread_mutex_lock(&mutex);
 	reply = iface.recordfile(map);
@@ -385,6 +703,7 @@ CameraErrortype Video::stopRecording()
 	QDBusPendingReply<QVariantMap> reply;
 	QVariantMap map;
 
+	saveStopped = true;
 	pthread_mutex_lock(&mutex);
 	reply = iface.stop();
 	reply.waitForFinished();
@@ -402,29 +721,47 @@ void Video::setDisplayPosition(bool videoOnRight)
 	displayWindowYOff = 0;
 
 	QVariantMap args;
-	QDBusPendingReply<QVariantMap> reply;
 	args.insert("hres", QVariant(displayWindowXSize));
 	args.insert("vres", QVariant(displayWindowYSize));
 	args.insert("xoff", QVariant(displayWindowXOff));
 	args.insert("yoff", QVariant(displayWindowYOff));
 
 	pthread_mutex_lock(&mutex);
-	reply = iface.configure(args);
+	watchCall(iface.configure(args), "configure horizontal offset");
 	pthread_mutex_unlock(&mutex);
-
-	if (reply.isError()) {
-		QDBusError err = reply.error();
-		fprintf(stderr, "Failed to configure horizontal offset: %s - %s\n", err.name().data(), err.message().toAscii().data());
-	}
 }
 
 void Video::sof(const QVariantMap &args)
 {
-	emit started(parseVideoState(args));
+	statusGeneration++;
+	cachedStatus.state = parseVideoState(args);
+	updateStatusTimer();
+	emit started(cachedStatus.state);
 }
 
 void Video::eof(const QVariantMap &args)
 {
+	/*
+	 * The pipeline falls back to playback once a filesave ends. Update the
+	 * cached state now, rather than when the refresh completes, so that
+	 * the save is not seen as still running.
+	 */
+	statusGeneration++;
+	if (parseVideoState(args) == VIDEO_STATE_FILESAVE) {
+		cachedStatus.state = VIDEO_STATE_PLAYBACK;
+		updateStatusTimer();
+	}
+	refreshStatus();
+
+	/* Learn the throughput of the storage device from saves that ran to completion. */
+	if ((parseVideoState(args) == VIDEO_STATE_FILESAVE) && !args.contains("error") && !saveStopped && saveLength) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		estimator.learn(saveMode, saveDirectory, saveSizeX, saveSizeY, saveLength,
+						nominalFrameBytes(saveMode, saveSizeX, saveSizeY), savedSize(savePath),
+						(now.tv_sec - saveStartTime.tv_sec) + (now.tv_nsec - saveStartTime.tv_nsec) / 1e9);
+		saveStopped = true;
+	}
 	if (args.contains("error")) {
 		emit ended(parseVideoState(args), args["error"].toString());
 	} else {
@@ -435,16 +772,46 @@ void Video::eof(const QVariantMap &args)
 void Video::segment(const QVariantMap &args)
 {
 	static VideoStatus st;
-	emit newSegment(parseVideoStatus(args, &st));
+	parseVideoStatus(args, &st);
+	memcpy(&cachedStatus, &st, sizeof(VideoStatus));
+	statusValid = true;
+	emit newSegment(&st);
 }
 
 Video::Video() : iface("ca.krontech.chronos.video", "/ca/krontech/chronos/video", QDBusConnection::systemBus())
 {
 	QDBusConnection conn = iface.connection();
-	int i;
 
 	pid = -1;
 	running = false;
+	memset(&cachedStatus, 0, sizeof(cachedStatus));
+	statusValid = false;
+	statusPending = false;
+	statusGeneration = 0;
+	statusRequested = 0;
+	playbackBusy = false;
+	playbackQueued = false;
+	memset(&pushedStatus, 0, sizeof(pushedStatus));
+	memset(&progress, 0, sizeof(progress));
+	strcpy(savePath, "");
+	saveStart = 0;
+	saveLength = 0;
+	saveEstSize = 0;
+	saveFree = 0;
+	saveFreeWritten = 0;
+	memset(&saveFreeTime, 0, sizeof(saveFreeTime));
+	saveMode = SAVE_MODE_H264;
+	saveSizeX = 0;
+	saveSizeY = 0;
+	strcpy(saveDirectory, "");
+	saveStopped = false;
+	memset(&savePrediction, 0, sizeof(savePrediction));
+
+	/* Status updates are disabled until someone subscribes to them. */
+	statusInterval = 0;
+	saveInterval = VIDEO_SAVE_INTERVAL_MSEC;
+	statusTimer = new QTimer(this);
+	connect(statusTimer, SIGNAL(timeout()), this, SLOT(statusTimeout()));
 
 	/* Default video geometry */
 	displayWindowXSize = 600;
@@ -460,14 +827,8 @@ Video::Video() : iface("ca.krontech.chronos.video", "/ca/krontech/chronos/video"
 	level = OMX_H264ENC_LVL_51;
 	strcpy(filename, "");
 
-	/* Set the default file path, or fall back to the MMC card. */
-	for (i = 1; i <= 3; i++) {
-		sprintf(fileDirectory, "/media/sda%d", i);
-		if (path_is_mounted(fileDirectory)) {
-			break;
-		}
-	}
-	strcpy(fileDirectory, "/media/mmcblk1p1");
+	/* Set the default file path to the fastest drive, or fall back to the MMC card. */
+	strcpy(fileDirectory, Storage::instance()->defaultDirectory().toAscii().constData());
 
 	pthread_mutex_init(&mutex, NULL);
 
@@ -479,12 +840,16 @@ Video::Video() : iface("ca.krontech.chronos.video", "/ca/krontech/chronos/video"
 	conn.connect("ca.krontech.chronos.video", "/ca/krontech/chronos/video", "ca.krontech.chronos.video",
 				 "segment", this, SLOT(segment(const QVariantMap&)));
 
-	/* Try to get the PID of the video pipeline. */
-	checkpid();
+	/* Get the PID of the video pipeline, and follow it if the pipeline restarts. */
+	SystemStatus::instance()->watchProcess(VIDEO_PIPELINE_PROCESS);
+	pid = SystemStatus::instance()->getProcess(VIDEO_PIPELINE_PROCESS);
+	connect(SystemStatus::instance(), SIGNAL(processChanged(QString,int)), this, SLOT(pipelineChanged(QString,int)));
+	SystemStatus::instance()->subscribe(SYSTEM_STATUS_PROCESSES);
 }
 
 Video::~Video()
 {
+	SystemStatus::instance()->unsubscribe(SYSTEM_STATUS_PROCESSES);
 	pthread_mutex_destroy(&mutex);
 }
 
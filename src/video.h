@@ -7,8 +7,10 @@
 #include "errorCodes.h"
 #include "chronosVideoInterface.h"
 #include "types.h"
+#include "saveEstimator.h"
 
 #include <QObject>
+#include <QTimer>
 
 /******************************************************************************/
 
@@ -98,6 +100,26 @@ struct VideoStatus {
 	double framerate;
 };
 
+struct VideoSaveProgress {
+	UInt32 framesWritten;
+	UInt32 framesTotal;
+	UInt64 bytesWritten;
+	UInt64 bytesFree;		/* Estimated free space on the target filesystem. */
+	double framerate;
+	double estimatedRate;	/* Measured rate blended with the learned model, used for secondsRemaining. */
+	double secondsRemaining;
+};
+
+/* Default maximum rate of status and save progress updates. */
+#define VIDEO_STATUS_INTERVAL_MSEC	30
+#define VIDEO_SAVE_INTERVAL_MSEC	1000
+
+/* Interval at which the free space is sampled during a filesave, and estimated in between. */
+#define VIDEO_FREE_SAMPLE_MSEC		5000
+
+/* Name of the video pipeline process. */
+#define VIDEO_PIPELINE_PROCESS		"cam-pipeline"
+
 class Video : public QObject {
 	Q_OBJECT
 
@@ -118,8 +140,16 @@ public:
 	void liveDisplay(bool flip);
 	void pauseDisplay(void);
 	VideoState getStatus(VideoStatus *st);
-
-	CameraErrortype startRecording(UInt32 sizeX, UInt32 sizeY, UInt32 start, UInt32 length, save_mode_type save_mode);
+	void setStatusInterval(UInt32 msec);
+	void setSaveProgressInterval(UInt32 msec);
+
+	CameraErrortype startRecording(UInt32 sizeX, UInt32 sizeY, UInt32 start, UInt32 length, save_mode_type save_mode,
+								   const char *directory = NULL, const char *name = NULL);
+	void setDngOpcodes(const QByteArray &opcodes);
+	static void defaultFilename(char *name);
+	static const char *fileExtension(save_mode_type save_mode);
+	double nominalFrameBytes(save_mode_type save_mode, UInt32 sizeX, UInt32 sizeY);
+	SaveEstimate estimateSave(save_mode_type save_mode, UInt32 sizeX, UInt32 sizeY, UInt32 frames, const char *directory = NULL);
 	CameraErrortype stopRecording(void);
 
 	void flushRegions(void);
@@ -140,25 +170,79 @@ signals:
 	void started(VideoState state);
 	void ended(VideoState state, QString error);
 	void newSegment(VideoStatus *status);
+	void statusChanged(VideoStatus *status);
+	void saveProgress(VideoSaveProgress *progress);
 
 private:
 	int pid;
 	bool running;
 	pthread_mutex_t mutex;
 
-	void checkpid(void);
-	int mkfilename(char *path, save_mode_type save_mode);
+	int mkfilename(char *path, save_mode_type save_mode, const char *directory, const char *name);
 
 	CaKrontechChronosVideoInterface iface;
 
 	UInt32 displayWindowXSize;
 	UInt32 displayWindowYSize;
 
+	/* Status cached from D-Bus signals and asynchronous status replies. */
+	VideoStatus cachedStatus;
+	bool statusValid;
+	bool statusPending;
+	UInt32 statusGeneration;	/* Incremented on each sof and eof signal. */
+	UInt32 statusRequested;		/* Generation of the request in flight. */
+	void refreshStatus(void);
+
+	/* Periodic updates pushed through statusChanged() and saveProgress(). */
+	QTimer *statusTimer;
+	UInt32 statusInterval;
+	UInt32 saveInterval;
+	VideoStatus pushedStatus;
+	void updateStatusTimer(void);
+	void sampleSaveFree(UInt64 bytesWritten);
+
+	/* Filesave progress tracking. */
+	char savePath[1000];
+	UInt32 saveStart;
+	UInt32 saveLength;
+	UInt64 saveEstSize;
+	UInt64 saveFree;				/* Free space when last sampled. */
+	UInt64 saveFreeWritten;		/* Bytes written to the save when the free space was sampled. */
+	struct timespec saveFreeTime;
+	struct timespec saveStartTime;
+	save_mode_type saveMode;
+	UInt32 saveSizeX;
+	UInt32 saveSizeY;
+	char saveDirectory[1000];
+	bool saveStopped;
+	SaveEstimator estimator;
+	SaveEstimate savePrediction;
+	VideoSaveProgress progress;
+	void updateSaveProgress(void);
+
+	/* DNG opcode list (big endian) embedded as OpcodeList1 when saving DNGs. */
+	QByteArray dngOpcodes;
+
+	/* Playback requests are coalesced while one is in flight. */
+	QVariantMap playbackArgs;
+	bool playbackBusy;
+	bool playbackQueued;
+	void requestPlayback(const QVariantMap &args);
+	void watchCall(const QDBusPendingCall &call, const char *what);
+
 	/* D-Bus signal handlers. */
 private slots:
 	void sof(const QVariantMap &args);
 	void eof(const QVariantMap &args);
 	void segment(const QVariantMap &args);
+
+	void statusTimeout(void);
+	void pipelineChanged(const QString &name, int newPid);
+
+	/* D-Bus asynchronous reply handlers. */
+	void statusFinished(QDBusPendingCallWatcher *watcher);
+	void playbackFinished(QDBusPendingCallWatcher *watcher);
+	void callFinished(QDBusPendingCallWatcher *watcher);
 };
 
 #endif // VIDEO_H